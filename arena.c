@@ -0,0 +1,86 @@
+
+#include <stdlib.h>
+
+#include "arena.h"
+
+#define ARENA_MIN_BLOCK_SIZE    4096
+
+static inline size_t arena_round_up( size_t size )
+{
+    return ( size + ARENA_ALIGNMENT - 1 ) & ~(size_t)( ARENA_ALIGNMENT - 1 );
+}
+
+extern void arena_init( arena_t *a, void *data, size_t size )
+{
+    a->first.next = NULL;
+    a->first.size = size;
+    a->first.used = 0;
+    a->first.data = data;
+    a->current = &a->first;
+}
+
+// a new block is allocated with its header followed by its data
+static arena_block_t *arena_new_block( arena_t *a, size_t size )
+{
+    size_t block_size = 2 * a->current->size;
+    if ( block_size < ARENA_MIN_BLOCK_SIZE ) {
+        block_size = ARENA_MIN_BLOCK_SIZE;
+    }
+    if ( block_size < size ) {
+        block_size = size;
+    }
+    size_t header_size = arena_round_up( sizeof(arena_block_t) );
+    if ( block_size > SIZE_MAX - header_size ) {
+        return NULL;
+    }
+    arena_block_t *block = malloc( header_size + block_size );
+    if ( NULL != block ) {
+        block->next = a->current;
+        block->size = block_size;
+        block->used = 0;
+        block->data = (uint8_t *)block + header_size;
+        a->current = block;
+    }
+    return block;
+}
+
+extern void *arena_alloc( arena_t *a, size_t size )
+{
+    if ( size > SIZE_MAX - ARENA_ALIGNMENT ) {
+        return NULL;
+    }
+    size = arena_round_up( size );
+
+    arena_block_t *block = a->current;
+    if ( block->size - block->used < size ) {
+        block = arena_new_block( a, size );
+        if ( NULL == block ) {
+            return NULL;
+        }
+    }
+    void *area = block->data + block->used;
+    block->used += size;
+    return area;
+}
+
+extern size_t arena_heap_size( const arena_t *a )
+{
+    size_t size = 0;
+    for ( const arena_block_t *block = a->current;
+          &a->first != block; block = block->next ) {
+        size += arena_round_up( sizeof(arena_block_t) ) + block->size;
+    }
+    return size;
+}
+
+extern void arena_release( arena_t *a )
+{
+    arena_block_t *block = a->current;
+    while ( &a->first != block ) {
+        arena_block_t *next = block->next;
+        free( block );
+        block = next;
+    }
+    a->current = &a->first;
+    a->first.used = 0;
+}
@@ -0,0 +1,50 @@
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+    Bump allocator used for all the data owned by an exif descriptor.
+
+    Memory is allocated from a list of blocks, simply by moving the current
+    position forward in the current block. Nothing is ever freed individually:
+    all blocks are released at once by arena_release. The first block can be
+    provided by the caller, e.g. allocated together with the arena owner, in
+    which case it is not released. Following blocks are allocated when needed,
+    each one twice as large as the previous one, or large enough for the
+    requested size.
+*/
+
+typedef struct _arena_block {
+    struct _arena_block *next;      // previously filled block
+    size_t              size;       // data size
+    size_t              used;       // data bytes already allocated
+    uint8_t             *data;      // aligned on ARENA_ALIGNMENT
+} arena_block_t;
+
+typedef struct {
+    arena_block_t       *current;   // block used for allocation
+    arena_block_t       first;      // caller-provided block, may be empty
+} arena_t;
+
+#define ARENA_ALIGNMENT     8       // enough for all TIFF types and pointers
+
+// initialize the arena, with an optional first block of size bytes at data,
+// which must be aligned on ARENA_ALIGNMENT.
+extern void arena_init( arena_t *a, void *data, size_t size );
+
+// return a new, uninitialized, memory area of size bytes aligned on
+// ARENA_ALIGNMENT, or NULL if no memory is available.
+extern void *arena_alloc( arena_t *a, size_t size );
+
+// release all memory allocated from the arena. The arena must be initialized
+// again before being reused.
+extern void arena_release( arena_t *a );
+
+// return the size of the blocks allocated by the arena, excluding the first
+// block if it was provided by the caller.
+extern size_t arena_heap_size( const arena_t *a );
+
+#endif /* __ARENA_H__ */
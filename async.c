@@ -0,0 +1,574 @@
+
+#define _DEFAULT_SOURCE             // for syscall, mmap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "exif.h"
+#include "parse.h"
+
+#define DEFAULT_QUEUE_DEPTH     32
+#define MAX_QUEUE_DEPTH         4096
+
+#if defined(__linux__) && ! defined(EXIF_NO_IO_URING)
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/*
+    exif_read_many_async io_uring reader.
+
+    Up to queue_depth files are read at the same time, each with at most one
+    read in flight. A file goes through the following states:
+
+    READ_HEAD           the first HEAD_READ_SIZE bytes are read. If they start
+                        with a JPEG SOI marker, the segments are walked. If
+                        they start with a TIFF header, the TIFF data are
+                        parsed. Otherwise the file is handed to read_exif,
+                        which scans it (blocking).
+    READ_SEGMENTS       the JPEG segments did not fit in the previous window:
+                        the next window is read from the first incomplete
+                        segment, or from after the segments to skip.
+    READ_EXIF_SEGMENT   the APP1 Exif segment did not fit in the window: the
+                        rest of the segment is read at the end of the buffer.
+    READ_TIFF           the TIFF IFDs or values did not fit in the buffer: the
+                        buffer is extended to the size reported by the parser
+                        and parsing is restarted.
+
+    Once parsed, the descriptor owns the buffer, as parse_exif_buffer data.
+    Files are opened synchronously, only reads are asynchronous.
+
+    The kernel interface is used directly, without liburing: the submission
+    and completion rings are mapped once, and each loop iteration submits all
+    queued reads and waits for at least one completion.
+*/
+
+#define HEAD_READ_SIZE      (64 * 1024)
+#define MAX_TIFF_READ_SIZE  (64 * 1024 * 1024)
+#define MAX_TIFF_READS      8
+
+typedef struct {
+    int                 fd;
+    unsigned int        sq_tail;        // local copy
+    unsigned int        *ksq_head, *ksq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned int        *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned int        to_submit;
+
+    void                *sq_ring, *cq_ring;
+    size_t              sq_ring_size, cq_ring_size, sqes_size;
+} uring_t;
+
+static bool uring_supports_read( int fd )
+{
+    size_t n_ops = 256;
+    struct io_uring_probe *probe =
+        calloc( 1, sizeof(struct io_uring_probe) +
+                   n_ops * sizeof(struct io_uring_probe_op) );
+    if ( NULL == probe ) {
+        return false;
+    }
+    bool supported = false;
+    if ( 0 == syscall( __NR_io_uring_register, fd,
+                       IORING_REGISTER_PROBE, probe, n_ops ) ) {
+        supported = probe->last_op >= IORING_OP_READ &&
+            ( probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED );
+    }
+    free( probe );
+    return supported;
+}
+
+static void uring_free( uring_t *u )
+{
+    if ( NULL != u->sqes ) {
+        munmap( u->sqes, u->sqes_size );
+    }
+    if ( NULL != u->cq_ring && u->cq_ring != u->sq_ring ) {
+        munmap( u->cq_ring, u->cq_ring_size );
+    }
+    if ( NULL != u->sq_ring ) {
+        munmap( u->sq_ring, u->sq_ring_size );
+    }
+    close( u->fd );
+}
+
+static void *uring_mmap( int fd, size_t size, off_t offset )
+{
+    void *ring = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, offset );
+    return ( MAP_FAILED == ring ) ? NULL : ring;
+}
+
+static bool uring_init( uring_t *u, unsigned int entries )
+{
+    memset( u, 0, sizeof(uring_t) );
+
+    struct io_uring_params params;
+    memset( &params, 0, sizeof(params) );
+    u->fd = (int)syscall( __NR_io_uring_setup, entries, &params );
+    if ( 0 > u->fd ) {
+        return false;
+    }
+
+    u->sq_ring_size = params.sq_off.array +
+                      params.sq_entries * sizeof(unsigned int);
+    u->cq_ring_size = params.cq_off.cqes +
+                      params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = 0 != ( params.features & IORING_FEAT_SINGLE_MMAP );
+    if ( single_mmap ) {
+        if ( u->cq_ring_size > u->sq_ring_size ) {
+            u->sq_ring_size = u->cq_ring_size;
+        }
+        u->cq_ring_size = u->sq_ring_size;
+    }
+    u->sq_ring = uring_mmap( u->fd, u->sq_ring_size, IORING_OFF_SQ_RING );
+    if ( NULL != u->sq_ring ) {
+        u->cq_ring = single_mmap ? u->sq_ring :
+                        uring_mmap( u->fd, u->cq_ring_size, IORING_OFF_CQ_RING );
+    }
+    u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if ( NULL != u->cq_ring ) {
+        u->sqes = uring_mmap( u->fd, u->sqes_size, IORING_OFF_SQES );
+    }
+    if ( NULL == u->sqes || ! uring_supports_read( u->fd ) ) {
+        uring_free( u );
+        return false;
+    }
+
+    uint8_t *sq = u->sq_ring;
+    u->ksq_head = (unsigned int *)( sq + params.sq_off.head );
+    u->ksq_tail = (unsigned int *)( sq + params.sq_off.tail );
+    u->sq_mask = (unsigned int *)( sq + params.sq_off.ring_mask );
+    u->sq_array = (unsigned int *)( sq + params.sq_off.array );
+    u->sq_tail = *u->ksq_tail;
+
+    uint8_t *cq = u->cq_ring;
+    u->cq_head = (unsigned int *)( cq + params.cq_off.head );
+    u->cq_tail = (unsigned int *)( cq + params.cq_off.tail );
+    u->cq_mask = (unsigned int *)( cq + params.cq_off.ring_mask );
+    u->cqes = (struct io_uring_cqe *)( cq + params.cq_off.cqes );
+    return true;
+}
+
+// queue a read, which is submitted by the next uring_submit_and_wait. The
+// caller guarantees that there are never more reads in flight than entries.
+static void uring_queue_read( uring_t *u, int fd, void *buf, size_t len,
+                              uint64_t offset, uint64_t user_data )
+{
+    unsigned int index = u->sq_tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[index];
+    memset( sqe, 0, sizeof(struct io_uring_sqe) );
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    u->sq_array[index] = index;
+
+    ++u->sq_tail;
+    __atomic_store_n( u->ksq_tail, u->sq_tail, __ATOMIC_RELEASE );
+    ++u->to_submit;
+}
+
+// return 0 or the errno value of a fatal error
+static int uring_submit_and_wait( uring_t *u )
+{
+    while ( true ) {
+        long res = syscall( __NR_io_uring_enter, u->fd, u->to_submit, 1,
+                            IORING_ENTER_GETEVENTS, NULL, 0 );
+        if ( res >= 0 ) {
+            u->to_submit -= (unsigned int)res;
+            return 0;
+        }
+        if ( EINTR != errno && EAGAIN != errno && EBUSY != errno ) {
+            return errno;
+        }
+    }
+}
+
+// after a fatal error, wait for the completion of the n_reads reads queued
+// and not reaped yet, without processing them, so that their buffers can be
+// freed. Reads that the kernel has not consumed from the submission queue are
+// never started. Returns false if the remaining reads could not be waited for.
+static bool uring_drain( uring_t *u, unsigned int n_reads )
+{
+    unsigned int not_started = u->sq_tail -
+                               __atomic_load_n( u->ksq_head, __ATOMIC_ACQUIRE );
+    unsigned int in_flight = n_reads - not_started;
+    while ( true ) {
+        unsigned int head = *u->cq_head;
+        unsigned int tail = __atomic_load_n( u->cq_tail, __ATOMIC_ACQUIRE );
+        in_flight -= tail - head;
+        __atomic_store_n( u->cq_head, tail, __ATOMIC_RELEASE );
+        if ( 0 == in_flight ) {
+            return true;
+        }
+        long res = syscall( __NR_io_uring_enter, u->fd, 0, 1,
+                            IORING_ENTER_GETEVENTS, NULL, 0 );
+        if ( res < 0 && EINTR != errno && EAGAIN != errno && EBUSY != errno ) {
+            return false;
+        }
+    }
+}
+
+typedef enum {
+    READ_HEAD, READ_SEGMENTS, READ_EXIF_SEGMENT, READ_TIFF
+} read_state_t;
+
+typedef struct {
+    size_t              index;          // path index
+    int                 fd;
+    read_state_t        state;
+    unsigned int        n_reads;
+
+    uint8_t             *data;          // buffer
+    size_t              size;           // allocated buffer size
+    size_t              len;            // bytes read in buffer
+    size_t              end;            // len expected after the current read
+    uint64_t            base;           // file offset of data[0]
+    size_t              tiff_pos;       // TIFF header in buffer
+    size_t              tiff_end;       // end of APP1 segment in buffer
+} async_file_t;
+
+typedef struct {
+    uring_t             ring;
+    char                **paths;
+    size_t              n_paths, next_path;
+    exif_control_t      *control;
+    exif_read_fct       callback;
+    void                *context;
+
+    async_file_t        *files;
+    unsigned int        *free_files;    // stack of free file indexes
+    unsigned int        n_free, n_files;
+} async_reader_t;
+
+// deliver the descriptor of file f, or an error if desc is NULL. If desc was
+// parsed from the file buffer, it takes the buffer and the next file gets a
+// new one.
+static void finish_file( async_reader_t *r, async_file_t *f,
+                         exif_desc_t *desc, bool from_data, int error )
+{
+    close( f->fd );
+    if ( NULL != desc ) {
+        if ( from_data ) {
+            desc->own_data = f->data;
+            f->data = NULL;
+            f->size = 0;
+        }
+        error = 0;
+    } else if ( 0 == error ) {
+        error = -1;
+    }
+    r->free_files[r->n_free++] = (unsigned int)( f - r->files );
+    r->callback( r->context, f->index, desc, error );
+}
+
+// hand files that are not JPEG with an APP1 segment nor TIFF to read_exif
+static void finish_file_blocking( async_reader_t *r, async_file_t *f )
+{
+    exif_desc_t *desc = read_exif( r->paths[f->index], 0, r->control );
+    finish_file( r, f, desc, false, 0 );
+}
+
+static bool grow_file_data( async_file_t *f, size_t size )
+{
+    if ( size <= f->size ) {
+        return true;
+    }
+    uint8_t *data = realloc( f->data, size );
+    if ( NULL == data ) {
+        return false;
+    }
+    f->data = data;
+    f->size = size;
+    return true;
+}
+
+// read in buffer from f->len to end
+static void read_file( async_reader_t *r, async_file_t *f, size_t end )
+{
+    f->end = end;
+    ++f->n_reads;
+    uring_queue_read( &r->ring, f->fd, f->data + f->len, end - f->len,
+                      f->base + f->len, (uint64_t)( f - r->files ) );
+}
+
+static void parse_exif_segment( async_reader_t *r, async_file_t *f )
+{
+    size_t end = ( f->len < f->tiff_end ) ? f->len : f->tiff_end;
+    exif_desc_t *desc = parse_tiff_buffer( f->data + f->tiff_pos,
+                                           end - f->tiff_pos, r->control, NULL );
+    finish_file( r, f, desc, true, 0 );
+}
+
+static void walk_segments( async_reader_t *r, async_file_t *f,
+                           size_t pos, bool eof )
+{
+    uint32_t tiff_size;
+    switch ( walk_jpeg_segments( f->data, f->len, &pos, &tiff_size ) ) {
+    case EXIF_SEGMENT:
+        f->tiff_pos = pos;
+        f->tiff_end = pos + tiff_size;
+        if ( f->tiff_end <= f->len || eof ) {
+            parse_exif_segment( r, f );
+        } else if ( ! grow_file_data( f, f->tiff_end ) ) {
+            finish_file( r, f, NULL, false, ENOMEM );
+        } else {
+            f->state = READ_EXIF_SEGMENT;
+            read_file( r, f, f->tiff_end );
+        }
+        break;
+    case TRUNCATED_JPEG:
+        if ( eof || 0 == pos ) {        // no more data or no progress
+            finish_file( r, f, NULL, false, 0 );
+            break;
+        }
+        if ( pos < f->len ) {           // keep the incomplete segment
+            memmove( f->data, f->data + pos, f->len - pos );
+            f->len -= pos;
+        } else {
+            f->len = 0;
+        }
+        f->base += pos;
+        f->state = READ_SEGMENTS;
+        read_file( r, f, HEAD_READ_SIZE );
+        break;
+    case NOT_A_JPEG:
+        finish_file_blocking( r, f );
+        break;
+    default:
+        finish_file( r, f, NULL, false, 0 );
+        break;
+    }
+}
+
+static void parse_tiff_data( async_reader_t *r, async_file_t *f, bool eof )
+{
+    // in lazy mode, values are not read during parsing: the size of the data
+    // is found with an eager parsing before the final lazy parsing.
+    exif_control_t eager = *r->control;
+    eager.lazy_values = false;
+
+    size_t needed = 0;
+    exif_desc_t *desc = parse_tiff_buffer( f->data, f->len, &eager, &needed );
+    if ( needed > f->len && ! eof && needed <= MAX_TIFF_READ_SIZE &&
+         f->n_reads < MAX_TIFF_READS ) {
+        exif_free( desc );
+        size_t size = ( needed + HEAD_READ_SIZE - 1 ) &
+                                            ~(size_t)( HEAD_READ_SIZE - 1 );
+        if ( ! grow_file_data( f, size ) ) {
+            finish_file( r, f, NULL, false, ENOMEM );
+        } else {
+            read_file( r, f, size );
+        }
+        return;
+    }
+    if ( NULL != desc && r->control->lazy_values ) {
+        exif_free( desc );
+        desc = parse_tiff_buffer( f->data, f->len, r->control, NULL );
+    }
+    finish_file( r, f, desc, true, 0 );
+}
+
+static bool is_tiff_header( const uint8_t *data, size_t len )
+{
+    return len >= 8 &&
+           ( ( 'I' == data[0] && 'I' == data[1] && 42 == data[2] && 0 == data[3] ) ||
+             ( 'M' == data[0] && 'M' == data[1] && 0 == data[2] && 42 == data[3] ) );
+}
+
+static void read_completed( async_reader_t *r, async_file_t *f, int res )
+{
+    if ( res < 0 ) {
+        finish_file( r, f, NULL, false, -res );
+        return;
+    }
+    f->len += (size_t)res;
+    if ( res > 0 && f->len < f->end ) {
+        read_file( r, f, f->end );      // partial read, continue
+        return;
+    }
+    bool eof = f->len < f->end;
+
+    switch ( f->state ) {
+    case READ_HEAD:
+        if ( f->len >= 2 && 0xff == f->data[0] && 0xd8 == f->data[1] ) {
+            walk_segments( r, f, 2, eof );
+        } else if ( is_tiff_header( f->data, f->len ) ) {
+            f->state = READ_TIFF;
+            parse_tiff_data( r, f, eof );
+        } else {
+            finish_file_blocking( r, f );
+        }
+        break;
+    case READ_SEGMENTS:
+        walk_segments( r, f, 0, eof );
+        break;
+    case READ_EXIF_SEGMENT:
+        parse_exif_segment( r, f );
+        break;
+    case READ_TIFF:
+        parse_tiff_data( r, f, eof );
+        break;
+    }
+}
+
+static void start_file( async_reader_t *r, async_file_t *f, size_t index )
+{
+    f->index = index;
+    f->fd = open( r->paths[index], O_RDONLY );
+    if ( 0 > f->fd ) {
+        int error = errno;
+        r->free_files[r->n_free++] = (unsigned int)( f - r->files );
+        r->callback( r->context, index, NULL, error );
+        return;
+    }
+    if ( ! grow_file_data( f, HEAD_READ_SIZE ) ) {
+        finish_file( r, f, NULL, false, ENOMEM );
+        return;
+    }
+    f->state = READ_HEAD;
+    f->n_reads = 0;
+    f->len = 0;
+    f->base = 0;
+    read_file( r, f, HEAD_READ_SIZE );
+}
+
+static void reap_completions( async_reader_t *r )
+{
+    uring_t *u = &r->ring;
+    unsigned int head = *u->cq_head;
+    unsigned int tail = __atomic_load_n( u->cq_tail, __ATOMIC_ACQUIRE );
+    for ( ; head != tail; ++head ) {
+        struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        read_completed( r, &r->files[cqe->user_data], cqe->res );
+    }
+    __atomic_store_n( u->cq_head, head, __ATOMIC_RELEASE );
+}
+
+static bool read_many_uring( char **paths, size_t n, exif_control_t *control,
+                             exif_read_fct callback, void *context,
+                             unsigned int queue_depth )
+{
+    async_reader_t r;
+    if ( ! uring_init( &r.ring, queue_depth ) ) {
+        return false;
+    }
+    r.paths = paths;
+    r.n_paths = n;
+    r.next_path = 0;
+    r.control = control;
+    r.callback = callback;
+    r.context = context;
+
+    r.n_files = ( n < queue_depth ) ? (unsigned int)n : queue_depth;
+    r.files = calloc( r.n_files, sizeof(async_file_t) );
+    r.free_files = malloc( r.n_files * sizeof(unsigned int) );
+    if ( NULL == r.files || NULL == r.free_files ) {
+        free( r.files );
+        free( r.free_files );
+        uring_free( &r.ring );
+        return false;
+    }
+    for ( unsigned int i = 0; i < r.n_files; ++i ) {
+        r.free_files[i] = r.n_files - 1 - i;
+    }
+    r.n_free = r.n_files;
+
+    int error = 0;
+    while ( true ) {
+        while ( r.n_free > 0 && r.next_path < r.n_paths ) {
+            unsigned int i = r.free_files[--r.n_free];
+            start_file( &r, &r.files[i], r.next_path++ );
+        }
+        if ( r.n_free == r.n_files ) {
+            break;                      // nothing in flight
+        }
+        error = uring_submit_and_wait( &r.ring );
+        if ( 0 != error ) {
+            break;
+        }
+        reap_completions( &r );
+    }
+
+    if ( 0 != error ) {                 // finish all files with blocking reads
+        bool busy[r.n_files];
+        memset( busy, true, sizeof(busy) );
+        for ( unsigned int i = 0; i < r.n_free; ++i ) {
+            busy[r.free_files[i]] = false;
+        }
+        // each busy file has exactly one read queued: closing the ring does
+        // not wait for those in flight, which may still write in their buffer.
+        if ( ! uring_drain( &r.ring, r.n_files - r.n_free ) ) {
+            for ( unsigned int i = 0; i < r.n_files; ++i ) {
+                if ( busy[i] ) {
+                    r.files[i].data = NULL;     // leaked rather than reused
+                }
+            }
+        }
+        uring_free( &r.ring );
+        for ( unsigned int i = 0; i < r.n_files; ++i ) {
+            if ( busy[i] ) {
+                finish_file_blocking( &r, &r.files[i] );
+            }
+        }
+        for ( ; r.next_path < r.n_paths; ++r.next_path ) {
+            exif_desc_t *desc = read_exif( paths[r.next_path], 0, control );
+            callback( context, r.next_path, desc, ( NULL == desc ) ? -1 : 0 );
+        }
+    } else {
+        uring_free( &r.ring );
+    }
+    for ( unsigned int i = 0; i < r.n_files; ++i ) {
+        free( r.files[i].data );
+    }
+    free( r.files );
+    free( r.free_files );
+    return true;
+}
+
+#else   // no io_uring
+
+static bool read_many_uring( char **paths, size_t n, exif_control_t *control,
+                             exif_read_fct callback, void *context,
+                             unsigned int queue_depth )
+{
+    (void)paths; (void)n; (void)control;
+    (void)callback; (void)context; (void)queue_depth;
+    return false;
+}
+
+#endif
+
+extern bool exif_read_many_async( char **paths, size_t n,
+                                  exif_control_t *control,
+                                  exif_read_fct callback, void *context,
+                                  unsigned int queue_depth )
+{
+    if ( NULL == paths || NULL == callback ) {
+        return false;
+    }
+    if ( 0 == n ) {
+        return true;
+    }
+    if ( 0 == queue_depth ) {
+        queue_depth = DEFAULT_QUEUE_DEPTH;
+    } else if ( queue_depth > MAX_QUEUE_DEPTH ) {
+        queue_depth = MAX_QUEUE_DEPTH;
+    }
+    if ( read_many_uring( paths, n, control, callback, context, queue_depth ) ) {
+        return true;
+    }
+    // io_uring is not available: as many blocking reads in flight with threads
+    return exif_read_many( paths, n, control, callback, context,
+                           queue_depth, false );
+}
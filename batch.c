@@ -0,0 +1,232 @@
+
+#define _POSIX_C_SOURCE 200112L     // for sysconf
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "exif.h"
+#include "parse.h"
+
+/*
+    exif_read_many thread pool.
+
+    Paths are grouped in chunks of consecutive paths, and chunks are dealt
+    round-robin to the workers: worker w owns chunks w, w + n_workers,
+    w + 2*n_workers, etc. Each worker has a deque of its chunks, which is
+    simply the range [head, tail[ of its chunk ranks. A worker takes chunks
+    from the head of its own deque, and when it is empty steals chunks from
+    the tail of the other workers' deques, until all deques are empty.
+
+    Since all workers progress at about the same pace through increasing
+    path indexes, and since stealing only happens near the end, results are
+    produced in an order close to the path order, which limits the number of
+    results waiting for ordered delivery.
+*/
+
+#define MAX_CHUNK_SIZE  16
+
+typedef struct {
+    pthread_mutex_t     lock;
+    size_t              head, tail;     // remaining chunk ranks
+} worker_deque_t;
+
+typedef struct {
+    exif_desc_t         *desc;
+    int                 error;
+    bool                done;
+} read_result_t;
+
+typedef struct {
+    char                **paths;
+    size_t              n_paths;
+    exif_control_t      *control;
+    exif_read_fct       callback;
+    void                *context;
+
+    size_t              chunk_size;
+    size_t              n_workers;
+    worker_deque_t      *deques;
+
+    read_result_t       *results;       // only for ordered delivery
+    pthread_mutex_t     delivery_lock;
+    size_t              next_delivery;
+} read_pool_t;
+
+typedef struct {
+    read_pool_t         *pool;
+    size_t              id;
+} worker_t;
+
+static exif_desc_t *read_one( char *path, exif_control_t *control, int *error )
+{
+    FILE *f = fopen( path, "rb" );
+    if ( NULL == f ) {
+        *error = errno;
+        return NULL;
+    }
+    exif_desc_t *desc = parse_exif( f, 0, control );
+    exif_keep_or_close_file( desc, f );
+    *error = ( NULL == desc ) ? -1 : 0;
+    return desc;
+}
+
+static void deliver_ordered( read_pool_t *pool, size_t index,
+                             exif_desc_t *desc, int error )
+{
+    pthread_mutex_lock( &pool->delivery_lock );
+    read_result_t *result = &pool->results[index];
+    result->desc = desc;
+    result->error = error;
+    result->done = true;
+    while ( pool->next_delivery < pool->n_paths ) {
+        result = &pool->results[pool->next_delivery];
+        if ( ! result->done ) {
+            break;
+        }
+        pool->callback( pool->context, pool->next_delivery,
+                        result->desc, result->error );
+        ++pool->next_delivery;
+    }
+    pthread_mutex_unlock( &pool->delivery_lock );
+}
+
+static void read_chunk( read_pool_t *pool, size_t chunk )
+{
+    size_t start = chunk * pool->chunk_size;
+    size_t end = start + pool->chunk_size;
+    if ( end > pool->n_paths ) {
+        end = pool->n_paths;
+    }
+    for ( size_t i = start; i < end; ++i ) {
+        int error;
+        exif_desc_t *desc = read_one( pool->paths[i], pool->control, &error );
+        if ( NULL != pool->results ) {
+            deliver_ordered( pool, i, desc, error );
+        } else {
+            pool->callback( pool->context, i, desc, error );
+        }
+    }
+}
+
+// return the next chunk from the head of worker id deque, or from the tail of
+// another worker deque. Returns false when all deques are empty.
+static bool get_chunk( read_pool_t *pool, size_t id, size_t *chunk )
+{
+    for ( size_t i = 0; i < pool->n_workers; ++i ) {
+        size_t victim = ( id + i ) % pool->n_workers;
+        worker_deque_t *deque = &pool->deques[victim];
+        bool found = false;
+
+        pthread_mutex_lock( &deque->lock );
+        if ( deque->head < deque->tail ) {
+            size_t rank = ( 0 == i ) ? deque->head++ : --deque->tail;
+            *chunk = victim + rank * pool->n_workers;
+            found = true;
+        }
+        pthread_mutex_unlock( &deque->lock );
+        if ( found ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *worker_main( void *arg )
+{
+    worker_t *worker = arg;
+    size_t chunk;
+    while ( get_chunk( worker->pool, worker->id, &chunk ) ) {
+        read_chunk( worker->pool, chunk );
+    }
+    return NULL;
+}
+
+static size_t get_n_workers( unsigned int n_threads, size_t n_paths )
+{
+    size_t n = n_threads;
+    if ( 0 == n ) {
+        long n_cpus = sysconf( _SC_NPROCESSORS_ONLN );
+        n = ( n_cpus > 0 ) ? (size_t)n_cpus : 1;
+    }
+    return ( n > n_paths ) ? n_paths : n;
+}
+
+extern bool exif_read_many( char **paths, size_t n, exif_control_t *control,
+                            exif_read_fct callback, void *context,
+                            unsigned int n_threads, bool ordered )
+{
+    if ( NULL == paths || NULL == callback ) {
+        return false;
+    }
+    if ( 0 == n ) {
+        return true;
+    }
+
+    read_pool_t pool;
+    pool.paths = paths;
+    pool.n_paths = n;
+    pool.control = control;
+    pool.callback = callback;
+    pool.context = context;
+
+    pool.n_workers = get_n_workers( n_threads, n );
+    pool.chunk_size = n / ( pool.n_workers * 16 );  // at least 16 chunks each
+    if ( 0 == pool.chunk_size ) {
+        pool.chunk_size = 1;
+    } else if ( pool.chunk_size > MAX_CHUNK_SIZE ) {
+        pool.chunk_size = MAX_CHUNK_SIZE;
+    }
+    size_t n_chunks = ( n + pool.chunk_size - 1 ) / pool.chunk_size;
+
+    pool.deques = malloc( pool.n_workers * sizeof(worker_deque_t) );
+    worker_t *workers = malloc( pool.n_workers * sizeof(worker_t) );
+    pthread_t *threads = malloc( pool.n_workers * sizeof(pthread_t) );
+    pool.results = NULL;
+    if ( ordered ) {
+        pool.results = calloc( n, sizeof(read_result_t) );
+        pthread_mutex_init( &pool.delivery_lock, NULL );
+        pool.next_delivery = 0;
+    }
+    bool success = NULL != pool.deques && NULL != workers &&
+                   NULL != threads && ( ! ordered || NULL != pool.results );
+
+    if ( success ) {
+        for ( size_t w = 0; w < pool.n_workers; ++w ) {
+            pthread_mutex_init( &pool.deques[w].lock, NULL );
+            pool.deques[w].head = 0;    // chunks w + rank * n_workers
+            pool.deques[w].tail = ( n_chunks + pool.n_workers - 1 - w ) /
+                                                            pool.n_workers;
+            workers[w].pool = &pool;
+            workers[w].id = w;
+        }
+
+        // the calling thread is worker 0
+        size_t n_started = 1;
+        for ( ; n_started < pool.n_workers; ++n_started ) {
+            if ( 0 != pthread_create( &threads[n_started], NULL,
+                                      worker_main, &workers[n_started] ) ) {
+                break;          // remaining chunks are stolen by others
+            }
+        }
+        worker_main( &workers[0] );
+        for ( size_t w = 1; w < n_started; ++w ) {
+            pthread_join( threads[w], NULL );
+        }
+        for ( size_t w = 0; w < pool.n_workers; ++w ) {
+            pthread_mutex_destroy( &pool.deques[w].lock );
+        }
+    }
+    if ( ordered ) {
+        pthread_mutex_destroy( &pool.delivery_lock );
+        free( pool.results );
+    }
+    free( threads );
+    free( workers );
+    free( pool.deques );
+    return success;
+}
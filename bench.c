@@ -0,0 +1,1422 @@
+
+#define _GNU_SOURCE                 // for fopencookie, clock_gettime, mkdtemp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "exif.h"
+#include "parse.h"
+#include "scan.h"
+#include "swap.h"
+
+// deterministic pseudo-random generator, so that runs are reproducible
+static uint32_t bench_seed = 1;
+
+static uint32_t bench_random( void )
+{
+    bench_seed = bench_seed * 1103515245 + 12345;
+    return bench_seed >> 8;
+}
+
+static double now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static const uint8_t exif_header[6] = { 'E', 'x', 'i', 'f', 0, 0 };
+
+// fill with random bytes, biased toward 'E' and '\0' to make candidate
+// positions more frequent than in real image data, and remove any accidental
+// exif header.
+static void fill_random( uint8_t *data, size_t len )
+{
+    for ( size_t i = 0; i < len; ++i ) {
+        uint32_t r = bench_random( );
+        switch ( r & 7 ) {
+        case 0: data[i] = 'E'; break;
+        case 1: data[i] = 0; break;
+        default: data[i] = (uint8_t)(r >> 8); break;
+        }
+    }
+    for ( size_t i = 0; i + 6 <= len; ++i ) {
+        if ( 0 == memcmp( data + i, exif_header, 6 ) ) {
+            data[i] = 'e';
+        }
+    }
+}
+
+// the original scan loop, one getc per byte
+static long scan_file_getc_bitap( FILE *f )
+{
+    unsigned char masks[256];
+    memset( masks, 0xff, sizeof(masks) );
+    masks['E'] = 0xfe;
+    masks['x'] = 0xfd;
+    masks['i'] = 0xfb;
+    masks['f'] = 0xf7;
+    masks[ 0 ] = 0xcf;
+
+    unsigned char bit_mask = 0xfe;
+    while ( true ) {
+        int byte = getc( f );
+        if ( EOF == byte ) {
+            break;
+        }
+        bit_mask |= masks[byte];
+        bit_mask <<= 1;
+        if ( 0 == ( bit_mask & 64 ) ) {
+            return ftell( f );
+        }
+    }
+    return -1;
+}
+
+static bool check_scan_variants( void )
+{
+    uint8_t data[512];
+    bool ok = true;
+
+    for ( int test = 0; test < 20000; ++test ) {
+        size_t len = bench_random( ) % sizeof(data);
+        fill_random( data, len );
+        if ( len >= 6 && ( test & 1 ) ) {     // plant a header, or part of it
+            size_t pos = bench_random( ) % ( len - 5 );
+            size_t n = 1 + bench_random( ) % 6;
+            memcpy( data + pos, exif_header, n );
+        }
+        size_t expected = scan_exif_header_variant( SCAN_BITAP, data, len );
+        for ( scan_variant_t v = SCAN_SSE2; v <= SCAN_AUTO; ++v ) {
+            if ( ! scan_variant_supported( v ) ) continue;
+            size_t res = scan_exif_header_variant( v, data, len );
+            if ( res != expected ) {
+                printf( "scan %s: mismatch len %zu, got %zu expected %zu\n",
+                        scan_variant_name( v ), len, res, expected );
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+#define SCAN_BENCH_SIZE     (64 * 1024 * 1024)
+#define SCAN_BENCH_ROUNDS   8
+
+static void bench_scan( void )
+{
+    uint8_t *data = malloc( SCAN_BENCH_SIZE );
+    if ( NULL == data ) {
+        printf( "Out of memory\n" );
+        return;
+    }
+    fill_random( data, SCAN_BENCH_SIZE );
+    memcpy( data + SCAN_BENCH_SIZE - 64, exif_header, 6 );
+
+    printf( "scan correctness: %s\n", check_scan_variants( ) ? "ok" : "FAILED" );
+
+    FILE *f = tmpfile( );
+    if ( NULL != f ) {
+        fwrite( data, 1, SCAN_BENCH_SIZE, f );
+        rewind( f );
+        double t = now( );
+        long pos = scan_file_getc_bitap( f );
+        t = now( ) - t;
+        printf( "scan %-8s %8.3f GB/s (found at %ld)\n", "getc",
+                (double)SCAN_BENCH_SIZE / t * 1e-9, pos - 6 );
+
+        rewind( f );        // no TIFF header after exif header: fails fast
+        t = now( );
+        parse_exif( f, 0, NULL );
+        t = now( ) - t;
+        printf( "scan %-8s %8.3f GB/s\n", "file",
+                (double)SCAN_BENCH_SIZE / t * 1e-9 );
+        fclose( f );
+    }
+
+    for ( scan_variant_t v = SCAN_BITAP; v <= SCAN_AUTO; ++v ) {
+        if ( ! scan_variant_supported( v ) ) {
+            printf( "scan %-8s not supported\n", scan_variant_name( v ) );
+            continue;
+        }
+        size_t pos = 0;
+        double t = now( );
+        for ( int r = 0; r < SCAN_BENCH_ROUNDS; ++r ) {
+            pos = scan_exif_header_variant( v, data, SCAN_BENCH_SIZE );
+        }
+        t = now( ) - t;
+        printf( "scan %-8s %8.3f GB/s (found at %zu)\n", scan_variant_name( v ),
+                (double)SCAN_BENCH_SIZE * SCAN_BENCH_ROUNDS / t * 1e-9, pos );
+    }
+    free( data );
+}
+
+static bool check_swap_variants( void )
+{
+    uint32_t data[301], expected[301];
+    bool ok = true;
+
+    for ( int test = 0; test < 2000; ++test ) {
+        size_t n = 1 + bench_random( ) % 300;
+        size_t size = n * sizeof(uint32_t);
+        fill_random( (uint8_t *)data, size );
+        for ( swap_variant_t v = SWAP_SSSE3; v <= SWAP_AUTO; ++v ) {
+            if ( ! swap_variant_supported( v ) ) continue;
+            bool width16 = test & 1;
+            memcpy( expected, data, size );
+            if ( width16 ) {
+                swap_uint16_array_variant( SWAP_SCALAR,
+                                           (uint16_t *)expected, 2 * n - 1 );
+                swap_uint16_array_variant( v, (uint16_t *)data, 2 * n - 1 );
+            } else {
+                swap_uint32_array_variant( SWAP_SCALAR, expected, n );
+                swap_uint32_array_variant( v, data, n );
+            }
+            if ( 0 != memcmp( data, expected, size ) ) {
+                printf( "swap %s: mismatch for %zu %s values\n",
+                        swap_variant_name( v ), width16 ? 2 * n - 1 : n,
+                        width16 ? "uint16" : "uint32" );
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+#define SWAP_BENCH_VALUES   20000       // typical StripOffsets count
+#define SWAP_BENCH_ROUNDS   20000
+
+// GB/s of in place byte swap of uint16 and uint32 arrays, for each variant
+static void bench_swap( void )
+{
+    printf( "swap correctness: %s\n", check_swap_variants( ) ? "ok" : "FAILED" );
+
+    uint32_t *data = malloc( SWAP_BENCH_VALUES * sizeof(uint32_t) );
+    if ( NULL == data ) {
+        printf( "Out of memory\n" );
+        return;
+    }
+    fill_random( (uint8_t *)data, SWAP_BENCH_VALUES * sizeof(uint32_t) );
+    for ( swap_variant_t v = SWAP_SCALAR; v <= SWAP_AUTO; ++v ) {
+        if ( ! swap_variant_supported( v ) ) {
+            printf( "swap %-8s not supported\n", swap_variant_name( v ) );
+            continue;
+        }
+        double t16 = now( );
+        for ( int r = 0; r < SWAP_BENCH_ROUNDS; ++r ) {
+            swap_uint16_array_variant( v, (uint16_t *)data, SWAP_BENCH_VALUES );
+        }
+        t16 = now( ) - t16;
+        double t32 = now( );
+        for ( int r = 0; r < SWAP_BENCH_ROUNDS; ++r ) {
+            swap_uint32_array_variant( v, data, SWAP_BENCH_VALUES );
+        }
+        t32 = now( ) - t32;
+        printf( "swap %-8s uint16 %8.3f GB/s, uint32 %8.3f GB/s\n",
+                swap_variant_name( v ),
+                2.0 * SWAP_BENCH_VALUES * SWAP_BENCH_ROUNDS / t16 * 1e-9,
+                4.0 * SWAP_BENCH_VALUES * SWAP_BENCH_ROUNDS / t32 * 1e-9 );
+    }
+    free( data );
+}
+
+// Synthetic exif files: a TIFF structure with IFD0 and an EXIF IFD, and
+// optionally strips, GPS and Interoperability IFDs and an IFD1 with a
+// thumbnail, written either as is or embedded in a minimal JPEG file,
+// possibly after other large APP segments.
+typedef struct {
+    const char  *name;
+    bool        tiff;           // bare TIFF instead of JPEG
+    bool        big_endian;     // MM instead of II byte order
+    bool        mixed;          // alternate byte order from file to file
+    uint16_t    n_exif_tags;    // at least 5, at most 5 + N_EXIF_FILLERS
+    uint32_t    n_strips;       // StripOffsets and StripByteCounts counts
+    bool        gps_iop;        // GPS and Interoperability IFDs
+    uint32_t    late_size;      // APP2 bytes before APP1 (JPEG only)
+    uint32_t    thumb_size;     // IFD1 JPEG thumbnail size, or 0
+    uint32_t    image_size;
+} bench_spec_t;
+
+static const bench_spec_t default_spec = {
+    "default", false, false, true, 5, 0, false, 0, 0, 8192
+};
+
+typedef struct {
+    uint8_t     *data;
+    size_t      len, cap;
+    bool        big_endian;
+} tiff_writer_t;
+
+static void put_bytes( tiff_writer_t *w, const void *data, size_t len )
+{
+    if ( w->len + len > w->cap ) {
+        size_t cap = 2 * w->cap + len;
+        uint8_t *p = realloc( w->data, cap );
+        if ( NULL == p ) {
+            return;
+        }
+        w->data = p;
+        w->cap = cap;
+    }
+    memcpy( w->data + w->len, data, len );
+    w->len += len;
+}
+
+static void put_uint16( tiff_writer_t *w, uint16_t v )
+{
+    uint8_t b[2];
+    b[0] = w->big_endian ? v >> 8 : v & 0xff;
+    b[1] = w->big_endian ? v & 0xff : v >> 8;
+    put_bytes( w, b, 2 );
+}
+
+static void put_uint32( tiff_writer_t *w, uint32_t v )
+{
+    put_uint16( w, w->big_endian ? v >> 16 : v & 0xffff );
+    put_uint16( w, w->big_endian ? v & 0xffff : v >> 16 );
+}
+
+static void patch_uint32( tiff_writer_t *w, size_t pos, uint32_t v )
+{
+    size_t len = w->len;
+    w->len = pos;
+    put_uint32( w, v );
+    w->len = len;
+}
+
+typedef struct {
+    uint16_t    tag, type;
+    uint32_t    count;
+    const void  *data;      // count items of type, in native byte order
+} bench_entry_t;
+
+#define MAX_BENCH_ENTRIES   64
+
+typedef struct {
+    bench_entry_t   entries[MAX_BENCH_ENTRIES];
+    uint16_t        n;
+} bench_ifd_t;
+
+static void add_entry( bench_ifd_t *ifd, uint16_t tag, uint16_t type,
+                       uint32_t count, const void *data )
+{
+    if ( ifd->n < MAX_BENCH_ENTRIES ) {
+        bench_entry_t *e = &ifd->entries[ifd->n++];
+        e->tag = tag;
+        e->type = type;
+        e->count = count;
+        e->data = data;
+    }
+}
+
+static int compare_entries( const void *a, const void *b )
+{
+    return (int)((const bench_entry_t *)a)->tag -
+           (int)((const bench_entry_t *)b)->tag;
+}
+
+static size_t type_size( uint16_t type )
+{
+    switch ( type ) {
+    case 3: case 8: return 2;
+    case 4: case 9: return 4;
+    case 5: case 10: return 8;
+    default: return 1;
+    }
+}
+
+static void put_values( tiff_writer_t *w, const bench_entry_t *e )
+{
+    for ( uint32_t i = 0; i < e->count; ++i ) {
+        switch ( type_size( e->type ) ) {
+        case 1: put_bytes( w, (const uint8_t *)e->data + i, 1 ); break;
+        case 2: put_uint16( w, ((const uint16_t *)e->data)[i] ); break;
+        case 4: put_uint32( w, ((const uint32_t *)e->data)[i] ); break;
+        case 8: put_uint32( w, ((const uint32_t *)e->data)[2*i] );
+                put_uint32( w, ((const uint32_t *)e->data)[2*i+1] ); break;
+        }
+    }
+}
+
+// sort and write an IFD at the current position (relative to the TIFF header
+// at origin), followed by its data area. Returns the IFD position.
+static size_t put_ifd( tiff_writer_t *w, size_t origin, bench_ifd_t *ifd )
+{
+    qsort( ifd->entries, ifd->n, sizeof(bench_entry_t), compare_entries );
+    size_t ifd_pos = w->len;
+    size_t data_pos = w->len - origin + 2 + 12 * (size_t)ifd->n + 4;
+    put_uint16( w, ifd->n );
+    for ( uint16_t i = 0; i < ifd->n; ++i ) {
+        const bench_entry_t *e = &ifd->entries[i];
+        size_t size = type_size( e->type ) * e->count;
+        put_uint16( w, e->tag );
+        put_uint16( w, e->type );
+        put_uint32( w, e->count );
+        if ( size <= 4 ) {          // left-justified in value field
+            put_values( w, e );
+            for ( size_t k = size; k < 4; ++k ) {
+                put_bytes( w, "", 1 );
+            }
+        } else {
+            put_uint32( w, (uint32_t)data_pos );
+            data_pos += size + ( size & 1 );
+        }
+    }
+    put_uint32( w, 0 );             // next IFD offset
+    for ( uint16_t i = 0; i < ifd->n; ++i ) {
+        size_t size = type_size( ifd->entries[i].type ) * ifd->entries[i].count;
+        if ( size > 4 ) {
+            put_values( w, &ifd->entries[i] );
+            if ( size & 1 ) put_bytes( w, "", 1 );
+        }
+    }
+    return ifd_pos;
+}
+
+// patch the value of the entry tag in the IFD written at ifd_pos
+static void patch_entry( tiff_writer_t *w, size_t ifd_pos,
+                         const bench_ifd_t *ifd, uint16_t tag, uint32_t value )
+{
+    for ( uint16_t i = 0; i < ifd->n; ++i ) {
+        if ( tag == ifd->entries[i].tag ) {
+            patch_uint32( w, ifd_pos + 2 + 12 * (size_t)i + 8, value );
+        }
+    }
+}
+
+// EXIF tags added to the 5 base EXIF tags in larger IFDs
+static const struct {
+    uint16_t    tag, type, count;
+} exif_fillers[] = {
+    { SHUTTER_SPEED_VALUE_TAG, 10, 1 }, { APERTURE_VALUE_TAG, 5, 1 },
+    { BRIGHTNESS_VALUE_TAG, 10, 1 }, { EXPOSURE_BIAS_VALUE_TAG, 10, 1 },
+    { MAX_APERTURE_VALUE_TAG, 5, 1 }, { SUBJECT_DISTANCE_TAG, 5, 1 },
+    { METERING_MODE_TAG, 3, 1 }, { LIGHT_SOURCE_TAG, 3, 1 },
+    { FLASH_TAG, 3, 1 }, { FOCAL_LENGTH_TAG, 5, 1 },
+    { SUBSEC_TIME_TAG, 2, 4 }, { SUBSEC_TIME_ORIGINAL_TAG, 2, 4 },
+    { SUBSEC_TIME_DIGITIZED_TAG, 2, 4 }, { FLASHPIX_VERSION_TAG, 7, 4 },
+    { COLOR_SPACE_TAG, 3, 1 }, { PIXEL_X_DIMENSION_TAG, 4, 1 },
+    { PIXEL_Y_DIMENSION_TAG, 4, 1 }, { FOCAL_PLANE_X_RESOLUTION_TAG, 5, 1 },
+    { FOCAL_PLANE_Y_RESOLUTION_TAG, 5, 1 },
+    { FOCAL_PLANE_RESOLUTION_UNIT_TAG, 3, 1 }, { EXPOSURE_INDEX_TAG, 5, 1 },
+    { SENSING_METHOD_TAG, 3, 1 }, { CUSTOM_RENDERED_TAG, 3, 1 },
+    { EXPOSURE_MODE_TAG, 3, 1 }, { WHITE_BALANCE_TAG, 3, 1 },
+    { DIGITAL_ZOOM_RATIO_TAG, 5, 1 }, { FOCAL_LENGTH_IN_35MM_FILM_TAG, 3, 1 },
+    { SCENE_CAPTURE_TYPE_TAG, 3, 1 }, { GAIN_CONTROL_TAG, 3, 1 },
+    { CONTRAST_TAG, 3, 1 }, { SATURATION_TAG, 3, 1 }, { SHARPNESS_TAG, 3, 1 },
+    { SUBJECT_DISTANCE_RANGE_TAG, 3, 1 }, { IMAGE_UNIQUE_ID_TAG, 2, 33 },
+    { BODY_SERIAL_NUMBER_TAG, 2, 13 }, { LENS_SPECIFICATION_TAG, 5, 4 },
+    { LENS_MAKE_TAG, 2, 13 }, { LENS_MODEL_TAG, 2, 13 }
+};
+#define N_EXIF_FILLERS  (sizeof(exif_fillers)/sizeof(exif_fillers[0]))
+
+static const void *filler_data( uint16_t type, uint16_t count )
+{
+    static const uint16_t shorts[4] = { 1, 1, 1, 1 };
+    static const uint32_t longs[8] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+    static const char string[] = "0123456789abcdef0123456789abcdef";
+    switch ( type ) {
+    case 3: return shorts;
+    case 4: case 5: case 10: return longs;
+    case 7: return "0100";
+    default: return string + sizeof(string) - count;    // ends with '\0'
+    }
+}
+
+// write a TIFF structure according to spec
+static void put_tiff( tiff_writer_t *w, const bench_spec_t *spec, uint32_t seed )
+{
+    static const uint32_t resolution[2] = { 72, 1 };
+    static const uint32_t exposure[2] = { 1, 250 };
+    static const uint32_t fnumber[2] = { 28, 10 };
+    static const uint32_t coordinates[6] = { 48, 1, 51, 1, 2400, 100 };
+    static const uint32_t black_white[12] = { 0, 1, 255, 1, 128, 1, 255, 1,
+                                              128, 1, 255, 1 };
+    static const uint16_t orientation = 1, unit = 2, iso = 400;
+    static const uint16_t jpeg_compression = 6;
+    static const uint8_t gps_version[4] = { 2, 3, 0, 0 };
+    static const uint8_t altitude_ref = 0;
+    static const uint32_t pointer = 0;      // patched after writing
+    char model[32], date[20];
+    snprintf( model, sizeof(model), "Bench model %u", seed % 1000 );
+    snprintf( date, sizeof(date), "2024:01:%02u 12:00:00", 1 + seed % 28 );
+
+    uint32_t *strips = NULL;
+    if ( spec->n_strips > 0 ) {
+        strips = malloc( spec->n_strips * sizeof(uint32_t) );
+        for ( uint32_t i = 0; NULL != strips && i < spec->n_strips; ++i ) {
+            strips[i] = 4096 + 1024 * i;
+        }
+    }
+
+    bench_ifd_t ifd0 = { .n = 0 };
+    add_entry( &ifd0, MAKE_TAG, 2, 11, "BenchMaker" );
+    add_entry( &ifd0, MODEL_TAG, 2, (uint32_t)strlen( model ) + 1, model );
+    add_entry( &ifd0, ORIENTATION_TAG, 3, 1, &orientation );
+    add_entry( &ifd0, X_RESOLUTION_TAG, 5, 1, resolution );
+    add_entry( &ifd0, Y_RESOLUTION_TAG, 5, 1, resolution );
+    add_entry( &ifd0, RESOLUTION_UNIT_TAG, 3, 1, &unit );
+    add_entry( &ifd0, DATE_TIME_TAG, 2, 20, date );
+    add_entry( &ifd0, EXIF_IFD_TAG, 4, 1, &pointer );
+    if ( NULL != strips ) {
+        add_entry( &ifd0, STRIP_OFFSETS_TAG, 4, spec->n_strips, strips );
+        add_entry( &ifd0, STRIP_BYTE_COUNTS_TAG, 4, spec->n_strips, strips );
+        add_entry( &ifd0, REFERENCE_BLACK_WHITE_TAG, 5, 6, black_white );
+    }
+    if ( spec->gps_iop ) {
+        add_entry( &ifd0, GPS_IFD_TAG, 4, 1, &pointer );
+    }
+
+    bench_ifd_t exif = { .n = 0 };
+    add_entry( &exif, EXPOSURE_TIME_TAG, 5, 1, exposure );
+    add_entry( &exif, FNUMBER_TAG, 5, 1, fnumber );
+    add_entry( &exif, ISO_SPEED_RATINGS_TAG, 3, 1, &iso );
+    add_entry( &exif, EXIF_VERSION_TAG, 7, 4, "0231" );
+    add_entry( &exif, DATE_TIME_ORIGINAL_TAG, 2, 20, date );
+    for ( size_t i = 0; i + 5 < spec->n_exif_tags && i < N_EXIF_FILLERS; ++i ) {
+        add_entry( &exif, exif_fillers[i].tag, exif_fillers[i].type,
+                   exif_fillers[i].count,
+                   filler_data( exif_fillers[i].type, exif_fillers[i].count ) );
+    }
+    if ( spec->gps_iop ) {
+        add_entry( &exif, INTEROPERABILITY_IFD_TAG, 4, 1, &pointer );
+    }
+
+    size_t origin = w->len;
+    put_bytes( w, w->big_endian ? "MM" : "II", 2 );
+    put_uint16( w, 42 );
+    put_uint32( w, 8 );
+    size_t ifd0_pos = put_ifd( w, origin, &ifd0 );
+    patch_entry( w, ifd0_pos, &ifd0, EXIF_IFD_TAG, (uint32_t)( w->len - origin ) );
+    size_t exif_pos = put_ifd( w, origin, &exif );
+    free( strips );
+
+    if ( spec->gps_iop ) {
+        bench_ifd_t iop = { .n = 0 };
+        add_entry( &iop, INTEROPERABILITY_INDEX_TAG, 2, 4, "R98" );
+        add_entry( &iop, INTEROPERABILITY_VERSION_TAG, 7, 4, "0100" );
+        patch_entry( w, exif_pos, &exif, INTEROPERABILITY_IFD_TAG,
+                     (uint32_t)( w->len - origin ) );
+        put_ifd( w, origin, &iop );
+
+        bench_ifd_t gps = { .n = 0 };
+        add_entry( &gps, GPS_VERSION_ID_TAG, 1, 4, gps_version );
+        add_entry( &gps, GPS_LATITUDE_REF_TAG, 2, 2, "N" );
+        add_entry( &gps, GPS_LATITUDE_TAG, 5, 3, coordinates );
+        add_entry( &gps, GPS_LONGITUDE_REF_TAG, 2, 2, "E" );
+        add_entry( &gps, GPS_LONGITUDE_TAG, 5, 3, coordinates );
+        add_entry( &gps, GPS_ALTITUDE_REF_TAG, 1, 1, &altitude_ref );
+        add_entry( &gps, GPS_ALTITUDE_TAG, 5, 1, coordinates + 4 );
+        add_entry( &gps, GPS_TIME_STAMP_TAG, 5, 3, coordinates );
+        add_entry( &gps, GPS_DATE_STAMP_TAG, 2, 11, "2024:01:01" );
+        patch_entry( w, ifd0_pos, &ifd0, GPS_IFD_TAG,
+                     (uint32_t)( w->len - origin ) );
+        put_ifd( w, origin, &gps );
+    }
+
+    if ( spec->thumb_size > 0 ) {
+        uint32_t thumb_size = spec->thumb_size;
+        bench_ifd_t ifd1 = { .n = 0 };
+        add_entry( &ifd1, COMPRESSION_TAG, 3, 1, &jpeg_compression );
+        add_entry( &ifd1, X_RESOLUTION_TAG, 5, 1, resolution );
+        add_entry( &ifd1, Y_RESOLUTION_TAG, 5, 1, resolution );
+        add_entry( &ifd1, RESOLUTION_UNIT_TAG, 3, 1, &unit );
+        add_entry( &ifd1, JPEG_INTERCHANGE_FORMAT_TAG, 4, 1, &pointer );
+        add_entry( &ifd1, JPEG_INTERCHANGE_FORMAT_LENGTH_TAG, 4, 1, &thumb_size );
+        patch_uint32( w, ifd0_pos + 2 + 12 * (size_t)ifd0.n,
+                      (uint32_t)( w->len - origin ) );
+        size_t ifd1_pos = put_ifd( w, origin, &ifd1 );
+        patch_entry( w, ifd1_pos, &ifd1, JPEG_INTERCHANGE_FORMAT_TAG,
+                     (uint32_t)( w->len - origin ) );
+        put_bytes( w, "\xff\xd8", 2 );
+        for ( uint32_t i = 4; i < thumb_size; ++i ) {
+            uint8_t b = (uint8_t)( bench_random( ) & 0xfe );    // no 0xff
+            put_bytes( w, &b, 1 );
+        }
+        put_bytes( w, "\xff\xd9", 2 );
+    }
+}
+
+static void put_image( tiff_writer_t *w, size_t image_size )
+{
+    for ( size_t i = 0; i < image_size; ++i ) {
+        uint8_t b = (uint8_t)( bench_random( ) & 0xfe );        // no 0xff
+        put_bytes( w, &b, 1 );
+    }
+}
+
+static void put_jpeg( tiff_writer_t *w, const bench_spec_t *spec, uint32_t seed )
+{
+    static const uint8_t soi_app0[] = {
+        0xff, 0xd8, 0xff, 0xe0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1,
+        0, 1, 0, 0 };
+    put_bytes( w, soi_app0, sizeof(soi_app0) );
+
+    for ( uint32_t late = spec->late_size; late > 0; ) {
+        uint32_t size = ( late > 65533 ) ? 65533 : late;
+        uint8_t app2_header[4] = { 0xff, 0xe2, (uint8_t)( (size + 2) >> 8 ),
+                                   (uint8_t)( size + 2 ) };
+        put_bytes( w, app2_header, sizeof(app2_header) );
+        put_image( w, size );
+        late -= size;
+    }
+
+    static const uint8_t app1_header[] = {
+        0xff, 0xe1, 0, 0, 'E', 'x', 'i', 'f', 0, 0 };
+    size_t app1 = w->len;
+    put_bytes( w, app1_header, sizeof(app1_header) );
+    put_tiff( w, spec, seed );
+    size_t len = w->len - app1 - 2;     // must be less than 64KB
+    w->data[app1+2] = (uint8_t)(len >> 8);
+    w->data[app1+3] = (uint8_t)len;
+
+    static const uint8_t sos[] = { 0xff, 0xda, 0, 8, 1, 1, 0, 0, 63, 0 };
+    put_bytes( w, sos, sizeof(sos) );
+    put_image( w, spec->image_size );
+    put_bytes( w, "\xff\xd9", 2 );
+}
+
+// write n synthetic files according to spec in a new temporary directory, and
+// return their paths, or NULL in case of failure. Files are identical from
+// run to run.
+static char **make_corpus( const bench_spec_t *spec, size_t n, char *dir )
+{
+    strcpy( dir, "/tmp/exifbenchXXXXXX" );
+    if ( NULL == mkdtemp( dir ) ) {
+        return NULL;
+    }
+    char **paths = calloc( n, sizeof(char *) );
+    tiff_writer_t w = { malloc( 65536 ), 0, 65536, false };
+    if ( NULL == paths || NULL == w.data ) {
+        free( paths );
+        free( w.data );
+        return NULL;
+    }
+    bench_seed = 1;
+    for ( size_t i = 0; i < n; ++i ) {
+        w.len = 0;
+        w.big_endian = spec->mixed ? ( i & 1 ) : spec->big_endian;
+        if ( spec->tiff ) {
+            put_tiff( &w, spec, (uint32_t)i );
+            put_image( &w, spec->image_size );
+        } else {
+            put_jpeg( &w, spec, (uint32_t)i );
+        }
+        paths[i] = malloc( strlen( dir ) + 32 );
+        sprintf( paths[i], "%s/img%06zu.%s", dir, i, spec->tiff ? "tif" : "jpg" );
+        FILE *f = fopen( paths[i], "wb" );
+        if ( NULL != f ) {
+            fwrite( w.data, 1, w.len, f );
+            fclose( f );
+        }
+    }
+    free( w.data );
+    return paths;
+}
+
+static void free_corpus( char **paths, size_t n, char *dir )
+{
+    for ( size_t i = 0; i < n; ++i ) {
+        remove( paths[i] );
+        free( paths[i] );
+    }
+    free( paths );
+    remove( dir );
+}
+
+typedef struct {
+    size_t      n_ok, n_failed;
+} many_result_t;
+
+static void count_result( void *context, size_t index,
+                          exif_desc_t *desc, int error )
+{
+    many_result_t *res = context;
+    if ( NULL != desc ) {
+        __sync_fetch_and_add( &res->n_ok, 1 );
+        exif_free( desc );
+    } else {
+        __sync_fetch_and_add( &res->n_failed, 1 );
+    }
+}
+
+#define MANY_BENCH_FILES    8000
+#define MANY_BENCH_ROUNDS   3
+
+static double time_read_many( char **paths, size_t n, exif_control_t *control,
+                              unsigned int n_threads, bool ordered,
+                              many_result_t *res )
+{
+    double best = 0;
+    for ( int r = 0; r < MANY_BENCH_ROUNDS; ++r ) {
+        res->n_ok = res->n_failed = 0;
+        double t = now( );
+        exif_read_many( paths, n, control, count_result, res, n_threads, ordered );
+        t = now( ) - t;
+        if ( 0 == r || t < best ) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+// files/sec for an increasing number of threads, on a warm page cache
+static void bench_read_many( void )
+{
+    char dir[32];
+    char **paths = make_corpus( &default_spec, MANY_BENCH_FILES, dir );
+    if ( NULL == paths ) {
+        printf( "Failed to create corpus\n" );
+        return;
+    }
+    exif_control_t control = { 0 };
+    control.skip_unknown_tags = true;
+    many_result_t res;
+
+    long n_cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    printf( "read_many: %d files, %ld processors\n", MANY_BENCH_FILES, n_cpus );
+    time_read_many( paths, MANY_BENCH_FILES, &control, 1, false, &res );   // warm up
+    double t1 = 0;
+    for ( unsigned int n = 1; n <= 64 && n <= 2 * n_cpus; n *= 2 ) {
+        for ( int ordered = 0; ordered < 2; ++ordered ) {
+            double t = time_read_many( paths, MANY_BENCH_FILES, &control,
+                                       n, ordered, &res );
+            if ( 1 == n && ! ordered ) {
+                t1 = t;
+            }
+            printf( "read_many %2u threads%s %10.0f files/s speedup %5.2f "
+                    "(%zu ok, %zu failed)\n", n, ordered ? " ordered" : "        ",
+                    MANY_BENCH_FILES / t, t1 / t, res.n_ok, res.n_failed );
+        }
+    }
+    free_corpus( paths, MANY_BENCH_FILES, dir );
+}
+
+// Reentrancy stress: hundreds of files parsed concurrently by many threads,
+// in normal and lazy mode, must give the same values as a sequential parse.
+// It is meant to be run with a bench built with -fsanitize=thread.
+// drop the corpus files from the page cache, so that they are read from the
+// storage device again (only clean pages are dropped, which they are after
+// fsync).
+static void evict_corpus( char **paths, size_t n )
+{
+    for ( size_t i = 0; i < n; ++i ) {
+        int fd = open( paths[i], O_RDONLY );
+        if ( 0 <= fd ) {
+            fdatasync( fd );
+            posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+            close( fd );
+        }
+    }
+}
+
+static double time_read_async( char **paths, size_t n, exif_control_t *control,
+                               unsigned int depth, bool async, bool cold,
+                               many_result_t *res )
+{
+    double best = 0;
+    for ( int r = 0; r < MANY_BENCH_ROUNDS; ++r ) {
+        if ( cold ) {
+            evict_corpus( paths, n );
+        }
+        res->n_ok = res->n_failed = 0;
+        double t = now( );
+        if ( async ) {
+            exif_read_many_async( paths, n, control, count_result, res, depth );
+        } else {
+            exif_read_many( paths, n, control, count_result, res, depth, false );
+        }
+        t = now( ) - t;
+        if ( 0 == r || t < best ) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+// files/sec for an increasing queue depth, with io_uring reads from a single
+// thread compared to as many threads doing blocking reads, on a warm page
+// cache and after dropping the files from the page cache.
+static void bench_read_async( void )
+{
+    char dir[32];
+    char **paths = make_corpus( &default_spec, MANY_BENCH_FILES, dir );
+    if ( NULL == paths ) {
+        printf( "Failed to create corpus\n" );
+        return;
+    }
+    exif_control_t control = { 0 };
+    control.skip_unknown_tags = true;
+    many_result_t res;
+
+    printf( "read_many_async: %d files\n", MANY_BENCH_FILES );
+    time_read_async( paths, MANY_BENCH_FILES, &control, 1, true, false, &res );
+    for ( int cold = 0; cold < 2; ++cold ) {
+        for ( unsigned int depth = 1; depth <= 256; depth *= 2 ) {
+            double ta = time_read_async( paths, MANY_BENCH_FILES, &control,
+                                         depth, true, cold, &res );
+            double tt = time_read_async( paths, MANY_BENCH_FILES, &control,
+                                         depth, false, cold, &res );
+            printf( "%s depth %3u: async %10.0f files/s, threads %10.0f files/s "
+                    "(%zu ok, %zu failed)\n", cold ? "cold" : "warm", depth,
+                    MANY_BENCH_FILES / ta, MANY_BENCH_FILES / tt,
+                    res.n_ok, res.n_failed );
+        }
+    }
+    free_corpus( paths, MANY_BENCH_FILES, dir );
+}
+
+// Allocations are counted by wrapping malloc, calloc and realloc at link time
+// (see makefile), only while count_allocs is set.
+static bool count_allocs;
+static size_t n_allocs;
+
+extern void *__real_malloc( size_t size );
+extern void *__real_calloc( size_t n, size_t size );
+extern void *__real_realloc( void *p, size_t size );
+
+extern void *__wrap_malloc( size_t size )
+{
+    if ( count_allocs ) ++n_allocs;
+    return __real_malloc( size );
+}
+
+extern void *__wrap_calloc( size_t n, size_t size )
+{
+    if ( count_allocs ) ++n_allocs;
+    return __real_calloc( n, size );
+}
+
+extern void *__wrap_realloc( void *p, size_t size )
+{
+    if ( count_allocs ) ++n_allocs;
+    return __real_realloc( p, size );
+}
+
+// read and seek system calls are counted through a FILE whose read and seek
+// functions make the system calls, with the same buffer size as fopen uses.
+typedef struct {
+    int         fd;
+    size_t      n_reads, n_seeks, n_bytes;
+} counting_file_t;
+
+static ssize_t counting_read( void *cookie, char *buf, size_t size )
+{
+    counting_file_t *cf = cookie;
+    ++cf->n_reads;
+    ssize_t n = read( cf->fd, buf, size );
+    if ( n > 0 ) {
+        cf->n_bytes += (size_t)n;
+    }
+    return n;
+}
+
+static int counting_seek( void *cookie, off64_t *offset, int whence )
+{
+    counting_file_t *cf = cookie;
+    ++cf->n_seeks;
+    off_t res = lseek( cf->fd, (off_t)*offset, whence );
+    if ( -1 == res ) {
+        return -1;
+    }
+    *offset = res;
+    return 0;
+}
+
+static int counting_close( void *cookie )
+{
+    counting_file_t *cf = cookie;
+    return close( cf->fd );
+}
+
+static FILE *open_counting_file( const char *path, counting_file_t *cf )
+{
+    cookie_io_functions_t io = {
+        counting_read, NULL, counting_seek, counting_close };
+    memset( cf, 0, sizeof(counting_file_t) );
+    cf->fd = open( path, O_RDONLY );
+    if ( 0 > cf->fd ) {
+        return NULL;
+    }
+    struct stat st;
+    FILE *f = fopencookie( cf, "r", io );
+    if ( NULL == f ) {
+        close( cf->fd );
+        return NULL;
+    }
+    if ( 0 == fstat( cf->fd, &st ) ) {
+        setvbuf( f, NULL, _IOFBF, (size_t)st.st_blksize );
+    }
+    return f;
+}
+
+static size_t count_tags( exif_desc_t *desc )
+{
+    size_t n_tags = 0;
+    for ( ifd_id_t id = PRIMARY; id < EXIF_IFD_N; ++id ) {
+        slice_t *tags = exif_get_ifd_tags( desc, id, NULL );
+        if ( NULL != tags ) {
+            n_tags += slice_len( tags );
+            slice_free( tags );
+        }
+    }
+    return n_tags;
+}
+
+#define CORPUS_FILES        400
+#define CORPUS_ROUNDS       5
+
+static const bench_spec_t corpus_specs[] = {
+//    name                tiff   MM     mixed tags strips gps   late    thumb  image
+    { "jpeg_small_ii",    false, false, false, 5,  0,     false, 0,      0,     8192 },
+    { "jpeg_small_mm",    false, true,  false, 5,  0,     false, 0,      0,     8192 },
+    { "jpeg_large_ifd_ii", false, false, false, 43, 0,    false, 0,      0,     8192 },
+    { "jpeg_large_ifd_mm", false, true, false, 43, 0,     false, 0,      0,     8192 },
+    { "jpeg_gps_iop_ii",  false, false, false, 20, 0,     true,  0,      0,     8192 },
+    { "jpeg_gps_iop_mm",  false, true,  false, 20, 0,     true,  0,      0,     8192 },
+    { "jpeg_late_app1_ii", false, false, false, 20, 0,    false, 200000, 0,     8192 },
+    { "jpeg_late_app1_mm", false, true, false, 20, 0,     false, 200000, 0,     8192 },
+    { "jpeg_thumbnail_ii", false, false, false, 20, 0,    true,  0,      60000, 8192 },
+    { "jpeg_thumbnail_mm", false, true, false, 20, 0,     true,  0,      60000, 8192 },
+    { "tiff_small_ii",    true,  false, false, 5,  1,     false, 0,      0,     8192 },
+    { "tiff_small_mm",    true,  true,  false, 5,  1,     false, 0,      0,     8192 },
+    { "tiff_strips_ii",   true,  false, false, 20, 20000, true,  0,      0,     8192 },
+    { "tiff_strips_mm",   true,  true,  false, 20, 20000, true,  0,      0,     8192 },
+};
+#define N_CORPUS_SPECS  (sizeof(corpus_specs)/sizeof(corpus_specs[0]))
+
+typedef struct {
+    size_t      n_ok, n_tags, file_size;
+    size_t      n_reads, n_seeks, n_bytes, n_allocs;
+    double      time;
+} corpus_result_t;
+
+// one pass with counting files and allocations, then timed passes of
+// read_exif, keeping the best time.
+static void measure_corpus( char **paths, size_t n, corpus_result_t *res )
+{
+    exif_control_t control = { 0 };
+    memset( res, 0, sizeof(corpus_result_t) );
+    for ( size_t i = 0; i < n; ++i ) {
+        struct stat st;
+        if ( 0 == stat( paths[i], &st ) ) {
+            res->file_size += (size_t)st.st_size;
+        }
+        counting_file_t cf;
+        FILE *f = open_counting_file( paths[i], &cf );
+        if ( NULL == f ) {
+            continue;
+        }
+        n_allocs = 0;
+        count_allocs = true;
+        exif_desc_t *desc = parse_exif( f, 0, &control );
+        count_allocs = false;
+        if ( NULL != desc ) {
+            ++res->n_ok;
+            res->n_tags += count_tags( desc );
+            exif_free( desc );
+        }
+        res->n_reads += cf.n_reads;
+        res->n_seeks += cf.n_seeks;
+        res->n_bytes += cf.n_bytes;
+        res->n_allocs += n_allocs;
+        fclose( f );
+    }
+
+    for ( int r = 0; r < CORPUS_ROUNDS; ++r ) {
+        double t = now( );
+        for ( size_t i = 0; i < n; ++i ) {
+            exif_free( read_exif( paths[i], 0, &control ) );
+        }
+        t = now( ) - t;
+        if ( 0 == r || t < res->time ) {
+            res->time = t;
+        }
+    }
+}
+
+// files/sec, ns/tag, bytes read, read/seek system calls and allocations per
+// file of read_exif for each corpus variant, as JSON, on a warm page cache.
+static void bench_corpus( void )
+{
+    printf( "{\n  \"benchmark\": \"corpus\",\n  \"files\": %d,\n"
+            "  \"rounds\": %d,\n  \"variants\": [\n",
+            CORPUS_FILES, CORPUS_ROUNDS );
+    for ( size_t s = 0; s < N_CORPUS_SPECS; ++s ) {
+        const bench_spec_t *spec = &corpus_specs[s];
+        char dir[32];
+        char **paths = make_corpus( spec, CORPUS_FILES, dir );
+        corpus_result_t res;
+        if ( NULL != paths ) {
+            measure_corpus( paths, CORPUS_FILES, &res );
+            free_corpus( paths, CORPUS_FILES, dir );
+        } else {
+            memset( &res, 0, sizeof(res) );
+        }
+        double n = CORPUS_FILES;
+        printf( "    { \"name\": \"%s\", \"file_size\": %.0f, \"ok\": %zu, "
+                "\"tags_per_file\": %.1f,\n      \"files_per_sec\": %.0f, "
+                "\"ns_per_tag\": %.1f, \"bytes_read_per_file\": %.0f,\n"
+                "      \"reads_per_file\": %.2f, \"seeks_per_file\": %.2f, "
+                "\"allocs_per_file\": %.2f }%s\n",
+                spec->name, res.file_size / n, res.n_ok, res.n_tags / n,
+                ( res.time > 0 ) ? n / res.time : 0.0,
+                ( res.n_tags > 0 ) ? res.time * 1e9 / (double)res.n_tags : 0.0,
+                res.n_bytes / n, res.n_reads / n, res.n_seeks / n,
+                res.n_allocs / n, ( s + 1 < N_CORPUS_SPECS ) ? "," : "" );
+    }
+    printf( "  ]\n}\n" );
+}
+
+#define DECODE_PARSES       2000
+#define DECODE_ROUNDS       5
+
+static const bench_spec_t decode_specs[] = {
+//    name                tiff   MM     mixed tags strips gps   late    thumb  image
+    { "strips_ii",        true,  false, false, 5,  20000, false, 0,      0,     0 },
+    { "strips_mm",        true,  true,  false, 5,  20000, false, 0,      0,     0 },
+    { "rationals_ii",     true,  false, false, 43, 1,     true,  0,      0,     0 },
+    { "rationals_mm",     true,  true,  false, 43, 1,     true,  0,      0,     0 },
+};
+#define N_DECODE_SPECS  (sizeof(decode_specs)/sizeof(decode_specs[0]))
+
+// ns per in-memory parsing of TIFF data with value arrays, in both byte
+// orders: 20000 StripOffsets and StripByteCounts, or ReferenceBlackWhite,
+// GPS rational triples and EXIF rationals.
+static void bench_decode( void )
+{
+    exif_control_t control = { 0 };
+    tiff_writer_t w = { malloc( 65536 ), 0, 65536, false };
+    if ( NULL == w.data ) {
+        return;
+    }
+    for ( size_t s = 0; s < N_DECODE_SPECS; ++s ) {
+        const bench_spec_t *spec = &decode_specs[s];
+        w.len = 0;
+        w.big_endian = spec->big_endian;
+        put_tiff( &w, spec, 0 );
+
+        exif_desc_t *desc = parse_tiff_buffer( w.data, w.len, &control, NULL );
+        size_t n_tags = ( NULL == desc ) ? 0 : count_tags( desc );
+        exif_free( desc );
+
+        double best = 0;
+        for ( int r = 0; r < DECODE_ROUNDS; ++r ) {
+            double t = now( );
+            for ( int i = 0; i < DECODE_PARSES; ++i ) {
+                exif_free( parse_tiff_buffer( w.data, w.len, &control, NULL ) );
+            }
+            t = now( ) - t;
+            if ( 0 == r || t < best ) {
+                best = t;
+            }
+        }
+        printf( "decode %-14s %7zu bytes %3zu tags %10.0f ns/parse\n",
+                spec->name, w.len, n_tags, best * 1e9 / DECODE_PARSES );
+    }
+    free( w.data );
+}
+
+#define STRESS_FILES        512
+#define STRESS_THREADS      64
+
+static const bench_spec_t stress_spec = {
+    "stress", false, false, true, 5, 0, false, 0, 0, 256
+};
+
+static uint32_t hash_bytes( uint32_t h, const void *data, size_t len )
+{
+    for ( size_t i = 0; i < len; ++i ) {
+        h = ( h ^ ((const uint8_t *)data)[i] ) * 16777619;  // FNV-1a
+    }
+    return h;
+}
+
+static uint32_t hash_desc( exif_desc_t *desc )
+{
+    static const struct { ifd_id_t id; uint16_t tag; } tags[] = {
+        { PRIMARY, MAKE_TAG }, { PRIMARY, MODEL_TAG }, { PRIMARY, DATE_TIME_TAG },
+        { PRIMARY, ORIENTATION_TAG }, { EXIF, EXPOSURE_TIME_TAG },
+        { EXIF, FNUMBER_TAG }, { EXIF, ISO_SPEED_RATINGS_TAG },
+        { EXIF, EXIF_VERSION_TAG }, { EXIF, DATE_TIME_ORIGINAL_TAG }
+    };
+    uint32_t h = 2166136261u;
+    for ( size_t i = 0; i < sizeof(tags)/sizeof(tags[0]); ++i ) {
+        vector_t *v;
+        if ( exif_get_ifd_tag_values( desc, tags[i].id, tags[i].tag, &v ) ) {
+            h = hash_bytes( h, vector_item_at( v, 0 ),
+                            vector_item_size( v ) * vector_cap( v ) );
+        }
+        h = hash_bytes( h, &i, sizeof(i) );
+    }
+    return h;
+}
+
+static void hash_result( void *context, size_t index,
+                         exif_desc_t *desc, int error )
+{
+    uint32_t *hashes = context;
+    hashes[index] = ( NULL == desc ) ? 0 : hash_desc( desc );
+    exif_free( desc );
+}
+
+static void bench_stress( void )
+{
+    char dir[32];
+    char **paths = make_corpus( &stress_spec, STRESS_FILES, dir );
+    if ( NULL == paths ) {
+        printf( "Failed to create corpus\n" );
+        return;
+    }
+    uint32_t expected[STRESS_FILES], hashes[STRESS_FILES];
+    exif_control_t control = { 0 };
+    exif_read_many( paths, STRESS_FILES, &control, hash_result, expected,
+                    1, false );
+
+    bool ok = true;
+    for ( int round = 0; round < 8; ++round ) {
+        control.lazy_values = round & 1;
+        memset( hashes, 0, sizeof(hashes) );
+        exif_read_many( paths, STRESS_FILES, &control, hash_result, hashes,
+                        STRESS_THREADS, round & 2 );
+        for ( size_t i = 0; i < STRESS_FILES; ++i ) {
+            if ( 0 == expected[i] || hashes[i] != expected[i] ) {
+                printf( "stress: mismatch for %s in round %d\n", paths[i], round );
+                ok = false;
+                break;
+            }
+        }
+    }
+    printf( "stress: %d files, %d threads: %s\n", STRESS_FILES, STRESS_THREADS,
+            ok ? "ok" : "FAILED" );
+    free_corpus( paths, STRESS_FILES, dir );
+}
+
+#define CATALOG_FILES       8000
+
+// true if the record has the same values as the descriptor for the tags
+// used by hash_desc
+static bool check_record( const exif_record_t *record, exif_desc_t *desc )
+{
+    static const struct { ifd_id_t id; uint16_t tag; } tags[] = {
+        { PRIMARY, MAKE_TAG }, { PRIMARY, MODEL_TAG }, { PRIMARY, DATE_TIME_TAG },
+        { PRIMARY, ORIENTATION_TAG }, { EXIF, EXPOSURE_TIME_TAG },
+        { EXIF, FNUMBER_TAG }, { EXIF, EXIF_VERSION_TAG }
+    };
+    for ( size_t i = 0; i < sizeof(tags)/sizeof(tags[0]); ++i ) {
+        vector_t *v;
+        const void *values;
+        uint32_t count;
+        exif_type_t type;
+        bool in_desc = exif_get_ifd_tag_values( desc, tags[i].id, tags[i].tag, &v );
+        bool in_record = exif_record_get_tag_values( record, tags[i].id,
+                                        tags[i].tag, &type, &values, &count );
+        if ( in_desc != in_record ) {
+            return false;
+        }
+        if ( in_desc && ( count != vector_cap( v ) ||
+                          type != exif_get_ifd_tag_type( desc, tags[i].id,
+                                                         tags[i].tag ) ||
+                          0 != memcmp( values, vector_item_at( v, 0 ),
+                                       count * vector_item_size( v ) ) ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// full scan, rescan without changes, and rescan after touching 1% of the
+// files, then opening the catalog and finding all files.
+static void bench_catalog( void )
+{
+    char dir[32];
+    char **paths = make_corpus( &default_spec, CATALOG_FILES, dir );
+    if ( NULL == paths ) {
+        printf( "Failed to create corpus\n" );
+        return;
+    }
+    char catalog_path[64];
+    snprintf( catalog_path, sizeof(catalog_path), "%s/catalog", dir );
+    exif_control_t control = { 0 };
+    exif_rescan_stats_t stats;
+
+    exif_catalog_t *catalog = exif_catalog_open( catalog_path );
+    for ( int pass = 0; pass < 3; ++pass ) {
+        if ( 2 == pass ) {
+            for ( size_t i = 0; i < CATALOG_FILES; i += 100 ) {
+                struct timespec times[2] = { { 0, UTIME_NOW }, { 0, UTIME_NOW } };
+                times[1].tv_sec = 1000000000 + (time_t)i;    // new mtime
+                times[1].tv_nsec = 0;
+                utimensat( AT_FDCWD, paths[i], times, 0 );
+            }
+        }
+        double t = now( );
+        bool ok = exif_catalog_rescan( catalog, paths, CATALOG_FILES,
+                                       &control, &stats );
+        t = now( ) - t;
+        printf( "catalog %-10s %s %8.3f s, %zu unchanged, %zu parsed, "
+                "%zu failed, %zu errors\n", ( 0 == pass ) ? "scan" :
+                                 ( 1 == pass ) ? "rescan" : "rescan 1%",
+                ok ? "ok" : "FAILED", t, stats.n_unchanged, stats.n_parsed,
+                stats.n_failed, stats.n_errors );
+    }
+    exif_catalog_close( catalog );
+
+    double t = now( );
+    catalog = exif_catalog_open( catalog_path );
+    t = now( ) - t;
+    printf( "catalog open       %8.6f s, %zu files\n", t,
+            exif_catalog_get_count( catalog ) );
+
+    exif_record_t record;
+    size_t n_found = 0;
+    t = now( );
+    for ( size_t i = 0; i < CATALOG_FILES; ++i ) {
+        n_found += exif_catalog_find( catalog, paths[i], &record ) &&
+                   exif_record_get_tag_values( &record, PRIMARY, MODEL_TAG,
+                                               NULL, NULL, NULL );
+    }
+    t = now( ) - t;
+    printf( "catalog find       %8.0f ns/file, %zu found\n",
+            t * 1e9 / CATALOG_FILES, n_found );
+
+    bool ok = true;
+    for ( size_t i = 0; ok && i < CATALOG_FILES; ++i ) {
+        exif_desc_t *desc = read_exif( paths[i], 0, &control );
+        ok = NULL != desc && exif_catalog_find( catalog, paths[i], &record ) &&
+             check_record( &record, desc );
+        exif_free( desc );
+        if ( ! ok ) {
+            printf( "catalog: mismatch for %s\n", paths[i] );
+        }
+    }
+    printf( "catalog values: %s\n", ok ? "ok" : "FAILED" );
+    exif_catalog_close( catalog );
+    remove( catalog_path );
+    free_corpus( paths, CATALOG_FILES, dir );
+}
+
+#define CACHE_FILES         1000
+#define CACHE_THREADS       8
+#define CACHE_READS         100000      // per thread
+
+typedef struct {
+    exif_cache_t        *cache;
+    char                **paths;
+    const uint32_t      *expected;      // hash_desc for each path
+    uint32_t            seed;
+    bool                ok;
+} cache_reader_t;
+
+static void *read_cached( void *arg )
+{
+    cache_reader_t *r = arg;
+    r->ok = true;
+    for ( size_t i = 0; i < CACHE_READS; ++i ) {
+        r->seed = r->seed * 1103515245 + 12345;
+        size_t k = ( r->seed >> 8 ) % CACHE_FILES;
+        exif_desc_t *desc = exif_cache_read( r->cache, r->paths[k], NULL );
+        if ( NULL == desc || hash_desc( desc ) != r->expected[k] ) {
+            r->ok = false;
+        }
+        exif_cache_release( r->cache, desc );
+    }
+    return NULL;
+}
+
+// read_exif for each file against cache misses and hits, then concurrent hits
+// from several threads, with a cache large enough for all files and with a
+// cache for a quarter of them.
+static void bench_cache( void )
+{
+    char dir[32];
+    char **paths = make_corpus( &default_spec, CACHE_FILES, dir );
+    if ( NULL == paths ) {
+        printf( "Failed to create corpus\n" );
+        return;
+    }
+    uint32_t expected[CACHE_FILES];
+    double t = now( );
+    for ( size_t i = 0; i < CACHE_FILES; ++i ) {
+        exif_desc_t *desc = read_exif( paths[i], 0, NULL );
+        expected[i] = ( NULL == desc ) ? 0 : hash_desc( desc );
+        exif_free( desc );
+    }
+    t = now( ) - t;
+    printf( "cache read_exif    %8.0f ns/file\n", t * 1e9 / CACHE_FILES );
+
+    exif_cache_t *cache = exif_cache_open( 64 * 1024 * 1024 );
+    for ( int pass = 0; pass < 2; ++pass ) {
+        t = now( );
+        for ( size_t i = 0; i < CACHE_FILES; ++i ) {
+            exif_cache_release( cache, exif_cache_read( cache, paths[i], NULL ) );
+        }
+        t = now( ) - t;
+        printf( "cache %-12s %8.0f ns/file\n", ( 0 == pass ) ? "miss" : "hit",
+                t * 1e9 / CACHE_FILES );
+    }
+    exif_cache_stats_t stats;
+    exif_cache_get_stats( cache, &stats );
+    size_t capacity = (size_t)stats.bytes / 4;
+
+    for ( int round = 0; round < 2; ++round ) {
+        if ( 1 == round ) {
+            exif_cache_close( cache );
+            cache = exif_cache_open( capacity );
+        }
+        pthread_t threads[CACHE_THREADS];
+        cache_reader_t readers[CACHE_THREADS];
+        t = now( );
+        for ( size_t i = 0; i < CACHE_THREADS; ++i ) {
+            readers[i] = (cache_reader_t){ cache, paths, expected,
+                                           (uint32_t)i + 1, false };
+            pthread_create( &threads[i], NULL, read_cached, &readers[i] );
+        }
+        bool ok = true;
+        for ( size_t i = 0; i < CACHE_THREADS; ++i ) {
+            pthread_join( threads[i], NULL );
+            ok = ok && readers[i].ok;
+        }
+        t = now( ) - t;
+        exif_cache_get_stats( cache, &stats );
+        printf( "cache %d threads %s %8.0f ns/read, %s, %llu hits, %llu misses, "
+                "%llu entries, %llu bytes\n", CACHE_THREADS,
+                ( 0 == round ) ? "all    " : "quarter",
+                t * 1e9 / ( CACHE_THREADS * CACHE_READS ), ok ? "ok" : "FAILED",
+                (unsigned long long)stats.n_hits,
+                (unsigned long long)stats.n_misses,
+                (unsigned long long)stats.n_entries,
+                (unsigned long long)stats.bytes );
+    }
+    exif_cache_close( cache );
+    free_corpus( paths, CACHE_FILES, dir );
+}
+
+#define JSON_FILES          1000
+
+static void print_desc( exif_desc_t *desc )
+{
+    for ( ifd_id_t id = PRIMARY; id <= IOP; ++id ) {
+        exif_print_ifd_entries( desc, id, "  " );
+    }
+}
+
+// JSON output of all descriptors in a reused buffer, against printing them,
+// with stdout redirected to /dev/null.
+static void bench_json( void )
+{
+    char dir[32];
+    char **paths = make_corpus( &default_spec, JSON_FILES, dir );
+    if ( NULL == paths ) {
+        printf( "Failed to create corpus\n" );
+        return;
+    }
+    exif_desc_t *descs[JSON_FILES];
+    for ( size_t i = 0; i < JSON_FILES; ++i ) {
+        descs[i] = read_exif( paths[i], 0, NULL );
+    }
+
+    char *buf = NULL;
+    size_t cap = 0, total = 0;
+    double t = now( );
+    for ( size_t i = 0; i < JSON_FILES; ++i ) {
+        total += exif_write_json_grow( descs[i], &buf, &cap );
+    }
+    t = now( ) - t;
+    free( buf );
+    printf( "json write         %8.0f ns/file, %zu bytes/file\n",
+            t * 1e9 / JSON_FILES, total / JSON_FILES );
+
+    fflush( stdout );
+    int saved = dup( STDOUT_FILENO );
+    int null = open( "/dev/null", O_WRONLY );
+    dup2( null, STDOUT_FILENO );
+    close( null );
+    t = now( );
+    for ( size_t i = 0; i < JSON_FILES; ++i ) {
+        print_desc( descs[i] );
+    }
+    fflush( stdout );
+    t = now( ) - t;
+    dup2( saved, STDOUT_FILENO );
+    close( saved );
+    printf( "json print         %8.0f ns/file\n", t * 1e9 / JSON_FILES );
+
+    for ( size_t i = 0; i < JSON_FILES; ++i ) {
+        exif_free( descs[i] );
+    }
+    free_corpus( paths, JSON_FILES, dir );
+}
+
+int main( int argc, char **argv )
+{
+    bool scan = argc < 2, many = argc < 2;   // all benchmarks by default
+    bool stress = false, async = false;     // only on request
+    bool corpus = false, decode = false, swap = false, catalog = false;
+    bool cache = false, json = false;
+    for ( int i = 1; i < argc; ++i ) {
+        if ( 0 == strcmp( argv[i], "scan" ) ) {
+            scan = true;
+        } else if ( 0 == strcmp( argv[i], "many" ) ) {
+            many = true;
+        } else if ( 0 == strcmp( argv[i], "stress" ) ) {
+            stress = true;
+        } else if ( 0 == strcmp( argv[i], "async" ) ) {
+            async = true;
+        } else if ( 0 == strcmp( argv[i], "corpus" ) ) {
+            corpus = true;
+        } else if ( 0 == strcmp( argv[i], "decode" ) ) {
+            decode = true;
+        } else if ( 0 == strcmp( argv[i], "swap" ) ) {
+            swap = true;
+        } else if ( 0 == strcmp( argv[i], "catalog" ) ) {
+            catalog = true;
+        } else if ( 0 == strcmp( argv[i], "cache" ) ) {
+            cache = true;
+        } else if ( 0 == strcmp( argv[i], "json" ) ) {
+            json = true;
+        } else {
+            printf( "Usage: %s [scan] [many] [async] [corpus] [decode] [swap] "
+                    "[catalog] [cache] [json] [stress]\n", argv[0] );
+            return 1;
+        }
+    }
+    if ( stress ) {
+        bench_stress( );
+    }
+    if ( scan ) {
+        bench_scan( );
+    }
+    if ( many ) {
+        bench_read_many( );
+    }
+    if ( async ) {
+        bench_read_async( );
+    }
+    if ( corpus ) {
+        bench_corpus( );
+    }
+    if ( decode ) {
+        bench_decode( );
+    }
+    if ( swap ) {
+        bench_swap( );
+    }
+    if ( catalog ) {
+        bench_catalog( );
+    }
+    if ( cache ) {
+        bench_cache( );
+    }
+    if ( json ) {
+        bench_json( );
+    }
+    return 0;
+}
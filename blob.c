@@ -0,0 +1,136 @@
+#include <string.h>
+
+#include "exif.h"
+#include "parse.h"
+#include "blob.h"
+
+#define BLOB_MAGIC      0x31425845      // "EXB1" on little endian processors
+
+static inline size_t align_blob( size_t size )
+{
+    return ( size + BLOB_ALIGNMENT - 1 ) & ~(size_t)( BLOB_ALIGNMENT - 1 );
+}
+
+static inline size_t ifd_size( uint32_t n_entries )
+{
+    return sizeof(blob_ifd_t) + n_entries * sizeof(blob_entry_t);
+}
+
+static uint32_t count_entries( ifd_table_t *table )
+{
+    uint32_t n = 0;
+    for ( uint16_t i = 0; i < table->n_entries; ++i ) {
+        if ( NULL != table->entries[i].values ) {
+            ++n;
+        }
+    }
+    return n;
+}
+
+extern size_t exif_serialize( exif_desc_t *desc, uint8_t *buf, size_t cap )
+{
+    if ( NULL == desc ) {
+        return 0;
+    }
+    size_t size = align_blob( sizeof(blob_header_t) );
+    for ( ifd_id_t id = PRIMARY; id < _IFD_N; ++id ) {
+        ifd_table_t *table = desc->ifds[id];
+        if ( NULL == table ) {
+            continue;
+        }
+        exif_load_ifd_entries( desc, id );      // only in lazy mode
+        size += align_blob( ifd_size( count_entries( table ) ) );
+        for ( uint16_t i = 0; i < table->n_entries; ++i ) {
+            ifd_values_t *values = table->entries[i].values;
+            if ( NULL != values ) {
+                size += align_blob( (size_t)values->count * values->item_size );
+            }
+        }
+    }
+    if ( size > UINT32_MAX ) {
+        return 0;
+    }
+    if ( NULL == buf || cap < size ) {
+        return size;
+    }
+
+    memset( buf, 0, size );     // including padding
+    blob_header_t *header = (blob_header_t *)buf;
+    header->magic = BLOB_MAGIC;
+    header->size = (uint32_t)size;
+    size_t pos = align_blob( sizeof(blob_header_t) );
+    for ( ifd_id_t id = PRIMARY; id < _IFD_N; ++id ) {
+        ifd_table_t *table = desc->ifds[id];
+        if ( NULL == table ) {
+            continue;
+        }
+        blob_ifd_t *ifd = (blob_ifd_t *)( buf + pos );
+        header->ifds[id] = (uint32_t)pos;
+        ifd->n_entries = count_entries( table );
+        pos += align_blob( ifd_size( ifd->n_entries ) );
+
+        blob_entry_t *entry = ifd->entries;
+        for ( uint16_t i = 0; i < table->n_entries; ++i ) {
+            ifd_values_t *values = table->entries[i].values;
+            if ( NULL == values ) {
+                continue;
+            }
+            size_t n = (size_t)values->count * values->item_size;
+            entry->tag = table->entries[i].tag;
+            entry->type = values->type;
+            entry->item_size = values->item_size;
+            entry->count = values->count;
+            entry->offset = (uint32_t)pos;
+            memcpy( buf + pos, values->data, n );
+            pos += align_blob( n );
+            ++entry;
+        }
+    }
+    return size;
+}
+
+extern const blob_ifd_t *exif_blob_get_ifd( const uint8_t *data, size_t len,
+                                            ifd_id_t id )
+{
+    const blob_header_t *header = (const blob_header_t *)data;
+    if ( NULL == data || len < sizeof(blob_header_t) ||
+         BLOB_MAGIC != header->magic || header->size > len ||
+         id < PRIMARY || id >= _IFD_N ) {
+        return NULL;
+    }
+    uint32_t size = header->size, offset = header->ifds[id];
+    if ( 0 == offset || offset > size || size - offset < sizeof(blob_ifd_t) ||
+         0 != offset % BLOB_ALIGNMENT ) {
+        return NULL;
+    }
+    const blob_ifd_t *ifd = (const blob_ifd_t *)( data + offset );
+    if ( ( size - offset - sizeof(blob_ifd_t) ) / sizeof(blob_entry_t) <
+                                                            ifd->n_entries ) {
+        return NULL;
+    }
+    return ifd;
+}
+
+extern const blob_entry_t *exif_blob_lookup( const uint8_t *data, size_t len,
+                                             ifd_id_t id, uint16_t tag )
+{
+    const blob_ifd_t *ifd = exif_blob_get_ifd( data, len, id );
+    if ( NULL == ifd ) {
+        return NULL;
+    }
+    uint32_t low = 0, high = ifd->n_entries;
+    while ( low < high ) {                  // binary search in [low, high[
+        uint32_t mid = ( low + high ) / 2;
+        const blob_entry_t *entry = &ifd->entries[mid];
+        if ( entry->tag == tag ) {
+            uint32_t size = ((const blob_header_t *)data)->size;
+            return is_blob_entry_valid( entry, size ) ? entry : NULL;
+        }
+        if ( entry->tag < tag ) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,91 @@
+#ifndef __BLOB_H__
+#define __BLOB_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "exif.h"
+#include "parse.h"
+
+/*
+    Serialized descriptor (blob), position independent so that it can be
+    stored in a file and used in place once mapped in memory:
+
+    header          magic, blob size, offset of each IFD from the blob start
+                    (0 if the IFD is absent)
+    IFDs            number of entries followed by the entries sorted by tag:
+                    tag, type, item size, count and offset of the values
+    values          count * item size bytes for each entry, aligned on 8
+                    bytes, in the native byte order
+
+    Only the values are kept, as exif_get_ifd_tag_values returns them: the
+    original IFD layout and byte order are not.
+*/
+
+#define BLOB_ALIGNMENT      8
+
+typedef struct {
+    uint32_t    magic;              // BLOB_MAGIC in native byte order
+    uint32_t    size;               // whole blob size
+    uint32_t    ifds[EXIF_IFD_N];   // IFD offsets, or 0
+} blob_header_t;
+
+typedef struct {
+    uint16_t    tag;
+    uint16_t    type;               // TIFF type, as in the IFD entry
+    uint16_t    item_size;
+    uint16_t    reserved;           // 0
+    uint32_t    count;              // number of items
+    uint32_t    offset;             // values offset from the blob start
+} blob_entry_t;
+
+typedef struct {
+    uint32_t    n_entries;
+    blob_entry_t entries[];
+} blob_ifd_t;
+
+// return the IFD id of the blob at data, after checking that the header and
+// the IFD entries are within len bytes, or NULL if the IFD is not in the blob
+// or the blob is invalid.
+extern const blob_ifd_t *exif_blob_get_ifd( const uint8_t *data, size_t len,
+                                            ifd_id_t id );
+
+// size of each value of a TIFF type in a blob, or 0 if the type is invalid.
+// Byte, ascii and undefined values, including those transformed into a
+// string by the parser, are kept as bytes.
+static inline uint16_t blob_type_item_size( uint16_t type )
+{
+    switch ( type ) {
+    case TIFF_UINT8: case TIFF_STRING: case TIFF_INT8: case TIFF_UNDEFINED:
+        return BYTE_SIZE;
+    case TIFF_UINT16: case TIFF_INT16:
+        return SHORT_SIZE;
+    case TIFF_UINT32: case TIFF_INT32: case TIFF_FLOAT:
+        return LONG_SIZE;
+    case TIFF_URATIONAL: case TIFF_RATIONAL: case TIFF_DOUBLE:
+        return RATIONAL_SIZE;
+    default:
+        return 0;
+    }
+}
+
+// true if the item size of entry is the size of its type, and if its values
+// are aligned and within the blob size bytes. Readers index values by their
+// type, so that a mismatched item size would make them read past the values.
+static inline bool is_blob_entry_valid( const blob_entry_t *entry,
+                                        uint32_t size )
+{
+    return entry->offset <= size && 0 == entry->offset % BLOB_ALIGNMENT &&
+           0 != entry->item_size &&
+           blob_type_item_size( entry->type ) == entry->item_size &&
+           ( size - entry->offset ) / entry->item_size >= entry->count;
+}
+
+// return the entry for tag in IFD id of the blob at data, after checking
+// that the header, the IFD and the entry values are within len bytes, or
+// NULL if the tag is not in the blob or the blob is invalid.
+extern const blob_entry_t *exif_blob_lookup( const uint8_t *data, size_t len,
+                                             ifd_id_t id, uint16_t tag );
+
+#endif /* __BLOB_H__ */
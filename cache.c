@@ -0,0 +1,418 @@
+
+#define _POSIX_C_SOURCE 200809L     // for st_mtim
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "exif.h"
+#include "parse.h"
+
+/*
+    Descriptor cache.
+
+    Entries are keyed by file identity (device, inode, size and modification
+    time), so that a file is parsed again as soon as it changes, whatever the
+    path used to reach it. On a hit, the file is only stat'ed.
+
+    Each entry keeps the serialized metadata of the file (exif_serialize) and
+    a view on them (exif_view_from_blob), which can be used by several threads
+    at the same time without locking. Its vectors are all created before the
+    entry is shared, so that the entry footprint, the size of the entry with
+    its blob and the heap size of the view, includes them. Files without
+    metadata are cached as entries without blob nor descriptor, so that they
+    are not parsed again.
+
+    Entries are distributed in CACHE_SHARDS shards according to their key
+    hash, each shard with its own lock, hash table, LRU list and a share of
+    the capacity. The least recently used entries of a shard are evicted when
+    its share is exceeded. An evicted entry is freed when the last descriptor
+    obtained from it is released.
+*/
+
+#define CACHE_SHARDS        16      // power of 2
+#define MIN_CACHE_BUCKETS   64      // power of 2, per shard
+
+typedef struct {
+    uint64_t            dev, ino, size;
+    int64_t             mtime_ns;
+} cache_key_t;
+
+typedef struct _cache_entry {
+    struct _cache_entry *hash_next;     // in shard bucket
+    struct _cache_entry *prev, *next;   // in shard LRU list, most recent first
+    cache_key_t         key;
+    uint64_t            hash;
+    size_t              refs;           // descriptors not released yet
+    bool                cached;         // false once evicted
+    size_t              bytes;          // footprint
+    exif_desc_t         *desc;          // view on blob
+    uint64_t            blob[];         // serialized metadata, 8-byte aligned
+} cache_entry_t;
+
+typedef struct {
+    pthread_mutex_t     lock;
+    cache_entry_t       **buckets;
+    size_t              n_buckets;
+    cache_entry_t       *head, *tail;   // LRU list
+    size_t              bytes, capacity;
+    exif_cache_stats_t  stats;
+} cache_shard_t;
+
+struct _exif_cache {
+    cache_shard_t       shards[CACHE_SHARDS];
+};
+
+extern exif_cache_t *exif_cache_open( size_t capacity_bytes )
+{
+    exif_cache_t *cache = calloc( 1, sizeof(exif_cache_t) );
+    if ( NULL == cache ) {
+        return NULL;
+    }
+    for ( size_t i = 0; i < CACHE_SHARDS; ++i ) {
+        cache_shard_t *shard = &cache->shards[i];
+        shard->buckets = calloc( MIN_CACHE_BUCKETS, sizeof(cache_entry_t *) );
+        if ( NULL == shard->buckets ) {
+            while ( i-- > 0 ) {
+                pthread_mutex_destroy( &cache->shards[i].lock );
+                free( cache->shards[i].buckets );
+            }
+            free( cache );
+            return NULL;
+        }
+        shard->n_buckets = MIN_CACHE_BUCKETS;
+        shard->capacity = capacity_bytes / CACHE_SHARDS;
+        pthread_mutex_init( &shard->lock, NULL );
+    }
+    return cache;
+}
+
+static void free_entry( cache_entry_t *entry )
+{
+    exif_free( entry->desc );
+    free( entry );
+}
+
+extern void exif_cache_close( exif_cache_t *cache )
+{
+    if ( NULL == cache ) {
+        return;
+    }
+    for ( size_t i = 0; i < CACHE_SHARDS; ++i ) {
+        cache_shard_t *shard = &cache->shards[i];
+        cache_entry_t *entry = shard->head;
+        while ( NULL != entry ) {
+            cache_entry_t *next = entry->next;
+            free_entry( entry );
+            entry = next;
+        }
+        pthread_mutex_destroy( &shard->lock );
+        free( shard->buckets );
+    }
+    free( cache );
+}
+
+static uint64_t hash_key( const cache_key_t *key )
+{
+    uint64_t h = key->ino * 0x9e3779b97f4a7c15u;
+    h ^= key->dev + ( h << 6 ) + ( h >> 2 );
+    h ^= (uint64_t)key->mtime_ns * 0xbf58476d1ce4e5b9u;
+    h ^= key->size * 0x94d049bb133111ebu;
+    return h ^ ( h >> 31 );
+}
+
+static bool same_key( const cache_key_t *a, const cache_key_t *b )
+{
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+           a->mtime_ns == b->mtime_ns;
+}
+
+static inline cache_shard_t *get_shard( exif_cache_t *cache, uint64_t hash )
+{
+    return &cache->shards[ hash & ( CACHE_SHARDS - 1 ) ];
+}
+
+// the low hash bits select the shard, the next ones the bucket
+static inline cache_entry_t **get_bucket( cache_shard_t *shard, uint64_t hash )
+{
+    return &shard->buckets[ ( hash / CACHE_SHARDS ) & ( shard->n_buckets - 1 ) ];
+}
+
+static cache_entry_t *find_entry( cache_shard_t *shard,
+                                  const cache_key_t *key, uint64_t hash )
+{
+    for ( cache_entry_t *entry = *get_bucket( shard, hash ); NULL != entry;
+                                                entry = entry->hash_next ) {
+        if ( entry->hash == hash && same_key( &entry->key, key ) ) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void unlink_lru( cache_shard_t *shard, cache_entry_t *entry )
+{
+    if ( NULL != entry->prev ) {
+        entry->prev->next = entry->next;
+    } else {
+        shard->head = entry->next;
+    }
+    if ( NULL != entry->next ) {
+        entry->next->prev = entry->prev;
+    } else {
+        shard->tail = entry->prev;
+    }
+}
+
+static void push_lru( cache_shard_t *shard, cache_entry_t *entry )
+{
+    entry->prev = NULL;
+    entry->next = shard->head;
+    if ( NULL != shard->head ) {
+        shard->head->prev = entry;
+    } else {
+        shard->tail = entry;
+    }
+    shard->head = entry;
+}
+
+// double the number of buckets when there are more entries than buckets.
+// The table is left as is if no memory is available.
+static void grow_buckets( cache_shard_t *shard )
+{
+    size_t n_buckets = 2 * shard->n_buckets;
+    cache_entry_t **buckets = calloc( n_buckets, sizeof(cache_entry_t *) );
+    if ( NULL == buckets ) {
+        return;
+    }
+    cache_entry_t **old = shard->buckets;
+    size_t n_old = shard->n_buckets;
+    shard->buckets = buckets;
+    shard->n_buckets = n_buckets;
+    for ( size_t i = 0; i < n_old; ++i ) {
+        cache_entry_t *entry = old[i];
+        while ( NULL != entry ) {
+            cache_entry_t *next = entry->hash_next;
+            cache_entry_t **bucket = get_bucket( shard, entry->hash );
+            entry->hash_next = *bucket;
+            *bucket = entry;
+            entry = next;
+        }
+    }
+    free( old );
+}
+
+static void remove_entry( cache_shard_t *shard, cache_entry_t *entry )
+{
+    cache_entry_t **link = get_bucket( shard, entry->hash );
+    while ( *link != entry ) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    unlink_lru( shard, entry );
+    shard->bytes -= entry->bytes;
+    --shard->stats.n_entries;
+    entry->cached = false;
+}
+
+// evict the least recently used entries until the shard footprint is within
+// its capacity, and return the list of evicted entries that can be freed.
+static cache_entry_t *evict_entries( cache_shard_t *shard )
+{
+    cache_entry_t *unused = NULL;
+    while ( shard->bytes > shard->capacity && NULL != shard->tail ) {
+        cache_entry_t *entry = shard->tail;
+        remove_entry( shard, entry );
+        ++shard->stats.n_evictions;
+        if ( 0 == entry->refs ) {
+            entry->next = unused;
+            unused = entry;
+        }
+    }
+    return unused;
+}
+
+// read the metadata of the open file f as an entry, not cached yet, with a
+// reference for the caller. A file without metadata gives an entry without
+// descriptor, or NULL if no memory is available.
+static cache_entry_t *read_entry( FILE *f, exif_control_t *control )
+{
+    exif_control_t eager = { 0 };
+    if ( NULL != control ) {
+        eager = *control;
+    }
+    eager.lazy_values = false;      // the file is closed after parsing
+
+    exif_desc_t *desc = parse_exif( f, 0, &eager );
+    size_t size = exif_serialize( desc, NULL, 0 );
+    cache_entry_t *entry = malloc( sizeof(cache_entry_t) + size );
+    if ( NULL == entry ) {
+        exif_free( desc );
+        return NULL;
+    }
+    entry->refs = 0;
+    entry->cached = false;
+    entry->bytes = sizeof(cache_entry_t);
+    entry->desc = NULL;
+    if ( 0 != size ) {
+        exif_serialize( desc, (uint8_t *)entry->blob, size );
+        entry->desc = exif_view_from_blob( (uint8_t *)entry->blob, size );
+    }
+    exif_free( desc );
+    if ( NULL == desc ) {
+        return entry;               // file without metadata
+    }
+    if ( NULL == entry->desc ) {
+        free( entry );
+        return NULL;
+    }
+
+    // create all vectors now, so that they are counted in the footprint
+    for ( ifd_id_t id = PRIMARY; id < _IFD_N; ++id ) {
+        ifd_table_t *table = entry->desc->ifds[id];
+        for ( uint16_t i = 0; NULL != table && i < table->n_entries; ++i ) {
+            vector_t *values;
+            if ( ! exif_get_ifd_tag_values( entry->desc, id,
+                                            table->entries[i].tag, &values ) ) {
+                free_entry( entry );
+                return NULL;
+            }
+        }
+    }
+    entry->bytes += size + exif_desc_heap_size( entry->desc );
+    entry->refs = 1;
+    return entry;
+}
+
+static void get_key( const struct stat *st, cache_key_t *key )
+{
+    key->dev = (uint64_t)st->st_dev;
+    key->ino = (uint64_t)st->st_ino;
+    key->size = (uint64_t)st->st_size;
+    key->mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 +
+                    st->st_mtim.tv_nsec;
+}
+
+extern exif_desc_t *exif_cache_read( exif_cache_t *cache, const char *path,
+                                     exif_control_t *control )
+{
+    struct stat st;
+    if ( NULL == cache || NULL == path || -1 == stat( path, &st ) ) {
+        return NULL;
+    }
+    cache_key_t key;
+    get_key( &st, &key );
+    uint64_t hash = hash_key( &key );
+    cache_shard_t *shard = get_shard( cache, hash );
+
+    pthread_mutex_lock( &shard->lock );
+    cache_entry_t *entry = find_entry( shard, &key, hash );
+    if ( NULL != entry ) {
+        if ( NULL != entry->desc ) {
+            ++entry->refs;
+        }
+        unlink_lru( shard, entry );
+        push_lru( shard, entry );
+        ++shard->stats.n_hits;
+        pthread_mutex_unlock( &shard->lock );
+        return entry->desc;
+    }
+    ++shard->stats.n_misses;
+    pthread_mutex_unlock( &shard->lock );
+
+    // the file is parsed without lock. Its identity is taken again from the
+    // open file, so that the entry key matches the data actually read.
+    FILE *f = fopen( path, "rb" );
+    if ( NULL == f ) {
+        return NULL;
+    }
+    if ( -1 == fstat( fileno( f ), &st ) ) {
+        fclose( f );
+        return NULL;
+    }
+    get_key( &st, &key );
+    hash = hash_key( &key );
+    shard = get_shard( cache, hash );
+    entry = read_entry( f, control );
+    fclose( f );
+    if ( NULL == entry ) {
+        return NULL;
+    }
+    entry->key = key;
+    entry->hash = hash;
+
+    pthread_mutex_lock( &shard->lock );
+    cache_entry_t *found = find_entry( shard, &key, hash );
+    if ( NULL != found ) {          // read at the same time by another thread
+        if ( NULL != found->desc ) {
+            ++found->refs;
+        }
+        pthread_mutex_unlock( &shard->lock );
+        free_entry( entry );
+        return found->desc;
+    }
+    cache_entry_t *unused = NULL;
+    if ( entry->bytes <= shard->capacity ) {   // otherwise, not cached
+        cache_entry_t **bucket = get_bucket( shard, hash );
+        entry->hash_next = *bucket;
+        *bucket = entry;
+        push_lru( shard, entry );
+        entry->cached = true;
+        shard->bytes += entry->bytes;
+        if ( ++shard->stats.n_entries > shard->n_buckets ) {
+            grow_buckets( shard );
+        }
+        unused = evict_entries( shard );
+    } else if ( NULL == entry->desc ) {
+        unused = entry;             // nobody refers to it
+        entry->next = NULL;
+    }
+    exif_desc_t *desc = entry->desc;
+    pthread_mutex_unlock( &shard->lock );
+
+    while ( NULL != unused ) {
+        cache_entry_t *next = unused->next;
+        free_entry( unused );
+        unused = next;
+    }
+    return desc;
+}
+
+extern void exif_cache_release( exif_cache_t *cache, exif_desc_t *desc )
+{
+    if ( NULL == cache || NULL == desc ) {
+        return;
+    }
+    cache_entry_t *entry = (cache_entry_t *)( desc->blob -
+                                              offsetof(cache_entry_t, blob) );
+    cache_shard_t *shard = get_shard( cache, entry->hash );
+    pthread_mutex_lock( &shard->lock );
+    bool unused = ( 0 == --entry->refs && ! entry->cached );
+    pthread_mutex_unlock( &shard->lock );
+    if ( unused ) {
+        free_entry( entry );
+    }
+}
+
+extern void exif_cache_get_stats( exif_cache_t *cache,
+                                  exif_cache_stats_t *stats )
+{
+    if ( NULL == cache || NULL == stats ) {
+        return;
+    }
+    memset( stats, 0, sizeof(exif_cache_stats_t) );
+    for ( size_t i = 0; i < CACHE_SHARDS; ++i ) {
+        cache_shard_t *shard = &cache->shards[i];
+        pthread_mutex_lock( &shard->lock );
+        stats->n_hits += shard->stats.n_hits;
+        stats->n_misses += shard->stats.n_misses;
+        stats->n_evictions += shard->stats.n_evictions;
+        stats->n_entries += shard->stats.n_entries;
+        stats->bytes += shard->bytes;
+        pthread_mutex_unlock( &shard->lock );
+    }
+}
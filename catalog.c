@@ -0,0 +1,479 @@
+
+#define _POSIX_C_SOURCE 200809L     // for mmap, st_mtim
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "exif.h"
+#include "parse.h"
+#include "blob.h"
+
+/*
+    Catalog file layout, in the native byte order:
+
+    header          magic, byte order mark, number of records, file size
+    records         one per file, sorted by path: file identity (device,
+                    inode, size and modification time), path location and
+                    metadata blob location in the catalog file
+    paths           all paths, without terminating 0
+    blobs           serialized metadata (see blob.h), aligned on 8 bytes
+
+    Files without metadata have a record without blob, so that they are not
+    parsed again as long as they do not change. Files that could not be read
+    (e.g. not enough memory or file descriptors) have a failed record without
+    blob, so that they are read again at the next rescan.
+*/
+
+#define CATALOG_MAGIC       "EXIFCAT2"
+#define CATALOG_BYTE_ORDER  0x01020304
+
+typedef struct {
+    char        magic[8];
+    uint32_t    byte_order;         // CATALOG_BYTE_ORDER in native order
+    uint32_t    n_records;
+    uint64_t    size;               // whole file size
+} catalog_header_t;
+
+typedef struct {
+    uint64_t    dev, ino, size;     // file identity
+    int64_t     mtime_ns;
+    uint64_t    path_offset;
+    uint64_t    blob_offset;        // 0 if no metadata
+    uint32_t    path_len;
+    uint32_t    blob_size;
+    uint32_t    state;              // record_state_t
+    uint32_t    reserved;           // 0
+} catalog_record_t;
+
+typedef enum {
+    RECORD_READ = 0,                // with its metadata, if any
+    RECORD_FAILED                   // to read again
+} record_state_t;
+
+struct _exif_catalog {
+    char                    *path;
+    uint8_t                 *map;           // NULL if empty
+    size_t                  map_size;
+    const catalog_record_t  *records;
+    uint32_t                n_records;
+};
+
+// map the catalog file, or leave the catalog empty if the file does not exist
+// or is not a valid catalog.
+static void map_catalog( exif_catalog_t *catalog )
+{
+    catalog->map = NULL;
+    catalog->map_size = 0;
+    catalog->records = NULL;
+    catalog->n_records = 0;
+
+    int fd = open( catalog->path, O_RDONLY );
+    if ( -1 == fd ) {
+        return;
+    }
+    struct stat st;
+    if ( -1 == fstat( fd, &st ) ||
+         (size_t)st.st_size < sizeof(catalog_header_t) ) {
+        close( fd );
+        return;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap( NULL, size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( MAP_FAILED == map ) {
+        return;
+    }
+    const catalog_header_t *header = map;
+    if ( 0 != memcmp( header->magic, CATALOG_MAGIC, sizeof(header->magic) ) ||
+         CATALOG_BYTE_ORDER != header->byte_order || size != header->size ||
+         ( size - sizeof(catalog_header_t) ) / sizeof(catalog_record_t) <
+                                                        header->n_records ) {
+        munmap( map, size );
+        return;
+    }
+    catalog->map = map;
+    catalog->map_size = size;
+    catalog->records = (const catalog_record_t *)( header + 1 );
+    catalog->n_records = header->n_records;
+}
+
+static void unmap_catalog( exif_catalog_t *catalog )
+{
+    if ( NULL != catalog->map ) {
+        munmap( catalog->map, catalog->map_size );
+        catalog->map = NULL;
+    }
+}
+
+extern exif_catalog_t *exif_catalog_open( const char *path )
+{
+    if ( NULL == path ) {
+        return NULL;
+    }
+    exif_catalog_t *catalog = malloc( sizeof(exif_catalog_t) );
+    if ( NULL == catalog ) {
+        return NULL;
+    }
+    catalog->path = malloc( strlen( path ) + 1 );
+    if ( NULL == catalog->path ) {
+        free( catalog );
+        return NULL;
+    }
+    strcpy( catalog->path, path );
+    map_catalog( catalog );
+    return catalog;
+}
+
+extern void exif_catalog_close( exif_catalog_t *catalog )
+{
+    if ( NULL != catalog ) {
+        unmap_catalog( catalog );
+        free( catalog->path );
+        free( catalog );
+    }
+}
+
+extern size_t exif_catalog_get_count( exif_catalog_t *catalog )
+{
+    return ( NULL == catalog ) ? 0 : catalog->n_records;
+}
+
+static int compare_paths( const char *a, size_t a_len,
+                          const char *b, size_t b_len )
+{
+    int res = memcmp( a, b, ( a_len < b_len ) ? a_len : b_len );
+    if ( 0 != res ) {
+        return res;
+    }
+    return ( a_len > b_len ) - ( a_len < b_len );
+}
+
+// return the path of a record, or NULL if it is not within the catalog.
+static const char *get_record_path( exif_catalog_t *catalog,
+                                    const catalog_record_t *record )
+{
+    if ( record->path_offset > catalog->map_size ||
+         record->path_len > catalog->map_size - record->path_offset ) {
+        return NULL;
+    }
+    return (const char *)catalog->map + record->path_offset;
+}
+
+// true if the record blob, if any, is within the catalog.
+static bool has_valid_blob( exif_catalog_t *catalog,
+                            const catalog_record_t *record )
+{
+    if ( 0 == record->blob_size ) {
+        return true;
+    }
+    return 0 != record->blob_offset &&
+           0 == record->blob_offset % BLOB_ALIGNMENT &&
+           record->blob_offset <= catalog->map_size &&
+           record->blob_size <= catalog->map_size - record->blob_offset;
+}
+
+static const catalog_record_t *find_record( exif_catalog_t *catalog,
+                                            const char *path, size_t len )
+{
+    uint32_t low = 0, high = catalog->n_records;
+    while ( low < high ) {                  // binary search in [low, high[
+        uint32_t mid = ( low + high ) / 2;
+        const catalog_record_t *record = &catalog->records[mid];
+        const char *mid_path = get_record_path( catalog, record );
+        if ( NULL == mid_path ) {
+            return NULL;                    // invalid catalog
+        }
+        int res = compare_paths( path, len, mid_path, record->path_len );
+        if ( 0 == res ) {
+            return record;
+        }
+        if ( res > 0 ) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+extern bool exif_catalog_find( exif_catalog_t *catalog, const char *path,
+                               exif_record_t *record )
+{
+    if ( NULL == catalog || NULL == path ) {
+        return false;
+    }
+    const catalog_record_t *found = find_record( catalog, path, strlen( path ) );
+    if ( NULL == found ) {
+        return false;
+    }
+    if ( NULL != record ) {
+        record->blob = NULL;
+        record->blob_size = 0;
+        if ( 0 != found->blob_size && has_valid_blob( catalog, found ) ) {
+            record->blob = catalog->map + found->blob_offset;
+            record->blob_size = found->blob_size;
+        }
+        record->dev = found->dev;
+        record->ino = found->ino;
+        record->size = found->size;
+        record->mtime_ns = found->mtime_ns;
+    }
+    return true;
+}
+
+extern bool exif_record_get_tag_values( const exif_record_t *record,
+                                        ifd_id_t id, uint16_t tag,
+                                        exif_type_t *type,
+                                        const void **values, uint32_t *count )
+{
+    if ( NULL == record ) {
+        return false;
+    }
+    const blob_entry_t *entry = exif_blob_lookup( record->blob,
+                                                  record->blob_size, id, tag );
+    if ( NULL == entry ) {
+        return false;
+    }
+    if ( NULL != type ) {
+        *type = (exif_type_t)entry->type;
+    }
+    if ( NULL != values ) {
+        *values = record->blob + entry->offset;
+    }
+    if ( NULL != count ) {
+        *count = entry->count;
+    }
+    return true;
+}
+
+// Rescan: each path is stat'ed and kept with its previous record if its
+// identity did not change, or parsed again otherwise. Changed files are read
+// by exif_read_many, and their blobs are kept in memory until the new
+// catalog is written.
+typedef struct {
+    const char              *path;
+    size_t                  path_len;
+    catalog_record_t        key;            // identity, then new locations
+    const catalog_record_t  *previous;      // in the current mapping
+    uint8_t                 *blob;          // new blob, if parsed again
+} scan_item_t;
+
+static int compare_items( const void *a, const void *b )
+{
+    const scan_item_t *ia = a, *ib = b;
+    return compare_paths( ia->path, ia->path_len, ib->path, ib->path_len );
+}
+
+static bool same_file( const catalog_record_t *a, const catalog_record_t *b )
+{
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+           a->mtime_ns == b->mtime_ns;
+}
+
+static void keep_blob( void *context, size_t index,
+                       exif_desc_t *desc, int error )
+{
+    scan_item_t **changed = context;
+    scan_item_t *item = changed[index];
+    if ( NULL == desc ) {           // -1 if no metadata, errno if not opened
+        item->key.state = ( -1 == error ) ? RECORD_READ : RECORD_FAILED;
+        return;
+    }
+    size_t size = exif_serialize( desc, NULL, 0 );
+    if ( 0 != size ) {
+        item->blob = malloc( size );
+    }
+    if ( NULL == item->blob ) {
+        item->key.state = RECORD_FAILED;
+    } else {
+        exif_serialize( desc, item->blob, size );
+        item->key.blob_size = (uint32_t)size;
+    }
+    exif_free( desc );
+}
+
+static bool write_padding( FILE *f, size_t n )
+{
+    static const uint8_t zeros[BLOB_ALIGNMENT] = { 0 };
+    return n == fwrite( zeros, 1, n, f );
+}
+
+// write the new catalog for the items, with the blobs of unchanged items
+// taken from the current mapping, in a temporary file synced to disk, then
+// renamed as the catalog.
+static bool write_catalog( exif_catalog_t *catalog,
+                           scan_item_t *items, size_t n )
+{
+    uint64_t pos = sizeof(catalog_header_t) + n * sizeof(catalog_record_t);
+    for ( size_t i = 0; i < n; ++i ) {
+        items[i].key.path_offset = pos;
+        items[i].key.path_len = (uint32_t)items[i].path_len;
+        pos += items[i].path_len;
+    }
+    uint64_t paths_end = pos;
+    pos = ( pos + BLOB_ALIGNMENT - 1 ) & ~(uint64_t)( BLOB_ALIGNMENT - 1 );
+    uint64_t blobs_start = pos;
+    for ( size_t i = 0; i < n; ++i ) {
+        size_t size = items[i].key.blob_size;
+        items[i].key.blob_offset = ( 0 == size ) ? 0 : pos;
+        pos += ( size + BLOB_ALIGNMENT - 1 ) & ~(size_t)( BLOB_ALIGNMENT - 1 );
+    }
+
+    size_t len = strlen( catalog->path );
+    char *tmp_path = malloc( len + 5 );
+    if ( NULL == tmp_path ) {
+        return false;
+    }
+    sprintf( tmp_path, "%s.tmp", catalog->path );
+    FILE *f = fopen( tmp_path, "wb" );
+    if ( NULL == f ) {
+        free( tmp_path );
+        return false;
+    }
+
+    catalog_header_t header;
+    memcpy( header.magic, CATALOG_MAGIC, sizeof(header.magic) );
+    header.byte_order = CATALOG_BYTE_ORDER;
+    header.n_records = (uint32_t)n;
+    header.size = pos;
+    bool ok = 1 == fwrite( &header, sizeof(header), 1, f );
+    for ( size_t i = 0; ok && i < n; ++i ) {
+        ok = 1 == fwrite( &items[i].key, sizeof(catalog_record_t), 1, f );
+    }
+    for ( size_t i = 0; ok && i < n; ++i ) {
+        ok = items[i].path_len == fwrite( items[i].path, 1,
+                                          items[i].path_len, f );
+    }
+    ok = ok && write_padding( f, blobs_start - paths_end );
+    for ( size_t i = 0; ok && i < n; ++i ) {
+        size_t size = items[i].key.blob_size;
+        if ( 0 == size ) {
+            continue;
+        }
+        const uint8_t *blob = items[i].blob;
+        if ( NULL == blob ) {           // unchanged
+            blob = catalog->map + items[i].previous->blob_offset;
+        }
+        ok = size == fwrite( blob, 1, size, f ) &&
+             write_padding( f, ( BLOB_ALIGNMENT - size % BLOB_ALIGNMENT ) %
+                                                            BLOB_ALIGNMENT );
+    }
+    // the data must reach the disk before the rename, otherwise a crash may
+    // leave an empty or partial catalog in place of the previous one
+    ok = ok && 0 == fflush( f ) && 0 == fsync( fileno( f ) );
+    ok = ( 0 == fclose( f ) ) && ok;
+    if ( ok ) {
+        ok = 0 == rename( tmp_path, catalog->path );
+    }
+    if ( ! ok ) {
+        remove( tmp_path );
+    }
+    free( tmp_path );
+    return ok;
+}
+
+extern bool exif_catalog_rescan( exif_catalog_t *catalog,
+                                 char **paths, size_t n,
+                                 exif_control_t *control,
+                                 exif_rescan_stats_t *stats )
+{
+    if ( NULL == catalog || ( NULL == paths && 0 != n ) ) {
+        return false;
+    }
+    scan_item_t *items = calloc( n + 1, sizeof(scan_item_t) );
+    scan_item_t **changed = calloc( n + 1, sizeof(scan_item_t *) );
+    if ( NULL == items || NULL == changed ) {
+        free( items );
+        free( changed );
+        return false;
+    }
+
+    exif_rescan_stats_t res = { 0 };
+    size_t n_items = 0, n_changed = 0, n_previous = 0;
+    for ( size_t i = 0; i < n; ++i ) {
+        struct stat st;
+        if ( NULL == paths[i] || -1 == stat( paths[i], &st ) ) {
+            ++res.n_missing;
+            continue;
+        }
+        scan_item_t *item = &items[n_items++];
+        item->path = paths[i];
+        item->path_len = strlen( paths[i] );
+        item->key.dev = (uint64_t)st.st_dev;
+        item->key.ino = (uint64_t)st.st_ino;
+        item->key.size = (uint64_t)st.st_size;
+        item->key.mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 +
+                             st.st_mtim.tv_nsec;
+    }
+    qsort( items, n_items, sizeof(scan_item_t), compare_items );
+
+    size_t n_unique = 0;
+    for ( size_t i = 0; i < n_items; ++i ) {
+        if ( n_unique > 0 && 0 == compare_items( &items[n_unique-1], &items[i] ) ) {
+            continue;                       // duplicate path
+        }
+        scan_item_t *item = &items[n_unique++];
+        *item = items[i];
+        item->previous = find_record( catalog, item->path, item->path_len );
+        if ( NULL != item->previous ) {
+            ++n_previous;
+        }
+        if ( NULL != item->previous && same_file( item->previous, &item->key ) &&
+             RECORD_READ == item->previous->state &&
+             has_valid_blob( catalog, item->previous ) ) {
+            item->key.blob_size = item->previous->blob_size;
+            ++res.n_unchanged;
+        } else {
+            changed[n_changed++] = item;
+        }
+    }
+
+    bool ok = true;
+    if ( n_changed > 0 ) {
+        // changed files are parsed as paths: the item pointers are the context
+        char **changed_paths = malloc( n_changed * sizeof(char *) );
+        exif_control_t eager = { 0 };
+        if ( NULL != control ) {
+            eager = *control;
+        }
+        eager.lazy_values = false;      // all values are serialized
+        ok = NULL != changed_paths;
+        for ( size_t i = 0; ok && i < n_changed; ++i ) {
+            changed_paths[i] = (char *)changed[i]->path;
+        }
+        ok = ok && exif_read_many( changed_paths, n_changed, &eager,
+                                   keep_blob, changed, 0, false );
+        free( changed_paths );
+        for ( size_t i = 0; i < n_changed; ++i ) {
+            if ( NULL != changed[i]->blob ) {
+                ++res.n_parsed;
+            } else if ( RECORD_FAILED == changed[i]->key.state ) {
+                ++res.n_errors;
+            } else {
+                ++res.n_failed;
+            }
+        }
+    }
+    res.n_removed = catalog->n_records - n_previous;
+
+    ok = ok && write_catalog( catalog, items, n_unique );
+    if ( ok ) {                         // map the new catalog
+        unmap_catalog( catalog );
+        map_catalog( catalog );
+    }
+    for ( size_t i = 0; i < n_unique; ++i ) {
+        free( items[i].blob );
+    }
+    free( items );
+    free( changed );
+    if ( NULL != stats ) {
+        *stats = res;
+    }
+    return ok;
+}
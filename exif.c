@@ -1,129 +1,186 @@
 
+#define _POSIX_C_SOURCE 200112L     // for mmap, posix_madvise
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <stdint.h>
 #include <stdbool.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "exif.h"
 #include "parse.h"
 #include "print.h"
-#include "_slice.h"
+#include "scan.h"
+#include "blob.h"
+#include "schema.h"
+
+// The descriptor is allocated with the first block of its arena, which is
+// large enough for the values found in most files. DESC_SIZE keeps the arena
+// block aligned.
+#define DESC_SIZE           ((sizeof(exif_desc_t) + ARENA_ALIGNMENT - 1) & \
+                                                    ~(size_t)(ARENA_ALIGNMENT - 1))
+#define DESC_ARENA_SIZE     8192
 
 static exif_desc_t *new_exif_desc( void )
 {
-    exif_desc_t *desc = malloc( sizeof(exif_desc_t) );
+    exif_desc_t *desc = malloc( DESC_SIZE + DESC_ARENA_SIZE );
     if ( NULL != desc ) {
         memset( desc, 0, sizeof(exif_desc_t) );
+        desc->fd = -1;
+        arena_init( &desc->arena, (uint8_t *)desc + DESC_SIZE, DESC_ARENA_SIZE );
     }
     return desc;
 }
 
-// read a uint16_t according to endianess
-extern uint16_t tiff_get_uint16( exif_desc_t *d )
+#ifndef EXIF_NO_STATS
+extern uint64_t stats_clock_ns( void )
 {
-    uint8_t data[2];
-    fread( data, 1, 2, d->file );
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
 
-    uint16_t val;
-    if ( d->big_endian ) {
-        val = data[0] << 8;
-        val |= data[1];
+// read n bytes at the current position, either from the file or from the
+// in-memory data. In memory, reads are bounds-checked: if fewer than n bytes
+// are left, the destination is zero-filled and the position is not updated,
+// but the size that would have been needed is recorded.
+static void tiff_read( exif_desc_t *d, uint8_t *dst, size_t n )
+{
+    if ( 0 == n ) {
+        return;
+    }
+    STATS_ADD( d, n_reads, 1 );
+    STATS_ADD( d, bytes_read, n );
+    if ( NULL != d->data ) {
+        if ( d->pos > d->size || n > d->size - d->pos ) {
+            if ( (size_t)d->pos + n > d->needed ) {
+                d->needed = (size_t)d->pos + n;
+            }
+            memset( dst, 0, n );
+            return;
+        }
+        memcpy( dst, d->data + d->pos, n );
+        d->pos += n;
     } else {
-        val = data[0];
-        val |= data[1] << 8;
+        size_t got = fread( dst, 1, n, d->file );
+        if ( got < n ) {
+            memset( dst + got, 0, n - got );
+        }
+    }
+}
+
+// return the current position, relative to the TIFF header
+extern uint32_t tiff_get_position( exif_desc_t *d )
+{
+    STATS_ADD( d, n_tells, 1 );
+    if ( NULL != d->data ) {
+        return d->pos;
+    }
+    return (uint32_t)(ftell( d->file ) - d->header);
+}
+
+// set the current position, given as an offset relative to the TIFF header
+extern void tiff_set_position( exif_desc_t *d, uint32_t offset )
+{
+    STATS_ADD( d, n_seeks, 1 );
+    if ( NULL != d->data ) {
+        d->pos = offset;        // checked at the next read
+    } else {
+        fseek( d->file, d->header + offset, SEEK_SET );
+    }
+}
+
+// return false if n bytes at offset cannot be read from the in-memory data,
+// after recording the size that would have been needed, as a failed read
+// does. Reads from a file are not checked, and true is always returned.
+extern bool tiff_has_data( exif_desc_t *d, uint32_t offset, uint64_t n )
+{
+    if ( NULL == d->data ) {
+        return true;
     }
-    return val;
+    if ( offset > d->size || n > d->size - offset ) {
+        uint64_t end = (uint64_t)offset + n;
+        if ( end > d->needed ) {
+            d->needed = ( end > SIZE_MAX ) ? SIZE_MAX : (size_t)end;
+        }
+        return false;
+    }
+    return true;
+}
+
+extern uint8_t tiff_get_uint8( exif_desc_t *d )
+{
+    uint8_t byte;
+    tiff_read( d, &byte, 1 );
+    return byte;
+}
+
+// read n bytes as is, without considering endianess
+extern void tiff_get_bytes( exif_desc_t *d, uint8_t *dst, size_t n )
+{
+    tiff_read( d, dst, n );
+}
+
+// read a uint16_t according to endianess
+extern uint16_t tiff_get_uint16( exif_desc_t *d )
+{
+    uint8_t data[2];
+    tiff_read( d, data, 2 );
+    return tiff_load_uint16( d->big_endian, data );
 }
 
 // read a uint32_t according to endianess
 extern uint32_t tiff_get_uint32( exif_desc_t *d )
 {
     uint8_t data[4];
-    fread( data, 1, 4, d->file );
-
-    uint32_t val;
-    if ( d->big_endian ) {
-        val = data[0] << 24;
-        val |= data[1] << 16;
-        val |= data[2] << 8;
-        val |= data[3];
-    } else {
-        val = data[0];
-        val |= data[1] << 8;
-        val |= data[2] << 16;
-        val |= data[3] << 24;
-    }
-    return val;
+    tiff_read( d, data, 4 );
+    return tiff_load_uint32( d->big_endian, data );
 }
 
 // raw read 4 bytes without considering endianess
 extern uint32_t tiff_get_raw_uint32( exif_desc_t *d )
 {
     uint8_t data[4];
-    fread( data, 1, 4, d->file );
+    tiff_read( d, data, 4 );
     return *(uint32_t *)data;
 }
 
 extern uint32_t tiff_endianize_uint32( exif_desc_t *d, uint32_t raw )
 {
-    uint8_t data[4];
-    *(uint32_t *)data = raw;
-
-    uint32_t val;
-    if ( d->big_endian ) {
-        val = data[0] << 24;
-        val |= data[1] << 16;
-        val |= data[2] << 8;
-        val |= data[3];
-    } else {
-        val = data[0];
-        val |= data[1] << 8;
-        val |= data[2] << 16;
-        val |= data[3] << 24;
-    }
-    return val;
+    return tiff_load_uint32( d->big_endian, (const uint8_t *)&raw );
 }
 
 extern uint16_t tiff_endianize_uint16( exif_desc_t *d, uint16_t raw )
 {
-    uint8_t data[2];
-    *(uint16_t *)data = raw;
-
-    uint16_t val;
-    if ( d->big_endian ) {
-        val = data[0] << 8;
-        val |= data[1];
-    } else {
-        val = data[0];
-        val |= data[1] << 8;
-    }
-    return val;
+    return tiff_load_uint16( d->big_endian, (const uint8_t *)&raw );
 }
 
 // consumes the TIFF endianess marker (2 bytes), updates the descriptor
 // big_endian value by side effect and returns true if the endianess is
 // either big endian or little endian, or false otherwise. Any multi-byte
 // value following this point must take in account the TIFF endianess.
-static bool check_tiff_endianess( FILE *f, bool *is_big_endian )
+static bool check_tiff_endianess( exif_desc_t *d )
 {
     // TIFF header starts with 2 bytes indicating the byte ordering ("II" short
     // for Intel or "MM" short for Motorola, indicating little or big endian
     // respectively)
 
-    unsigned char data[4];
-    fread( data, 1, 2, f );
+    unsigned char data[2];
+    tiff_read( d, data, 2 );
     if ( data[0] == 'I' && data[1] == 'I' ) {
-        if ( NULL != is_big_endian ) {
-            *is_big_endian = false;
-        }
+        d->big_endian = false;
         return true;
     }
     if ( data[0] == 'M' && data[1] == 'M' ) {
-        if ( NULL != is_big_endian ) {
-            *is_big_endian = true;
-        }
+        d->big_endian = true;
         return true;
     }
     return false;
@@ -142,62 +199,258 @@ static bool check_tiff_validity( exif_desc_t *d, uint32_t *ifd_offset )
     return true;
 }
 
-//  starting at the tiff header (all offsets are relative to the TIFF header)
-static exif_desc_t *parse_tiff( FILE *f, exif_control_t *control )
+static exif_desc_t *parse_tiff_failed( exif_desc_t *d, size_t *needed )
 {
-
-    exif_desc_t *d = new_exif_desc( );
-    if ( NULL == d ) {
-        return NULL;
+    if ( NULL != needed ) {
+        *needed = d->needed;
     }
-    d->file = f;
-    d->header = ftell( f );  // keep TIFF header location
+    exif_free( d );
+    return NULL;
+}
 
-    if ( ! check_tiff_endianess( f, &(d->big_endian) ) ) {
-        free( d );
-        return NULL;
+//  starting at the tiff header (all offsets are relative to the TIFF header)
+//  If needed is not NULL, it is set to the in-memory data size that would
+//  have been needed to read everything, if larger than the available size.
+static exif_desc_t *parse_tiff( exif_desc_t *d, exif_control_t *control,
+                                size_t *needed )
+{
+    STATS_START( start );
+    if ( ! check_tiff_endianess( d ) ) {
+        return parse_tiff_failed( d, needed );
     }
+    d->decoder = tiff_get_decoder( d->big_endian );
     d->control = *control;
 
     uint32_t ifd_offset;    // offset relative to the  TIF header
     if ( ! check_tiff_validity( d, &ifd_offset ) ) {
-        free( d );
+        return parse_tiff_failed( d, needed );
+    }
+    STATS_STOP( d, header_ns, start );
+    tiff_set_position( d, ifd_offset );
+    ifd_table_t *ifd_table = exif_parse_ifd( d, PRIMARY, &ifd_offset );
+    if ( NULL == ifd_table ) {
+        return parse_tiff_failed( d, needed );
+    }
+    d->ifds[ PRIMARY ] = ifd_table;
+    if ( 0 != ifd_offset && is_ifd_wanted( d, THUMBNAIL ) ) {
+        tiff_set_position( d, ifd_offset );
+        ifd_table_t *ifd_table = exif_parse_ifd( d, THUMBNAIL, NULL );
+        if ( NULL == ifd_table ) {
+            return parse_tiff_failed( d, needed );
+        }
+        d->ifds[ THUMBNAIL ] = ifd_table;
+    }
+    if ( NULL != needed ) {
+        *needed = d->needed;
+    }
+    return d;
+}
+
+static exif_desc_t *new_file_desc( FILE *f )
+{
+    exif_desc_t *desc = new_exif_desc( );
+    if ( NULL != desc ) {
+        desc->file = f;
+        desc->header = ftell( f );  // keep TIFF header location
+    }
+    return desc;
+}
+
+static exif_desc_t *new_buffer_desc( const uint8_t *data, size_t len )
+{
+    exif_desc_t *desc = new_exif_desc( );
+    if ( NULL != desc ) {
+        desc->data = data;          // TIFF header location
+        desc->size = len;
+    }
+    return desc;
+}
+
+extern exif_desc_t *parse_tiff_buffer( const uint8_t *data, size_t len,
+                                       exif_control_t *control, size_t *needed )
+{
+    exif_desc_t *desc = new_buffer_desc( data, len );
+    if ( NULL == desc ) {
+        return NULL;
+    }
+    return parse_tiff( desc, control, needed );
+}
+
+// read the TIFF data of an APP1 segment, at the current file position, at once
+// in a buffer owned by the returned descriptor
+static exif_desc_t *new_segment_desc( FILE *f, uint32_t tiff_size )
+{
+    uint8_t *data = malloc( tiff_size );
+    if ( NULL == data ) {
         return NULL;
     }
-    fseek( f, d->header + ifd_offset, SEEK_SET );
-    map_t *ifd_map = exif_parse_ifd( d, PRIMARY, &ifd_offset );
-    if ( NULL == ifd_map ) {
-        free( d );
+    size_t len = fread( data, 1, tiff_size, f );
+    exif_desc_t *desc = new_buffer_desc( data, len );
+    if ( NULL == desc ) {
+        free( data );
         return NULL;
     }
-    d->ifds[ PRIMARY ] = ifd_map;
-    if ( 0 != ifd_offset ) {
-        fseek( f, d->header + ifd_offset, SEEK_SET );
-        map_t *ifd_map = exif_parse_ifd( d, THUMBNAIL, NULL );
-        if ( NULL == ifd_map ) {
-            free( d );
-            return NULL;
+    desc->own_data = data;
+    STATS_ADD( desc, n_reads, 1 );
+    STATS_ADD( desc, bytes_read, len );
+    return desc;
+}
+
+static const uint8_t exif_header[ORIGIN_OFFSET] = { 'E', 'x', 'i', 'f', 0, 0 };
+
+// walk the JPEG segments from the current file position, which must be at the
+// JPEG SOI marker, until an APP1 segment starting with the Exif header or the
+// SOS marker is found. Only the segment markers and lengths are read, other
+// segments are skipped. If an Exif APP1 segment is found, the file is left at
+// the TIFF header and the size of the TIFF data is returned by side effect.
+static jpeg_walk_t walk_jpeg_file( FILE *f, uint32_t *tiff_size )
+{
+    uint8_t data[ORIGIN_OFFSET];
+    if ( 2 != fread( data, 1, 2, f ) ||
+         JPEG_MARKER != data[0] || JPEG_SOI != data[1] ) {
+        return NOT_A_JPEG;
+    }
+    while ( true ) {
+        int marker = getc( f );
+        if ( JPEG_MARKER != marker ) {
+            return ( EOF == marker ) ? NO_EXIF_SEGMENT : NOT_A_JPEG;
+        }
+        do {                            // skip optional fill bytes
+            marker = getc( f );
+        } while ( JPEG_MARKER == marker );
+
+        if ( EOF == marker || JPEG_SOS == marker || JPEG_EOI == marker ) {
+            return NO_EXIF_SEGMENT;
+        }
+        if ( JPEG_TEM == marker || ( JPEG_RST0 <= marker && JPEG_RST7 >= marker ) ) {
+            continue;                   // no segment length
+        }
+        if ( 2 != fread( data, 1, 2, f ) ) {
+            return NO_EXIF_SEGMENT;
+        }
+        uint32_t length = ( data[0] << 8 ) | data[1];
+        if ( length < 2 ) {
+            return NOT_A_JPEG;
+        }
+        length -= 2;                    // length includes its own 2 bytes
+        if ( JPEG_APP1 == marker && length > ORIGIN_OFFSET ) {
+            if ( ORIGIN_OFFSET != fread( data, 1, ORIGIN_OFFSET, f ) ) {
+                return NO_EXIF_SEGMENT;
+            }
+            if ( 0 == memcmp( data, exif_header, ORIGIN_OFFSET ) ) {
+                *tiff_size = length - ORIGIN_OFFSET;
+                return EXIF_SEGMENT;
+            }
+            length -= ORIGIN_OFFSET;    // not Exif, e.g. XMP
+        }
+        if ( 0 != fseek( f, (long)length, SEEK_CUR ) ) {
+            return NO_EXIF_SEGMENT;
         }
-        d->ifds[ THUMBNAIL ] = ifd_map;
     }
-    return d;
 }
 
-// bitap table for Exif
-static unsigned char masks [256];
+extern jpeg_walk_t walk_jpeg_segments( const uint8_t *data, size_t len,
+                                       size_t *pos, uint32_t *tiff_size )
+{
+    size_t i = *pos;
+    while ( true ) {
+        size_t start = i;               // in case data is truncated
+        if ( i >= len ) {
+            *pos = start;
+            return TRUNCATED_JPEG;
+        }
+        if ( JPEG_MARKER != data[i] ) {
+            return NOT_A_JPEG;
+        }
+        while ( i < len && JPEG_MARKER == data[i] ) {
+            ++i;                        // skip marker and fill bytes
+        }
+        if ( len - i < 3 ) {            // marker and length
+            *pos = start;
+            return TRUNCATED_JPEG;
+        }
+        uint8_t marker = data[i++];
+        if ( JPEG_SOS == marker || JPEG_EOI == marker ) {
+            return NO_EXIF_SEGMENT;
+        }
+        if ( JPEG_TEM == marker || ( JPEG_RST0 <= marker && JPEG_RST7 >= marker ) ) {
+            continue;                   // no segment length
+        }
+        uint32_t length = ( data[i] << 8 ) | data[i+1];
+        if ( length < 2 ) {
+            return NOT_A_JPEG;
+        }
+        i += 2;
+        length -= 2;                    // length includes its own 2 bytes
+        if ( JPEG_APP1 == marker && length > ORIGIN_OFFSET ) {
+            if ( len - i <= ORIGIN_OFFSET ) {
+                *pos = start;
+                return TRUNCATED_JPEG;
+            }
+            if ( 0 == memcmp( data + i, exif_header, ORIGIN_OFFSET ) ) {
+                *pos = i + ORIGIN_OFFSET;
+                *tiff_size = length - ORIGIN_OFFSET;
+                return EXIF_SEGMENT;
+            }
+        }
+        if ( len - i < length ) {
+            *pos = i + length;          // skip segment, even beyond data
+            return TRUNCATED_JPEG;
+        }
+        i += length;
+    }
+}
 
-static void init_exif_bitap( void ) {
-    for ( int i = 0; i < 256; ++i ) {
-        masks[i] = 0xff;
+// same as walk_jpeg_file, from the position *pos in memory. If an Exif APP1
+// segment is found *pos is updated to the TIFF header position.
+static jpeg_walk_t walk_jpeg_buffer( const uint8_t *data, size_t len,
+                                     size_t *pos, uint32_t *tiff_size )
+{
+    size_t i = *pos;
+    if ( len - i < 2 || JPEG_MARKER != data[i] || JPEG_SOI != data[i+1] ) {
+        return NOT_A_JPEG;
+    }
+    *pos = i + 2;
+    jpeg_walk_t res = walk_jpeg_segments( data, len, pos, tiff_size );
+    if ( TRUNCATED_JPEG == res ) {
+        return NO_EXIF_SEGMENT;         // no more data
     }
+    return res;
+}
+
+#define SCAN_CHUNK_SIZE    (32 * 1024)
+
+// scan the file from the current position, chunk by chunk, for the exif
+// header and return the location of the following TIFF header or -1 if no
+// exif header was found. Consecutive chunks overlap by the header size minus
+// one, so that a header straddling two chunks is not missed. The number of
+// bytes scanned is returned in *scanned.
+static long scan_file_exif_header( FILE *f, long pos, size_t *scanned )
+{
+    uint8_t chunk[SCAN_CHUNK_SIZE];
+    size_t kept = 0;
 
-    masks['E'] = 0xfe;  // E position at bit 0 in pattern,
-    masks['x'] = 0xfd;  // x position at bit 1,
-    masks['i'] = 0xfb;  // i position at bit 2,
-    masks['f'] = 0xf7;  // f position at bit 3,
-    masks[ 0 ] = 0xcf;  // \0 at 2 positions, bits 4 and 5.
+    *scanned = 0;
+    while ( true ) {
+        size_t n = fread( chunk + kept, 1, SCAN_CHUNK_SIZE - kept, f );
+        if ( 0 == n ) {
+            return -1;
+        }
+        *scanned += n;
+        n += kept;
+        size_t i = scan_exif_header( chunk, n );
+        if ( i < n ) {
+            return pos + (long)(i + ORIGIN_OFFSET);
+        }
+        kept = ( n < ORIGIN_OFFSET - 1 ) ? n : ORIGIN_OFFSET - 1;
+        memmove( chunk, chunk + n - kept, kept );
+        pos += (long)(n - kept);
+    }
 }
 
+// If the file is a JPEG file, parse_exif walks the JPEG segments to find the
+// APP1 Exif segment and stops at the image data (SOS). Otherwise, it falls
+// back to a scan for the exif header over the whole file.
 extern exif_desc_t *parse_exif( FILE *f, uint32_t start,
                                 exif_control_t *control )
 {
@@ -205,34 +458,115 @@ extern exif_desc_t *parse_exif( FILE *f, uint32_t start,
 
     fseek( f, (long)start, SEEK_SET );
 
-    init_exif_bitap( );
-    unsigned char bit_mask = 0xfe;
-
+    exif_control_t default_control = { 0 };
     if ( NULL == control ) {
-        exif_control_t default_control = { 0 };
         control = &default_control;
     }
-    while ( true ) {
 
-        int byte = getc( f );
-        if ( EOF == byte ) {
-            break;
+    STATS_START( scan_start );
+    uint32_t tiff_size;
+    switch ( walk_jpeg_file( f, &tiff_size ) ) {
+    case EXIF_SEGMENT:
+        {
+            exif_desc_t *desc = new_segment_desc( f, tiff_size );
+            if ( NULL == desc ) {
+                return NULL;
+            }
+            STATS_STOP( desc, scan_ns, scan_start );
+            return parse_tiff( desc, control, NULL );
         }
+    case NO_EXIF_SEGMENT:
+    case TRUNCATED_JPEG:
+        if ( control->warnings ) {
+            printf( "Did not find EXIF header\n" );
+        }
+        return NULL;
+    case NOT_A_JPEG:
+        break;
+    }
 
-        bit_mask |= masks[byte];
-        bit_mask <<= 1;
-        if ( 0 == ( bit_mask & 64 ) ) {
-            return parse_tiff( f, control );
+    fseek( f, (long)start, SEEK_SET );
+    size_t scanned;
+    long header = scan_file_exif_header( f, start, &scanned );
+    if ( -1 != header ) {
+        fseek( f, header, SEEK_SET );
+        exif_desc_t *desc = new_file_desc( f );
+        if ( NULL == desc ) {
+            return NULL;
         }
+        STATS_STOP( desc, scan_ns, scan_start );
+        STATS_ADD( desc, bytes_scanned, scanned );
+        return parse_tiff( desc, control, NULL );
     }
     if ( control->warnings ) {
         printf( "Did not find EXIF header\n" );
     }
-    exif_desc_t *desc = NULL;
     fseek( f, (long)start, SEEK_SET );
-    if ( check_tiff_endianess( f, NULL ) ) {
-        fseek( f, -2, SEEK_CUR );
-        desc = parse_tiff( f, control );
+    exif_desc_t *desc = new_file_desc( f );
+    if ( NULL != desc ) {
+        STATS_STOP( desc, scan_ns, scan_start );
+        STATS_ADD( desc, bytes_scanned, scanned );
+        desc = parse_tiff( desc, control, NULL );
+    }
+    if ( NULL == desc && control->warnings ) {
+        printf( "Did not find TIFF header\n" );
+    }
+    return desc;
+}
+
+extern exif_desc_t *parse_exif_buffer( const uint8_t *data, size_t len,
+                                       uint32_t start,
+                                       exif_control_t *control )
+{
+    if ( NULL == data || start > len ) return NULL;
+
+    exif_control_t default_control = { 0 };
+    if ( NULL == control ) {
+        control = &default_control;
+    }
+
+    STATS_START( scan_start );
+    size_t pos = start;
+    uint32_t tiff_size;
+    switch ( walk_jpeg_buffer( data, len, &pos, &tiff_size ) ) {
+    case EXIF_SEGMENT:
+        {
+            exif_desc_t *desc = new_buffer_desc( data + pos, len - pos );
+            if ( NULL == desc ) {
+                return NULL;
+            }
+            STATS_STOP( desc, scan_ns, scan_start );
+            return parse_tiff( desc, control, NULL );
+        }
+    case NO_EXIF_SEGMENT:
+    case TRUNCATED_JPEG:
+        if ( control->warnings ) {
+            printf( "Did not find EXIF header\n" );
+        }
+        return NULL;
+    case NOT_A_JPEG:
+        break;
+    }
+
+    size_t i = start + scan_exif_header( data + start, len - start );
+    if ( i < len ) {
+        exif_desc_t *desc = new_buffer_desc( data + i + ORIGIN_OFFSET,
+                                             len - i - ORIGIN_OFFSET );
+        if ( NULL == desc ) {
+            return NULL;
+        }
+        STATS_STOP( desc, scan_ns, scan_start );
+        STATS_ADD( desc, bytes_scanned, i - start );
+        return parse_tiff( desc, control, NULL );
+    }
+    if ( control->warnings ) {
+        printf( "Did not find EXIF header\n" );
+    }
+    exif_desc_t *desc = new_buffer_desc( data + start, len - start );
+    if ( NULL != desc ) {
+        STATS_STOP( desc, scan_ns, scan_start );
+        STATS_ADD( desc, bytes_scanned, len - start );
+        desc = parse_tiff( desc, control, NULL );
     }
     if ( NULL == desc && control->warnings ) {
         printf( "Did not find TIFF header\n" );
@@ -240,6 +574,87 @@ extern exif_desc_t *parse_exif( FILE *f, uint32_t start,
     return desc;
 }
 
+// make the IFD table id of a view from the blob IFD, after checking that all
+// entries are valid and sorted by increasing tag. Entries are not copied: the
+// values refer to the items in the blob.
+static ifd_table_t *new_view_table( exif_desc_t *desc, const blob_ifd_t *ifd,
+                                    uint32_t size )
+{
+    uint32_t n = ifd->n_entries;
+    if ( n > UINT16_MAX ) {
+        return NULL;
+    }
+    ifd_table_t *table = arena_alloc( &desc->arena, sizeof(ifd_table_t) +
+                                                    n * sizeof(ifd_entry_t) );
+    ifd_values_t *values = arena_alloc( &desc->arena,
+                                        n * sizeof(ifd_values_t) );
+    if ( NULL == table || ( NULL == values && 0 != n ) ) {
+        return NULL;
+    }
+    table->n_entries = (uint16_t)n;
+    for ( uint32_t i = 0; i < n; ++i ) {
+        const blob_entry_t *be = &ifd->entries[i];
+        if ( ! is_blob_entry_valid( be, size ) ||
+             ( 0 != i && be->tag <= ifd->entries[i-1].tag ) ) {
+            return NULL;
+        }
+        values[i].next = NULL;
+        values[i].vector = NULL;
+        values[i].data = desc->blob + be->offset;
+        values[i].count = be->count;
+        values[i].item_size = be->item_size;
+        values[i].type = be->type;
+
+        ifd_entry_t *entry = &table->entries[i];
+        entry->tag = be->tag;
+        entry->type = be->type;
+        entry->count = be->count;
+        entry->valoff = 0;
+        entry->deferred = false;
+        entry->values = &values[i];
+    }
+    return table;
+}
+
+extern exif_desc_t *exif_view_from_blob( const uint8_t *blob, size_t len )
+{
+    const blob_header_t *header = (const blob_header_t *)blob;
+    if ( NULL == blob || 0 != (uintptr_t)blob % BLOB_ALIGNMENT ||
+         NULL == exif_blob_get_ifd( blob, len, PRIMARY ) ) {
+        return NULL;                // invalid blob, or without PRIMARY IFD
+    }
+    exif_desc_t *desc = new_exif_desc( );
+    if ( NULL == desc ) {
+        return NULL;
+    }
+    desc->blob = blob;
+    for ( ifd_id_t id = PRIMARY; id < _IFD_N; ++id ) {
+        if ( 0 == header->ifds[id] ) {
+            continue;
+        }
+        const blob_ifd_t *ifd = exif_blob_get_ifd( blob, len, id );
+        if ( NULL == ifd ||
+             NULL == ( desc->ifds[id] = new_view_table( desc, ifd,
+                                                        header->size ) ) ) {
+            exif_free( desc );
+            return NULL;
+        }
+    }
+    return desc;
+}
+
+extern void exif_keep_or_close_file( exif_desc_t *desc, FILE *f )
+{
+    if ( NULL != desc && f == desc->file ) {
+        if ( desc->control.lazy_values ) {
+            desc->own_file = true;  // needed to load values later
+            return;
+        }
+        desc->file = NULL;
+    }
+    fclose( f );
+}
+
 extern exif_desc_t *read_exif( char *path, uint32_t start,
                                exif_control_t *control )
 {
@@ -251,8 +666,66 @@ extern exif_desc_t *read_exif( char *path, uint32_t start,
     }
 
     exif_desc_t *desc = parse_exif( f, start, control );
+    exif_keep_or_close_file( desc, f );
+    return desc;
+}
 
-    fclose( f );
+// The EXIF APP1 segment is at most 64KB and is normally located at the very
+// beginning of the file, just after a possible APP0 segment. Metadata are
+// expected within that window, which can be read ahead, whereas the rest of
+// the file is accessed only through random offsets, if at all.
+#define MMAP_WILLNEED_WINDOW   (128 * 1024)
+
+static void advise_mapping( void *map, size_t size, uint32_t start )
+{
+    posix_madvise( map, size, POSIX_MADV_RANDOM );
+
+    long page_size = sysconf( _SC_PAGESIZE );
+    size_t head = ( page_size > 0 ) ? start - ( start % page_size ) : 0;
+    if ( head < size ) {
+        size_t len = size - head;
+        if ( len > MMAP_WILLNEED_WINDOW ) {
+            len = MMAP_WILLNEED_WINDOW;
+        }
+        posix_madvise( (uint8_t *)map + head, len, POSIX_MADV_WILLNEED );
+    }
+}
+
+extern exif_desc_t *read_exif_mmap( char *path, uint32_t start,
+                                    exif_control_t *control )
+{
+    if ( NULL == path ) return NULL;
+
+    int fd = open( path, O_RDONLY );
+    if ( -1 == fd ) {
+        return NULL;
+    }
+    struct stat st;
+    if ( -1 == fstat( fd, &st ) || st.st_size <= 0 ) {
+        close( fd );
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( MAP_FAILED == map ) {
+        close( fd );
+        return NULL;
+    }
+    advise_mapping( map, size, start );
+
+    exif_desc_t *desc = parse_exif_buffer( map, size, start, control );
+    if ( NULL == desc ) {
+        munmap( map, size );
+        close( fd );
+        return NULL;
+    }
+    desc->mapping = map;    // unmapped by exif_free
+    desc->mapping_size = size;
+    if ( 0 != desc->thumb_size ) {
+        desc->fd = fd;      // for exif_write_thumbnail_fd, closed by exif_free
+    } else {
+        close( fd );        // the mapping remains valid after closing
+    }
     return desc;
 }
 
@@ -280,92 +753,382 @@ extern slice_t *exif_get_ifd_ids( exif_desc_t *desc )
     return ids;
 }
 
-// cmparison for sorting by increasing tag values.
-static int cmp( const void *item1, const void *item2 )
-{
-    return *(uint16_t *)item1 - *(uint16_t *)item2;
-}
-
 extern slice_t *exif_get_ifd_tags( exif_desc_t *desc, ifd_id_t id, comp_fct cmp )
 {
     if ( NULL == desc || id < PRIMARY || id >= _IFD_N || NULL == desc->ifds[id] )
         return NULL;
 
-    slice_t *keys = map_keys( desc->ifds[id], NULL );
-    if ( NULL == keys ) {
-        return NULL;
-    }
-
-    // in a map, keys are void pointers, whereas tags are uint16_t values,
-    // which unfortunately requires a transfer to a different tag slice
-    slice_t *tags = new_slice( sizeof(uint16_t), slice_len( keys ) );
+    exif_load_ifd_entries( desc, id );
+    ifd_table_t *table = desc->ifds[id];
+    slice_t *tags = new_slice( sizeof(uint16_t), table->n_entries );
     if ( NULL == tags ) {
-        slice_free( keys );
         return NULL;
     }
 
-    for ( size_t i = 0; i < slice_len( keys ); ++i ) {
-        uint16_t tag = (uint16_t)((size_t)_pointer_slice_item_at( keys, i ));
-        slice_append_item( tags, &tag );
+    // entries are already sorted by increasing tag values
+    for ( uint16_t i = 0; i < table->n_entries; ++i ) {
+        if ( NULL != table->entries[i].values ) {   // failed lazy loading?
+            slice_append_item( tags, &table->entries[i].tag );
+        }
     }
-    slice_free( keys );
     if ( NULL != cmp ) {
         slice_sort_items( tags, cmp );
     }
     return tags;
 }
 
+// return the values of tag in IFD id, loading them first in lazy mode, or
+// NULL if the tag is not in IFD id.
+static ifd_values_t *get_ifd_tag_values( exif_desc_t *desc, ifd_id_t id,
+                                         uint16_t tag )
+{
+    if ( NULL == desc || id < PRIMARY || id >= _IFD_N || NULL == desc->ifds[id] ) {
+        return NULL;
+    }
+    ifd_entry_t *entry = ifd_table_lookup( desc->ifds[id], tag );
+    if ( NULL == entry ) {
+        return NULL;
+    }
+    if ( entry->deferred ) {
+        exif_load_ifd_entry( desc, id, entry );
+    }
+    return entry->values;
+}
+
 extern exif_type_t exif_get_ifd_tag_type( exif_desc_t *desc, ifd_id_t id,
                                           uint16_t tag )
 {
     if ( NULL == desc || id < PRIMARY || id >= _IFD_N || NULL == desc->ifds[id] ) {
         return NOT_A_TYPE;
     }
-
-    size_t key = make_key_from_tag( tag );
-    const void *res = map_lookup_entry( desc->ifds[id], (void *)key );
-    if ( NULL == res ) {
+    // entries are kept only once their type is accepted by the tag schema:
+    // deferred values do not need to be loaded for their type.
+    ifd_entry_t *entry = ifd_table_lookup( desc->ifds[id], tag );
+    if ( NULL == entry ) {
         return NOT_A_TYPE;
     }
-    // TODO make a sorted tag type array...
-    return NOT_A_TYPE;
+    return (exif_type_t)entry->type;
 }
 
 extern bool exif_get_ifd_tag_values( exif_desc_t *desc, ifd_id_t id,
                                      uint16_t tag, vector_t **values )
 {
-    if ( NULL == desc || id < PRIMARY || id >= _IFD_N || NULL == desc->ifds[id] ) {
+    ifd_values_t *ifd_values = get_ifd_tag_values( desc, id, tag );
+    if ( NULL == ifd_values ) {
         return false;
     }
-    size_t key = make_key_from_tag( tag );
-    const void *res = map_lookup_entry( desc->ifds[id], (void *)key );
-    if ( NULL == res ) {
+    if ( NULL != values ) {
+        vector_t *vector = __atomic_load_n( &ifd_values->vector,
+                                            __ATOMIC_ACQUIRE );
+        if ( NULL == vector ) {             // first request
+            vector = new_vector_from_data( ifd_values->data,
+                                           ifd_values->item_size,
+                                           ifd_values->count );
+            if ( NULL == vector ) {
+                return false;
+            }
+            // several threads may request the same values at the same time:
+            // only the first vector is kept and linked in the descriptor.
+            vector_t *first = NULL;
+            if ( __atomic_compare_exchange_n( &ifd_values->vector, &first,
+                                              vector, false, __ATOMIC_ACQ_REL,
+                                              __ATOMIC_ACQUIRE ) ) {
+                ifd_values_t *next = __atomic_load_n( &desc->vectors,
+                                                      __ATOMIC_RELAXED );
+                do {
+                    ifd_values->next = next;
+                } while ( ! __atomic_compare_exchange_n( &desc->vectors, &next,
+                                                         ifd_values, true,
+                                                         __ATOMIC_RELEASE,
+                                                         __ATOMIC_RELAXED ) );
+            } else {
+                vector_free( vector );
+                vector = first;
+            }
+        }
+        *values = vector;
+    }
+    return true;
+}
+
+extern bool exif_get_ifd_tag_bytes( exif_desc_t *desc, ifd_id_t id,
+                                    uint16_t tag, const uint8_t **data,
+                                    uint32_t *count )
+{
+    if ( NULL == desc || NULL == desc->data ||
+         id < PRIMARY || id >= _IFD_N || NULL == desc->ifds[id] ) {
         return false;
     }
-    if ( NULL != values ) {
-        *values = (vector_t *)res;
+
+    // the entry kept in the table, i.e. the last one if the tag appears more
+    // than once in the IFD, as for exif_get_ifd_tag_values
+    ifd_entry_t *entry = ifd_table_lookup( desc->ifds[id], tag );
+    if ( NULL == entry ) {
+        return false;
+    }
+    switch ( entry->type ) {
+    case TIFF_UINT8: case TIFF_STRING: case TIFF_INT8: case TIFF_UNDEFINED:
+        break;
+    default:
+        return false;       // not a byte array
+    }
+    const uint8_t *value = (const uint8_t *)&entry->valoff;
+    if ( entry->count > VAL_OFF_SIZE ) {    // otherwise value is in the entry
+        uint32_t offset = tiff_endianize_uint32( desc, entry->valoff );
+        if ( offset > desc->size || entry->count > desc->size - offset ) {
+            return false;
+        }
+        value = desc->data + offset;
+    }
+    if ( NULL != data ) {
+        *data = value;
+    }
+    if ( NULL != count ) {
+        *count = entry->count;
     }
     return true;
 }
 
-extern bool exif_print_ifd_entries( exif_desc_t *desc, ifd_id_t id,
-                                    char *indent_string )
+#define TYPE_MASK( type )  ( 1u << (type) )
+
+// return the values of tag in IFD id if they have at least index + 1 items of
+// one of the given types (TIFF type mask), or NULL otherwise.
+static inline const ifd_values_t *get_ifd_tag_item( exif_desc_t *desc,
+                                                    ifd_id_t id, uint16_t tag,
+                                                    uint32_t index,
+                                                    uint32_t types )
 {
-    slice_t *tags = exif_get_ifd_tags( desc, id, cmp );
+    const ifd_values_t *values = get_ifd_tag_values( desc, id, tag );
+    if ( NULL == values || index >= values->count ||
+         values->type > TIFF_DOUBLE ||
+         0 == ( types & TYPE_MASK( values->type ) ) ) {
+        return NULL;
+    }
+    return values;
+}
+
+extern bool exif_get_u16( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
+                          uint32_t index, uint16_t *out )
+{
+    const ifd_values_t *values = get_ifd_tag_item( desc, id, tag, index,
+                            TYPE_MASK( TIFF_UINT8 ) | TYPE_MASK( TIFF_UINT16 ) );
+    if ( NULL == values ) {
+        return false;
+    }
+    if ( NULL != out ) {
+        if ( TIFF_UINT16 == values->type ) {
+            *out = ((const uint16_t *)values->data)[index];
+        } else {
+            *out = ((const uint8_t *)values->data)[index];
+        }
+    }
+    return true;
+}
+
+extern bool exif_get_u32( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
+                          uint32_t index, uint32_t *out )
+{
+    const ifd_values_t *values = get_ifd_tag_item( desc, id, tag, index,
+                            TYPE_MASK( TIFF_UINT8 ) | TYPE_MASK( TIFF_UINT16 ) |
+                            TYPE_MASK( TIFF_UINT32 ) );
+    if ( NULL == values ) {
+        return false;
+    }
+    if ( NULL != out ) {
+        switch ( values->type ) {
+        case TIFF_UINT32:
+            *out = ((const uint32_t *)values->data)[index];
+            break;
+        case TIFF_UINT16:
+            *out = ((const uint16_t *)values->data)[index];
+            break;
+        default:
+            *out = ((const uint8_t *)values->data)[index];
+            break;
+        }
+    }
+    return true;
+}
+
+extern bool exif_get_urational( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
+                                uint32_t index, urational_t *out )
+{
+    const ifd_values_t *values = get_ifd_tag_item( desc, id, tag, index,
+                                                   TYPE_MASK( TIFF_URATIONAL ) );
+    if ( NULL == values ) {
+        return false;
+    }
+    if ( NULL != out ) {
+        *out = ((const urational_t *)values->data)[index];
+    }
+    return true;
+}
+
+extern bool exif_get_double( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
+                             uint32_t index, double *out )
+{
+    const ifd_values_t *values = get_ifd_tag_item( desc, id, tag, index,
+                            TYPE_MASK( TIFF_UINT8 ) | TYPE_MASK( TIFF_UINT16 ) |
+                            TYPE_MASK( TIFF_UINT32 ) | TYPE_MASK( TIFF_URATIONAL ) |
+                            TYPE_MASK( TIFF_INT8 ) | TYPE_MASK( TIFF_INT16 ) |
+                            TYPE_MASK( TIFF_INT32 ) | TYPE_MASK( TIFF_RATIONAL ) |
+                            TYPE_MASK( TIFF_FLOAT ) | TYPE_MASK( TIFF_DOUBLE ) );
+    if ( NULL == values ) {
+        return false;
+    }
+    double value;
+    switch ( values->type ) {
+    case TIFF_UINT8:
+        value = ((const uint8_t *)values->data)[index];
+        break;
+    case TIFF_UINT16:
+        value = ((const uint16_t *)values->data)[index];
+        break;
+    case TIFF_UINT32:
+        value = ((const uint32_t *)values->data)[index];
+        break;
+    case TIFF_INT8:
+        value = ((const int8_t *)values->data)[index];
+        break;
+    case TIFF_INT16:
+        value = ((const int16_t *)values->data)[index];
+        break;
+    case TIFF_INT32:
+        value = ((const int32_t *)values->data)[index];
+        break;
+    case TIFF_FLOAT:
+        value = ((const float *)values->data)[index];
+        break;
+    case TIFF_DOUBLE:
+        value = ((const double *)values->data)[index];
+        break;
+    case TIFF_URATIONAL: {
+        urational_t r = ((const urational_t *)values->data)[index];
+        if ( 0 == r.denominator ) {
+            return false;
+        }
+        value = (double)r.numerator / (double)r.denominator;
+        break;
+    }
+    default: {      // TIFF_RATIONAL
+        rational_t r = ((const rational_t *)values->data)[index];
+        if ( 0 == r.denominator ) {
+            return false;
+        }
+        value = (double)r.numerator / (double)r.denominator;
+        break;
+    }
+    }
+    if ( NULL != out ) {
+        *out = value;
+    }
+    return true;
+}
+
+extern bool exif_get_string_view( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
+                                  uint32_t index, exif_string_view_t *out )
+{
+    const ifd_values_t *values = get_ifd_tag_values( desc, id, tag );
+    if ( NULL == values ) {
+        return false;
+    }
+    if ( TIFF_UNDEFINED == values->type ) {
+        // only the values transformed into a string by the parser
+        const tag_schema_t *schema = schema_lookup( id, tag );
+        if ( 0 != index || NULL == schema ||
+             ( PARSE_VERSION != schema->parse &&
+               PARSE_COMPONENTS != schema->parse &&
+               PARSE_CFA_PATTERN != schema->parse ) ) {
+            return false;
+        }
+    } else if ( TIFF_STRING != values->type ) {
+        return false;
+    }
+
+    const char *string = values->data;
+    const char *end = string + values->count;
+    for ( ; ; ) {       // skip index strings, each followed by a 0
+        const char *zero = memchr( string, 0, (size_t)( end - string ) );
+        if ( 0 == index ) {
+            if ( NULL != out ) {
+                out->string = string;
+                out->length = (uint32_t)( ( NULL == zero ? end : zero ) - string );
+            }
+            return true;
+        }
+        if ( NULL == zero || zero + 1 == end ) {
+            return false;
+        }
+        string = zero + 1;
+        --index;
+    }
+}
+
+extern size_t exif_desc_heap_size( exif_desc_t *desc )
+{
+    size_t size = DESC_SIZE + DESC_ARENA_SIZE + arena_heap_size( &desc->arena );
+    for ( ifd_values_t *v = desc->vectors; NULL != v; v = v->next ) {
+        size += vector_item_size( v->vector ) * vector_cap( v->vector );
+    }
+    return size;
+}
+
+extern bool exif_get_stats( exif_desc_t *desc, exif_stats_t *stats )
+{
+#ifndef EXIF_NO_STATS
+    if ( NULL == desc || NULL == stats ) {
+        return false;
+    }
+    *stats = desc->stats;
+    stats->heap_bytes = exif_desc_heap_size( desc );
+    for ( ifd_id_t id = PRIMARY; id < _IFD_N; ++id ) {
+        stats->n_entries[id] = ( NULL == desc->ifds[id] ) ?
+                                            0 : desc->ifds[id]->n_entries;
+    }
+    for ( ifd_values_t *v = desc->vectors; NULL != v; v = v->next ) {
+        ++stats->n_vectors;
+    }
+    return true;
+#else
+    (void)desc;
+    (void)stats;
+    return false;
+#endif
+}
+
+extern uint32_t exif_get_diagnostics( exif_desc_t *desc,
+                                      const exif_diagnostic_t **diagnostics )
+{
+    if ( NULL == desc ) {
+        return 0;
+    }
+    if ( NULL != diagnostics ) {
+        *diagnostics = desc->diagnostics;
+    }
+    return desc->n_diagnostics;
+}
+
+extern bool exif_print_ifd_entries_to( exif_desc_t *desc, ifd_id_t id,
+                                       char *indent_string,
+                                       exif_sink_t *sink )
+{
+    if ( NULL == sink ) {
+        return false;
+    }
+    slice_t *tags = exif_get_ifd_tags( desc, id, NULL );    // already sorted
     if ( tags ) {
-        print_ifd_tags( desc, id, tags, indent_string );
+        bool success = print_ifd_tags( desc, id, tags, indent_string, sink );
         slice_free( tags );
-        return true;
+        return success;
     }
     return false;
 }
 
-static bool free_map_entry( uint32_t index,
-                            const void *key, const void *data, void *context )
+extern bool exif_print_ifd_entries( exif_desc_t *desc, ifd_id_t id,
+                                    char *indent_string )
 {
-    vector_t *entry = (vector_t *)data;
-    vector_free( entry );   // map entries are all vectors
-    return false;
+    exif_sink_t sink = { .type = EXIF_SINK_FILE, .file = stdout };
+    return exif_print_ifd_entries_to( desc, id, indent_string, &sink );
 }
 
 extern bool exif_free( exif_desc_t *desc )
@@ -373,12 +1136,22 @@ extern bool exif_free( exif_desc_t *desc )
     if ( NULL == desc ) {
         return false;
     }
-    for ( uint8_t i = PRIMARY; i < _IFD_N; ++i ) {
-        if ( NULL != desc->ifds[i] ) {
-            map_process_entries( desc->ifds[i], free_map_entry, NULL );
-            map_free( desc->ifds[i] );
-        }
+    // only values requested with exif_get_ifd_tag_values have a vector
+    for ( ifd_values_t *values = desc->vectors; NULL != values;
+                                                values = values->next ) {
+        vector_free( values->vector );
+    }
+    if ( desc->own_file ) {
+        fclose( desc->file );
+    }
+    if ( NULL != desc->mapping ) {
+        munmap( desc->mapping, desc->mapping_size );
+    }
+    if ( -1 != desc->fd ) {
+        close( desc->fd );
     }
-    free( desc );
+    free( desc->own_data );
+    arena_release( &desc->arena );
+    free( desc );               // including the first arena block
     return true;
 }
@@ -600,14 +600,118 @@ typedef struct {
     uint32_t        size;   // image size
 } thumbnail_info_t;
 
+#define EXIF_IFD_N  (IOP+1)     // number of supported IFDs, to size arrays
+
+// set of tags, one bit per possible tag value. A zero initialized set is empty.
+typedef struct {
+    uint32_t                n_tags;         // number of tags in the set
+    uint64_t                bits[65536/64];
+} exif_tag_set_t;
+
+static inline bool exif_tag_set_has( const exif_tag_set_t *set, uint16_t tag )
+{
+    return 0 != ( set->bits[tag >> 6] & ( (uint64_t)1 << ( tag & 63 ) ) );
+}
+
+static inline void exif_tag_set_add( exif_tag_set_t *set, uint16_t tag )
+{
+    if ( ! exif_tag_set_has( set, tag ) ) {
+        set->bits[tag >> 6] |= (uint64_t)1 << ( tag & 63 );
+        ++set->n_tags;
+    }
+}
+
 typedef struct {
     bool                    skip_unknown_tags;
     bool                    warnings;
     bool                    parse_debug;
+    bool                    lazy_values;    // load tag values on first access
+                                            // NULL, or only tags to keep
+    const exif_tag_set_t    *wanted_tags[EXIF_IFD_N];
 } exif_control_t;
 
+// Tag projection: if wanted_tags[id] is not NULL in exif_control_t, only the
+// tags in that set are kept for the IFD id. The other entries are skipped
+// during parsing, without reading or allocating their values, and without
+// checking if they are known. An empty set means that nothing is wanted in
+// that IFD: an embedded IFD (EXIF, GPS or IOP) is then not parsed at all,
+// unless it embeds itself an IFD with wanted tags (EXIF for IOP tags), and
+// the THUMBNAIL IFD is not parsed either. The sets are only used during
+// parsing and need not remain valid afterwards. If wanted_tags[id] is NULL
+// (the default), all tags are kept for the IFD id.
+
+// In lazy mode (lazy_values true in exif_control_t), parsing reads only the
+// IFD entries and checks their type and count, without reading or allocating
+// their values. Each tag's values are loaded the first time they are accessed
+// with exif_get_ifd_tag_values (or for all tags in an IFD, the first time
+// exif_get_ifd_tags is called for that IFD), and then kept for further calls.
+// The source of the data must therefore remain available until exif_free:
+// the FILE given to parse_exif must not be closed (read_exif keeps the file
+// open if needed and exif_free closes it), and the buffer given to
+// parse_exif_buffer must remain valid. Since values are loaded during those
+// calls, the same descriptor must not be accessed concurrently in lazy mode.
+// Otherwise, the getters can be called concurrently on the same descriptor:
+// the vectors created on first request by exif_get_ifd_tag_values are created
+// atomically, without lock.
+
 typedef struct _exif_desc exif_desc_t;
 
+// Parsing is reentrant: it does not use any global state, it does not print
+// anything except the warnings explicitly requested in exif_control_t, when
+// no metadata can be found, and it never exits. Different descriptors can be
+// parsed and used concurrently from different threads. Problems found while
+// parsing are recorded as diagnostics in the descriptor.
+typedef enum {
+    EXIF_UNKNOWN_TAG = 1,       // tag not known in its IFD, skipped (only if
+                                // skip_unknown_tags is false in exif_control_t)
+    EXIF_ILLEGAL_TYPE,          // entry with an illegal TIFF type, IFD skipped
+    EXIF_INVALID_CFA_PATTERN,   // CFA pattern sizes do not match its count
+    EXIF_INVALID_COUNT          // entry count does not fit its type or the
+                                // available data, entry values skipped
+} exif_diagnostic_code_t;
+
+typedef struct {
+    exif_diagnostic_code_t  code;
+    ifd_id_t                id;     // IFD where the problem was found
+    uint16_t                tag;    // IFD entry tag, type and count
+    uint16_t                type;
+    uint32_t                count;
+} exif_diagnostic_t;
+
+#define EXIF_MAX_DIAGNOSTICS    16  // only the first diagnostics are kept
+
+// exif_get_diagnostics returns the number of problems found while parsing
+// and, as a side effect if diagnostics is not NULL, the array of the first
+// EXIF_MAX_DIAGNOSTICS of them (at most) in their order of discovery. The
+// array belongs to the descriptor and is valid until exif_free is called.
+extern uint32_t exif_get_diagnostics( exif_desc_t *desc,
+                                      const exif_diagnostic_t **diagnostics );
+
+// Statistics collected while parsing and using a descriptor, to understand why
+// some files are slow. They are not collected if the library is built with
+// EXIF_NO_STATS defined, which removes all related code and data.
+typedef struct {
+    uint64_t    bytes_read;         // TIFF data read from the file or memory
+    uint32_t    n_reads;            // fread calls, or copies from memory
+    uint32_t    n_seeks;            // fseek calls, or moves in memory
+    uint32_t    n_tells;            // ftell calls, or positions in memory
+    uint64_t    bytes_scanned;      // by the exif header search, if any
+    uint16_t    n_entries[EXIF_IFD_N];  // entries kept in each IFD
+    uint32_t    n_vectors;          // created by exif_get_ifd_tag_values
+    uint32_t    n_loads;            // values loaded on first access (lazy)
+    uint64_t    heap_bytes;         // descriptor, arena blocks and vectors
+    uint64_t    scan_ns;            // locating the TIFF header
+    uint64_t    header_ns;          // checking the TIFF header
+    uint64_t    ifd_ns[EXIF_IFD_N]; // parsing each IFD, including the time
+                                    // spent in the IFDs it points to
+    uint64_t    load_ns;            // loading values on first access (lazy)
+} exif_stats_t;
+
+// exif_get_stats copies the current statistics of the descriptor in stats and
+// returns true, or returns false if desc is NULL or if statistics are not
+// collected (EXIF_NO_STATS).
+extern bool exif_get_stats( exif_desc_t *desc, exif_stats_t *stats );
+
 // parse_exif looks up for the EXIF header at the offset corresponding to the
 // given start value. If an exif header is found the following file content is
 // parsed, otherwise it backs up to the beginning of the file and looks for a
@@ -617,13 +721,36 @@ typedef struct _exif_desc exif_desc_t;
 // descriptor pointer that can be used to get the content of all IFDs that
 // have been sucessfully parsed,
 //
-// It implements the bitap (or shift-Or) algorithm to quickly find the exif
-// header. Exif header is 6-byte long ("Exif\x0\x0") and requires only a 6-bit
-// position mask. It uses a 256-byte mask array, which is is likely to stay in
-// cache, and a bitmask that fits in a register. The time complexity is O(n).
+// If the file at start is a JPEG file, the JPEG segments are walked, reading
+// only their markers and lengths, until the APP1 segment holding the exif
+// header is found. The walk stops at the start of the image data (SOS marker)
+// and if no exif header was found before, a NULL pointer is returned. The
+// whole file is scanned only if it is not a JPEG file. Since all metadata are
+// in the APP1 segment, the segment is read at once and parsed from memory: the
+// file is not accessed anymore after parse_exif returns. Otherwise, the file
+// is read as needed while parsing, and in lazy mode, while loading values.
+//
+// The scan reads the file in 32KB chunks and looks for the exif header 16,
+// 32 or 64 bytes at a time, using SSE2, AVX2 or AVX-512 instructions depending
+// on the processor. Only the positions starting with 'E' and followed 5 bytes
+// later with '\0' are fully compared with the 6-byte exif header "Exif\x0\x0".
+// On other processors, it implements the bitap (or shift-Or) algorithm, which
+// requires only a 6-bit position mask, a 256-byte mask array, which is likely
+// to stay in cache, and a bitmask that fits in a register. In both cases the
+// time complexity is O(n).
 extern exif_desc_t *parse_exif( FILE *f, uint32_t start,
                                 exif_control_t *control );
 
+// parse_exif_buffer is similar to parse_exif, but it parses the EXIF or TIFF
+// data directly from the len bytes in memory at data, starting at the offset
+// given by start. All reads are bounds-checked against len, and no copy of
+// the buffer is made: the buffer must remain valid and unmodified as long as
+// the returned descriptor is in use, since exif_get_ifd_tag_bytes may return
+// pointers inside the buffer.
+extern exif_desc_t *parse_exif_buffer( const uint8_t *data, size_t len,
+                                       uint32_t start,
+                                       exif_control_t *control );
+
 // read_exif opens the file associated with the given path and calls parse_exif.
 // If no EXIF or TIFF header was found it returns a NULL pointer, otherwise it
 // returns a non-NULL exif descriptor pointer that can be used to get the
@@ -631,15 +758,123 @@ extern exif_desc_t *parse_exif( FILE *f, uint32_t start,
 extern exif_desc_t *read_exif( char *path, uint32_t start,
                                exif_control_t *control );
 
+// read_exif_mmap is similar to read_exif, but instead of reading the file it
+// maps it in memory once and parses the mapping as parse_exif_buffer does.
+// The kernel is advised that the first 128KB from start, where the metadata
+// are expected, will be needed soon, whereas the rest of the file will only
+// be accessed randomly, so that no image data is read ahead. The mapping is
+// owned by the returned descriptor and released by exif_free. As with any
+// file mapping, the file must not be truncated while the descriptor is used.
+// If the file has a thumbnail, it also remains open until exif_free, so that
+// exif_write_thumbnail_fd can copy the thumbnail without reading it.
+extern exif_desc_t *read_exif_mmap( char *path, uint32_t start,
+                                    exif_control_t *control );
+
+// A push parser receives the data of a file as they arrive, for example from
+// a pipe or a network connection, and parses the metadata as soon as they are
+// complete, without ever going back in the stream. Only the data needed are
+// kept: for a JPEG stream, the segments before the APP1 Exif segment are
+// skipped, and the data following the last IFD or value needed are ignored.
+typedef struct _exif_push exif_push_t;
+
+typedef enum {
+    EXIF_PUSH_MORE,             // more data are needed
+    EXIF_PUSH_DONE,             // metadata are complete
+    EXIF_PUSH_FAILED            // no metadata found in the stream
+} exif_push_status_t;
+
+// exif_push_new returns a new push parser, which parses according to control
+// (copied, but the wanted tag sets must remain valid), or NULL if no memory
+// is available. After use, the parser must be freed by exif_push_free.
+extern exif_push_t *exif_push_new( exif_control_t *control );
+
+// exif_push gives the next len bytes of the stream to the parser. It returns
+// EXIF_PUSH_MORE until the metadata are complete, that is when all wanted
+// IFDs and their values (see wanted_tags in exif_control_t) have been
+// received, in which case it returns EXIF_PUSH_DONE and the following data
+// are ignored. If the stream is neither a JPEG or TIFF stream nor contains an
+// exif header, it returns EXIF_PUSH_FAILED.
+extern exif_push_status_t exif_push( exif_push_t *state,
+                                     const uint8_t *data, size_t len );
+
+// exif_push_end indicates that the stream ended. The metadata received are
+// parsed if possible, and the function returns EXIF_PUSH_DONE or
+// EXIF_PUSH_FAILED.
+extern exif_push_status_t exif_push_end( exif_push_t *state );
+
+// exif_push_get_needed returns false if the parser does not need any data
+// anymore, or true with the stream offset of the next byte needed, and the
+// number of bytes needed from there, or 0 if that number is not known yet.
+// Data between the current stream position and that offset are ignored, so
+// that a caller reading from a seekable source can skip them.
+extern bool exif_push_get_needed( exif_push_t *state,
+                                  uint64_t *offset, size_t *size );
+
+// exif_push_get_desc returns the descriptor, once exif_push or exif_push_end
+// has returned EXIF_PUSH_DONE, or NULL otherwise. The descriptor then belongs
+// to the caller and must be freed by exif_free, independently of the parser.
+// It holds all the data received from the TIFF header to the last IFD or
+// value needed, so that exif_get_ifd_tag_bytes and the thumbnail offset may
+// refer to data that were not kept.
+extern exif_desc_t *exif_push_get_desc( exif_push_t *state );
+
+// exif_push_free frees the parser, and the descriptor if it was not taken by
+// exif_push_get_desc.
+extern void exif_push_free( exif_push_t *state );
+
+// exif_read_fct is the type of the callback given to exif_read_many. It is
+// called for each path with the path index, and either a non-NULL descriptor,
+// which then belongs to the callback, or a NULL descriptor and an error: the
+// errno value if the file could not be opened, or -1 if no EXIF or TIFF
+// metadata could be parsed.
+typedef void (*exif_read_fct)( void *context, size_t index,
+                               exif_desc_t *desc, int error );
+
+// exif_read_many reads the n files given by paths, as read_exif would do with
+// a start value of 0, using n_threads threads, including the calling thread,
+// or as many threads as there are processors if n_threads is 0. Each result
+// is delivered to callback with the given context as soon as it is available,
+// and since several files are read at the same time, callback may be called
+// concurrently from different threads. If ordered is true, results are
+// delivered one at a time by increasing path index, and callback is never
+// called concurrently. The function returns when all results have been
+// delivered, or false immediately if it could not start.
+//
+// Files are read by chunks of consecutive paths, dealt to threads which steal
+// remaining chunks from each other when they are done with their own chunks.
+extern bool exif_read_many( char **paths, size_t n, exif_control_t *control,
+                            exif_read_fct callback, void *context,
+                            unsigned int n_threads, bool ordered );
+
+// exif_read_many_async reads the n files given by paths as exif_read_many
+// does, but from the calling thread only, with up to queue_depth reads in
+// flight thanks to io_uring, or 32 if queue_depth is 0. Only the metadata are
+// read: the first 64KB of each file, then if needed the rest of a JPEG APP1
+// Exif segment, or the rest of the TIFF IFDs and values, and the descriptors
+// are parsed from memory, as parse_exif_buffer would do. Files that are
+// neither JPEG nor TIFF are scanned by read_exif, which blocks.
+//
+// Results are delivered to callback in completion order. If io_uring is not
+// available (not Linux, kernel older than 5.6 or library built with
+// EXIF_NO_IO_URING defined) the function falls back to exif_read_many with
+// queue_depth threads and unordered delivery, in which case callback may be
+// called concurrently. The function returns when all results have been
+// delivered, or false immediately if it could not start.
+extern bool exif_read_many_async( char **paths, size_t n,
+                                  exif_control_t *control,
+                                  exif_read_fct callback, void *context,
+                                  unsigned int queue_depth );
+
 // exif_get_ifd_ids returns the slice of available IFD Ids from the given exif
 // descriptor, or NULL in case of failure. IFD ids are returned as type ifd_id_t
 // inside the slice. After use, the returned slice must be freed by the caller.
 extern slice_t *exif_get_ifd_ids( exif_desc_t *desc );
 
 // exif_get_ifd_tags returns a slice with all tags available from the requested
-// IFD id or NULL in case of failure. If the argument cmp is not NULL, the
-// returned slice is sorted according the the given comparison function cmp.
-// After use, the returned slice must be freed by the caller.
+// IFD id or NULL in case of failure. Tags are returned by increasing values,
+// as they are kept internally. If the argument cmp is not NULL, the returned
+// slice is sorted according the the given comparison function cmp. After use,
+// the returned slice must be freed by the caller.
 extern slice_t *exif_get_ifd_tags( exif_desc_t *desc, ifd_id_t id,
                                    comp_fct cmp );
 
@@ -661,7 +896,10 @@ typedef enum {
 } exif_type_t;
 // if the requested tag is found in the IFD specified by id then the exif type
 // of its values is returned, otherwise the exif_type_t value of NOT_A_TYPE
-// is returned
+// is returned. This is the type found in the IFD entry, even for the few tags
+// whose values are transformed into an ascii string by the parser (e.g. an
+// exif version, which is UNDEFINED_TYPE). In lazy mode, values are not loaded
+// to get their type.
 extern exif_type_t exif_get_ifd_tag_type( exif_desc_t *desc, ifd_id_t id,
                                           uint16_t tag );
 // if the requested tag is found in the IFD specified by id then the vector
@@ -670,16 +908,289 @@ extern exif_type_t exif_get_ifd_tag_type( exif_desc_t *desc, ifd_id_t id,
 //
 // WARNING: The vector obtained with this call is the internal vector and it
 // should NEVER be modified or freed by the caller.
+//
+// Tag values are kept in a memory area owned by the descriptor, and the
+// vector is only created the first time it is requested for a given tag.
 extern bool exif_get_ifd_tag_values( exif_desc_t *desc, ifd_id_t id,
                                      uint16_t tag, vector_t **values );
 
+// if the descriptor was obtained from parse_exif_buffer and the requested tag
+// is found in the IFD specified by id with a byte type (unsigned or signed
+// byte, ascii string or undefined), a pointer to the raw bytes as they are
+// stored in the original buffer and their count are returned as side effects
+// and the function returns true. Otherwise it returns false. Nothing is
+// copied: ascii strings include their terminating 0 only if it was stored in
+// the original buffer, and values are not transformed as they may be by
+// exif_get_ifd_tag_values (e.g. CFA pattern or components configuration).
+// Values of up to 4 bytes, stored in the IFD entry itself, are returned from
+// the entry kept by the descriptor, valid until exif_free is called. If the
+// tag appears more than once in the IFD, the entry kept is the last one, as
+// for exif_get_ifd_tag_values.
+extern bool exif_get_ifd_tag_bytes( exif_desc_t *desc, ifd_id_t id,
+                                    uint16_t tag, const uint8_t **data,
+                                    uint32_t *count );
+
+// The following accessors return as a side effect the value at index in the
+// values of tag in the IFD specified by id, and return true if the tag is
+// found with a compatible type and at least index + 1 values. Otherwise they
+// return false and out is not modified. They allocate nothing and do not
+// create the vector returned by exif_get_ifd_tag_values. In lazy mode, the
+// values are loaded first.
+//
+// exif_get_u16 accepts UBYTE_TYPE and USHORT_TYPE values, and exif_get_u32
+// accepts ULONG_TYPE values as well, since tags such as PIXEL_X_DIMENSION_TAG
+// may be stored in any of those types. exif_get_urational accepts only
+// URATIONAL_TYPE values. exif_get_double accepts all numeric types, signed or
+// not, including TIFF float and double, but not rationals whose denominator
+// is 0.
+extern bool exif_get_u16( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
+                          uint32_t index, uint16_t *out );
+extern bool exif_get_u32( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
+                          uint32_t index, uint32_t *out );
+extern bool exif_get_urational( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
+                                uint32_t index, urational_t *out );
+extern bool exif_get_double( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
+                             uint32_t index, double *out );
+
+// A string view refers to length chars kept by the descriptor, which are not
+// necessarily followed by a terminating 0. It remains valid until the
+// descriptor is freed.
+typedef struct {
+    const char  *string;
+    uint32_t    length;
+} exif_string_view_t;
+
+// exif_get_string_view returns the string at index in an ASCII_TYPE value,
+// which may hold several strings separated by a 0, or the string made by the
+// parser from an UNDEFINED_TYPE value (e.g. an exif version) at index 0.
+extern bool exif_get_string_view( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
+                                  uint32_t index, exif_string_view_t *out );
+
+// if the descriptor has a thumbnail (JPEGInterchangeFormat in IFD1) and its
+// data are in memory, the address of the thumbnail bytes and their count are
+// returned as side effects and the function returns true. Otherwise it returns
+// false. Nothing is copied: the bytes are in the buffer given to
+// parse_exif_buffer, in the mapping made by read_exif_mmap or in the APP1
+// segment read by parse_exif. They are not available in memory if the TIFF
+// data were read from a file (bare TIFF file, or file without JPEG structure).
+extern bool exif_get_thumbnail( exif_desc_t *desc,
+                                const uint8_t **data, uint32_t *size );
+
+// exif_get_thumbnail_info returns true and the thumbnail origin, compression
+// and size as a side effect if the descriptor has a thumbnail, wherever its
+// data are, or false otherwise.
+extern bool exif_get_thumbnail_info( exif_desc_t *desc, thumbnail_info_t *info );
+
+// exif_write_thumbnail_fd writes the thumbnail bytes to the file descriptor fd
+// at its current position, and returns true if all bytes could be written. If
+// the descriptor still refers to its file (mapped by read_exif_mmap, read from
+// a bare TIFF file by parse_exif, which the caller must keep open, or read by
+// read_exif in lazy mode), the bytes are copied by the kernel with
+// copy_file_range, or with sendfile if fd is a pipe or a socket, and never
+// pass through user space. Otherwise, they are written from memory.
+extern bool exif_write_thumbnail_fd( exif_desc_t *desc, int fd );
+
+// exif_serialize writes in buf all IFDs and tag values of the descriptor as a
+// single blob, if cap is large enough, and returns the blob size in any case,
+// or 0 in case of failure: exif_serialize( desc, NULL, 0 ) gives the size to
+// allocate. The blob contains only offsets, no pointers, so that it can be
+// copied, written to a file and mapped again anywhere. Values are stored as
+// exif_get_ifd_tag_values returns them, in the native byte order. In lazy
+// mode, all deferred values are loaded first.
+extern size_t exif_serialize( exif_desc_t *desc, uint8_t *buf, size_t cap );
+
+// exif_view_from_blob returns a descriptor that reads the blob made by
+// exif_serialize in place, or NULL if the blob is invalid or not aligned on 8
+// bytes, or if no memory is available. The blob is checked and a small index
+// of its entries is made, but no value is copied: exif_get_ifd_ids,
+// exif_get_ifd_tags, exif_get_ifd_tag_type, exif_get_ifd_tag_values and
+// exif_print_ifd_entries work as with the original descriptor. The original
+// data are not in the blob: exif_get_ifd_tag_bytes and the thumbnail
+// functions return false. The blob must remain valid and
+// unmodified until the descriptor is freed with exif_free, which does not
+// free the blob.
+extern exif_desc_t *exif_view_from_blob( const uint8_t *blob, size_t len );
+
+// A catalog keeps the metadata of many files in a single file, which is
+// mapped in memory when the catalog is opened and queried in place, without
+// parsing. Each file is recorded with its path and its identity: device,
+// inode, size and modification time. The catalog is updated by rescanning the
+// whole list of files: only the files whose identity changed, or that are
+// new, are parsed again.
+typedef struct _exif_catalog exif_catalog_t;
+
+// exif_catalog_open maps the catalog file at path and returns the catalog, or
+// NULL if no memory is available. If the file does not exist or is not a
+// valid catalog (e.g. it was written on a processor with a different byte
+// order), the catalog is empty until exif_catalog_rescan writes it.
+extern exif_catalog_t *exif_catalog_open( const char *path );
+
+// exif_catalog_close unmaps and frees the catalog. Records found in the
+// catalog must not be used anymore.
+extern void exif_catalog_close( exif_catalog_t *catalog );
+
+// exif_catalog_get_count returns the number of files in the catalog.
+extern size_t exif_catalog_get_count( exif_catalog_t *catalog );
+
+typedef struct {
+    size_t      n_unchanged;        // recorded files that did not change
+    size_t      n_parsed;           // new or changed files with metadata
+    size_t      n_failed;           // new or changed files without metadata
+    size_t      n_errors;           // new or changed files that were not read
+    size_t      n_removed;          // recorded files not in paths anymore
+    size_t      n_missing;          // paths that could not be stat'ed
+} exif_rescan_stats_t;
+
+// exif_catalog_rescan updates the catalog for the n files given by paths,
+// which replace all the files previously recorded. Each file is stat'ed and
+// if its identity is the same as in the catalog, its record is kept as is.
+// Otherwise, the file is read with exif_read_many and the given control,
+// except for lazy_values which is ignored. Files without metadata are also
+// recorded, so that they are not read again if they do not change. Files that
+// could not be read (e.g. not opened or not enough memory) are recorded
+// without metadata, but they are read again at the next rescan. The new
+// catalog is written in a temporary file, which then replaces the catalog
+// file, and it is mapped again. Records found before must not be used
+// anymore. The function returns false if the catalog could not be written,
+// in which case the catalog is not modified, and the statistics of the
+// rescan as a side effect if stats is not NULL.
+extern bool exif_catalog_rescan( exif_catalog_t *catalog,
+                                 char **paths, size_t n,
+                                 exif_control_t *control,
+                                 exif_rescan_stats_t *stats );
+
+// A record gives the metadata of a file in the catalog, which remain in the
+// catalog mapping and are never copied. All values are in the native byte
+// order, as they would be returned by exif_get_ifd_tag_values. The blob is
+// made by exif_serialize, and can be given to exif_view_from_blob.
+typedef struct {
+    const uint8_t   *blob;          // serialized metadata, NULL if none
+    size_t          blob_size;
+    uint64_t        dev, ino, size; // file identity when it was read
+    int64_t         mtime_ns;
+} exif_record_t;
+
+// exif_catalog_find returns true and the record of the file at path as a side
+// effect, if the file is in the catalog, or false otherwise. Paths are
+// compared as given to exif_catalog_rescan, without any normalization.
+extern bool exif_catalog_find( exif_catalog_t *catalog, const char *path,
+                               exif_record_t *record );
+
+// if the requested tag is found in the IFD specified by id in the record, its
+// type, the address of its values in the catalog mapping and their count are
+// returned as side effects and the function returns true. Otherwise it
+// returns false. The values are the items that exif_get_ifd_tag_values would
+// return in a vector, with the same item size (e.g. 2 uint32_t for each
+// rational). Entries whose item size does not match their type are rejected
+// as invalid, so that count items of that size can always be read.
+extern bool exif_record_get_tag_values( const exif_record_t *record,
+                                        ifd_id_t id, uint16_t tag,
+                                        exif_type_t *type,
+                                        const void **values, uint32_t *count );
+
+// A cache keeps the descriptors of recently read files in memory, so that
+// the metadata of the same files can be requested many times without reading
+// them again. Files are identified by device, inode, size and modification
+// time: a file that changes is read again, whatever the path used to reach it.
+// The cache can be used by several threads at the same time.
+typedef struct _exif_cache exif_cache_t;
+
+// exif_cache_open returns an empty cache that keeps at most capacity_bytes of
+// descriptors, or NULL if no memory is available. The size of a descriptor is
+// its actual memory footprint, including its serialized metadata and vectors.
+extern exif_cache_t *exif_cache_open( size_t capacity_bytes );
+
+// exif_cache_close frees the cache and all its descriptors, which must all
+// have been released before.
+extern void exif_cache_close( exif_cache_t *cache );
+
+// exif_cache_read returns the descriptor of the file at path, or NULL if the
+// file cannot be read or has no metadata. If the file did not change since it
+// was cached, the file is only stat'ed. Otherwise it is read as parse_exif
+// would do with the given control (except for lazy_values which is ignored),
+// and cached. Entries are keyed by file identity only: the same control
+// should be given for all reads in a cache.
+//
+// The descriptor is shared with all other readers of the same file: it is a
+// view on the serialized metadata (see exif_view_from_blob), which must be
+// used read-only, and never given to exif_free. It must be released with
+// exif_cache_release instead, when it is not used anymore.
+extern exif_desc_t *exif_cache_read( exif_cache_t *cache, const char *path,
+                                     exif_control_t *control );
+
+// exif_cache_release releases a descriptor returned by exif_cache_read. The
+// descriptor remains in the cache until it is evicted, as the least recently
+// used, to make room for other descriptors.
+extern void exif_cache_release( exif_cache_t *cache, exif_desc_t *desc );
+
+typedef struct {
+    uint64_t    n_hits;             // reads without parsing
+    uint64_t    n_misses;           // reads with parsing
+    uint64_t    n_evictions;
+    uint64_t    n_entries;          // descriptors in cache
+    uint64_t    bytes;              // their footprint
+} exif_cache_stats_t;
+
+// exif_cache_get_stats returns the cache statistics as a side effect.
+extern void exif_cache_get_stats( exif_cache_t *cache,
+                                  exif_cache_stats_t *stats );
+
 // exif_print_ifd_entries prints all metadata found in the ifd specified by id.
 // The argument indent_string gives the optional text that is prepended to each
 // entry.
 extern bool exif_print_ifd_entries( exif_desc_t *desc, ifd_id_t id,
                                     char *indent_string );
 
-// exif_free frees all internal exif data structures.
+// Printing can also be sent to any of the following sinks.
+typedef enum {
+    EXIF_SINK_FILE,                 // a stdio stream
+    EXIF_SINK_FD,                   // a file descriptor (file, pipe, socket)
+    EXIF_SINK_MEMORY                // a memory buffer
+} exif_sink_type_t;
+
+typedef struct {
+    exif_sink_type_t    type;
+    FILE                *file;      // EXIF_SINK_FILE
+    int                 fd;         // EXIF_SINK_FD
+    char                *buf;       // EXIF_SINK_MEMORY, text is appended at
+    size_t              cap;        // buf + len, without exceeding cap bytes,
+    size_t              len;        // but len is updated with the full size
+} exif_sink_t;
+
+// exif_print_ifd_entries_to is similar to exif_print_ifd_entries, but the text
+// is written to the given sink. The text is formatted in an internal buffer,
+// which is written to the sink when full and before returning, so that the
+// sink is written a few times per call and not once per value. A memory sink
+// receives a terminating 0 only if cap is larger than the resulting len, so
+// that several calls can append to the same buffer, and a len larger than or
+// equal to cap indicates that the buffer was too small. It returns false if
+// no tag could be found in the ifd or if the sink could not be written.
+extern bool exif_print_ifd_entries_to( exif_desc_t *desc, ifd_id_t id,
+                                       char *indent_string,
+                                       exif_sink_t *sink );
+
+// exif_write_json writes all metadata of the descriptor in buf as a single
+// JSON object, with a member per IFD and a member per tag in each IFD, named
+// as exif_print_ifd_entries prints them (or "0x9000" if the tag is not
+// printed). Strings are UTF-8, numbers are written with digits that read
+// back as the same double, whatever the locale, and rationals as the result
+// of their division. The JSON length is returned, and the JSON is
+// written with a terminating 0 only if cap is larger than that length:
+// exif_write_json( desc, NULL, 0 ) gives the size to allocate minus 1.
+extern size_t exif_write_json( exif_desc_t *desc, char *buf, size_t cap );
+
+// exif_write_json_grow is similar to exif_write_json, but the buffer *buf of
+// *cap bytes is reallocated as needed, and the new buffer and its size are
+// returned as side effects. *buf can be NULL initially, and the same buffer
+// can be reused for many descriptors. It returns the JSON length, or 0 if no
+// memory is available, in which case *buf must still be freed by the caller.
+extern size_t exif_write_json_grow( exif_desc_t *desc, char **buf,
+                                    size_t *cap );
+
+// exif_free frees all internal exif data structures. Since all IFDs and tag
+// values are allocated from a few large memory blocks owned by the descriptor,
+// it only has to free those blocks and the vectors that have been requested
+// with exif_get_ifd_tag_values.
 extern bool exif_free( exif_desc_t *desc );
 
 #endif /* __EXIF_H__ */
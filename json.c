@@ -0,0 +1,371 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "exif.h"
+#include "parse.h"
+#include "schema.h"
+#include "numfmt.h"
+
+/*
+    JSON output.
+
+    The descriptor is written as one object with a member per IFD, in the
+    order of ifd_id_t, each an object with a member per tag, in increasing tag
+    order:
+
+    {"Primary":{"Manufacturer":"Maker","X Resolution":72,...},"Exif":{...}}
+
+    Tags are named as printed by exif_print_ifd_entries, or with their value
+    in hexadecimal ("0x9000") if they are not printed. Values are written
+    according to their TIFF type: a string for ascii values and for undefined
+    values that are printable text (after the ASCII character code for user
+    comments), a number for a single numeric value, or an array of numbers.
+    Rationals are written as the result of their division, or null if their
+    denominator is 0.
+
+    The values are read once, directly from the IFD tables, without creating
+    vectors, and written in the caller buffer without stdio.
+*/
+
+typedef struct {
+    char        *buf;
+    size_t      cap;            // buf size
+    size_t      len;            // JSON length, even beyond cap
+    bool        grow;           // buf is reallocated as needed
+    bool        failed;         // no memory to grow
+} json_writer_t;
+
+// true if n more bytes can be written in the buffer, keeping room for the
+// terminating 0, after growing it if possible.
+static bool json_reserve( json_writer_t *w, size_t n )
+{
+    if ( w->len + n < w->cap ) {
+        return true;
+    }
+    if ( ! w->grow || w->failed ) {
+        return false;
+    }
+    size_t cap = ( w->cap < 256 ) ? 256 : 2 * w->cap;
+    while ( cap <= w->len + n ) {
+        cap *= 2;
+    }
+    char *buf = realloc( w->buf, cap );
+    if ( NULL == buf ) {
+        w->failed = true;
+        return false;
+    }
+    w->buf = buf;
+    w->cap = cap;
+    return true;
+}
+
+static void json_put( json_writer_t *w, const char *data, size_t n )
+{
+    if ( json_reserve( w, n ) ) {
+        memcpy( w->buf + w->len, data, n );
+    }
+    w->len += n;
+}
+
+static inline void json_put_char( json_writer_t *w, char c )
+{
+    if ( json_reserve( w, 1 ) ) {
+        w->buf[w->len] = c;
+    }
+    ++w->len;
+}
+
+// how each byte is written in a JSON string: 0 as is, 'u' as \u00XX, 'x' as
+// is if it starts a valid UTF-8 sequence or as \u00XX otherwise, any other
+// character after a backslash.
+static const char json_escapes[256] = {
+    'u','u','u','u','u','u','u','u','b','t','n','u','f','r','u','u',  // 0x00
+    'u','u','u','u','u','u','u','u','u','u','u','u','u','u','u','u',  // 0x10
+      0,  0,'"',  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x20
+      0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x30
+      0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x40
+      0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,'\\',  0,  0,  0,  // 0x50
+      0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x60
+      0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x70
+    'x','x','x','x','x','x','x','x','x','x','x','x','x','x','x','x',  // 0x80
+    'x','x','x','x','x','x','x','x','x','x','x','x','x','x','x','x',  // 0x90
+    'x','x','x','x','x','x','x','x','x','x','x','x','x','x','x','x',  // 0xa0
+    'x','x','x','x','x','x','x','x','x','x','x','x','x','x','x','x',  // 0xb0
+    'x','x','x','x','x','x','x','x','x','x','x','x','x','x','x','x',  // 0xc0
+    'x','x','x','x','x','x','x','x','x','x','x','x','x','x','x','x',  // 0xd0
+    'x','x','x','x','x','x','x','x','x','x','x','x','x','x','x','x',  // 0xe0
+    'x','x','x','x','x','x','x','x','x','x','x','x','x','x','x','x'   // 0xf0
+};
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+// length of the valid UTF-8 sequence at s, within n bytes, or 0
+static size_t utf8_length( const uint8_t *s, size_t n )
+{
+    uint8_t c = s[0], low = 0x80, high = 0xbf;
+    size_t len;
+    if ( c >= 0xc2 && c <= 0xdf ) {
+        len = 2;
+    } else if ( c >= 0xe0 && c <= 0xef ) {
+        len = 3;
+        if ( 0xe0 == c ) {
+            low = 0xa0;                     // overlong
+        } else if ( 0xed == c ) {
+            high = 0x9f;                    // surrogates
+        }
+    } else if ( c >= 0xf0 && c <= 0xf4 ) {
+        len = 4;
+        if ( 0xf0 == c ) {
+            low = 0x90;                     // overlong
+        } else if ( 0xf4 == c ) {
+            high = 0x8f;                    // beyond U+10FFFF
+        }
+    } else {
+        return 0;
+    }
+    if ( n < len || s[1] < low || s[1] > high ) {
+        return 0;
+    }
+    for ( size_t i = 2; i < len; ++i ) {
+        if ( 0x80 != ( s[i] & 0xc0 ) ) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+// write the n bytes at s as a JSON string, stopping at the first 0 byte.
+// Bytes that are not valid UTF-8 are taken as Latin-1 characters.
+static void json_put_string( json_writer_t *w, const uint8_t *s, size_t n )
+{
+    json_put_char( w, '"' );
+    size_t i = 0, start = 0;
+    while ( i < n && 0 != s[i] ) {
+        char escape = json_escapes[s[i]];
+        if ( 0 == escape ) {
+            ++i;
+            continue;
+        }
+        size_t len = ( 'x' == escape ) ? utf8_length( s + i, n - i ) : 0;
+        if ( 0 != len ) {
+            i += len;
+            continue;
+        }
+        json_put( w, (const char *)s + start, i - start );
+        if ( 'u' == escape || 'x' == escape ) {
+            char u[6] = { '\\', 'u', '0', '0',
+                          hex_digits[s[i] >> 4], hex_digits[s[i] & 0xf] };
+            json_put( w, u, sizeof(u) );
+        } else {
+            char e[2] = { '\\', escape };
+            json_put( w, e, sizeof(e) );
+        }
+        start = ++i;
+    }
+    json_put( w, (const char *)s + start, i - start );
+    json_put_char( w, '"' );
+}
+
+static void json_put_name( json_writer_t *w, ifd_id_t id, uint16_t tag )
+{
+    const tag_schema_t *schema = schema_lookup( id, tag );
+    const char *name = ( NULL == schema ) ? NULL : schema->name;
+    if ( NULL != name ) {
+        json_put_string( w, (const uint8_t *)name, strlen( name ) );
+        return;
+    }
+    char hex[8] = { '"', '0', 'x',
+                    hex_digits[tag >> 12], hex_digits[( tag >> 8 ) & 0xf],
+                    hex_digits[( tag >> 4 ) & 0xf], hex_digits[tag & 0xf],
+                    '"' };
+    json_put( w, hex, sizeof(hex) );
+}
+
+static void json_put_double( json_writer_t *w, double value )
+{
+    char buf[NUMFMT_MAX_SIZE];
+    size_t n = numfmt_double( value, buf );
+    if ( 'i' == buf[n-1] || 'f' == buf[n-1] || 'n' == buf[n-1] ) {
+        json_put( w, "null", 4 );   // no infinity or NaN in JSON
+    } else {
+        json_put( w, buf, n );
+    }
+}
+
+// write item i of the values
+static void json_put_number( json_writer_t *w, const ifd_values_t *values,
+                             uint32_t i )
+{
+    const uint8_t *item = (const uint8_t *)values->data +
+                          (size_t)i * values->item_size;
+    char buf[NUMFMT_MAX_SIZE];
+    size_t n = 0;
+    switch ( values->type ) {
+    case TIFF_INT8:
+        n = numfmt_int32( *(const int8_t *)item, buf );
+        break;
+    case TIFF_INT16:
+        n = numfmt_int32( *(const int16_t *)item, buf );
+        break;
+    case TIFF_INT32:
+        n = numfmt_int32( *(const int32_t *)item, buf );
+        break;
+    case TIFF_URATIONAL:
+        {
+            const urational_t *r = (const urational_t *)item;
+            if ( 0 == r->denominator ) {
+                json_put( w, "null", 4 );
+            } else {
+                json_put_double( w, (double)r->numerator / r->denominator );
+            }
+            return;
+        }
+    case TIFF_RATIONAL:
+        {
+            const rational_t *r = (const rational_t *)item;
+            if ( 0 == r->denominator ) {
+                json_put( w, "null", 4 );
+            } else {
+                json_put_double( w, (double)r->numerator / r->denominator );
+            }
+            return;
+        }
+    case TIFF_FLOAT:
+        json_put_double( w, *(const float *)item );
+        return;
+    case TIFF_DOUBLE:
+        json_put_double( w, *(const double *)item );
+        return;
+    default:            // unsigned, or undefined
+        switch ( values->item_size ) {
+        case 1: n = numfmt_uint32( *item, buf ); break;
+        case 2: n = numfmt_uint32( *(const uint16_t *)item, buf ); break;
+        default: n = numfmt_uint32( *(const uint32_t *)item, buf ); break;
+        }
+        break;
+    }
+    json_put( w, buf, n );
+}
+
+// true if the bytes are printable ascii, possibly followed by 0 bytes
+static bool is_text( const uint8_t *s, uint32_t n )
+{
+    while ( n > 0 && 0 == s[n-1] ) {
+        --n;
+    }
+    for ( uint32_t i = 0; i < n; ++i ) {
+        if ( s[i] < 0x20 || s[i] > 0x7e ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// character code that starts user comments and GPS processing methods
+static const uint8_t ascii_code[8] = { 'A', 'S', 'C', 'I', 'I', 0, 0, 0 };
+
+static void json_put_values( json_writer_t *w, const ifd_values_t *values )
+{
+    const uint8_t *data = values->data;
+    if ( TIFF_UNDEFINED == values->type && 1 == values->item_size &&
+         values->count > sizeof(ascii_code) &&
+         0 == memcmp( data, ascii_code, sizeof(ascii_code) ) &&
+         is_text( data + sizeof(ascii_code),
+                  values->count - sizeof(ascii_code) ) ) {
+        json_put_string( w, data + sizeof(ascii_code),
+                         values->count - sizeof(ascii_code) );
+        return;
+    }
+    bool text = ( TIFF_STRING == values->type ) ||
+                ( TIFF_UNDEFINED == values->type &&
+                  is_text( data, values->count ) );
+    if ( text && 1 == values->item_size ) {
+        json_put_string( w, data, values->count );
+        return;
+    }
+    if ( 1 == values->count ) {
+        json_put_number( w, values, 0 );
+        return;
+    }
+    json_put_char( w, '[' );
+    for ( uint32_t i = 0; i < values->count; ++i ) {
+        if ( 0 != i ) {
+            json_put_char( w, ',' );
+        }
+        json_put_number( w, values, i );
+    }
+    json_put_char( w, ']' );
+}
+
+static const char *ifd_names[_IFD_N] = {
+    "Primary", "Thumbnail", "Exif", "GPS", "Interoperability"
+};
+
+static void json_put_desc( json_writer_t *w, exif_desc_t *desc )
+{
+    bool first_ifd = true;
+    json_put_char( w, '{' );
+    for ( ifd_id_t id = PRIMARY; id < _IFD_N; ++id ) {
+        ifd_table_t *table = desc->ifds[id];
+        if ( NULL == table ) {
+            continue;
+        }
+        if ( ! first_ifd ) {
+            json_put_char( w, ',' );
+        }
+        first_ifd = false;
+        json_put_char( w, '"' );
+        json_put( w, ifd_names[id], strlen( ifd_names[id] ) );
+        json_put( w, "\":{", 3 );
+
+        bool first_tag = true;
+        for ( uint16_t i = 0; i < table->n_entries; ++i ) {
+            ifd_entry_t *entry = &table->entries[i];
+            if ( entry->deferred ) {
+                exif_load_ifd_entry( desc, id, entry );
+            }
+            if ( NULL == entry->values ) {
+                continue;                   // failed lazy loading
+            }
+            if ( ! first_tag ) {
+                json_put_char( w, ',' );
+            }
+            first_tag = false;
+            json_put_name( w, id, entry->tag );
+            json_put_char( w, ':' );
+            json_put_values( w, entry->values );
+        }
+        json_put_char( w, '}' );
+    }
+    json_put_char( w, '}' );
+}
+
+extern size_t exif_write_json( exif_desc_t *desc, char *buf, size_t cap )
+{
+    if ( NULL == desc ) {
+        return 0;
+    }
+    json_writer_t w = { buf, ( NULL == buf ) ? 0 : cap, 0, false, false };
+    json_put_desc( &w, desc );
+    if ( w.len < w.cap ) {
+        w.buf[w.len] = 0;
+    }
+    return w.len;
+}
+
+extern size_t exif_write_json_grow( exif_desc_t *desc, char **buf, size_t *cap )
+{
+    if ( NULL == desc || NULL == buf || NULL == cap ) {
+        return 0;
+    }
+    json_writer_t w = { *buf, ( NULL == *buf ) ? 0 : *cap, 0, true, false };
+    json_put_desc( &w, desc );
+    *buf = w.buf;
+    *cap = w.cap;
+    if ( w.failed ) {
+        return 0;
+    }
+    w.buf[w.len] = 0;
+    return w.len;
+}
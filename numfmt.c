@@ -0,0 +1,304 @@
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "numfmt.h"
+
+extern size_t numfmt_uint32( uint32_t value, char *buf )
+{
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)( '0' + value % 10 );
+        value /= 10;
+    } while ( 0 != value );
+    for ( size_t i = 0; i < n; ++i ) {
+        buf[i] = digits[n - 1 - i];
+    }
+    return n;
+}
+
+extern size_t numfmt_int32( int32_t value, char *buf )
+{
+    if ( value < 0 ) {
+        *buf = '-';
+        return 1 + numfmt_uint32( 0u - (uint32_t)value, buf + 1 );
+    }
+    return numfmt_uint32( (uint32_t)value, buf );
+}
+
+/*
+    Grisu2 (Florian Loitsch, "Printing floating-point numbers quickly and
+    accurately with integers", PLDI 2010).
+
+    The double and the boundaries of its rounding interval are scaled by a
+    cached power of ten, so that their integer parts have a few digits, and
+    the digits are generated from 64-bit integers until they are within the
+    interval. The result always reads back as the same double, and is the
+    shortest one in more than 99.9% of the cases.
+*/
+
+typedef struct {
+    uint64_t    f;                  // significand
+    int         e;                  // binary exponent
+} diy_fp_t;
+
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS    ( 0x3ff + DP_SIGNIFICAND_SIZE )
+#define DP_HIDDEN_BIT       ( (uint64_t)1 << DP_SIGNIFICAND_SIZE )
+#define DP_SIGNIFICAND_MASK ( DP_HIDDEN_BIT - 1 )
+#define DP_EXPONENT_MASK    ( (uint64_t)0x7ff << DP_SIGNIFICAND_SIZE )
+#define DP_SIGN_MASK        ( (uint64_t)1 << 63 )
+
+// 10^k for k = -348, -340, ... 340, normalized with the highest bit set
+static const diy_fp_t cached_powers[] = {
+    { 0xfa8fd5a0081c0288u, -1220 }, { 0xbaaee17fa23ebf76u, -1193 },
+    { 0x8b16fb203055ac76u, -1166 }, { 0xcf42894a5dce35eau, -1140 },
+    { 0x9a6bb0aa55653b2du, -1113 }, { 0xe61acf033d1a45dfu, -1087 },
+    { 0xab70fe17c79ac6cau, -1060 }, { 0xff77b1fcbebcdc4fu, -1034 },
+    { 0xbe5691ef416bd60cu, -1007 }, { 0x8dd01fad907ffc3cu,  -980 },
+    { 0xd3515c2831559a83u,  -954 }, { 0x9d71ac8fada6c9b5u,  -927 },
+    { 0xea9c227723ee8bcbu,  -901 }, { 0xaecc49914078536du,  -874 },
+    { 0x823c12795db6ce57u,  -847 }, { 0xc21094364dfb5637u,  -821 },
+    { 0x9096ea6f3848984fu,  -794 }, { 0xd77485cb25823ac7u,  -768 },
+    { 0xa086cfcd97bf97f4u,  -741 }, { 0xef340a98172aace5u,  -715 },
+    { 0xb23867fb2a35b28eu,  -688 }, { 0x84c8d4dfd2c63f3bu,  -661 },
+    { 0xc5dd44271ad3cdbau,  -635 }, { 0x936b9fcebb25c996u,  -608 },
+    { 0xdbac6c247d62a584u,  -582 }, { 0xa3ab66580d5fdaf6u,  -555 },
+    { 0xf3e2f893dec3f126u,  -529 }, { 0xb5b5ada8aaff80b8u,  -502 },
+    { 0x87625f056c7c4a8bu,  -475 }, { 0xc9bcff6034c13053u,  -449 },
+    { 0x964e858c91ba2655u,  -422 }, { 0xdff9772470297ebdu,  -396 },
+    { 0xa6dfbd9fb8e5b88fu,  -369 }, { 0xf8a95fcf88747d94u,  -343 },
+    { 0xb94470938fa89bcfu,  -316 }, { 0x8a08f0f8bf0f156bu,  -289 },
+    { 0xcdb02555653131b6u,  -263 }, { 0x993fe2c6d07b7facu,  -236 },
+    { 0xe45c10c42a2b3b06u,  -210 }, { 0xaa242499697392d3u,  -183 },
+    { 0xfd87b5f28300ca0eu,  -157 }, { 0xbce5086492111aebu,  -130 },
+    { 0x8cbccc096f5088ccu,  -103 }, { 0xd1b71758e219652cu,   -77 },
+    { 0x9c40000000000000u,   -50 }, { 0xe8d4a51000000000u,   -24 },
+    { 0xad78ebc5ac620000u,     3 }, { 0x813f3978f8940984u,    30 },
+    { 0xc097ce7bc90715b3u,    56 }, { 0x8f7e32ce7bea5c70u,    83 },
+    { 0xd5d238a4abe98068u,   109 }, { 0x9f4f2726179a2245u,   136 },
+    { 0xed63a231d4c4fb27u,   162 }, { 0xb0de65388cc8ada8u,   189 },
+    { 0x83c7088e1aab65dbu,   216 }, { 0xc45d1df942711d9au,   242 },
+    { 0x924d692ca61be758u,   269 }, { 0xda01ee641a708deau,   295 },
+    { 0xa26da3999aef774au,   322 }, { 0xf209787bb47d6b85u,   348 },
+    { 0xb454e4a179dd1877u,   375 }, { 0x865b86925b9bc5c2u,   402 },
+    { 0xc83553c5c8965d3du,   428 }, { 0x952ab45cfa97a0b3u,   455 },
+    { 0xde469fbd99a05fe3u,   481 }, { 0xa59bc234db398c25u,   508 },
+    { 0xf6c69a72a3989f5cu,   534 }, { 0xb7dcbf5354e9beceu,   561 },
+    { 0x88fcf317f22241e2u,   588 }, { 0xcc20ce9bd35c78a5u,   614 },
+    { 0x98165af37b2153dfu,   641 }, { 0xe2a0b5dc971f303au,   667 },
+    { 0xa8d9d1535ce3b396u,   694 }, { 0xfb9b7cd9a4a7443cu,   720 },
+    { 0xbb764c4ca7a44410u,   747 }, { 0x8bab8eefb6409c1au,   774 },
+    { 0xd01fef10a657842cu,   800 }, { 0x9b10a4e5e9913129u,   827 },
+    { 0xe7109bfba19c0c9du,   853 }, { 0xac2820d9623bf429u,   880 },
+    { 0x80444b5e7aa7cf85u,   907 }, { 0xbf21e44003acdd2du,   933 },
+    { 0x8e679c2f5e44ff8fu,   960 }, { 0xd433179d9c8cb841u,   986 },
+    { 0x9e19db92b4e31ba9u,  1013 }, { 0xeb96bf6ebadf77d9u,  1039 },
+    { 0xaf87023b9bf0ee6bu,  1066 }
+};
+
+static inline diy_fp_t diy_fp_mul( diy_fp_t x, diy_fp_t y )
+{
+    const uint64_t m32 = 0xffffffffu;
+    uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = ( bd >> 32 ) + ( ad & m32 ) + ( bc & m32 );
+    tmp += 1u << 31;                        // round
+    diy_fp_t r = { ac + ( ad >> 32 ) + ( bc >> 32 ) + ( tmp >> 32 ),
+                   x.e + y.e + 64 };
+    return r;
+}
+
+static inline diy_fp_t diy_fp_normalize( diy_fp_t x )
+{
+    int shift = __builtin_clzll( x.f );
+    diy_fp_t r = { x.f << shift, x.e - shift };
+    return r;
+}
+
+// the boundaries m- and m+ of the interval of numbers that round to the
+// double v, normalized with the same exponent.
+static void normalized_boundaries( diy_fp_t v, diy_fp_t *minus,
+                                   diy_fp_t *plus )
+{
+    diy_fp_t p = { ( v.f << 1 ) + 1, v.e - 1 };
+    p = diy_fp_normalize( p );
+    diy_fp_t m;
+    if ( DP_HIDDEN_BIT == v.f ) {           // closer lower boundary
+        m.f = ( v.f << 2 ) - 1;
+        m.e = v.e - 2;
+    } else {
+        m.f = ( v.f << 1 ) - 1;
+        m.e = v.e - 1;
+    }
+    m.f <<= m.e - p.e;
+    m.e = p.e;
+    *minus = m;
+    *plus = p;
+}
+
+// the cached power c = 10^-k such that the exponent of e * c is in [-60, -32]
+static diy_fp_t get_cached_power( int e, int *k )
+{
+    double dk = ( -61 - e ) * 0.30102999566398114 + 347;    // log10(2)
+    int ik = (int)dk;
+    if ( dk - ik > 0.0 ) {
+        ++ik;
+    }
+    unsigned index = (unsigned)( ( ik >> 3 ) + 1 );
+    *k = -( -348 + (int)( index << 3 ) );
+    return cached_powers[index];
+}
+
+static const uint32_t pow10_32[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static inline int count_decimal_digits( uint32_t n )
+{
+    int count = 1;
+    while ( count < 10 && n >= pow10_32[count] ) {
+        ++count;
+    }
+    return count;
+}
+
+// move the last digit down while the result stays within the interval and
+// gets closer to the exact value
+static void grisu_round( char *buf, int len, uint64_t delta, uint64_t rest,
+                         uint64_t ten_kappa, uint64_t wp_w )
+{
+    while ( rest < wp_w && delta - rest >= ten_kappa &&
+            ( rest + ten_kappa < wp_w ||
+              wp_w - rest > rest + ten_kappa - wp_w ) ) {
+        --buf[len - 1];
+        rest += ten_kappa;
+    }
+}
+
+static int generate_digits( diy_fp_t w, diy_fp_t mp, uint64_t delta,
+                            char *buf, int *k )
+{
+    diy_fp_t one = { (uint64_t)1 << -mp.e, mp.e };
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)( mp.f >> -one.e );     // integer part
+    uint64_t p2 = mp.f & ( one.f - 1 );             // fractional part
+    int kappa = count_decimal_digits( p1 );
+    int len = 0;
+
+    while ( kappa > 0 ) {
+        uint32_t d = p1 / pow10_32[kappa - 1];
+        p1 %= pow10_32[kappa - 1];
+        if ( 0 != d || 0 != len ) {
+            buf[len++] = (char)( '0' + d );
+        }
+        --kappa;
+        uint64_t rest = ( (uint64_t)p1 << -one.e ) + p2;
+        if ( rest <= delta ) {
+            *k += kappa;
+            grisu_round( buf, len, delta, rest,
+                         (uint64_t)pow10_32[kappa] << -one.e, wp_w );
+            return len;
+        }
+    }
+    while ( true ) {                        // kappa <= 0
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)( p2 >> -one.e );
+        if ( 0 != d || 0 != len ) {
+            buf[len++] = (char)( '0' + d );
+        }
+        p2 &= one.f - 1;
+        --kappa;
+        if ( p2 < delta ) {
+            *k += kappa;
+            int index = -kappa;
+            grisu_round( buf, len, delta, p2, one.f,
+                         wp_w * ( index < 10 ? pow10_32[index] : 0 ) );
+            return len;
+        }
+    }
+}
+
+// the digits of the positive, finite and non-zero value v = digits * 10^k
+static int grisu2( diy_fp_t v, char *buf, int *k )
+{
+    diy_fp_t minus, plus;
+    normalized_boundaries( v, &minus, &plus );
+    diy_fp_t c_mk = get_cached_power( plus.e, k );
+    diy_fp_t w = diy_fp_mul( diy_fp_normalize( v ), c_mk );
+    diy_fp_t wp = diy_fp_mul( plus, c_mk );
+    diy_fp_t wm = diy_fp_mul( minus, c_mk );
+    ++wm.f;                                 // stay strictly inside
+    --wp.f;
+    return generate_digits( w, wp, wp.f - wm.f, buf, k );
+}
+
+static size_t write_exponent( int e, char *buf )
+{
+    size_t n = 0;
+    buf[n++] = 'e';
+    buf[n++] = ( e < 0 ) ? '-' : '+';
+    return n + numfmt_uint32( (uint32_t)( ( e < 0 ) ? -e : e ), buf + n );
+}
+
+// format the len digits in buf, which represent digits * 10^k
+static size_t prettify( char *buf, int len, int k )
+{
+    int kk = len + k;                       // 10^(kk-1) <= v < 10^kk
+    if ( 0 <= k && kk <= 21 ) {             // 1234e7 -> 12340000000
+        memset( buf + len, '0', (size_t)k );
+        return (size_t)kk;
+    }
+    if ( 0 < kk && kk <= 21 ) {             // 1234e-2 -> 12.34
+        memmove( buf + kk + 1, buf + kk, (size_t)( len - kk ) );
+        buf[kk] = '.';
+        return (size_t)len + 1;
+    }
+    if ( -6 < kk && kk <= 0 ) {             // 1234e-6 -> 0.001234
+        int offset = 2 - kk;
+        memmove( buf + offset, buf, (size_t)len );
+        buf[0] = '0';
+        buf[1] = '.';
+        memset( buf + 2, '0', (size_t)( offset - 2 ) );
+        return (size_t)( len + offset );
+    }
+    if ( 1 == len ) {                       // 1e30
+        return 1 + write_exponent( kk - 1, buf + 1 );
+    }
+    memmove( buf + 2, buf + 1, (size_t)( len - 1 ) );   // 1234e30 -> 1.234e33
+    buf[1] = '.';
+    return (size_t)len + 1 + write_exponent( kk - 1, buf + len + 1 );
+}
+
+extern size_t numfmt_double( double value, char *buf )
+{
+    uint64_t u;
+    memcpy( &u, &value, sizeof(u) );
+    size_t n = 0;
+    if ( 0 != ( u & DP_SIGN_MASK ) ) {
+        buf[n++] = '-';
+    }
+    uint64_t exponent = ( u & DP_EXPONENT_MASK ) >> DP_SIGNIFICAND_SIZE;
+    diy_fp_t v = { u & DP_SIGNIFICAND_MASK, 1 - DP_EXPONENT_BIAS };
+    if ( 0x7ff == exponent ) {
+        if ( 0 != v.f ) {
+            memcpy( buf, "nan", 3 );
+            return 3;
+        }
+        memcpy( buf + n, "inf", 3 );
+        return n + 3;
+    }
+    if ( 0 == exponent && 0 == v.f ) {
+        buf[n] = '0';
+        return n + 1;
+    }
+    if ( 0 != exponent ) {                  // normalized
+        v.f += DP_HIDDEN_BIT;
+        v.e = (int)exponent - DP_EXPONENT_BIAS;
+    }
+    int k;
+    int len = grisu2( v, buf + n, &k );
+    return n + prettify( buf + n, len, k );
+}
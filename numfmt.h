@@ -0,0 +1,23 @@
+#ifndef __NUMFMT_H__
+#define __NUMFMT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Locale independent number formatting, without stdio. Each function writes
+// the characters of the number in buf, without terminating 0, and returns
+// their count, which is never more than NUMFMT_MAX_SIZE.
+#define NUMFMT_MAX_SIZE     32
+
+extern size_t numfmt_uint32( uint32_t value, char *buf );
+extern size_t numfmt_int32( int32_t value, char *buf );
+
+// the shortest digits that read back as the same double in most cases, and
+// always digits that read back as the same double (Grisu2). Numbers are
+// written in decimal notation if they have at most 21 integer digits or 6
+// leading fractional zeros, in exponent notation otherwise (e.g. 1e+30).
+// Infinities and NaN, which have no decimal representation, are written as
+// "inf", "-inf" and "nan".
+extern size_t numfmt_double( double value, char *buf );
+
+#endif /* __NUMFMT_H__ */
@@ -4,8 +4,18 @@
 
 #include "exif.h"
 #include "parse.h"
-
-typedef void (parse_tag_fct)( ifd_desc_t *ifdd );
+#include "swap.h"
+#include "schema.h"
+
+// Byte order specific decoding, instantiated for each byte order so that
+// big_endian is a constant in each instance (see tiff_get_decoder): the IFD
+// walker, and conversion of value arrays read as is to the native byte order.
+struct _tiff_decoder {
+    bool (*parse_entries)( ifd_desc_t *ifdd, ifd_table_t *table,
+                           uint16_t n_entries );
+    void (*load_uint16_array)( uint16_t *values, uint32_t n );
+    void (*load_uint32_array)( uint32_t *values, uint32_t n );
+};
 
 static inline bool check_entry_type( ifd_desc_t *ifdd )
 {
@@ -29,29 +39,61 @@ static uint32_t tiff_type_size[] = { /* unused */           0,
                                      /* TIFF_FLOAT */       FLOAT_SIZE,
                                      /* TIFF_DOUBLE */      DOUBLE_SIZE };
 
+// record a diagnostic about the current entry in the descriptor
+static void add_diagnostic( ifd_desc_t *ifdd, exif_diagnostic_code_t code )
+{
+    exif_desc_t *desc = ifdd->desc;
+    if ( desc->n_diagnostics < EXIF_MAX_DIAGNOSTICS ) {
+        exif_diagnostic_t *diag = &desc->diagnostics[desc->n_diagnostics];
+        diag->code = code;
+        diag->id = ifdd->id;
+        diag->tag = ifdd->tag;
+        diag->type = ifdd->type;
+        diag->count = ifdd->count;
+    }
+    ++desc->n_diagnostics;
+}
+
 static inline bool is_direct_value( ifd_desc_t *ifdd )
 {
-    uint32_t n_bytes = ifdd->count * tiff_type_size[ifdd->type];
+    uint64_t n_bytes = (uint64_t)ifdd->count * tiff_type_size[ifdd->type];
     if ( n_bytes > 0 && n_bytes <= 4 ) {
         return true;
     }
     return false;
 }
 
-static inline void ifdd_map_insert_array( ifd_desc_t *ifdd, vector_t *array )
+// In lazy mode, entries are kept in the IFD table once their type and count
+// have been checked, but their values are not read: they are loaded on demand,
+// through the same parsing functions, by exif_load_ifd_entry. Returns true if
+// the values must not be loaded now.
+static bool defer_values( ifd_desc_t *ifdd )
 {
-    size_t key = make_key_from_tag( ifdd->tag ); // force key to be non-zero
-    if ( map_insert_entry( ifdd->content, (void *)key, array ) ) {
-        return;     // success...
+    if ( ! ifdd->lazy ) {
+        return false;
     }
-    // failed to insert this entry, perhaps same as a previous one?
-    vector_t *previous_array =
-                    (vector_t *)map_lookup_entry( ifdd->content, (void *)key);
-    if ( NULL != previous_array ) {
-        map_delete_entry( ifdd->content, (void *)key ); // rid of previous entry
-        vector_free( previous_array );
+    ifdd->entry->deferred = true;
+    return true;
+}
+
+// allocate in the descriptor arena n items of item_size bytes for the current
+// tag and attach them to the current entry. Returns the uninitialized item
+// array, or NULL if no memory is available.
+static void *new_tag_values( ifd_desc_t *ifdd, size_t item_size, uint32_t n )
+{
+    ifd_values_t *values = arena_alloc( &ifdd->desc->arena,
+                                        sizeof(ifd_values_t) + item_size * n );
+    if ( NULL == values ) {
+        return NULL;
     }
-    map_insert_entry( ifdd->content, (void *)key, array );
+    values->next = NULL;
+    values->vector = NULL;
+    values->data = values + 1;
+    values->count = n;
+    values->item_size = (uint16_t)item_size;
+    values->type = ifdd->type;
+    ifdd->entry->values = values;
+    return values + 1;
 }
 
 static inline void add_tag_direct_byte_values( ifd_desc_t *ifdd )
@@ -59,9 +101,14 @@ static inline void add_tag_direct_byte_values( ifd_desc_t *ifdd )
     uint8_t val[4] = { 0 };     // max 4 bytes in direct entry value
                                 // bytes are left-justified in field
     *(uint32_t *)val = ifdd->valoff;
-    assert( ifdd->count <= 4 );
-    vector_t *array = new_vector_from_data( val, BYTE_SIZE, ifdd->count );
-    ifdd_map_insert_array( ifdd, array );
+    if ( ifdd->count > 4 ) {
+        add_diagnostic( ifdd, EXIF_INVALID_COUNT );
+        return;
+    }
+    uint8_t *array = new_tag_values( ifdd, BYTE_SIZE, ifdd->count );
+    if ( NULL != array ) {
+        memcpy( array, val, ifdd->count );
+    }
 }
 
 static inline void add_tag_direct_short_values( ifd_desc_t *ifdd )
@@ -70,77 +117,105 @@ static inline void add_tag_direct_short_values( ifd_desc_t *ifdd )
                                 // shorts are left-justified in field
     val[0] = tiff_endianize_uint16(ifdd->desc, (uint16_t)(ifdd->valoff));
     val[1] = tiff_endianize_uint16(ifdd->desc, (uint16_t)(ifdd->valoff >> 16));
-    assert( ifdd->count <= 2 );
-    vector_t *array = new_vector_from_data( val, SHORT_SIZE, ifdd->count );
-    ifdd_map_insert_array( ifdd, array );
+    if ( ifdd->count > 2 ) {
+        add_diagnostic( ifdd, EXIF_INVALID_COUNT );
+        return;
+    }
+    uint16_t *array = new_tag_values( ifdd, SHORT_SIZE, ifdd->count );
+    if ( NULL != array ) {
+        memcpy( array, val, SHORT_SIZE * ifdd->count );
+    }
 }
 
 static inline void add_tag_direct_long_values( ifd_desc_t *ifdd )
 {
     uint32_t val;               // exactly 1 long in direct entry value
 
+    if ( ifdd->count != 1 ) {
+        add_diagnostic( ifdd, EXIF_INVALID_COUNT );
+        return;
+    }
     val = tiff_endianize_uint32(ifdd->desc, ifdd->valoff);
-    assert( ifdd->count == 1 );
-    vector_t *array = new_vector_from_data( &val, LONG_SIZE, 1 );
-    ifdd_map_insert_array( ifdd, array );
+    uint32_t *array = new_tag_values( ifdd, LONG_SIZE, 1 );
+    if ( NULL != array ) {
+        array[0] = val;
+    }
 }
 
 static inline void move_file_position_to_offset( ifd_desc_t *ifdd )
 {
     uint32_t offset = tiff_endianize_uint32( ifdd->desc, ifdd->valoff );
-    ifdd->saved_pos = ftell( ifdd->desc->file );
-    fseek( ifdd->desc->file, ifdd->desc->header + offset, SEEK_SET );
+    ifdd->saved_pos = tiff_get_position( ifdd->desc );
+    tiff_set_position( ifdd->desc, offset );
 }
 
 static inline void restore_file_position( ifd_desc_t *ifdd )
 {
-    fseek( ifdd->desc->file, ifdd->saved_pos, SEEK_SET );
+    tiff_set_position( ifdd->desc, ifdd->saved_pos );
+}
+
+// check that count values of item_size bytes can be read at the entry offset
+// before they are allocated, since a bogus count would otherwise allocate up
+// to 32 GB. Records a diagnostic and returns false if they cannot be read.
+static bool check_offset_values( ifd_desc_t *ifdd, uint32_t item_size )
+{
+    uint32_t offset = tiff_endianize_uint32( ifdd->desc, ifdd->valoff );
+    if ( tiff_has_data( ifdd->desc, offset,
+                        (uint64_t)ifdd->count * item_size ) ) {
+        return true;
+    }
+    add_diagnostic( ifdd, EXIF_INVALID_COUNT );
+    return false;
 }
 
 static inline void add_tag_indirect_byte_values( ifd_desc_t *ifdd )
 {
-    vector_t *array = new_vector( BYTE_SIZE, ifdd->count );
+    if ( ! check_offset_values( ifdd, BYTE_SIZE ) ) {
+        return;
+    }
+    uint8_t *array = new_tag_values( ifdd, BYTE_SIZE, ifdd->count );
     if ( NULL != array ) {
         move_file_position_to_offset( ifdd );
-        for ( uint32_t i = 0; i < ifdd->count; ++i ) {
-            uint8_t byte = getc( ifdd->desc->file );
-            vector_write_item_at( array, i, &byte );
-        }
-        ifdd_map_insert_array( ifdd, array );
+        tiff_get_bytes( ifdd->desc, array, ifdd->count );
         restore_file_position( ifdd );
     }
 }
 
 static inline void add_tag_indirect_short_values( ifd_desc_t *ifdd )
 {
-    vector_t *array = new_vector( SHORT_SIZE, ifdd->count );
+    if ( ! check_offset_values( ifdd, SHORT_SIZE ) ) {
+        return;
+    }
+    uint16_t *array = new_tag_values( ifdd, SHORT_SIZE, ifdd->count );
     if ( NULL != array ) {
         move_file_position_to_offset( ifdd );
-        for ( uint32_t i = 0; i < ifdd->count; ++i ) {
-            uint16_t word = tiff_get_uint16( ifdd->desc );
-            vector_write_item_at( array, i, &word );
-        }
-        ifdd_map_insert_array( ifdd, array );
+        tiff_get_bytes( ifdd->desc, (uint8_t *)array,
+                        (size_t)ifdd->count * SHORT_SIZE );
+        ifdd->desc->decoder->load_uint16_array( array, ifdd->count );
         restore_file_position( ifdd );
     }
 }
 
 static inline void add_tag_indirect_long_values( ifd_desc_t *ifdd )
 {
-    vector_t *array = new_vector( SHORT_SIZE, ifdd->count );
+    if ( ! check_offset_values( ifdd, LONG_SIZE ) ) {
+        return;
+    }
+    uint32_t *array = new_tag_values( ifdd, LONG_SIZE, ifdd->count );
     if ( NULL != array ) {
         move_file_position_to_offset( ifdd );
-        for ( uint32_t i = 0; i < ifdd->count; ++i ) {
-            uint32_t lword = tiff_get_uint32( ifdd->desc );
-            vector_write_item_at( array, i, &lword );
-        }
-        ifdd_map_insert_array( ifdd, array );
+        tiff_get_bytes( ifdd->desc, (uint8_t *)array,
+                        (size_t)ifdd->count * LONG_SIZE );
+        ifdd->desc->decoder->load_uint32_array( array, ifdd->count );
         restore_file_position( ifdd );
     }
 }
 
 static void add_tag_byte_values( ifd_desc_t *ifdd )
 {
+    if ( defer_values( ifdd ) ) {
+        return;
+    }
     if ( is_direct_value( ifdd ) ) {
         add_tag_direct_byte_values( ifdd );
     } else {
@@ -150,6 +225,9 @@ static void add_tag_byte_values( ifd_desc_t *ifdd )
 
 static void add_tag_short_values( ifd_desc_t *ifdd )
 {
+    if ( defer_values( ifdd ) ) {
+        return;
+    }
     if ( is_direct_value( ifdd ) ) {
         add_tag_direct_short_values( ifdd );
     } else {
@@ -159,6 +237,9 @@ static void add_tag_short_values( ifd_desc_t *ifdd )
 
 static void add_tag_long_values( ifd_desc_t *ifdd )
 {
+    if ( defer_values( ifdd ) ) {
+        return;
+    }
     if ( is_direct_value( ifdd ) ) {
         add_tag_direct_long_values( ifdd );
     } else {
@@ -166,7 +247,7 @@ static void add_tag_long_values( ifd_desc_t *ifdd )
     }
 }
 
-// add a map entry with key=tag and count value=integers of 8, 16 or 32 bits
+// add values for the current tag, count integers of 8, 16 or 32 bits
 // item_size.
 static void add_tag_int_values( ifd_desc_t *ifdd )
 {
@@ -188,662 +269,454 @@ static void add_tag_int_values( ifd_desc_t *ifdd )
 // a matter of interpreting what has been stored here.
 static void add_tag_rational_values( ifd_desc_t *ifdd )
 {
+    if ( defer_values( ifdd ) ) {
+        return;
+    }
     // since a rational id too big to fit in valoff, no direct values here
-    vector_t *array = new_vector( RATIONAL_SIZE, ifdd->count );
+    if ( ! check_offset_values( ifdd, RATIONAL_SIZE ) ) {
+        return;
+    }
+    uint32_t *array = new_tag_values( ifdd, RATIONAL_SIZE, ifdd->count );
     if ( NULL != array ) {
-        move_file_position_to_offset( ifdd );
-        for ( uint32_t i = 0; i < ifdd->count; ++i ) {
-            uint32_t rational[2];
-            rational[0] = tiff_get_uint32( ifdd->desc );
-            rational[1] = tiff_get_uint32( ifdd->desc );
-            vector_write_item_at( array, i, rational );
-        }
-        ifdd_map_insert_array( ifdd, array );
+        move_file_position_to_offset( ifdd );     // numerator, denominator
+        tiff_get_bytes( ifdd->desc, (uint8_t *)array,
+                        (size_t)ifdd->count * RATIONAL_SIZE );
+        ifdd->desc->decoder->load_uint32_array( array, 2 * ifdd->count );
         restore_file_position( ifdd );
     }
 }
 
-static void process_n_unsigned_bytes( ifd_desc_t *ifdd, uint32_t n )
+// add values for the current tag as they are, once their type has been
+// accepted by the schema
+static void add_tag_values( ifd_desc_t *ifdd )
 {
-    if ( TIFF_UINT8 == ifdd->type && ( n == 0 || n == ifdd->count ) ) {
+    switch ( ifdd->type ) {
+    case TIFF_URATIONAL: case TIFF_RATIONAL:
+        add_tag_rational_values( ifdd );
+        break;
+    case TIFF_UNDEFINED:
         add_tag_byte_values( ifdd );
+        break;
+    default:
+        add_tag_int_values( ifdd );
+        break;
     }
 }
 
-// if n == 0 accept any count, otherwise accept only count == n
-static void process_n_unsigned_shorts( ifd_desc_t *ifdd, uint32_t n )
+static void process_jpeg_interchange_format( ifd_desc_t *ifdd )
 {
-    if ( TIFF_UINT16 == ifdd->type && ( n == 0 || n == ifdd->count ) ) {
-        add_tag_short_values( ifdd );
-    }
+    ifdd->desc->thumb_offset = tiff_endianize_uint32( ifdd->desc, ifdd->valoff );
 }
 
-// if u == 0 accept only if l <= count otherwise accept only if l <= count <= u
-static void process_min_max_unsigned_shorts( ifd_desc_t *ifdd,
-                                             uint32_t l, uint32_t u )
+static void process_jpeg_interchange_format_length( ifd_desc_t *ifdd )
 {
-    if ( TIFF_UINT16 == ifdd->type && l <= ifdd->count &&
-        ( 0 == u || u >= ifdd->count ) ) {
-        add_tag_short_values( ifdd );
-    }
+    ifdd->desc->thumb_size = tiff_endianize_uint32( ifdd->desc, ifdd->valoff );
 }
 
-static void process_ascii_string( ifd_desc_t *ifdd )
+static void process_embedded_ifd( ifd_desc_t *ifdd, ifd_id_t id )
 {
-    if ( TIFF_STRING == ifdd->type && ifdd->count > 0 ) {
-        add_tag_byte_values( ifdd );
+    if ( is_ifd_wanted( ifdd->desc, id ) ) {
+        move_file_position_to_offset( ifdd );
+        ifdd->desc->ifds[id] = exif_parse_ifd( ifdd->desc, id, NULL );
+        restore_file_position( ifdd );
     }
 }
 
-// if n == 0 accept any count, otherwise accept only count == n
-static void process_n_undefined_bytes( ifd_desc_t *ifdd, uint32_t n )
+static void process_unknown_tag( ifd_desc_t *ifdd )
 {
-    if ( TIFF_UNDEFINED == ifdd->type && (n == 0 || n == ifdd->count ) ) {
-        add_tag_byte_values( ifdd );
+    if ( ! ifdd->desc->control.skip_unknown_tags ) {
+        add_diagnostic( ifdd, EXIF_UNKNOWN_TAG );
     }
 }
 
-#if 0
-// if u == 0 accept only if l <= count otherwise accept only if l <= count <= u
-static void process_min_max_undefined_bytes( ifd_desc_t *ifdd,
-                                             uint32_t l, uint32_t u )
+static void process_version_string( ifd_desc_t *ifdd )
 {
-    if ( TIFF_UNDEFINED == ifdd->type && l <= ifdd->count &&
-        ( 0 == u || u >= ifdd->count ) ) {
-        add_tag_byte_values( ifdd );
+    if ( defer_values( ifdd ) ) {
+        return;
     }
-}
-#endif
-static void process_n_unsigned_shorts_longs( ifd_desc_t *ifdd, uint32_t n )
-{
-    switch ( ifdd->type ) {
-    case TIFF_UINT16: case TIFF_UINT32:
-        if ( 0 == n || n == ifdd->count ) {
-            add_tag_int_values( ifdd );
-        }
+    // 4 ascii chars fitting in valoff (non-zero terminated ascii string)
+    char buffer[5];
+    memcpy( buffer, &ifdd->valoff, 4 );
+    buffer[4] = 0;
+
+    uint8_t *array = new_tag_values( ifdd, BYTE_SIZE, 5 );
+    if ( NULL != array ) {
+        memcpy( array, buffer, 5 );
     }
 }
 
-static void process_n_unsigned_longs( ifd_desc_t *ifdd, uint32_t n )
+static void process_components_configuration( ifd_desc_t *ifdd )
 {
-    switch ( ifdd->type ) {
-    case TIFF_UINT32:
-        if ( 0 == n || n == ifdd->count ) {
-            add_tag_int_values( ifdd );
+    if ( defer_values( ifdd ) ) {
+        return;
+    }
+    char buffer[8];            // assuming no more than 4 components and
+    memset( buffer, 0, 8 );    // up to 2 char by component, e.g. "Cb"
+    // 4 bytes fit directly in valoff
+    char *config = (char *)(&ifdd->valoff);
+    int j = 0;
+    for ( size_t i = 0; i < ifdd->count; ++i ) {
+        switch( config[i] ) {
+        default: break;
+        case 1: buffer[j++] = 'Y'; break;
+        case 2: buffer[j++] = 'C'; buffer[j++] = 'b'; break;
+        case 3: buffer[j++] = 'C'; buffer[j++] = 'r'; break;
+        case 4: buffer[j++] = 'R'; break;
+        case 5: buffer[j++] = 'G'; break;
+        case 6: buffer[j++] = 'B'; break;
         }
     }
-}
-
-static void process_n_urationals( ifd_desc_t *ifdd, uint32_t n )
-{
-    if ( TIFF_URATIONAL == ifdd->type && ( n == 0 || n == ifdd->count ) ) {
-        add_tag_rational_values( ifdd );
+    buffer[j++] = '\0';
+    uint8_t *array = new_tag_values( ifdd, BYTE_SIZE, j );
+    if ( NULL != array ) {
+        memcpy( array, buffer, j );
     }
 }
 
-static void process_n_rationals( ifd_desc_t *ifdd, uint32_t n )
+static void process_user_comment( ifd_desc_t *ifdd )
 {
-    if ( TIFF_RATIONAL == ifdd->type && ( n == 0 || n == ifdd->count ) ) {
-        add_tag_rational_values( ifdd );
+    if ( defer_values( ifdd ) ) {
+        return;
     }
-}
-
-static void process_jpeg_interchange_format( ifd_desc_t *ifdd )
-{
-    if ( TIFF_UINT32 == ifdd->type && 1 == ifdd->count ) {
-        ifdd->desc->thumb_offset =
-                    tiff_endianize_uint32( ifdd->desc, ifdd->valoff );
+    // add a terminating 0
+    if ( UINT32_MAX == ifdd->count ) {
+        add_diagnostic( ifdd, EXIF_INVALID_COUNT );
+        return;
     }
-}
-
-static void process_jpeg_interchange_format_length( ifd_desc_t *ifdd )
-{
-    if ( TIFF_UINT32 == ifdd->type && 1 == ifdd->count ) {
-        ifdd->desc->thumb_size =
-                    tiff_endianize_uint32( ifdd->desc, ifdd->valoff );
+    if ( ! check_offset_values( ifdd, BYTE_SIZE ) ) {
+        return;
     }
-}
-
-static void process_embedded_ifd( ifd_desc_t *ifdd, ifd_id_t id )
-{
-    if ( TIFF_UINT32 == ifdd->type && 1 == ifdd->count ) {
+    uint8_t *array = new_tag_values( ifdd, BYTE_SIZE, ifdd->count + 1 );
+    if ( NULL != array ) {
         move_file_position_to_offset( ifdd );
-//printf("Switching to IFD if %d\n", id );
-        ifdd->desc->ifds[id] = exif_parse_ifd( ifdd->desc, id, NULL );
-//printf("Back from id %d\n", id );
+        tiff_get_bytes( ifdd->desc, array, ifdd->count );
+        array[ifdd->count] = 0;
         restore_file_position( ifdd );
     }
 }
 
-static void process_unknown_tag( ifd_desc_t *ifdd, ifd_id_t id )
+// the exif CFA pattern structure is transformed to a simple ascii string:
+// original structure: (uint16_t)n_h_repeat, (uin16_t)n_v_repeat, followed
+// by a n_h_repeat * n_v_repeat array of bytes is transformed into a zero
+// terminated string: "c .... c, ... , c .... c", where the comma ',' appears
+// after each group of n_h_repeat.
+static void process_cfa_pattern( ifd_desc_t *ifdd )
 {
-    if ( ! ifdd->desc->control.skip_unknown_tags ) {
-        printf( "Unknown tag 0x%04x type %d count %d in IFD %d\n",
-                ifdd->tag, ifdd->type, ifdd->count, id );
-        exit(1);
+    if ( defer_values( ifdd ) ) {
+        return;
     }
-}
-
-static void parse_tiff_tags( ifd_desc_t *ifdd, ifd_id_t id )
-{
-    switch( ifdd->tag ) {
-    case IMAGE_WIDTH_TAG: case IMAGE_LENGTH_TAG: case ROWS_PER_STRIP_TAG:
-    case TILE_WIDTH_TAG: case TILE_LENGTH_TAG: case TILE_BYTE_COUNTS_TAG:
-        process_n_unsigned_shorts_longs( ifdd, 1 );
-        break;
-
-    case STRIP_OFFSETS_TAG: case STRIP_BYTE_COUNTS_TAG:
-        process_n_unsigned_shorts_longs( ifdd, 0 );
-        break;
-
-    case TILE_OFFSETS_TAG:
-        process_n_unsigned_longs( ifdd, 1 );
-        break;
-
-    case BITS_PER_SAMPLE_TAG:
-        add_tag_int_values( ifdd ); /* 1 short by color component */
-        break;
-
-    case COMPRESSION_TAG: case PHOTOMETRIC_INTERPRETATION_TAG:
-    case ORIENTATION_TAG: case RESOLUTION_UNIT_TAG: case YCBCR_POSITIONING_TAG:
-    case SAMPLES_PER_PIXEL_TAG: case PLANAR_CONFIGURATION_TAG:
-
-    case RELATED_IMAGE_WIDTH_TAG:   // should not be in IFD 0, but sometimes is!
-    case RELATED_IMAGE_HEIGHT_TAG:  // should not be in IFD 0, but sometimes is!
-    case CUSTOM_RENDERED_TAG:   // should not be in IFD 0, but sometimes is!
-    case EXPOSURE_MODE_TAG:     // should not be in IFD 0, but sometimes is!
-    case WHITE_BALANCE_TAG:     // should not be in IFD 0, but sometimes is!
-    case FOCAL_LENGTH_IN_35MM_FILM_TAG: // should not be in IFD 0, but...
-    case SCENE_CAPTURE_TYPE_TAG:// should not be in IFD 0, but sometimes is!
-    case GAIN_CONTROL_TAG:      // should not be in IFD 0, but sometimes is!
-    case CONTRAST_TAG:          // should not be in IFD 0, but sometimes is!
-    case SATURATION_TAG:        // should not be in IFD 0, but sometimes is!
-    case SHARPNESS_TAG:         // should not be in IFD 0, but sometimes is!
-    case SUBJECT_DISTANCE_RANGE_TAG:    // should not be in IFD 0, but...
-        process_n_unsigned_shorts( ifdd, 1 );
-        break;
-
-    case YCBCR_SUBSAMPLING_TAG:
-        process_n_unsigned_shorts( ifdd, 2 );
-        break;
-
-    case PROCESSING_SOFTWARE:
-    case IMAGE_DESCRIPTION_TAG: case MAKE_TAG: case MODEL_TAG:
-    case SOFTWARE_TAG:  case DATE_TIME_TAG: case ARTIST_TAG:
-    case HOST_COMPUTER_TAG: case COPYRIGHT_TAG:
-        process_ascii_string( ifdd );
-        break;
-
-    case X_RESOLUTION_TAG: case Y_RESOLUTION_TAG:
-    case DIGITAL_ZOOM_RATIO_TAG: // should not be in IFD 0, but sometimes is!
-        process_n_rationals( ifdd, 1 );
-        break;
-
-    case WHITE_POINT_TAG:
-        process_n_rationals( ifdd, 2 );
-        break;
-
-    case YCBCR_COEFFICIENTS_TAG:
-        process_n_rationals( ifdd, 3 );
-        break;
-
-    case PRIMARY_CHROMACITIES_TAG: case REFERENCE_BLACK_WHITE_TAG:
-        process_n_rationals( ifdd, 6 );
-        break;
-
-    case JPEG_INTERCHANGE_FORMAT_TAG:
-        process_jpeg_interchange_format( ifdd );
-        break;
-
-    case JPEG_INTERCHANGE_FORMAT_LENGTH_TAG:
-        process_jpeg_interchange_format_length( ifdd );
-        break;
-
-    case EXIF_IFD_TAG:
-        process_embedded_ifd( ifdd, EXIF );
-        break;
-
-    case  GPS_IFD_TAG:
-        process_embedded_ifd( ifdd, GPS );
-        break;
-
-    case PANASONIC_TITLE: case PANASONIC_TITLE2: case XP_COMMENT:
-    case UNKNOWN_TAG1: case UNKNOWN_TAG2: case UNKNOWN_TAG3:
-    case UNKNOWN_TAG4: case UNKNOWN_TAG5: case UNKNOWN_TAG6:
-    case PADDING_TAG:  // just ignore
-        break;
+    if ( ifdd->count < 4 ) {
+        add_diagnostic( ifdd, EXIF_INVALID_CFA_PATTERN );
+        return;
+    }
+    if ( ! check_offset_values( ifdd, BYTE_SIZE ) ) {
+        return;
+    }
+    move_file_position_to_offset( ifdd );
+    uint32_t hz = (uint32_t)tiff_get_uint16( ifdd->desc );
+    uint32_t vt = (uint32_t)tiff_get_uint16( ifdd->desc );
 
-    case PRINT_IM_TAG:
-        process_n_undefined_bytes( ifdd, 0 );   // any number
-        break;
+    // as it is a byte array and endianess is not clearly specified,
+    // different tools generate different data: it seems that older
+    // microsoft tools do not use the proper endianess, so check here if
+    // the values are consistent with the total count:
 
-    default:
-        process_unknown_tag( ifdd, id );
+    if ( hz * vt != ifdd->count - 4 ) {
+        // need to change the endianess
+        uint32_t h = ((hz & 0xff) << 8) + (hz >> 8);
+        uint32_t v = ((vt & 0xff) << 8) + (vt >> 8 );
+        if ( h * v != ifdd->count - 4 ) {
+            restore_file_position( ifdd );
+            add_diagnostic( ifdd, EXIF_INVALID_CFA_PATTERN );
+            return;     // invalif repeat patterns
+        }
+        hz = h;
+        vt = v;
     }
-}
 
-static void parse_primary_tags( ifd_desc_t *ifdd )
-{
-    parse_tiff_tags( ifdd, PRIMARY );
+    uint32_t n = ( hz + 1 ) * vt;
+    char *array = new_tag_values( ifdd, BYTE_SIZE, n );
+    if ( NULL != array ) {
+        uint32_t k = 0;
+        for ( uint32_t i = 0; i < vt; ++i ) {
+            char c;
+            for ( uint32_t j = 0; j < hz; ++j ) {
+                uint8_t byte = tiff_get_uint8( ifdd->desc );
+                switch ( byte ) {
+                case 0: c = 'R'; break;
+                case 1: c = 'G'; break;
+                case 2: c = 'B'; break;
+                case 3: c = 'C'; break;
+                case 4: c = 'M'; break;
+                case 5: c = 'Y'; break;
+                case 6: c = 'W'; break;
+                default: c = '-'; break;
+                }
+                array[k++] = c;
+            }
+            if ( k == n-1 ) {
+                c = 0;
+            } else {
+                c = ',';
+            }
+            array[k++] = c;
+        }
+    }
+    restore_file_position( ifdd );
 }
 
-static void parse_thumbnail_tags( ifd_desc_t *ifdd )
+// process the current entry according to its schema row (see schema.h), or
+// as an unknown tag if it has none
+static void parse_tag( ifd_desc_t *ifdd, const tag_schema_t *schema )
 {
-    parse_tiff_tags( ifdd, THUMBNAIL );
+    if ( NULL == schema ) {
+        process_unknown_tag( ifdd );
+        return;
+    }
+    if ( ! schema_accepts( schema, ifdd->type, ifdd->count ) ) {
+        return;
+    }
+    switch ( schema->parse ) {
+    case PARSE_VALUES:          add_tag_values( ifdd ); break;
+    case PARSE_VERSION:         process_version_string( ifdd ); break;
+    case PARSE_COMPONENTS:      process_components_configuration( ifdd ); break;
+    case PARSE_USER_COMMENT:    process_user_comment( ifdd ); break;
+    case PARSE_CFA_PATTERN:     process_cfa_pattern( ifdd ); break;
+    case PARSE_THUMB_OFFSET:    process_jpeg_interchange_format( ifdd ); break;
+    case PARSE_THUMB_SIZE:
+        process_jpeg_interchange_format_length( ifdd );
+        break;
+    case PARSE_EXIF_IFD:        process_embedded_ifd( ifdd, EXIF ); break;
+    case PARSE_GPS_IFD:         process_embedded_ifd( ifdd, GPS ); break;
+    case PARSE_IOP_IFD:         process_embedded_ifd( ifdd, IOP ); break;
+    case PARSE_IGNORE:          break;
+    }
 }
 
-static void process_version_string( ifd_desc_t *ifdd )
+// In case of tag projection, entries that are not wanted are skipped, except
+// for those that locate embedded IFDs or the thumbnail image.
+static bool is_tag_wanted( ifd_desc_t *ifdd, const tag_schema_t *schema )
 {
-    if ( TIFF_UNDEFINED == ifdd->type && 4 == ifdd->count ) {
-        // 4 ascii chars fitting in valoff (non-zero terminated ascii string)
-        char buffer[5];
-        memcpy( buffer, &ifdd->valoff, 4 );
-        buffer[4] = 0;
-
-        vector_t *array = new_vector_from_data( buffer, BYTE_SIZE, 5 );
-        ifdd_map_insert_array( ifdd, array );
+    const exif_tag_set_t *wanted = ifdd->desc->control.wanted_tags[ifdd->id];
+    if ( NULL == wanted || exif_tag_set_has( wanted, ifdd->tag ) ) {
+        return true;
+    }
+    if ( NULL == schema ) {
+        return false;
+    }
+    switch ( schema->parse ) {
+    case PARSE_EXIF_IFD: case PARSE_GPS_IFD: case PARSE_IOP_IFD:
+    case PARSE_THUMB_OFFSET: case PARSE_THUMB_SIZE:
+        return true;
+    default:
+        break;
     }
+    return false;
 }
 
-static void process_components_configuration( ifd_desc_t *ifdd )
+// sort entries by tag, keeping only the last one in case of duplicate tags.
+// Since TIFF requires entries sorted by increasing tags, an insertion sort
+// is used: in most cases, it just checks that entries are already sorted.
+static void sort_ifd_table( ifd_table_t *table )
 {
-    if ( TIFF_UNDEFINED == ifdd->type && 4 >= ifdd->count ) {
-        char buffer[8];            // assuming no more than 4 components and
-        memset( buffer, 0, 8 );    // up to 2 char by component, e.g. "Cb"
-        // 4 bytes fit directly in valoff
-        char *config = (char *)(&ifdd->valoff);
-        int j = 0;
-        for ( size_t i = 0; i < ifdd->count; ++i ) {
-            switch( config[i] ) {
-            default: break;
-            case 1: buffer[j++] = 'Y'; break;
-            case 2: buffer[j++] = 'C'; buffer[j++] = 'b'; break;
-            case 3: buffer[j++] = 'C'; buffer[j++] = 'r'; break;
-            case 4: buffer[j++] = 'R'; break;
-            case 5: buffer[j++] = 'G'; break;
-            case 6: buffer[j++] = 'B'; break;
-            }
+    ifd_entry_t *entries = table->entries;
+    uint32_t n = 0;
+    for ( uint32_t i = 0; i < table->n_entries; ++i ) {
+        ifd_entry_t entry = entries[i];
+        uint32_t j = n;
+        while ( j > 0 && entries[j-1].tag > entry.tag ) {
+            --j;
         }
-        buffer[j++] = '\0';
-        vector_t *array = new_vector_from_data( buffer, BYTE_SIZE, j );
-        ifdd_map_insert_array( ifdd, array );
+        if ( j > 0 && entries[j-1].tag == entry.tag ) {
+            entries[j-1] = entry;       // duplicate: last one wins
+            continue;
+        }
+        memmove( &entries[j+1], &entries[j], (n - j) * sizeof(ifd_entry_t) );
+        entries[j] = entry;
+        ++n;
     }
+    table->n_entries = (uint16_t)n;
 }
 
-static void process_user_comment( ifd_desc_t *ifdd )
+// Entries are read by chunks of IFD_CHUNK_ENTRIES entries, then decoded from
+// the chunk according to the byte order. Values beyond the entries are read
+// by parse_tag, which restores the position at the end of the chunk.
+#define IFD_CHUNK_ENTRIES   32
+
+static inline bool parse_ifd_entries( ifd_desc_t *ifdd, ifd_table_t *table,
+                                      uint16_t n_entries,
+                                      const bool big_endian )
 {
-    if ( TIFF_UNDEFINED == ifdd->type && 8 <= ifdd->count ) {
-        // add a terminating 0
-        vector_t *array = new_vector( BYTE_SIZE, ifdd->count + 1 );
-        if ( NULL != array ) {
-            move_file_position_to_offset( ifdd );
-            uint32_t i = 0;
-            uint8_t byte;
-            for ( ; i < ifdd->count; ++i ) {
-                byte = getc( ifdd->desc->file );
-                vector_write_item_at( array, i, &byte );
+    uint8_t chunk[IFD_CHUNK_ENTRIES * IFD_ENTRY_SIZE];
+    uint32_t n = 0;
+    const uint8_t *field = chunk;
+
+    for ( uint16_t i = 0; i < n_entries; ++i, --n, field += IFD_ENTRY_SIZE ) {
+        if ( 0 == n ) {
+            n = n_entries - i;
+            if ( n > IFD_CHUNK_ENTRIES ) {
+                n = IFD_CHUNK_ENTRIES;
             }
-            byte = 0;
-            vector_write_item_at( array, i, &byte );
-            ifdd_map_insert_array( ifdd, array );
-            restore_file_position( ifdd );
+            tiff_get_bytes( ifdd->desc, chunk, n * IFD_ENTRY_SIZE );
+            field = chunk;
+        }
+        ifdd->tag = tiff_load_uint16( big_endian, field );      // field tag
+        ifdd->type = tiff_load_uint16( big_endian, field + 2 ); // field type
+        ifdd->count = tiff_load_uint32( big_endian, field + 4 );// field count
+        memcpy( &ifdd->valoff, field + 8, VAL_OFF_SIZE );   // no endianess
+        if ( ! check_entry_type( ifdd ) ) {
+            add_diagnostic( ifdd, EXIF_ILLEGAL_TYPE );
+            return false;
+        }
+        const tag_schema_t *schema = schema_lookup( ifdd->id, ifdd->tag );
+        if ( ! is_tag_wanted( ifdd, schema ) ) {
+            continue;
+        }
+        ifd_entry_t *entry = &table->entries[table->n_entries];
+        entry->tag = ifdd->tag;
+        entry->type = ifdd->type;
+        entry->count = ifdd->count;
+        entry->valoff = ifdd->valoff;
+        entry->deferred = false;
+        entry->values = NULL;
+        ifdd->entry = entry;
+
+        parse_tag( ifdd, schema );
+        if ( entry->deferred || NULL != entry->values ) {
+            ++table->n_entries;         // otherwise entry is reused
         }
     }
+    return true;
 }
 
-// the exif CFA pattern structure is transformed to a simple ascii string:
-// original structure: (uint16_t)n_h_repeat, (uin16_t)n_v_repeat, followed
-// by a n_h_repeat * n_v_repeat array of bytes is transformed into a zero
-// terminated string: "c .... c, ... , c .... c", where the comma ',' appears
-// after each group of n_h_repeat.
-static void process_cfa_pattern( ifd_desc_t *ifdd )
+// convert arrays of values read as is to the native byte order
+static inline void load_uint16_array( uint16_t *values, uint32_t n,
+                                      const bool big_endian )
 {
-    if ( TIFF_UNDEFINED == ifdd->type && 4 < ifdd->count ) {
-        move_file_position_to_offset( ifdd );
-        uint32_t hz = (uint32_t)tiff_get_uint16( ifdd->desc );
-        uint32_t vt = (uint32_t)tiff_get_uint16( ifdd->desc );
-
-        // as it is a byte array and endianess is not clearly specified,
-        // different tools generate different data: it seems that older
-        // microsoft tools do not use the proper endianess, so check here if
-        // the values are consistent with the total count:
-
-        if ( hz * vt != ifdd->count - 4 ) {
-            // need to change the endianess
-            uint32_t h = ((hz & 0xff) << 8) + (hz >> 8);
-            uint32_t v = ((vt & 0xff) << 8) + (vt >> 8 );
-            if ( h * v != ifdd->count - 4 ) {
-                restore_file_position( ifdd );
-                printf("Invalid repeat patterns: hz=%d, vt=%d\n", hz, vt );
-                return;     // invalif repeat patterns
-            }
-            hz = h;
-            vt = v;
-        }
-
-        uint32_t n = ( hz + 1 ) * vt;
-        vector_t *array = new_vector( BYTE_SIZE, n );
-        if ( NULL != array ) {
-            uint32_t k = 0;
-            for ( uint32_t i = 0; i < vt; ++i ) {
-                char c;
-                for ( uint32_t j = 0; j < hz; ++j ) {
-                    uint8_t byte = getc( ifdd->desc->file );
-                    switch ( byte ) {
-                    case 0: c = 'R'; break;
-                    case 1: c = 'G'; break;
-                    case 2: c = 'B'; break;
-                    case 3: c = 'C'; break;
-                    case 4: c = 'M'; break;
-                    case 5: c = 'Y'; break;
-                    case 6: c = 'W'; break;
-                    default: c = '-'; break;
-                    }
-                    vector_write_item_at( array, k++, &c );
-                }
-                if ( k == n-1 ) {
-                    c = 0;
-                } else {
-                    c = ',';
-                }
-                vector_write_item_at( array, k++, &c );
-            }
-            ifdd_map_insert_array( ifdd, array );
-        }
-        restore_file_position( ifdd );
+    if ( big_endian != NATIVE_BIG_ENDIAN ) {
+        swap_uint16_array( values, n );
     }
 }
 
-static void parse_exif_tags( ifd_desc_t *ifdd )
+static inline void load_uint32_array( uint32_t *values, uint32_t n,
+                                      const bool big_endian )
 {
-    switch ( ifdd->tag ) {
-    case EXPOSURE_TIME_TAG: case FNUMBER_TAG:
-    case COMPRESSED_BITS_PER_PIXEL_TAG:
-    case APERTURE_VALUE_TAG:
-    case MAX_APERTURE_VALUE_TAG:
-    case SUBJECT_DISTANCE_TAG:
-    case FOCAL_LENGTH_TAG:
-    case EXPOSURE_INDEX_TAG:
-    case DIGITAL_ZOOM_RATIO_TAG:
-    case FOCAL_PLANE_X_RESOLUTION_TAG:
-    case FOCAL_PLANE_Y_RESOLUTION_TAG:
-        process_n_urationals( ifdd, 1 );
-        break;
-
-    case SHUTTER_SPEED_VALUE_TAG:   // signed rational
-    case BRIGHTNESS_VALUE_TAG:      // signed rational
-    case EXPOSURE_BIAS_VALUE_TAG:   // signed rational
-        process_n_rationals( ifdd, 1 );
-        break;
-
-    case EXPOSURE_PROGRAM_TAG: case ISO_SPEED_RATINGS_TAG:
-    case METERING_MODE_TAG: case LIGHT_SOURCE_TAG: case FLASH_TAG:
-    case COLOR_SPACE_TAG: case SENSING_METHOD_TAG:
-    case CUSTOM_RENDERED_TAG: case EXPOSURE_MODE_TAG:
-    case WHITE_BALANCE_TAG: case FOCAL_LENGTH_IN_35MM_FILM_TAG:
-    case SCENE_CAPTURE_TYPE_TAG: case GAIN_CONTROL_TAG:
-    case CONTRAST_TAG: case SATURATION_TAG: case SHARPNESS_TAG:
-    case SUBJECT_DISTANCE_RANGE_TAG: case FOCAL_PLANE_RESOLUTION_UNIT_TAG:
-    case COMPOSITE_IMAGE_TAG: case SENSITIVITY_TYPE_TAG:
-        process_n_unsigned_shorts( ifdd, 1 );
-        break;
-
-    case SPATIAL_FREQUENCY_RESPONSE_TAG:
-        process_n_unsigned_bytes( ifdd, 0 );
-        break;
-
-    case STANDARD_OUTPUT_SENSITIVITY_TAG: case RECOMMENDED_EXPOSURE_INDEX_TAG:
-        process_n_unsigned_longs( ifdd, 1 );
-        break;
-
-    case EXIF_VERSION_TAG: case FLASHPIX_VERSION_TAG:
-        process_version_string( ifdd );
-        break;
-
-    case DATE_TIME_ORIGINAL_TAG: case DATE_TIME_DIGITIZED_TAG:
-    case OFFSET_TIME_TAG: case OFFSET_TIME_ORIGINAL_TAG:
-    case OFFSET_TIME_DIGITIZED_TAG:
-    case SUBSEC_TIME_TAG: case SUBSEC_TIME_ORIGINAL_TAG:
-    case SUBSEC_TIME_DIGITIZED_TAG: case IMAGE_UNIQUE_ID_TAG:
-    case LENS_MAKE_TAG: case LENS_MODEL_TAG: case LENS_SERIAL_NUMBER_TAG:
-    case RELATED_SOUND_FILE_TAG:
-    case OWNER_NAME_TAG: case BODY_SERIAL_NUMBER_TAG:
-        process_ascii_string( ifdd );
-        break;
-
-    case COMPONENTS_CONFIGURATION_TAG:
-        process_components_configuration( ifdd );
-        break;
-
-     case SUBJECT_AREA_TAG:
-        process_min_max_unsigned_shorts( ifdd, 2, 4 );
-        break;
-
-    case USER_COMMENT_TAG:
-        process_user_comment( ifdd );
-        break;
-
-    case PIXEL_X_DIMENSION_TAG: case PIXEL_Y_DIMENSION_TAG:
-        process_n_unsigned_shorts_longs( ifdd, 1 );
-
-    case SUBJECT_LOCATION_TAG: case COMPOSITE_IMAGE_COUNT_TAG:
-        process_n_unsigned_shorts( ifdd, 2 );
-        break;
-
-    case FILE_SOURCE_TAG: case SCENE_TYPE_TAG:
-        process_n_undefined_bytes( ifdd, 1 );
-        break;
-
-    case CFA_PATTERN_TAG:
-        process_cfa_pattern( ifdd );
-        break;
-
-    case LENS_SPECIFICATION_TAG:
-        process_n_urationals( ifdd, 4 );
-        break;
-
-    case COMPOSITE_IMAGE_EXPOSURE_TIME_TAG:
-        process_n_undefined_bytes( ifdd, 0 );
-        break;
-
-    case INTEROPERABILITY_IFD_TAG:
-        process_embedded_ifd( ifdd, IOP );
-        break;
-
-    case MAKER_NOTE_TAG: case OFFSET_SCHEMA_TAG:
-    case UNKNOWN_TAG5: case UNKNOWN_TAG6:
-
-    case PADDING_TAG:
-        break;              // just ignore
-
-    default:
-        process_unknown_tag( ifdd, EXIF );
-        break;
+    if ( big_endian != NATIVE_BIG_ENDIAN ) {
+        swap_uint32_array( values, n );
     }
 }
 
-static void parse_gps_tags( ifd_desc_t *ifdd )
+static bool parse_ii_entries( ifd_desc_t *ifdd, ifd_table_t *table,
+                              uint16_t n_entries )
 {
-    switch ( ifdd->tag ) {
-    case GPS_VERSION_ID_TAG:
-        process_version_string( ifdd );
-        break;
-    case GPS_LATITUDE_REF_TAG:              // "N\0" or "S\0"
-        process_ascii_string( ifdd );
-        break;
-    case GPS_LATITUDE_TAG:
-        process_n_urationals( ifdd, 3 );
-        break;
-    case GPS_LONGITUDE_REF_TAG:             // "E\0" or "W\0"
-        process_ascii_string( ifdd );
-        break;
-    case GPS_LONGITUDE_TAG:
-        process_n_urationals( ifdd, 3 );
-        break;
-    case GPS_ALTITUDE_REF_TAG:              // 0 = above sea level, 1 = below sea level
-        process_n_unsigned_bytes( ifdd, 1 );
-        break;
-    case GPS_ALTITUDE_TAG:                  // altitude in meters
-        process_n_urationals( ifdd, 1 );
-        break;
-    case GPS_TIME_STAMP_TAG:                // UTC time, hh, mm, ss (atomic time)
-        process_n_urationals( ifdd, 3 );
-        break;
-    case GPS_SATELLITES_TAG:                // whatever the device can indicate
-        process_ascii_string( ifdd );
-        break;
-    case GPS_STATUS_TAG:                    // "A\0" (measurement active) or "V\0" (void)
-        process_ascii_string( ifdd );
-        break;
-    case GPS_MEASURE_MODE_TAG:              // GPS dimension measurement "2\0" or "3\0""
-        process_ascii_string( ifdd );
-        break;
-    case GPS_DOP_TAG:                       // GPS degree of precision value
-        process_n_urationals( ifdd, 1 );
-        break;
-    case GPS_SPEED_REF_TAG:                 // "K\0" (km/h), "M\0" (Miles/h) or "N\0" (Knots/h)
-        process_ascii_string( ifdd );
-        break;
-    case GPS_SPEED_TAG:                     // GPS reciever speed value
-        process_n_urationals( ifdd, 1 );
-        break;
-    case GPS_TRACK_REF_TAG:                 // "T\0" (true North) or "M\0" (magnetic)
-        process_ascii_string( ifdd );
-        break;
-    case GPS_TRACK_TAG:                     // Track direction
-        process_n_urationals( ifdd, 1 );
-        break;
-    case GPS_IMG_DIRECTION_REF_TAG:         // "T\0" (true North) or "M\0" (magnetic)
-        process_ascii_string( ifdd );
-        break;
-    case GPS_IMG_DIRECTION_TAG:             // Image direction
-        process_n_urationals( ifdd, 1 );
-        break;
+    return parse_ifd_entries( ifdd, table, n_entries, false );
+}
 
-    case GPS_MAP_DATUM_TAG:                 // string e.g. 'TOKYO' or 'WGS-84'.
-        process_ascii_string( ifdd );
-        break;
-    case GPS_DEST_LATITUDE_REF_TAG:         // Destination point latitude region "N\0" or "S\0"
-        process_ascii_string( ifdd );
-        break;
-    case GPS_DEST_LATITUDE_TAG:             // Destination point latitude
-        process_n_urationals( ifdd, 3 );
-        break;
-    case GPS_DEST_LONGITUDE_REF_TAG:        // Destination point longitude region "E\0" or "W\0"
-        process_ascii_string( ifdd );
-        break;
-    case GPS_DEST_LONGITUDE_TAG:            // Destination point longitude
-        process_n_urationals( ifdd, 3 );
-        break;
+static void load_ii_uint16_array( uint16_t *values, uint32_t n )
+{
+    load_uint16_array( values, n, false );
+}
 
-    case GPS_DEST_BEARING_REF_TAG:          // "T\0" (true North) or "M\0" (magnetic)
-        process_ascii_string( ifdd );
-        break;
-    case GPS_DEST_BEARING_TAG:              // Destination point angle
-        process_n_urationals( ifdd, 1 );
-        break;
-    case GPS_DEST_DISTANCE_REF_TAG:         // "K\0" (km), "M\0" (Miles) or "N\0" (Knots)
-        process_ascii_string( ifdd );
-        break;
-    case GPS_DEST_DISTANCE_TAG:             // Destination point distance
-        process_n_urationals( ifdd, 1 );
-        break;
-    case GPS_PROCESSING_METHOD_TAG:         // byte array: character code followed by method name  (not 0 terminated)
-        process_n_unsigned_bytes( ifdd, 0 );    // names are "GPS", "CELLID", "WLAN" or "MANUAL"
-        break;
-    case GPS_AREA_INFORMATION_TAG:          // byte array: character code followed by name  (not 0 terminated)
-        process_n_unsigned_bytes( ifdd, 0 );
-        break;
-    case GPS_DATE_STAMP_TAG:                // UTC date & Time as ASCII string YYYY:MM:DD\0
-        process_ascii_string( ifdd );
-        break;
-    case GPS_DIFFERENTIAL_TAG:              // Differential correction applied: 0 no, 1 yes
-        process_n_unsigned_shorts( ifdd, 1 );
-        break;
+static void load_ii_uint32_array( uint32_t *values, uint32_t n )
+{
+    load_uint32_array( values, n, false );
+}
 
-    case GPS_H_POSITIONING_ERROR_TAG:       // Max error distance in meters?
-        process_n_urationals( ifdd, 1 );
-        break;
+static bool parse_mm_entries( ifd_desc_t *ifdd, ifd_table_t *table,
+                              uint16_t n_entries )
+{
+    return parse_ifd_entries( ifdd, table, n_entries, true );
+}
 
-    default:
-        process_unknown_tag( ifdd, GPS );
-        break;
-    }
+static void load_mm_uint16_array( uint16_t *values, uint32_t n )
+{
+    load_uint16_array( values, n, true );
 }
 
-static void parse_iop_tags( ifd_desc_t *ifdd )
+static void load_mm_uint32_array( uint32_t *values, uint32_t n )
 {
-    switch ( ifdd->tag ) {
-    case INTEROPERABILITY_INDEX_TAG: case RELATED_IMAGE_FILE_FORMAT_TAG:
-        process_ascii_string( ifdd );
-        break;
+    load_uint32_array( values, n, true );
+}
 
-    case INTEROPERABILITY_VERSION_TAG:
-        process_version_string( ifdd );
-        break;
+static const tiff_decoder_t ii_decoder = {
+    parse_ii_entries, load_ii_uint16_array, load_ii_uint32_array
+};
 
-    case RELATED_IMAGE_WIDTH_TAG: case RELATED_IMAGE_HEIGHT_TAG:
-        process_n_unsigned_shorts( ifdd, 1 );
-        break;
+static const tiff_decoder_t mm_decoder = {
+    parse_mm_entries, load_mm_uint16_array, load_mm_uint32_array
+};
 
-    default:
-        process_unknown_tag( ifdd, IOP );
-        break;
-    }
+extern const tiff_decoder_t *tiff_get_decoder( bool big_endian )
+{
+    return big_endian ? &mm_decoder : &ii_decoder;
 }
 
-extern map_t *exif_parse_ifd( exif_desc_t *desc, ifd_id_t id, uint32_t *next )
+extern ifd_table_t *exif_parse_ifd( exif_desc_t *desc, ifd_id_t id,
+                                    uint32_t *next )
 {
-    parse_tag_fct *parse_tag;
+    if ( id < PRIMARY || id >= _IFD_N ) {
+        return NULL;                    // not implemented
+    }
 
-    switch( id ) {
-    case PRIMARY:
-        parse_tag = parse_primary_tags;
-        break;
-    case THUMBNAIL:
-        parse_tag = parse_thumbnail_tags;
-        break;
-    case EXIF:
-        parse_tag = parse_exif_tags;
-        break;
-    case GPS:
-        parse_tag = parse_gps_tags;
-        break;
-    case IOP:
-        parse_tag = parse_iop_tags;
-        break;
-//  case MAKER:  case EMBEDDED:
-    default:
-        printf( "Request for ifd %d is not implemented\n", id );
+    STATS_START( start );
+    uint16_t n_entries = tiff_get_uint16( desc );
+    ifd_table_t *table = arena_alloc( &desc->arena, sizeof(ifd_table_t) +
+                                        n_entries * sizeof(ifd_entry_t) );
+    if ( NULL == table ) {
         return NULL;
     }
+    table->n_entries = 0;
 
     ifd_desc_t ifdd;
     ifdd.id = id;
     ifdd.desc = desc;
-    ifdd.content = new_map( NULL, NULL, 0, 32 );
+    ifdd.lazy = desc->control.lazy_values;
 
-    uint16_t n_entries = tiff_get_uint16( desc );
-//    printf( "ifd id %d: number of entries=%d\n", id, n_entries );
-    for ( uint16_t i = 0; i < n_entries; ++i ) {
-        ifdd.tag = tiff_get_uint16( desc );     // field tag
-        ifdd.type = tiff_get_uint16( desc );    // field type
-        ifdd.count = tiff_get_uint32( desc );   // field count
-        ifdd.valoff = tiff_get_raw_uint32( desc ); // field valoff (no endianess)
-//        printf("Parsing tag=0x%04x, type=0x%04x, count=%d, valoff=0x%08x\n",
-//                ifdd.tag, ifdd.type, ifdd.count, ifdd.valoff);
-        if ( ! check_entry_type( &ifdd ) ) {
-            printf( "Illegal tiff type: 0x%04x\n", ifdd.type );
-            map_free( ifdd.content );
-            return NULL;
-        }
-        parse_tag( &ifdd );
+    if ( ! desc->decoder->parse_entries( &ifdd, table, n_entries ) ) {
+        STATS_STOP( desc, ifd_ns[id], start );
+        return NULL;                    // table remains in arena
     }
+    sort_ifd_table( table );
 
     uint32_t next_offset = tiff_get_uint32( desc);
-//    printf( "ifd id %d: next offset=0x%08x\n", id, next_offset );
     if ( NULL != next ) {
         *next = next_offset;
     }
-    return ifdd.content;
+    STATS_STOP( desc, ifd_ns[id], start );
+    return table;
+}
+
+extern void exif_load_ifd_entry( exif_desc_t *desc, ifd_id_t id,
+                                 ifd_entry_t *entry )
+{
+    if ( ! entry->deferred ) {
+        return;
+    }
+
+    ifd_desc_t ifdd;
+    ifdd.id = id;
+    ifdd.desc = desc;
+    ifdd.lazy = false;              // load values now
+    ifdd.entry = entry;
+    ifdd.tag = entry->tag;
+    ifdd.type = entry->type;
+    ifdd.count = entry->count;
+    ifdd.valoff = entry->valoff;
+    entry->deferred = false;        // loaded (or failed), do not retry
+
+    STATS_START( start );
+    parse_tag( &ifdd, schema_lookup( id, entry->tag ) );
+    STATS_STOP( desc, load_ns, start );
+    STATS_ADD( desc, n_loads, 1 );
+}
+
+extern void exif_load_ifd_entries( exif_desc_t *desc, ifd_id_t id )
+{
+    ifd_table_t *table = desc->ifds[id];
+    if ( NULL == table || ! desc->control.lazy_values ) {
+        return;
+    }
+    for ( uint16_t i = 0; i < table->n_entries; ++i ) {
+        exif_load_ifd_entry( desc, id, &table->entries[i] );
+    }
 }
@@ -4,8 +4,10 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
-#include "map.h"
+#include "slice.h"
+#include "arena.h"
 
 /*
     EXIF metadata layout:
@@ -23,6 +25,26 @@
     IFD1:           Thumbnail Image Data (optional)
 */
 
+/*
+    JPEG layout (only what is needed to find the EXIF metadata):
+
+      0xff 0xd8                 SOI marker (start of image)
+      { segment } *             0xff <marker> <2-byte big endian length>
+                                followed by (length - 2) bytes. The EXIF
+                                metadata are in an APP1 segment (0xff 0xe1)
+                                starting with the EXIF header.
+      0xff 0xda                 SOS marker (start of scan) followed by the
+                                entropy-coded image data: no metadata after.
+*/
+#define JPEG_MARKER     0xff    // any marker starts with 0xff (fill byte)
+#define JPEG_SOI        0xd8    // start of image
+#define JPEG_EOI        0xd9    // end of image
+#define JPEG_SOS        0xda    // start of scan
+#define JPEG_RST0       0xd0    // restart markers RST0-RST7 and TEM have
+#define JPEG_RST7       0xd7    // no length and no segment data
+#define JPEG_TEM        0x01
+#define JPEG_APP1       0xe1    // EXIF (or XMP) segment
+
 // TIFF header offsets and sizes
 #define ORIGIN_OFFSET   6   // TIFF header offset in EXIF file
 #define HEADER_SIZE     8   // TIFF header size
@@ -152,7 +174,7 @@
       next IFD = 0
 */
 
-#define _IFD_N (IOP+1)      // last supported ifd entry + 1 to size arrays
+#define _IFD_N EXIF_IFD_N   // last supported ifd entry + 1 to size arrays
 
 // internal tag definitions, not directly accessible
 
@@ -178,12 +200,64 @@
 #define PADDING_TAG                         0xea1c  // May be in IFD0, IFD1 & Exif
 #define OFFSET_SCHEMA_TAG                   0xea1d  // in EXIF (Microsoft proprietary)
 
+// Tag values, allocated in the descriptor arena. A vector is created from
+// the values only when requested by exif_get_ifd_tag_values, and then linked
+// in the descriptor list of values to free when the descriptor is freed.
+// The items follow the values in the arena, except in a descriptor made by
+// exif_view_from_blob, where they remain in the blob.
+typedef struct _ifd_values {
+    struct _ifd_values  *next;      // next values with a vector
+    vector_t            *vector;    // NULL until requested
+    const void          *data;      // count * item_size bytes
+    uint32_t            count;      // number of items
+    uint16_t            item_size;  // size of each item in bytes
+    uint16_t            type;       // TIFF type
+} ifd_values_t;
+
+// IFD entry as found in the IFD, with its values once they are loaded.
+typedef struct {
+    uint16_t            tag;        // field tag
+    uint16_t            type;       // field type
+    uint32_t            count;      // field count
+    uint32_t            valoff;     // field value or offset in following data
+    bool                deferred;   // lazy mode: values not loaded yet
+    ifd_values_t        *values;    // NULL if not loaded
+} ifd_entry_t;
+
+// Each IFD is a table of entries sorted by tag, with a single entry per tag,
+// all allocated in the descriptor arena. Only the entries with valid values
+// (or with deferred values in lazy mode) are in the table.
+typedef struct {
+    uint16_t            n_entries;
+    ifd_entry_t         entries[];
+} ifd_table_t;
+
+// return the entry for tag in the table, or NULL if there is none.
+static inline ifd_entry_t *ifd_table_lookup( ifd_table_t *table, uint16_t tag )
+{
+    uint32_t low = 0, high = table->n_entries;
+    while ( low < high ) {                  // binary search in [low, high[
+        uint32_t mid = ( low + high ) / 2;
+        uint16_t mid_tag = table->entries[mid].tag;
+        if ( mid_tag == tag ) {
+            return &table->entries[mid];
+        }
+        if ( mid_tag < tag ) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
 // IFD generic support (conforming to TIFF, EXIF etc.)
 typedef struct {
     ifd_id_t            id;         // namespace for each IFD
     struct _exif_desc   *desc;      // parent descriptor
-    map_t               *content;   // all ifd { tag, values }
-    long                saved_pos;  // temporary saved file position
+    ifd_entry_t         *entry;     // current entry in IFD table
+    bool                lazy;       // defer loading values
+    uint32_t            saved_pos;  // temporary saved position
 
                                     // current IFD field during parsing
     uint16_t            tag;        // field tag
@@ -192,32 +266,143 @@ typedef struct {
     uint32_t            valoff;     // field value or offset in following data
 } ifd_desc_t;
 
+// byte order specific IFD walker and value loaders, selected by parse_tiff
+typedef struct _tiff_decoder tiff_decoder_t;
+
+extern const tiff_decoder_t *tiff_get_decoder( bool big_endian );
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NATIVE_BIG_ENDIAN   true
+#else
+#define NATIVE_BIG_ENDIAN   false
+#endif
+
+// return the 16 or 32-bit value at data, stored in big or little endian order.
+// With a constant big_endian, it is a native load, byte-swapped if needed.
+static inline uint16_t tiff_load_uint16( bool big_endian, const uint8_t *data )
+{
+    uint16_t val;
+    memcpy( &val, data, sizeof(val) );
+    return ( big_endian == NATIVE_BIG_ENDIAN ) ? val : __builtin_bswap16( val );
+}
+
+static inline uint32_t tiff_load_uint32( bool big_endian, const uint8_t *data )
+{
+    uint32_t val;
+    memcpy( &val, data, sizeof(val) );
+    return ( big_endian == NATIVE_BIG_ENDIAN ) ? val : __builtin_bswap32( val );
+}
+
 // exif descriptor with all required IFD metadata
 struct _exif_desc {
     FILE                *file;
-    long                header;
+    bool                own_file;       // file is closed by exif_free
+    long                header;         // TIFF header location in file
+    const uint8_t       *data;          // or TIFF header location in memory
+    size_t              size;           // size of data in memory
+    uint32_t            pos;            // current position in memory data
+    size_t              needed;         // data size needed by failed reads
+    void                *mapping;       // file mapping owned by descriptor
+    size_t              mapping_size;
+    int                 fd;             // mapped file kept open, or -1
+    void                *own_data;      // memory data owned by descriptor
+    const uint8_t       *blob;          // for a view, blob with all values
     bool                big_endian;
+    const tiff_decoder_t *decoder;      // according to big_endian
     exif_control_t      control;        // what to do when parsing
 
     uint32_t            thumb_offset;
     uint32_t            thumb_size;
 
 //    map_t               *global;        // map for global information ?
-    map_t               *ifds[_IFD_N];  // flat ifd content access by id
+    ifd_table_t         *ifds[_IFD_N];  // flat ifd content access by id
 
+    uint32_t            n_diagnostics;  // problems found while parsing
+    exif_diagnostic_t   diagnostics[EXIF_MAX_DIAGNOSTICS];
+
+    ifd_values_t        *vectors;       // values with a vector to free
+    arena_t             arena;          // for all values and entries
+#ifndef EXIF_NO_STATS
+    exif_stats_t        stats;
+#endif
 };
 
-static inline size_t make_key_from_tag( uint16_t tag ) {
-    return (size_t)0x10000 + (size_t)tag; // force key to be non-zero
+// statistics collection, compiled out if EXIF_NO_STATS is defined
+#ifndef EXIF_NO_STATS
+extern uint64_t stats_clock_ns( void );
+#define STATS_ADD( d, field, n )        ( (d)->stats.field += (n) )
+#define STATS_START( start )            uint64_t start = stats_clock_ns( )
+#define STATS_STOP( d, field, start )   \
+                        ( (d)->stats.field += stats_clock_ns( ) - (start) )
+#else
+#define STATS_ADD( d, field, n )        ((void)0)
+#define STATS_START( start )
+#define STATS_STOP( d, field, start )   ((void)0)
+#endif
+
+// true if tags are wanted from the IFD id or from an IFD it embeds (IOP in
+// EXIF), according to the wanted tag sets in the descriptor control.
+static inline bool is_ifd_wanted( exif_desc_t *d, ifd_id_t id )
+{
+    const exif_tag_set_t *wanted = d->control.wanted_tags[id];
+    if ( NULL == wanted || 0 != wanted->n_tags ) {
+        return true;
+    }
+    return EXIF == id && is_ifd_wanted( d, IOP );
 }
 
+// once the file f, opened by the library, has been parsed into desc, give it
+// to the descriptor if it is needed to load deferred values later (lazy mode),
+// or close it. Once closed, the descriptor does not refer to it anymore.
+extern void exif_keep_or_close_file( exif_desc_t *desc, FILE *f );
+
+// return the memory allocated for the descriptor: the descriptor itself with
+// its first arena block, the following arena blocks and the requested vectors.
+// The data it refers to (buffer, mapping or segment) are not included.
+extern size_t exif_desc_heap_size( exif_desc_t *desc );
+
+// parse the TIFF data at data (len bytes starting with the TIFF header). If
+// needed is not NULL, it is set to the data size that would have been needed
+// to read all IFDs and values, which is larger than len if some were beyond.
+extern exif_desc_t *parse_tiff_buffer( const uint8_t *data, size_t len,
+                                       exif_control_t *control, size_t *needed );
+
+typedef enum {
+    NOT_A_JPEG,             // or broken JPEG structure: requires a full scan
+    NO_EXIF_SEGMENT,        // JPEG without APP1 Exif segment before SOS
+    EXIF_SEGMENT,           // APP1 Exif segment found
+    TRUNCATED_JPEG          // more data is needed to continue the walk
+} jpeg_walk_t;
+
+// walk the JPEG segments in memory from the marker at position *pos (after
+// the SOI marker), until an APP1 segment starting with the Exif header or the
+// SOS marker is found. If an Exif APP1 segment is found, *pos is updated to
+// the TIFF header position and the size of the TIFF data is returned in
+// *tiff_size. If data ends before, *pos is updated to the position where the
+// walk can continue with more data, possibly beyond len.
+extern jpeg_walk_t walk_jpeg_segments( const uint8_t *data, size_t len,
+                                       size_t *pos, uint32_t *tiff_size );
+
+extern uint32_t tiff_get_position( exif_desc_t *d );
+extern void tiff_set_position( exif_desc_t *d, uint32_t offset );
+extern bool tiff_has_data( exif_desc_t *d, uint32_t offset, uint64_t n );
+
+extern uint8_t tiff_get_uint8( exif_desc_t *d );
+extern void tiff_get_bytes( exif_desc_t *d, uint8_t *dst, size_t n );
 extern uint16_t tiff_get_uint16( exif_desc_t *d );
 extern uint32_t tiff_get_uint32( exif_desc_t *d );
 extern uint32_t tiff_get_raw_uint32( exif_desc_t *d );
 extern uint32_t tiff_endianize_uint32( exif_desc_t *d, uint32_t raw );
 extern uint16_t tiff_endianize_uint16( exif_desc_t *d, uint16_t raw );
 
-extern map_t *exif_parse_ifd( struct _exif_desc *desc,
-                              ifd_id_t id, uint32_t *next );
+extern ifd_table_t *exif_parse_ifd( struct _exif_desc *desc,
+                                    ifd_id_t id, uint32_t *next );
+
+// In lazy mode, load the deferred values of the given entry or of all entries
+// in the IFD id. Once loaded, values are in the entries as if they had been
+// loaded by exif_parse_ifd.
+extern void exif_load_ifd_entry( struct _exif_desc *desc,
+                                 ifd_id_t id, ifd_entry_t *entry );
+extern void exif_load_ifd_entries( struct _exif_desc *desc, ifd_id_t id );
 
 #endif /* __PARSE_H__ */
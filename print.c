@@ -1,17 +1,190 @@
-
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+
 #include "print.h"
+#include "schema.h"
+#include "numfmt.h"
+
+// Printed text is accumulated in a buffer, which is written to the sink when
+// full and at the end of each exif_print_ifd_entries_to call. Numbers are
+// formatted without stdio, so that printing a descriptor does not depend on
+// printf speed or locale.
+#define PRINT_BUFFER_SIZE   4096
+
+typedef struct {
+    exif_sink_t *sink;
+    size_t      len;                    // text in buf
+    bool        failed;                 // sink write error
+    char        buf[PRINT_BUFFER_SIZE];
+} print_out_t;
+
+static bool out_write_sink( exif_sink_t *sink, const char *data, size_t len )
+{
+    switch( sink->type ) {
+    case EXIF_SINK_FILE:
+        return len == fwrite( data, 1, len, sink->file );
+    case EXIF_SINK_FD:
+        while ( len ) {
+            ssize_t n = write( sink->fd, data, len );
+            if ( -1 == n ) {
+                if ( EINTR == errno ) {
+                    continue;
+                }
+                return false;
+            }
+            data += n;
+            len -= (size_t)n;
+        }
+        return true;
+    case EXIF_SINK_MEMORY:
+        if ( sink->len < sink->cap ) {
+            size_t room = sink->cap - sink->len;
+            memcpy( sink->buf + sink->len, data, ( len < room ) ? len : room );
+        }
+        sink->len += len;               // even beyond cap, to give the size
+        return true;
+    }
+    return false;
+}
+
+static void out_flush( print_out_t *out )
+{
+    if ( out->len && ! out->failed ) {
+        out->failed = ! out_write_sink( out->sink, out->buf, out->len );
+    }
+    out->len = 0;
+}
+
+static void out_write( print_out_t *out, const char *data, size_t len )
+{
+    if ( out->len + len > PRINT_BUFFER_SIZE ) {
+        out_flush( out );
+        if ( len > PRINT_BUFFER_SIZE ) {    // long strings bypass the buffer
+            if ( ! out->failed ) {
+                out->failed = ! out_write_sink( out->sink, data, len );
+            }
+            return;
+        }
+    }
+    memcpy( out->buf + out->len, data, len );
+    out->len += len;
+}
+
+static void out_puts( print_out_t *out, const char *text )
+{
+    out_write( out, text, strlen( text ) );
+}
+
+static void out_char( print_out_t *out, char c )
+{
+    if ( out->len == PRINT_BUFFER_SIZE ) {
+        out_flush( out );
+    }
+    out->buf[out->len++] = c;
+}
+
+static void out_uint( print_out_t *out, uint32_t value )
+{
+    char digits[NUMFMT_MAX_SIZE];
+    out_write( out, digits, numfmt_uint32( value, digits ) );
+}
+
+// same as printf( "<prefix>%u<suffix>", value )
+static void out_text_uint( print_out_t *out, const char *prefix,
+                           uint32_t value, const char *suffix )
+{
+    out_puts( out, prefix );
+    out_uint( out, value );
+    out_puts( out, suffix );
+}
+
+// same as printf( "<prefix>%d<suffix>", value )
+static void out_text_int( print_out_t *out, const char *prefix,
+                          uint32_t value, const char *suffix )
+{
+    char digits[NUMFMT_MAX_SIZE];
+    out_puts( out, prefix );
+    out_write( out, digits, numfmt_int32( (int32_t)value, digits ) );
+    out_puts( out, suffix );
+}
+
+static void out_text( print_out_t *out, const char *text1,
+                      const char *text2, const char *text3 )
+{
+    out_puts( out, text1 );
+    out_puts( out, text2 );
+    out_puts( out, text3 );
+}
+
+// same as printf( "%s%s: ", indent, name )
+static void out_tag_name( print_out_t *out, const char *indent,
+                          const char *name )
+{
+    out_text( out, indent, name, ": " );
+}
+
+// same as printf( "%.<decimals>f", value ), with decimals 2 or 6. A float
+// times 100 or 10^6 is exact in a double (24 + 7 or 20 significant bits),
+// so that rounding it to an integer, to nearest even as printf does, gives
+// exactly the printf digits. Large and non finite values still go through
+// snprintf.
+static void out_fixed( print_out_t *out, float value, int decimals )
+{
+    double scaled = (double)value * ( ( 2 == decimals ) ? 100.0 : 1000000.0 );
+    double magnitude = ( scaled < 0 ) ? -scaled : scaled;
+
+    if ( ! ( magnitude < 9007199254740992.0 ) ) {       // 2^53, inf or nan
+        char text[512];                 // FLT_MAX has 39 integer digits
+        int len = snprintf( text, sizeof(text), "%.*f", decimals, value );
+        out_write( out, text, (size_t)len );
+        return;
+    }
+    uint64_t units = (uint64_t)magnitude;
+    double rest = magnitude - (double)units;            // exact
+    if ( rest > 0.5 || ( 0.5 == rest && ( units & 1 ) ) ) {
+        ++units;
+    }
+    uint64_t scale = ( 2 == decimals ) ? 100 : 1000000;
+    uint64_t integer = units / scale, fraction = units % scale;
+
+    char text[NUMFMT_MAX_SIZE];
+    int len = 0;
+    if ( value < 0 || ( 0 == value && signbit( value ) ) ) {
+        text[len++] = '-';
+    }
+    char digits[20];
+    int n_digits = 0;
+    do {
+        digits[n_digits++] = (char)( '0' + integer % 10 );
+        integer /= 10;
+    } while ( integer );
+    while ( n_digits ) {
+        text[len++] = digits[--n_digits];
+    }
+    text[len++] = '.';
+    for ( int i = decimals - 1; i >= 0; --i ) {
+        text[len + i] = (char)( '0' + fraction % 10 );
+        fraction /= 10;
+    }
+    len += decimals;
+    out_write( out, text, (size_t)len );
+}
 
 // called to format each value in an array. The argument number is the number
 // of items in the array, index is the value index in the array, den is the
 // value denominator (0 if not a rational), num is the value numerator. The
 // returned boolean indicates whether a comma separator should be printed
 // between values.
-typedef bool (*formated_print_fct)( uint32_t num, uint32_t den,
-                                    uint32_t index, uint32_t number );
+typedef bool (*formated_print_fct)( print_out_t *out, uint32_t num,
+                                    uint32_t den, uint32_t index,
+                                    uint32_t number );
 
 // Note: this can be used for signed values with an appropriate format _print
-static void print_unsigned_values( vector_t *v, formated_print_fct format_print )
+static void print_unsigned_values( print_out_t *out, vector_t *v,
+                                   formated_print_fct format_print )
 {
     size_t size = vector_item_size( v );
     uint32_t n_items = vector_cap( v );
@@ -23,9 +196,10 @@ static void print_unsigned_values( vector_t *v, formated_print_fct format_print
             {
                 uint8_t *val = vector_item_at( v, i );
                 if ( format_print ) {
-                    print_comma = format_print( (uint32_t)*val, 0, i, n_items );
+                    print_comma = format_print( out, (uint32_t)*val, 0,
+                                                i, n_items );
                 } else {
-                    printf( "%u", (uint32_t)*val );
+                    out_uint( out, (uint32_t)*val );
                 }
                 break;
             }
@@ -33,9 +207,10 @@ static void print_unsigned_values( vector_t *v, formated_print_fct format_print
             {
                 uint16_t *val = vector_item_at( v, i );
                 if ( format_print ) {
-                    print_comma = format_print( (uint32_t)*val, 0, i, n_items );
+                    print_comma = format_print( out, (uint32_t)*val, 0,
+                                                i, n_items );
                 } else {
-                    printf( "%u", (uint32_t)*val );
+                    out_uint( out, (uint32_t)*val );
                 }
                 break;
             }
@@ -43,9 +218,10 @@ static void print_unsigned_values( vector_t *v, formated_print_fct format_print
             {
                 uint32_t *val = vector_item_at( v, i );
                 if ( format_print ) {
-                    print_comma = format_print( (uint32_t)*val, 0, i, n_items );
+                    print_comma = format_print( out, (uint32_t)*val, 0,
+                                                i, n_items );
                 } else {
-                    printf( "%u", (uint32_t)*val );
+                    out_uint( out, (uint32_t)*val );
                 }
                 break;
             }
@@ -53,646 +229,683 @@ static void print_unsigned_values( vector_t *v, formated_print_fct format_print
             {
                 urational_t *val = vector_item_at( v, i );
                 if ( format_print ) {
-                    print_comma = format_print( val->numerator, val->denominator,
-                                                i, n_items );
+                    print_comma = format_print( out, val->numerator,
+                                                val->denominator, i, n_items );
                 } else if ( 0 == val->denominator ) {
-                    printf( "%u/0", val->numerator );
+                    out_text_uint( out, "", val->numerator, "/0" );
                 } else {
-                    printf( "%f (%u/%u)",
-                        (float)(val->numerator)/(float)(val->denominator),
-                        (uint32_t)val->numerator, (uint32_t)val->denominator );
+                    out_fixed( out,
+                        (float)(val->numerator)/(float)(val->denominator), 6 );
+                    out_text_uint( out, " (", val->numerator, "/" );
+                    out_text_uint( out, "", val->denominator, ")" );
                 }
                 break;
             }
         }
         if ( print_comma && i != n_items-1 ) {
-            printf( ", ");
+            out_puts( out, ", " );
         }
     }
 }
 
-static void print_string_tag( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
-                              char *indent, char *name,
+static void print_string_tag( print_out_t *out, exif_desc_t *desc,
+                              ifd_id_t id, uint16_t tag,
+                              char *indent, const char *name,
                               formated_print_fct format )
 {
     vector_t *v;
     bool success = exif_get_ifd_tag_values( desc, id, tag, &v );
 
     if ( success ) {
-        printf( "%s%s: \"%s\"\n", indent, name, vector_read_string( v ) );
+        out_tag_name( out, indent, name );
+        out_char( out, '"' );
+        out_puts( out, vector_read_string( v ) );
+        out_puts( out, "\"\n" );
     }
 }
 
-static void print_uint_tag_array( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
-                                  char *indent, char *name,
+static void print_uint_tag_array( print_out_t *out, exif_desc_t *desc,
+                                  ifd_id_t id, uint16_t tag,
+                                  char *indent, const char *name,
                                   formated_print_fct format )
 {
     vector_t *v;
     bool success = exif_get_ifd_tag_values( desc, id, tag, &v );
 
     if ( success ) {
-        printf( "%s%s: ", indent, name );
-        print_unsigned_values( v, format );
-        printf( "\n" );
+        out_tag_name( out, indent, name );
+        print_unsigned_values( out, v, format );
+        out_char( out, '\n' );
     }
 }
 
-static void print_user_comment( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
-                                char *indent, char *name,
+static void print_user_comment( print_out_t *out, exif_desc_t *desc,
+                                ifd_id_t id, uint16_t tag,
+                                char *indent, const char *name,
                                 formated_print_fct format )
 {
     vector_t *v;
     bool success = exif_get_ifd_tag_values( desc, id, tag, &v );
 
     if ( success ) {
-        char *encoding = (char *)vector_item_at( v, 0 );
-        char *text = (char *)vector_item_at( v, 8 );
-        if ( 0 == *encoding ) {
+        // 8-byte encoding followed by the text, neither of them necessarily
+        // terminated by 0 (GPS byte values), and possibly shorter than 8.
+        size_t count = vector_cap( v );
+        const char *encoding = ( 0 == count ) ? "" : vector_item_at( v, 0 );
+        size_t encoding_len = ( count < 8 ) ? count : 8;
+        const char *text = "";
+        size_t text_len = 0;
+        if ( count > 8 ) {
+            text = vector_item_at( v, 8 );
+            text_len = count - 8;
+        }
+        const char *end = memchr( encoding, 0, encoding_len );
+        if ( NULL != end ) {
+            encoding_len = (size_t)( end - encoding );
+        }
+        if ( 0 == encoding_len ) {
             encoding = "Undefined";
-            text = "";
+            encoding_len = strlen( encoding );
+            text_len = 0;
+        }
+        end = memchr( text, 0, text_len );
+        if ( NULL != end ) {
+            text_len = (size_t)( end - text );
         }
-        printf( "%s%s: (Encoding %s)\n%s  \"%s\"\n",
-                indent, name, encoding, indent, text );
+        out_tag_name( out, indent, name );
+        out_puts( out, "(Encoding " );
+        out_write( out, encoding, encoding_len );
+        out_puts( out, ")\n" );
+        out_puts( out, indent );
+        out_puts( out, "  \"" );
+        out_write( out, text, text_len );
+        out_puts( out, "\"\n" );
     }
 }
 
-static bool format_hex_bytes( uint32_t num, uint32_t den,
+static bool format_hex_bytes( print_out_t *out, uint32_t num, uint32_t den,
                               uint32_t index, uint32_t number )
 {
-    printf("0x%02x ", (uint8_t)num );
+    static const char hex[] = "0123456789abcdef";
+    char text[5] = { '0', 'x', hex[(num >> 4) & 0xf], hex[num & 0xf], ' ' };
+    out_write( out, text, sizeof(text) );
     return true;
 }
 
-static bool format_srational( uint32_t num, uint32_t den,
+static bool format_srational( print_out_t *out, uint32_t num, uint32_t den,
                               uint32_t index, uint32_t number )
 {
-    printf( "%f", (float)(int32_t)num / (float)(int32_t)den );
+    out_fixed( out, (float)(int32_t)num / (float)(int32_t)den, 6 );
     return true;
 }
 
-static bool format_compression( uint32_t num, uint32_t den,
+static bool format_compression( print_out_t *out, uint32_t num, uint32_t den,
                                 uint32_t index, uint32_t number )
 {
 
     switch( num ) {
-    default:                    printf("unknown (%d)", num); break;
-    case NOT_COMPRESSED:        printf("none"); break;
-    case CCITT_1D:              printf("CCITT 1D"); break;
-    case CCITT_Group3:          printf("CCITT Group3"); break;
-    case CCITT_Group4:          printf("CCITT Group4"); break;
-    case LZW:                   printf("LZW"); break;
-    case JPEG:                  printf("JPEG"); break;
-    case JPEG_Technote2:        printf("JPEG Techmote2"); break;
-    case Deflate:               printf("Deflate"); break;
-    case RFC_2301_BW_JBIG:      printf("RFC 2301 BW JBIG"); break;
-    case RFC_2301_Color_JBIG:   printf("RFC 2301 Color JBIG"); break;
-    case PACKBITS:              printf("Packbits (Apple)"); break;
+    default:                    out_text_int( out, "unknown (", num, ")" ); break;
+    case NOT_COMPRESSED:        out_puts( out, "none" ); break;
+    case CCITT_1D:              out_puts( out, "CCITT 1D" ); break;
+    case CCITT_Group3:          out_puts( out, "CCITT Group3" ); break;
+    case CCITT_Group4:          out_puts( out, "CCITT Group4" ); break;
+    case LZW:                   out_puts( out, "LZW" ); break;
+    case JPEG:                  out_puts( out, "JPEG" ); break;
+    case JPEG_Technote2:        out_puts( out, "JPEG Techmote2" ); break;
+    case Deflate:               out_puts( out, "Deflate" ); break;
+    case RFC_2301_BW_JBIG:      out_puts( out, "RFC 2301 BW JBIG" ); break;
+    case RFC_2301_Color_JBIG:   out_puts( out, "RFC 2301 Color JBIG" ); break;
+    case PACKBITS:              out_puts( out, "Packbits (Apple)" ); break;
     }
     return true;
 }
 
-static bool format_photographic_interpretation( uint32_t num, uint32_t den,
+static bool format_photographic_interpretation( print_out_t *out, uint32_t num, uint32_t den,
                                                 uint32_t index, uint32_t number )
 {
     switch( num ) {
     default:
-        printf( "Unknown (%d)\n", num ); break;
+        out_text_int( out, "Unknown (", num, ")\n" ); break;
     case BILEVEL_OR_GRAYSCALE_0_WHITE:
-        printf( "Bilevel or Grayscale, 0 is white\n" ); break;
+        out_puts( out, "Bilevel or Grayscale, 0 is white\n" ); break;
     case BILEVEL_OR_GRAYSCALE_0_BLACK:
-        printf( "Bilevel or Grayscale, 0 is black\n" ); break;
+        out_puts( out, "Bilevel or Grayscale, 0 is black\n" ); break;
     case RGB:
-        printf( "RGB components\n" ); break;
+        out_puts( out, "RGB components\n" ); break;
     case PALETTE:
-        printf( "Palette indexes\n"); break;
+        out_puts( out, "Palette indexes\n" ); break;
     }
     return true;
 }
 
-static bool format_orientation( uint32_t num, uint32_t den,
+static bool format_orientation( print_out_t *out, uint32_t num, uint32_t den,
                                 uint32_t index, uint32_t number )
 {
     switch( num ) {
     default:
-        printf( "unknown (%d)\n", num ); break;
+        out_text_int( out, "unknown (", num, ")\n" ); break;
     case ROW_0_TOP_COL_0_LEFT:
-        printf( "Row 0 on top, Col 0 on left" ); break;
+        out_puts( out, "Row 0 on top, Col 0 on left" ); break;
     case ROW_0_TOP_COL_0_RIGHT:
-        printf( "Row 0 on top, Col 0 on right" ); break;
+        out_puts( out, "Row 0 on top, Col 0 on right" ); break;
     case ROW_0_BOTTOM_COL0_RIGHT:
-        printf( "Row 0 on bottom, Col 0 on right" ); break;
+        out_puts( out, "Row 0 on bottom, Col 0 on right" ); break;
     case ROW_0_BOTTOM_COL0_LEFT:
-        printf( "Row 0 on bottom, Col 0 on left" ); break;
+        out_puts( out, "Row 0 on bottom, Col 0 on left" ); break;
     case ROW_0_LEFT_COL_0_TOP:
-        printf( "Row 0 on left, Col 0 on Top" ); break;
+        out_puts( out, "Row 0 on left, Col 0 on Top" ); break;
     case ROW_0_RIGHT_COL_0_TOP:
-        printf( "Row 0 on right, Col 0 on Top" ); break;
+        out_puts( out, "Row 0 on right, Col 0 on Top" ); break;
     case ROW_0_RIGHT_COL_0_BOTTOM:
-        printf( "Row 0 on right, Col 0 on bottom" ); break;
+        out_puts( out, "Row 0 on right, Col 0 on bottom" ); break;
     case ROW_0_LEFT_COL_0_BOTTOM:
-        printf( "Row 0 on left, Col 0 on bottom" ); break;
+        out_puts( out, "Row 0 on left, Col 0 on bottom" ); break;
     }
     return true;
 }
 
-static bool format_resolution_uint( uint32_t num, uint32_t den,
+static bool format_resolution_uint( print_out_t *out, uint32_t num, uint32_t den,
                                     uint32_t index, uint32_t number )
 {
     switch( num ) {
     default:
-        printf("Unknown (%d)", num); break;
+        out_text_int( out, "Unknown (", num, ")" ); break;
     case DOTS_PER_ARBITRATY_UNIT:
-        printf("Dots per arbitraty unit"); break;
+        out_puts( out, "Dots per arbitraty unit" ); break;
     case DOTS_PER_INCH:
-        printf("Dots per inch"); break;
+        out_puts( out, "Dots per inch" ); break;
     case DOTS_PER_CM:
-        printf("Dots per cm"); break;
+        out_puts( out, "Dots per cm" ); break;
     }
     return true;
 }
 
-static bool format_ycbcr_positioning( uint32_t num, uint32_t den,
+static bool format_ycbcr_positioning( print_out_t *out, uint32_t num, uint32_t den,
                                       uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                printf("Unknown (%d)", num); break;
-    case YCBCR_CENTERED:    printf("Centered"); break;
-    case YCBCR_COSITED:     printf("Cosited"); break;
+    default:                out_text_int( out, "Unknown (", num, ")" ); break;
+    case YCBCR_CENTERED:    out_puts( out, "Centered" ); break;
+    case YCBCR_COSITED:     out_puts( out, "Cosited" ); break;
     }
     return true;
 }
 
-static bool format_exposure_time( uint32_t num, uint32_t den,
+static bool format_exposure_time( print_out_t *out, uint32_t num, uint32_t den,
                                   uint32_t index, uint32_t number )
 {
-    printf( "%f seconds (%u/%u)", (float)(num)/(float)(den), num, den );
+    out_fixed( out, (float)(num)/(float)(den), 6 );
+    out_text_uint( out, " seconds (", num, "/" );
+    out_text_uint( out, "", den, ")" );
     return true;
 }
 
-static bool format_exposure_program( uint32_t num, uint32_t den,
+static bool format_exposure_program( print_out_t *out, uint32_t num, uint32_t den,
                                      uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                printf( "Unknown (%u)", num ); break;
-    case UNDEFINED:         printf( "Undefined" ); break;
-    case MANUAL:            printf( "Manual" ); break;
-    case NORMAL_PROGRAM:    printf( "Normal program" ); break;
-    case APERTURE_PRIORITY: printf( "Aperture priority" ); break;
-    case SHUTTER_PRIORITY:  printf( "Shutter priority" ); break;
-    case CREATIVE_PROGRAM:  printf( "Creative program" ); break;
-    case ACTION_PROGRAM:    printf( "Action program" ); break;
-    case PORTRAIT_MODE:     printf( "Portrait mode" ); break;
-    case LANDSCAPE_MODE:    printf( "Landscape mode" ); break;
+    default:                out_text_uint( out, "Unknown (", num, ")" ); break;
+    case UNDEFINED:         out_puts( out, "Undefined" ); break;
+    case MANUAL:            out_puts( out, "Manual" ); break;
+    case NORMAL_PROGRAM:    out_puts( out, "Normal program" ); break;
+    case APERTURE_PRIORITY: out_puts( out, "Aperture priority" ); break;
+    case SHUTTER_PRIORITY:  out_puts( out, "Shutter priority" ); break;
+    case CREATIVE_PROGRAM:  out_puts( out, "Creative program" ); break;
+    case ACTION_PROGRAM:    out_puts( out, "Action program" ); break;
+    case PORTRAIT_MODE:     out_puts( out, "Portrait mode" ); break;
+    case LANDSCAPE_MODE:    out_puts( out, "Landscape mode" ); break;
     }
     return true;
 }
 
-static bool format_sensitivity_type( uint32_t num, uint32_t den,
+static bool format_sensitivity_type( print_out_t *out, uint32_t num, uint32_t den,
                                      uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                    printf( "Non-listed (%u)", num ); break;
-    case UNKNOWN_SENSITIVITY:   printf( "UNknown" ); break;
+    default:                    out_text_uint( out, "Non-listed (", num, ")" ); break;
+    case UNKNOWN_SENSITIVITY:   out_puts( out, "UNknown" ); break;
 
     case STANDARD_OUTPUT_SENSITIVITY:
-        printf( "Standard output sensitivity" );
+        out_puts( out, "Standard output sensitivity" );
         break;
     case RECOMMENDED_EXPOSURE_INDEX:
-        printf( "Recommended exposure index" );
+        out_puts( out, "Recommended exposure index" );
         break;
-    case ISO_SPEED:             printf( "ISO speed" ); break;
+    case ISO_SPEED:             out_puts( out, "ISO speed" ); break;
 
     case STANDARD_OUTPUT_SENSITIVITY_RECOMMENDED_EXPOSURE_INDEX:
-        printf( "Standard output sensitivity, Recommended exposure index" );
+        out_puts( out, "Standard output sensitivity, Recommended exposure index" );
         break;
     case STANDARD_OUTPUT_SENSITIVITY_ISO_SPEED:
-        printf( "Standard output sensitivity, ISO speed" );
+        out_puts( out, "Standard output sensitivity, ISO speed" );
         break;
     case RECOMMENDED_EXPOSURE_INDEX_ISO_SPEED:
-        printf( "Recommended exposure index, ISO speed" );
+        out_puts( out, "Recommended exposure index, ISO speed" );
         break;
     case STANDARD_OUTPUT_SENSITIVITY_RECOMMENDED_EXPOSURE_INDEX_ISO_SPEED:
-        printf( "Standard output sensitivity, Recommended exposure index, ISO speed" );
+        out_puts( out, "Standard output sensitivity, Recommended exposure index, ISO speed" );
         break;
     }
     return true;
 }
 
-static bool format_metering_mode( uint32_t num, uint32_t den,
+static bool format_metering_mode( print_out_t *out, uint32_t num, uint32_t den,
                                   uint32_t index, uint32_t number )
 {
     switch( num ) {
     default:
-        printf( "Not listed (%u)", num ); break;
+        out_text_uint( out, "Not listed (", num, ")" ); break;
     case UNKNOWN_MODE:
-        printf( "Unknown mode" ); break;
+        out_puts( out, "Unknown mode" ); break;
     case AVERAGE:
-        printf( "Average" ); break;
+        out_puts( out, "Average" ); break;
     case CENTER_WEIGHTED_AVERAGE_PROGRAM:
-        printf( "Center Weighted Average" ); break;
+        out_puts( out, "Center Weighted Average" ); break;
     case SPOT:
-        printf( "Spot" ); break;
+        out_puts( out, "Spot" ); break;
     case MULTISPOT:
-        printf( "Multispot" ); break;
+        out_puts( out, "Multispot" ); break;
     case PATTERN:
-        printf( "Pattern" ); break;
+        out_puts( out, "Pattern" ); break;
     case PARTIAL:
-        printf( "Partial" ); break;
+        out_puts( out, "Partial" ); break;
     case OTHER:
-        printf( "Other" ); break;
+        out_puts( out, "Other" ); break;
     }
     return true;
 }
 
-static bool format_ligth_source( uint32_t num, uint32_t den,
+static bool format_ligth_source( print_out_t *out, uint32_t num, uint32_t den,
                                  uint32_t index, uint32_t number )
 {
     switch( num ) {
     default:
-        printf( "Not listed (%u)", num ); break;
+        out_text_uint( out, "Not listed (", num, ")" ); break;
     case UNKNOWN_SOURCE:
-        printf( "Unknown source" ); break;
+        out_puts( out, "Unknown source" ); break;
     case DAYLIGHT:
-        printf( "Daylight" ); break;
+        out_puts( out, "Daylight" ); break;
     case FLUORESCENT:
-        printf( "Fluorescent" ); break;
+        out_puts( out, "Fluorescent" ); break;
     case TUNGSTEN_INCANDESCENT_LIGHT:
-        printf( "Tungsten Incandescent" ); break;
+        out_puts( out, "Tungsten Incandescent" ); break;
     case FLASH:
-        printf( "Flash" ); break;
+        out_puts( out, "Flash" ); break;
     case FINE_WEATHER:
-        printf( "Fine weather" ); break;
+        out_puts( out, "Fine weather" ); break;
     case CLOUDY_WEATHER:
-        printf( "Cloudy weather" ); break;
+        out_puts( out, "Cloudy weather" ); break;
     case SHADE:
-        printf( "Shade" ); break;
+        out_puts( out, "Shade" ); break;
     case DAYLIGHT_FLUORESCENT_D_5700_7100K:
-        printf( "Daylight fluorescent D 5700-7400K" ); break;
+        out_puts( out, "Daylight fluorescent D 5700-7400K" ); break;
     case DAY_WHITE_FLUORESCENT_N_4600_5400K:
-        printf( "Day white fluorescent D 4600-5400K" ); break;
+        out_puts( out, "Day white fluorescent D 4600-5400K" ); break;
     case COOL_WHITE_FLUORESCENT_W_3900_4500K:
-        printf( "Cool white fluorescent D 3900-4500K" ); break;
+        out_puts( out, "Cool white fluorescent D 3900-4500K" ); break;
     case WHITE_FLUORESCENT_WW_3200_3700K:
-        printf( "White fluorescent D 3200-3700K" ); break;
+        out_puts( out, "White fluorescent D 3200-3700K" ); break;
     case STANDARD_LIGHT_A:
-        printf( "Standard light A" ); break;
+        out_puts( out, "Standard light A" ); break;
     case STANDARD_LIGHT_B:
-        printf( "Standard light B" ); break;
+        out_puts( out, "Standard light B" ); break;
     case STANDARD_LIGHT_C:
-        printf( "Standard light C" ); break;
+        out_puts( out, "Standard light C" ); break;
     case D55:
-        printf( "D55" ); break;
+        out_puts( out, "D55" ); break;
     case D65:
-        printf( "D65" ); break;
+        out_puts( out, "D65" ); break;
     case D75:
-        printf( "D75" ); break;
+        out_puts( out, "D75" ); break;
     case D50:
-        printf( "D50" ); break;
+        out_puts( out, "D50" ); break;
     case ISO_STUDIO_TUNGSTEN:
-        printf( "ISO studio tungsten" ); break;
+        out_puts( out, "ISO studio tungsten" ); break;
     case OTHER_LIGHT_SOURCE:
-        printf( "Other light source" ); break;
+        out_puts( out, "Other light source" ); break;
     }
     return true;
 }
 
-static bool format_flash( uint32_t num, uint32_t den,
+static bool format_flash( print_out_t *out, uint32_t num, uint32_t den,
                           uint32_t index, uint32_t number )
 {
     switch( num ) {
     default:
-        printf( "Not listed (%u)", num ); break;
+        out_text_uint( out, "Not listed (", num, ")" ); break;
     case NO_FLASH_FUNCTION:
-        printf("No flash function"); break;
+        out_puts( out, "No flash function" ); break;
     case FLASH_DID_NOT_FIRE:
-        printf("Flash did not fire"); break;
+        out_puts( out, "Flash did not fire" ); break;
     case FLASH_DID_NOT_FIRE_COMPULSORY_FLASH_MODE:
-        printf("Flash did not fire, compulsory mode"); break;
+        out_puts( out, "Flash did not fire, compulsory mode" ); break;
     case FLASH_DID_NOT_FIRE_AUTO_MODE:
-        printf("Flash did not fire, auto mode"); break;
+        out_puts( out, "Flash did not fire, auto mode" ); break;
     case FLASH_FIRED:
-        printf("Flash fired"); break;
+        out_puts( out, "Flash fired" ); break;
     case FLASH_FIRED_STROBE_RETURN_LIGHT_NOT_DETECTED:
-        printf("Flash fired, return light not detected"); break;
+        out_puts( out, "Flash fired, return light not detected" ); break;
     case FLASH_FIRED_STROBE_RETURN_LIGHT_DETECTED:
-        printf("Flash fired, return light detected"); break;
+        out_puts( out, "Flash fired, return light detected" ); break;
     case FLASH_FIRED_COMPULSORY_FLASH_MODE:
-        printf("Flash fired, compulsory mode"); break;
+        out_puts( out, "Flash fired, compulsory mode" ); break;
     case FLASH_FIRED_COMPULSORY_FLASH_MODE_RETURN_LIGHT_NOT_DETECTED:
-        printf("Flash fired, compulsory mode, return light not detected"); break;
+        out_puts( out, "Flash fired, compulsory mode, return light not detected" ); break;
     case FLASH_FIRED_COMPULSORY_FLASH_MODE_RETURN_LIGHT_DETECTED:
-        printf("Flash fired, compulsory mode, return light detected"); break;
+        out_puts( out, "Flash fired, compulsory mode, return light detected" ); break;
     case FLASH_FIRED_RED_EYE_REDUCTION_MODE:
-        printf("Flash fired, red eye reduction"); break;
+        out_puts( out, "Flash fired, red eye reduction" ); break;
     case FLASH_FIRED_RED_EYE_REDUCTION_MODE_RETURN_LIGHT_NOT_DETECTED:
-        printf("Flash fired, red eye reduction, return light not detected"); break;
+        out_puts( out, "Flash fired, red eye reduction, return light not detected" ); break;
     case FLASH_FIRED_RED_EYE_REDUCTION_MODE_RETURN_LIGHT_DETECTED:
-        printf("Flash fired, red eye reduction, return light detected"); break;
+        out_puts( out, "Flash fired, red eye reduction, return light detected" ); break;
     case FLASH_FIRED_COMPULSORY_FLASH_MODE_RED_EYE_REDUCTION_MODE_RETURN_LIGHT_NOT_DETECTED:
-        printf("Flash fired, compulsory mode, red eye reduction, return light not detected"); break;
+        out_puts( out, "Flash fired, compulsory mode, red eye reduction, return light not detected" ); break;
     case FLASH_FIRED_COMPULSORY_FLASH_MODE_RED_EYE_REDUCTION_MODE_RETURN_LIGHT_DETECTED:
-        printf("Flash fired, compulsory mode, red eye reduction, return light detected"); break;
+        out_puts( out, "Flash fired, compulsory mode, red eye reduction, return light detected" ); break;
     case FLASH_FIRED_AUTO_MODE:
-        printf("Flash fired, auto mode"); break;
+        out_puts( out, "Flash fired, auto mode" ); break;
     case FLASH_FIRED_AUTO_MODE_RETURN_LIGHT_NOT_DETECTED:
-        printf("Flash fired, auto mode, return light not detected"); break;
+        out_puts( out, "Flash fired, auto mode, return light not detected" ); break;
     case FLASH_FIRED_AUTO_MODE_RETURN_LIGHT_DETECTED:
-        printf("Flash fired, auto mode, return light detected"); break;
+        out_puts( out, "Flash fired, auto mode, return light detected" ); break;
     case FLASH_FIRED_AUTO_MODE_RED_EYE_REDUCTION_MODE:
-        printf("Flash fired, auto mode, red eye reduction"); break;
+        out_puts( out, "Flash fired, auto mode, red eye reduction" ); break;
     case FLASH_FIRED_AUTO_MODE_RED_EYE_REDUCTION_MODE_RETURN_LIGHT_NOT_DETECTED:
-        printf("Flash fired, auto mode, red eye reduction, return light not detected"); break;
+        out_puts( out, "Flash fired, auto mode, red eye reduction, return light not detected" ); break;
     case FLASH_FIRED_AUTO_MODE_RED_EYE_REDUCTION_MODE_RETURN_LIGHT_DETECTED:
-        printf("Flash fired, auto mode, red eye reduction, return light detected"); break;
+        out_puts( out, "Flash fired, auto mode, red eye reduction, return light detected" ); break;
     }
     return true;
 }
 
-static bool format_color_space( uint32_t num, uint32_t den,
+static bool format_color_space( print_out_t *out, uint32_t num, uint32_t den,
                                 uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:            printf("Not listed (%u)", num); break;
-    case SRGB:          printf("SRGB"); break;
-    case UNCALIBRATED:  printf("Uncalibrated"); break;
+    default:            out_text_uint( out, "Not listed (", num, ")" ); break;
+    case SRGB:          out_puts( out, "SRGB" ); break;
+    case UNCALIBRATED:  out_puts( out, "Uncalibrated" ); break;
     }
     return true;
 }
 
-static bool format_planar_configuration( uint32_t num, uint32_t den,
+static bool format_planar_configuration( print_out_t *out, uint32_t num, uint32_t den,
                                          uint32_t index, uint32_t number )
 {
     switch ( num ) {
-    default:            printf("Not listed (%u)", num); break;
-    case CHUNKY_FORMAT: printf("Chunky"); break;
-    case PLANAR_FORMAT: printf("Planar"); break;
+    default:            out_text_uint( out, "Not listed (", num, ")" ); break;
+    case CHUNKY_FORMAT: out_puts( out, "Chunky" ); break;
+    case PLANAR_FORMAT: out_puts( out, "Planar" ); break;
     }
     return true;
 }
 
-static bool format_resolution_unit( uint32_t num, uint32_t den,
+static bool format_resolution_unit( print_out_t *out, uint32_t num, uint32_t den,
                                     uint32_t index, uint32_t number )
 {
     switch ( num ) {
-    default:                    printf("Not listed (%u)", num); break;
-    case RESOLUTION_UNIT_NONE:  printf("No Unit"); break;
-    case RESOLUTION_UNIT_INCHES:printf("Inches"); break;
-    case RESOLUTION_UNIT_CM:    printf("Centimeter"); break;
-    case RESOLUTION_UNIT_MM:    printf("Millimeter"); break;
-    case RESOLUTION_UNIT_UM:    printf("Micrometer"); break;
+    default:                    out_text_uint( out, "Not listed (", num, ")" ); break;
+    case RESOLUTION_UNIT_NONE:  out_puts( out, "No Unit" ); break;
+    case RESOLUTION_UNIT_INCHES:out_puts( out, "Inches" ); break;
+    case RESOLUTION_UNIT_CM:    out_puts( out, "Centimeter" ); break;
+    case RESOLUTION_UNIT_MM:    out_puts( out, "Millimeter" ); break;
+    case RESOLUTION_UNIT_UM:    out_puts( out, "Micrometer" ); break;
     }
     return true;
 }
 
-static bool format_sensing_method( uint32_t num, uint32_t den,
+static bool format_sensing_method( print_out_t *out, uint32_t num, uint32_t den,
                                    uint32_t index, uint32_t number )
 {
     switch( num ) {
     default:
-        printf("Not listed (%u)", num); break;
+        out_text_uint( out, "Not listed (", num, ")" ); break;
     case UNDEFINED_SENSOR:
-        printf("Not defined"); break;
+        out_puts( out, "Not defined" ); break;
     case ONE_CHIP_COLOR_AREA_SENSOR:
-        printf("One-chip color area"); break;
+        out_puts( out, "One-chip color area" ); break;
     case TWO_CHIP_COLOR_AREA_SENSOR:
-        printf("Two-chip color area"); break;
+        out_puts( out, "Two-chip color area" ); break;
     case THREE_CHIP_COLOR_AREA_SENSOR:
-        printf("Three-chip color area"); break;
+        out_puts( out, "Three-chip color area" ); break;
     case COLOR_SEQUENTIAL_AREA_SENSOR:
-        printf("Color sequential area"); break;
+        out_puts( out, "Color sequential area" ); break;
     case TRILINEAR_SENSOR:
-        printf("Trilinear"); break;
+        out_puts( out, "Trilinear" ); break;
     case COLOR_SEQUENTIAL_LINEAR_SENSOR:
-        printf("Color sequential linear"); break;
+        out_puts( out, "Color sequential linear" ); break;
     }
     return true;
 }
 
-static bool format_file_source( uint32_t num, uint32_t den,
+static bool format_file_source( print_out_t *out, uint32_t num, uint32_t den,
                                 uint32_t index, uint32_t number )
 {
     if ( num == 3 ) {
-        printf( "DSC");
+        out_puts( out, "DSC" );
     } else {
-        printf( "Unknown (%d)", num );
+        out_text_int( out, "Unknown (", num, ")" );
     }
     return true;
 }
 
-static bool format_scene_type( uint32_t num, uint32_t den,
+static bool format_scene_type( print_out_t *out, uint32_t num, uint32_t den,
                                uint32_t index, uint32_t number )
 {
     if ( num == 1 ) {
-        printf( "DSC");
+        out_puts( out, "DSC" );
     } else {
-        printf( "Unknown (%d)", num );
+        out_text_int( out, "Unknown (", num, ")" );
     }
     return true;
 }
 
-static bool format_custom_rendered( uint32_t num, uint32_t den,
+static bool format_custom_rendered( print_out_t *out, uint32_t num, uint32_t den,
                                     uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                printf("Not listed (%u)", num); break;
-    case NORMAL_PROCESS:    printf("Normal process"); break;
-    case CUSTOM_PROCESS:    printf("Custom process"); break;
+    default:                out_text_uint( out, "Not listed (", num, ")" ); break;
+    case NORMAL_PROCESS:    out_puts( out, "Normal process" ); break;
+    case CUSTOM_PROCESS:    out_puts( out, "Custom process" ); break;
     }
     return true;
 }
 
-static bool format_exposure_mode( uint32_t num, uint32_t den,
+static bool format_exposure_mode( print_out_t *out, uint32_t num, uint32_t den,
                                   uint32_t index, uint32_t number  )
 {
     switch( num ) {
-    default:                printf("Not listed (%u)", num); break;
-    case AUTO_EXPOSURE:     printf("Auto exposure"); break;
-    case MANUAL_EXPOSURE:   printf("Manual exposure"); break;
-    case AUTO_BRACKET:      printf("Auto bracket"); break;
+    default:                out_text_uint( out, "Not listed (", num, ")" ); break;
+    case AUTO_EXPOSURE:     out_puts( out, "Auto exposure" ); break;
+    case MANUAL_EXPOSURE:   out_puts( out, "Manual exposure" ); break;
+    case AUTO_BRACKET:      out_puts( out, "Auto bracket" ); break;
     }
     return true;
 }
 
-static bool format_white_balance( uint32_t num, uint32_t den,
+static bool format_white_balance( print_out_t *out, uint32_t num, uint32_t den,
                                   uint32_t index, uint32_t number  )
 {
     switch( num ) {
-    default:                    printf("Not listed (%u)", num); break;
-    case AUTO_WHITE_BALANCE:    printf("Auto balance"); break;
-    case MANUAL_WHITE_BALANCE:  printf("Manual balance"); break;
+    default:                    out_text_uint( out, "Not listed (", num, ")" ); break;
+    case AUTO_WHITE_BALANCE:    out_puts( out, "Auto balance" ); break;
+    case MANUAL_WHITE_BALANCE:  out_puts( out, "Manual balance" ); break;
     }
     return true;
 }
 
-static bool format_digital_zoom_ratio( uint32_t num, uint32_t den,
+static bool format_digital_zoom_ratio( print_out_t *out, uint32_t num, uint32_t den,
                                        uint32_t index, uint32_t number )
 {
     if ( num != 0 && den != 0 ) {
-        printf( "%f", (float)num / (float)den );
+        out_fixed( out, (float)num / (float)den, 6 );
     } else {
-        printf( "No digital zoom" );
+        out_puts( out, "No digital zoom" );
     }
     return true;
 }
 
-static bool format_35mm_focal_length( uint32_t num, uint32_t den,
+static bool format_35mm_focal_length( print_out_t *out, uint32_t num, uint32_t den,
                                       uint32_t index, uint32_t number  )
 {
     if ( num != 0 ) {
-        printf("%u", num);
+        out_uint( out, num );
     } else {
-        printf("Unknown length");
+        out_puts( out, "Unknown length" );
     }
     return true;
 }
 
-static bool format_scene_capture_type( uint32_t num, uint32_t den,
+static bool format_scene_capture_type( print_out_t *out, uint32_t num, uint32_t den,
                                        uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                printf( "Not listed (%u)", num ); break;
-    case STANDARD_SCENE:    printf( "Standard" ); break;
-    case LANDSCAPE:         printf( "Landscape" ); break;
-    case PORTRAIT:          printf( "Portrait" ); break;
-    case NIGHT_SCENE:       printf( "Night Scene" ); break;
+    default:                out_text_uint( out, "Not listed (", num, ")" ); break;
+    case STANDARD_SCENE:    out_puts( out, "Standard" ); break;
+    case LANDSCAPE:         out_puts( out, "Landscape" ); break;
+    case PORTRAIT:          out_puts( out, "Portrait" ); break;
+    case NIGHT_SCENE:       out_puts( out, "Night Scene" ); break;
     }
     return true;
 }
 
-static bool format_gain_control( uint32_t num, uint32_t den,
+static bool format_gain_control( print_out_t *out, uint32_t num, uint32_t den,
                                  uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                printf( "Not listed (%u)", num ); break;
-    case NO_GAIN:           printf( "No gain" ); break;
-    case LOW_GAIN_UP:       printf( "Low gain up" ); break;
-    case HIGH_GAIN_UP:      printf( "High gain up" ); break;
-    case LOW_GAIN_DOWN:     printf( "Low gain down" ); break;
-    case HIGH_GAIN_DOWN:    printf( "High gain down" ); break;
+    default:                out_text_uint( out, "Not listed (", num, ")" ); break;
+    case NO_GAIN:           out_puts( out, "No gain" ); break;
+    case LOW_GAIN_UP:       out_puts( out, "Low gain up" ); break;
+    case HIGH_GAIN_UP:      out_puts( out, "High gain up" ); break;
+    case LOW_GAIN_DOWN:     out_puts( out, "Low gain down" ); break;
+    case HIGH_GAIN_DOWN:    out_puts( out, "High gain down" ); break;
     }
     return true;
 }
 
-static bool format_contrast( uint32_t num, uint32_t den,
+static bool format_contrast( print_out_t *out, uint32_t num, uint32_t den,
                              uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                printf( "Not listed (%u)", num ); break;
-    case NORMAL_CONTRAST:   printf( "Normal contrast" ); break;
-    case SOFT_CONTRAST:     printf( "Soft contrast" ); break;
-    case HARD_CONTRAST:     printf( "Hard contrast" ); break;
+    default:                out_text_uint( out, "Not listed (", num, ")" ); break;
+    case NORMAL_CONTRAST:   out_puts( out, "Normal contrast" ); break;
+    case SOFT_CONTRAST:     out_puts( out, "Soft contrast" ); break;
+    case HARD_CONTRAST:     out_puts( out, "Hard contrast" ); break;
     }
     return true;
 }
 
-static bool format_saturation( uint32_t num, uint32_t den,
+static bool format_saturation( print_out_t *out, uint32_t num, uint32_t den,
                                uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                printf( "Not listed (%u)", num ); break;
-    case NORMAL_SATURATION: printf( "Normal saturation" ); break;
-    case LOW_SATURATION:    printf( "Low saturation" ); break;
-    case HIGH_SATURATION:   printf( "High saturation" ); break;
+    default:                out_text_uint( out, "Not listed (", num, ")" ); break;
+    case NORMAL_SATURATION: out_puts( out, "Normal saturation" ); break;
+    case LOW_SATURATION:    out_puts( out, "Low saturation" ); break;
+    case HIGH_SATURATION:   out_puts( out, "High saturation" ); break;
     }
     return true;
 }
 
-static bool format_sharpness( uint32_t num, uint32_t den,
+static bool format_sharpness( print_out_t *out, uint32_t num, uint32_t den,
                               uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                printf( "Not listed (%u)", num ); break;
-    case NORMAL_SHARPNESS:  printf( "Normal sharpness" ); break;
-    case SOFT_SHARPNESS:    printf( "Low sharpness" ); break;
-    case HARD_SHARNESS:     printf( "High saturation" ); break;
+    default:                out_text_uint( out, "Not listed (", num, ")" ); break;
+    case NORMAL_SHARPNESS:  out_puts( out, "Normal sharpness" ); break;
+    case SOFT_SHARPNESS:    out_puts( out, "Low sharpness" ); break;
+    case HARD_SHARNESS:     out_puts( out, "High saturation" ); break;
     }
     return true;
 }
 
-static bool format_subject_distance_range( uint32_t num, uint32_t den,
+static bool format_subject_distance_range( print_out_t *out, uint32_t num, uint32_t den,
                                            uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                printf( "Not listed (%u)", num ); break;
-    case UNKNOWN_DISTANCE:  printf( "Unknown" ); break;
-    case MACRO:             printf( "Macro" ); break;
-    case CLOSE_VIEW:        printf( "Close View" ); break;
-    case DISTANT_VIEW:      printf( "Distant view" ); break;
+    default:                out_text_uint( out, "Not listed (", num, ")" ); break;
+    case UNKNOWN_DISTANCE:  out_puts( out, "Unknown" ); break;
+    case MACRO:             out_puts( out, "Macro" ); break;
+    case CLOSE_VIEW:        out_puts( out, "Close View" ); break;
+    case DISTANT_VIEW:      out_puts( out, "Distant view" ); break;
     }
     return true;
 }
 
-static bool format_composite_image( uint32_t num, uint32_t den,
+static bool format_composite_image( print_out_t *out, uint32_t num, uint32_t den,
                                     uint32_t index, uint32_t number )
 {
     switch( num ) {
-    default:                        printf( "Not listed (%u)", num ); break;
-    case UNKNOWN_COMPOSITION:       printf( "Unknown" ); break;
-    case NON_COMPOSITE_IMAGE:       printf( "Image is not composite" ); break;
-    case GENERAL_COMPOSITE_IMAGE:   printf( "General composite image" ); break;
+    default:                        out_text_uint( out, "Not listed (", num, ")" ); break;
+    case UNKNOWN_COMPOSITION:       out_puts( out, "Unknown" ); break;
+    case NON_COMPOSITE_IMAGE:       out_puts( out, "Image is not composite" ); break;
+    case GENERAL_COMPOSITE_IMAGE:   out_puts( out, "General composite image" ); break;
     case COMPOSITE_IMAGE_CAPTURED_WHEN_SHOOTING:
-                                    printf( "Images captured when shooting" ); break;
+                                    out_puts( out, "Images captured when shooting" ); break;
     }
     return true;
 }
 
-static bool gps_coordinates( uint32_t num, uint32_t den,
+static bool gps_coordinates( print_out_t *out, uint32_t num, uint32_t den,
                              uint32_t index, uint32_t number )
 {
     if ( 1 >= den ) {
-        printf( "%u", num );
+        out_uint( out, num );
     } else {
-        printf( "%.2f", (float)num/(float)den );
+        out_fixed( out, (float)num/(float)den, 2 );
     }
     switch( index ) {
-    case 0: printf( "%c%c", 0xc2, 0xb0 ); break;
-    case 1: printf( "'" ); break;
-    case 2: printf( "\"" ); break;
-    default: printf( "?" ); break;
+    case 0: out_puts( out, "\xc2\xb0" ); break;
+    case 1: out_puts( out, "'" ); break;
+    case 2: out_puts( out, "\"" ); break;
+    default: out_puts( out, "?" ); break;
     }
     return false;
 }
 
-static bool gps_altitude( uint32_t num, uint32_t den,
+static bool gps_altitude( print_out_t *out, uint32_t num, uint32_t den,
                           uint32_t index, uint32_t number )
 {
     if ( 1 >= den ) {
-        printf( "%u meters", num );
+        out_text_uint( out, "", num, " meters" );
     } else {
-        printf( "%.2f meters", (float)num/(float)den );
+        out_fixed( out, (float)num/(float)den, 2 );
+        out_puts( out, " meters" );
     }
     return true;
 }
 
-static bool gps_time( uint32_t num, uint32_t den,
+static bool gps_time( print_out_t *out, uint32_t num, uint32_t den,
                       uint32_t index, uint32_t number )
 {
     if ( 1 >= den ) {
-        printf( "%u", num );
+        out_uint( out, num );
     } else {
-        printf( "%.2f", (float)num/(float)den );
+        out_fixed( out, (float)num/(float)den, 2 );
     }
     switch( index ) {
-    case 0: case 1: printf(":"); break;
+    case 0: case 1: out_puts( out, ":" ); break;
     default: break;
     }
     return false;
 }
 
-static bool gps_angle( uint32_t num, uint32_t den,
+static bool gps_angle( print_out_t *out, uint32_t num, uint32_t den,
                        uint32_t index, uint32_t number )
 {
     if ( 1 >= den ) {
-        printf( "%u", num );
+        out_uint( out, num );
     } else {
-        printf( "%.2f", (float)num/(float)den );
+        out_fixed( out, (float)num/(float)den, 2 );
     }
-    printf( "%c%c", 0xc2, 0xb0 );
+    out_puts( out, "\xc2\xb0" );
     return false;
 }
 
-static void print_gps_latitude_ref( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
-                                    char *indent, char *name,
+static void print_gps_latitude_ref( print_out_t *out, exif_desc_t *desc,
+                                    ifd_id_t id, uint16_t tag,
+                                    char *indent, const char *name,
                                     formated_print_fct format )
 {
     vector_t *v;
@@ -705,12 +918,15 @@ static void print_gps_latitude_ref( exif_desc_t *desc, ifd_id_t id, uint16_t tag
             case 'S': ref = "South"; break;
             default: ref = "Undefined"; break;
         }
-        printf( "%s%s: %s\n", indent, name, ref );
+        out_tag_name( out, indent, name );
+        out_puts( out, ref );
+        out_char( out, '\n' );
     }
 }
 
-static void print_gps_longitude_ref( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
-                                    char *indent, char *name,
+static void print_gps_longitude_ref( print_out_t *out, exif_desc_t *desc,
+                                     ifd_id_t id, uint16_t tag,
+                                    char *indent, const char *name,
                                     formated_print_fct format )
 {
     vector_t *v;
@@ -723,12 +939,15 @@ static void print_gps_longitude_ref( exif_desc_t *desc, ifd_id_t id, uint16_t ta
             case 'W': ref = "West"; break;
             default: ref = "Undefined"; break;
         }
-        printf( "%s%s: %s\n", indent, name, ref );
+        out_tag_name( out, indent, name );
+        out_puts( out, ref );
+        out_char( out, '\n' );
     }
 }
 
-static void print_gps_altitude_ref( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
-                                    char *indent, char *name,
+static void print_gps_altitude_ref( print_out_t *out, exif_desc_t *desc,
+                                    ifd_id_t id, uint16_t tag,
+                                    char *indent, const char *name,
                                     formated_print_fct format )
 {
     vector_t *v;
@@ -742,12 +961,15 @@ static void print_gps_altitude_ref( exif_desc_t *desc, ifd_id_t id, uint16_t tag
             case 1: ref = "Below sea level"; break;
             default: ref = "Undefined"; break;
         }
-        printf( "%s%s: %s\n", indent, name, ref );
+        out_tag_name( out, indent, name );
+        out_puts( out, ref );
+        out_char( out, '\n' );
     }
 }
 
-static void print_gps_direction_ref( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
-                                     char *indent, char *name,
+static void print_gps_direction_ref( print_out_t *out, exif_desc_t *desc,
+                                     ifd_id_t id, uint16_t tag,
+                                     char *indent, const char *name,
                                      formated_print_fct format )
 {
     vector_t *v;
@@ -760,12 +982,15 @@ static void print_gps_direction_ref( exif_desc_t *desc, ifd_id_t id, uint16_t ta
             case 'M': ref = "Magnetic direction"; break;
             default: ref = "Undefined"; break;
         }
-        printf( "%s%s: %s\n", indent, name, ref );
+        out_tag_name( out, indent, name );
+        out_puts( out, ref );
+        out_char( out, '\n' );
     }
 }
 
-static void print_gps_yes_no( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
-                              char *indent, char *name,
+static void print_gps_yes_no( print_out_t *out, exif_desc_t *desc,
+                              ifd_id_t id, uint16_t tag,
+                              char *indent, const char *name,
                               formated_print_fct format )
 {
     vector_t *v;
@@ -779,319 +1004,55 @@ static void print_gps_yes_no( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
             case 1: res = "Yes"; break;
             default: res = "Undefined"; break;
         }
-        printf( "%s%s: %s\n", indent, name, res );
+        out_tag_name( out, indent, name );
+        out_puts( out, res );
+        out_char( out, '\n' );
     }
 }
 
-typedef void (*print_fct)( exif_desc_t *desc, ifd_id_t id, uint16_t tag,
-                           char *indent, char *header,
+typedef void (*print_fct)( print_out_t *out, exif_desc_t *desc,
+                           ifd_id_t id, uint16_t tag, char *indent,
+                           const char *header,
                            formated_print_fct format );
 
 typedef struct {
-    uint16_t            tag;
-    char *              header;
     print_fct           print;
     formated_print_fct  format;
-} ifd_tag_print_t;
-
-static ifd_tag_print_t ifd_01_tag_print[] = {
-
-    { PROCESSING_SOFTWARE, "Processing Software", print_string_tag, NULL },
-    { IMAGE_WIDTH_TAG, "Image Width", print_uint_tag_array, NULL },
-    { IMAGE_LENGTH_TAG, "Image Length", print_uint_tag_array, NULL },
-    { BITS_PER_SAMPLE_TAG, "Bits per Sample", print_uint_tag_array, NULL },
-    { COMPRESSION_TAG, "Compression", print_uint_tag_array, format_compression },
-    { PHOTOMETRIC_INTERPRETATION_TAG, "Photographic Interpretation",
-        print_uint_tag_array, format_photographic_interpretation },
-
-    { IMAGE_DESCRIPTION_TAG, "Image Description", print_string_tag, NULL },
-    { MAKE_TAG, "Manufacturer", print_string_tag, NULL },
-    { MODEL_TAG, "Model", print_string_tag, NULL },
-
-    { STRIP_OFFSETS_TAG, "Strip offsets", print_uint_tag_array, NULL },
-
-    { ORIENTATION_TAG, "Image Orientation",
-        print_uint_tag_array, format_orientation },
-
-    { SAMPLES_PER_PIXEL_TAG, "Samples per Pixel", print_uint_tag_array, NULL },
-    { ROWS_PER_STRIP_TAG, "Rows per strip", print_uint_tag_array, NULL },
-    { STRIP_BYTE_COUNTS_TAG, "Strip byte counts", print_uint_tag_array, NULL },
-
-
-    // should not be in IFD0, but it happens...
-    { CUSTOM_RENDERED_TAG, "Data Processing",
-        print_uint_tag_array, format_custom_rendered },
-    { EXPOSURE_MODE_TAG, "Exposure Mode",
-        print_uint_tag_array, format_exposure_mode },
-    { WHITE_BALANCE_TAG, "White Balance",
-        print_uint_tag_array, format_white_balance },
-    { FOCAL_LENGTH_IN_35MM_FILM_TAG, "Focal length in 35mm film",
-        print_uint_tag_array, format_35mm_focal_length },
-
-    { GAIN_CONTROL_TAG, "Gain Control",
-        print_uint_tag_array, format_gain_control },
-    { CONTRAST_TAG, "Contrast", print_uint_tag_array, format_contrast },
-    { SATURATION_TAG, "Saturation", print_uint_tag_array, format_saturation },
-    { SHARPNESS_TAG, "Sharpness", print_uint_tag_array, format_sharpness },
-    { SUBJECT_DISTANCE_RANGE_TAG, "Subject Distance Range",
-        print_uint_tag_array, format_subject_distance_range },
-    // end of special tags
-
-    { X_RESOLUTION_TAG, "X Resolution", print_uint_tag_array, NULL },
-    { Y_RESOLUTION_TAG, "Y Resolution", print_uint_tag_array, NULL },
-    { PLANAR_CONFIGURATION_TAG, "Planar Configuration",
-        print_uint_tag_array, format_planar_configuration },
+} print_rule_t;
 
-    { RESOLUTION_UNIT_TAG, "Resolution unit",
-        print_uint_tag_array, format_resolution_unit },
+// print functions for each row of the tag schema, in the same order
+#define PRINT_RULE( ifds, tag, types, min, max, parse, name, print, format ) \
+    { print, format },
 
-    { SOFTWARE_TAG, "Software", print_string_tag, NULL },
-    { DATE_TIME_TAG, "Date", print_string_tag, NULL },
-
-    { ARTIST_TAG, "Artist", print_string_tag, NULL },
-    { HOST_COMPUTER_TAG, "HostComputer", print_string_tag, NULL },
-
-    { WHITE_POINT_TAG, "White point", print_uint_tag_array, NULL },
-    { PRIMARY_CHROMACITIES_TAG, "Primary Chromacities",
-      print_uint_tag_array, NULL },
-
-    { TILE_WIDTH_TAG, "Tile width", print_uint_tag_array, NULL },
-    { TILE_LENGTH_TAG, "Tile length", print_uint_tag_array, NULL },
-    { TILE_BYTE_COUNTS_TAG, "Tiles size in bytes", print_uint_tag_array, NULL },
-    { TILE_OFFSETS_TAG, "Tiles offset in TIFF", print_uint_tag_array, NULL },
-
-    { YCBCR_COEFFICIENTS_TAG, "YCbCr Coefficients", print_uint_tag_array, NULL },
-    { YCBCR_SUBSAMPLING_TAG, "YCbCr Subsampling", print_uint_tag_array, NULL },
-    { YCBCR_POSITIONING_TAG, "YCbCr Positioning",
-        print_uint_tag_array, format_ycbcr_positioning },
-
-    { REFERENCE_BLACK_WHITE_TAG, "Reference Black, White",
-        print_uint_tag_array, NULL },
-
-    { COPYRIGHT_TAG, "Copyright", print_string_tag, NULL },
-
-    { PRINT_IM_TAG, "Print IM", print_uint_tag_array, format_hex_bytes }
-};
-
-static ifd_tag_print_t ifd_2_tag_print[] = {
-    { EXPOSURE_TIME_TAG, "Exposure Time",
-        print_uint_tag_array, format_exposure_time },
-    { FNUMBER_TAG, "FNumber", print_uint_tag_array, NULL },
-    { EXPOSURE_PROGRAM_TAG, "Exposure Program",
-        print_uint_tag_array, format_exposure_program },
-    { ISO_SPEED_RATINGS_TAG, "ISO Speed Ratings", print_uint_tag_array, NULL },
-
-    { SENSITIVITY_TYPE_TAG, "Sensitivity type",
-      print_uint_tag_array, format_sensitivity_type  },
-    { STANDARD_OUTPUT_SENSITIVITY_TAG, "Standard output sensitivity",
-      print_uint_tag_array, NULL },
-    { RECOMMENDED_EXPOSURE_INDEX_TAG, "Recommended exposure index",
-      print_uint_tag_array, NULL },
-
-    { EXIF_VERSION_TAG,"Exif version", print_string_tag, NULL },
-
-    { DATE_TIME_ORIGINAL_TAG, "Original Picture Date", print_string_tag, NULL },
-    { DATE_TIME_DIGITIZED_TAG, "Digitized Picture Date",
-        print_string_tag, NULL },
-    { OFFSET_TIME_TAG, "Time offset from UTC", print_string_tag, NULL },
-    { OFFSET_TIME_ORIGINAL_TAG, "Original Picture Time offset from UTC",
-        print_string_tag, NULL },
-    { OFFSET_TIME_DIGITIZED_TAG, "Digitized Picture Time offset from UTC",
-        print_string_tag, NULL },
-
-    { COMPONENTS_CONFIGURATION_TAG, "Components configuration",
-        print_string_tag, NULL },
-
-    { COMPRESSED_BITS_PER_PIXEL_TAG, "Compressed bits per pixel",
-        print_uint_tag_array, NULL },
-
-    { SHUTTER_SPEED_VALUE_TAG, "Shutter-speed value",
-        print_uint_tag_array, format_srational },
-
-    { APERTURE_VALUE_TAG, "Aperture Value", print_uint_tag_array, NULL },
-    { BRIGHTNESS_VALUE_TAG, "Brightness Value",
-        print_uint_tag_array, format_srational },
-
-    { EXPOSURE_BIAS_VALUE_TAG, "Exposure-Bias value",
-        print_uint_tag_array, format_srational },
-
-    { MAX_APERTURE_VALUE_TAG, "Max Aperture Value",
-         print_uint_tag_array, NULL },
-    { SUBJECT_DISTANCE_TAG, "Subject Distance", print_uint_tag_array, NULL },
-
-    { METERING_MODE_TAG, "Metering mode",
-        print_uint_tag_array, format_metering_mode },
-    { LIGHT_SOURCE_TAG, "Light Source",
-        print_uint_tag_array, format_ligth_source },
-
-    { FLASH_TAG, "Flash", print_uint_tag_array, format_flash },
-    { FOCAL_LENGTH_TAG, "Focal length", print_uint_tag_array, NULL },
-
-    { SUBJECT_AREA_TAG, "Subject Area", print_uint_tag_array, NULL },
-
-    { USER_COMMENT_TAG, "User Comment", print_user_comment, NULL },
-
-    { SUBSEC_TIME_TAG, "Sub-second time", print_string_tag, NULL },
-    { SUBSEC_TIME_ORIGINAL_TAG, "Sub-second original time",
-        print_string_tag, NULL },
-    { SUBSEC_TIME_DIGITIZED_TAG, "Sub-second digitized time",
-        print_string_tag, NULL },
-
-    { FLASHPIX_VERSION_TAG, "Flashpix version", print_string_tag, NULL },
-    { COLOR_SPACE_TAG, "Color Space", print_uint_tag_array,
-        format_color_space },
-
-    { PIXEL_X_DIMENSION_TAG, "Image X dimension in pixels",
-        print_uint_tag_array, NULL },
-    { PIXEL_Y_DIMENSION_TAG, "Image Y dimension in pixels",
-        print_uint_tag_array, NULL },
-    { RELATED_SOUND_FILE_TAG, "Related Sound File", print_string_tag, NULL },
-
-    { SPATIAL_FREQUENCY_RESPONSE_TAG, "Spatial frequency response",
-        print_uint_tag_array, format_hex_bytes },
-
-    { FOCAL_PLANE_X_RESOLUTION_TAG, "Focal Plane X resolution",
-        print_uint_tag_array, NULL },
-    { FOCAL_PLANE_Y_RESOLUTION_TAG, "Focal Plane Y resolution",
-        print_uint_tag_array, NULL },
-    { FOCAL_PLANE_RESOLUTION_UNIT_TAG, "Focal Plane Resolution Unit",
-        print_uint_tag_array, format_resolution_uint },
-
-    { SUBJECT_LOCATION_TAG, "Subject Location (X,Y)",
-        print_uint_tag_array, NULL },
-
-    { EXPOSURE_INDEX_TAG, "Exposure Index", print_uint_tag_array, NULL },
-    { SENSING_METHOD_TAG, "Sensing Method",
-        print_uint_tag_array, format_sensing_method },
-
-    { FILE_SOURCE_TAG, "File Source",
-        print_uint_tag_array, format_file_source },
-    { SCENE_TYPE_TAG, "Scene Type",
-        print_uint_tag_array, format_scene_type },
-
-    // CFS pattern hs been replaced with an ascii string during parsing
-    { CFA_PATTERN_TAG, "Color Filter Array", print_string_tag, NULL },
-    { CUSTOM_RENDERED_TAG, "Data Processing",
-        print_uint_tag_array, format_custom_rendered },
-
-    { EXPOSURE_MODE_TAG, "Exposure Mode",
-        print_uint_tag_array, format_exposure_mode },
-    { WHITE_BALANCE_TAG, "White Balance",
-        print_uint_tag_array, format_white_balance },
-    { DIGITAL_ZOOM_RATIO_TAG, "Digital Zoom Ration",
-        print_uint_tag_array, format_digital_zoom_ratio },
-    { FOCAL_LENGTH_IN_35MM_FILM_TAG, "Focal length in 35mm film",
-        print_uint_tag_array, format_35mm_focal_length },
-
-    { SCENE_CAPTURE_TYPE_TAG, "Scene Capture Type",
-        print_uint_tag_array, format_scene_capture_type },
-    { GAIN_CONTROL_TAG, "Gain Control",
-        print_uint_tag_array, format_gain_control },
-
-    { CONTRAST_TAG, "Contrast", print_uint_tag_array, format_contrast },
-    { SATURATION_TAG, "Saturation", print_uint_tag_array, format_saturation },
-    { SHARPNESS_TAG, "Sharpness", print_uint_tag_array, format_sharpness },
-    { SUBJECT_DISTANCE_RANGE_TAG, "Subject Distance Range",
-        print_uint_tag_array, format_subject_distance_range },
-    { IMAGE_UNIQUE_ID_TAG, "Image Unique ID", print_string_tag, NULL },
-
-    { OWNER_NAME_TAG, "Owner name", print_string_tag, NULL },
-    { BODY_SERIAL_NUMBER_TAG, "Serial Numner", print_string_tag, NULL },
-
-    { LENS_SPECIFICATION_TAG, "Lens Specification",
-        print_uint_tag_array, NULL },
-    { LENS_MAKE_TAG, "Lens Manufacturer", print_string_tag, NULL },
-    { LENS_MODEL_TAG, "Lens Model", print_string_tag, NULL },
-    { LENS_SERIAL_NUMBER_TAG, "Lens serial number", print_string_tag, NULL },
-
-    { COMPOSITE_IMAGE_TAG, "Composition",
-        print_uint_tag_array, format_composite_image },
-    { COMPOSITE_IMAGE_COUNT_TAG, "Composite image count",
-        print_uint_tag_array, NULL },
-    { COMPOSITE_IMAGE_EXPOSURE_TIME_TAG, "Composite image exposure time",
-        print_uint_tag_array, NULL }
+static const print_rule_t print_rules[] = {
+    TAG_SCHEMA( PRINT_RULE )
 };
 
-static ifd_tag_print_t ifd_3_tag_print[] = {
-
-    { GPS_VERSION_ID_TAG, "GPS version", print_uint_tag_array, NULL },
-    { GPS_LATITUDE_REF_TAG, "GPS Latitude reference", print_gps_latitude_ref, NULL },
-    { GPS_LATITUDE_TAG, "GPS Latitude", print_uint_tag_array, gps_coordinates },
-    { GPS_LONGITUDE_REF_TAG, "GPS Longitude reference", print_gps_longitude_ref, NULL },
-    { GPS_LONGITUDE_TAG, "GPS Longitude", print_uint_tag_array, gps_coordinates },
-    { GPS_ALTITUDE_REF_TAG, "GPS Altitude reference", print_gps_altitude_ref, NULL },
-    { GPS_ALTITUDE_TAG, "GPS Altitude", print_uint_tag_array, gps_altitude },
-    { GPS_TIME_STAMP_TAG, "GPS time", print_uint_tag_array, gps_time },
-    { GPS_SATELLITES_TAG, "GPS Satellites", print_string_tag, NULL },
-    { GPS_STATUS_TAG, "GPS Status", print_string_tag, NULL },
-    { GPS_MEASURE_MODE_TAG, "GPS Measure mode", print_string_tag, NULL },
-    { GPS_DOP_TAG, "GPS DOP", print_uint_tag_array, NULL },
-    { GPS_SPEED_REF_TAG, "GPS Speed reference", print_string_tag, NULL },
-    { GPS_SPEED_TAG, "GPS Speed", print_uint_tag_array, NULL },
-    { GPS_TRACK_REF_TAG, "GPS Track reference", print_gps_direction_ref, NULL },
-    { GPS_TRACK_TAG, "GPS Track", print_uint_tag_array, NULL },
-    { GPS_IMG_DIRECTION_REF_TAG, "GPS Image direction reference", print_gps_direction_ref, NULL },
-    { GPS_IMG_DIRECTION_TAG, "GPS Image direction", print_uint_tag_array, gps_angle },
-
-    { GPS_MAP_DATUM_TAG, "GPS Map Datum", print_string_tag, NULL },
-    { GPS_DEST_LATITUDE_REF_TAG, "GPS Destination latitude reference", print_gps_latitude_ref, NULL },
-    { GPS_DEST_LATITUDE_TAG, "GPS Destination latitude", print_uint_tag_array, gps_coordinates },
-    { GPS_DEST_LONGITUDE_REF_TAG, "GPS Destination longitude reference", print_gps_longitude_ref, NULL },
-    { GPS_DEST_LONGITUDE_TAG, "GPS Destination longitude", print_uint_tag_array, gps_coordinates },
-
-    { GPS_DEST_BEARING_REF_TAG, "GPS Destination bearing reference", print_gps_direction_ref, NULL },
-    { GPS_DEST_BEARING_TAG, "GPS Destination bearing", print_uint_tag_array, NULL },
-    { GPS_PROCESSING_METHOD_TAG, "GPS Processing method", print_user_comment, NULL },
-    { GPS_AREA_INFORMATION_TAG, "GPS Area information", print_user_comment, NULL },
-    { GPS_DATE_STAMP_TAG, "GPS UTC Date stamp", print_string_tag, NULL },
-    { GPS_DIFFERENTIAL_TAG, "GPS Differential applied", print_gps_yes_no, NULL },
-    { GPS_H_POSITIONING_ERROR_TAG, "GPS Positioning error", print_uint_tag_array, NULL },
-};
-
-extern void print_ifd_tags( exif_desc_t *desc, ifd_id_t id, slice_t *tags,
-                            char *indent_string )
+extern bool print_ifd_tags( exif_desc_t *desc, ifd_id_t id, slice_t *tags,
+                            char *indent_string, exif_sink_t *sink )
 {
     if ( NULL == tags ) {
-        return;
+        return false;
     }
 
-    ifd_tag_print_t *ptr;
-    int n_tags;
-    switch( id ) {
-    case PRIMARY: case THUMBNAIL:
-        ptr = ifd_01_tag_print;
-        n_tags = sizeof(ifd_01_tag_print)/sizeof(ifd_tag_print_t);
-        break;
-    case EXIF:
-        ptr = ifd_2_tag_print;
-        n_tags = sizeof(ifd_2_tag_print)/sizeof(ifd_tag_print_t);
-        break;
-    case GPS:
-        ptr = ifd_3_tag_print;
-        n_tags = sizeof(ifd_2_tag_print)/sizeof(ifd_tag_print_t);
-        break;
-    case IOP:
-        return;
-    }
+    print_out_t out;
+    out.sink = sink;
+    out.len = 0;
+    out.failed = false;
 
-    int start = -1;
     uint32_t len = slice_len( tags );
     for ( uint32_t i = 0; i < len; ++i ) {
         uint16_t tag = *(uint16_t *)slice_item_at( tags, i );
-
-        int index = start;
-        while ( true ) {
-            ++index;
-            if ( index == n_tags ) {
-                break;
-            }
-
-            if ( ptr[index].tag == tag ) {
-                ptr[index].print( desc, id, tag, indent_string,
-                                  ptr[index].header, ptr[index].format );
-                start = index;
-                break;
-            }
+        const tag_schema_t *schema = schema_lookup( id, tag );
+        if ( NULL != schema && NULL != schema->name ) {
+            const print_rule_t *rule = &print_rules[schema - tag_schema];
+            rule->print( &out, desc, id, tag, indent_string,
+                         schema->name, rule->format );
         }
     }
+    out_flush( &out );
+    if ( EXIF_SINK_MEMORY == sink->type && sink->len < sink->cap ) {
+        sink->buf[sink->len] = 0;
+    }
+    return ! out.failed;
 }
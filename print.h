@@ -1,5 +1,7 @@
 
 #include "exif.h"
 
-extern void print_ifd_tags( exif_desc_t *desc, ifd_id_t id, slice_t *tags,
-                            char *indent_string );
+// print the tags found in IFD id to sink. It returns false if the sink
+// could not be written.
+extern bool print_ifd_tags( exif_desc_t *desc, ifd_id_t id, slice_t *tags,
+                            char *indent_string, exif_sink_t *sink );
@@ -0,0 +1,319 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "exif.h"
+#include "parse.h"
+#include "scan.h"
+
+/*
+    Push parser.
+
+    Data are given by the caller as they arrive, and only what the parser
+    needs is kept:
+
+    PUSH_START      the first bytes decide between a JPEG stream (SOI marker),
+                    a TIFF stream (TIFF header) or a scan for the exif header.
+    PUSH_SEGMENTS   JPEG segments are walked in a small window. Segments that
+                    do not fit in the window are skipped (PUSH_SKIP), without
+                    being kept, until the APP1 Exif segment is found.
+    PUSH_SKIP       data are ignored until the stream offset skip_to.
+    PUSH_SCAN       the exif header is searched, keeping only the last bytes
+                    that could be the beginning of a header.
+    PUSH_TIFF       the TIFF data are kept, up to the end of the APP1 segment
+                    for a JPEG stream. Each time the data reach the size that
+                    was needed the last time, the TIFF data are parsed again
+                    from memory: either the parser needs more data, beyond
+                    IFD or value offsets, or all wanted IFDs and values are
+                    available and the descriptor is complete (PUSH_DONE).
+
+    The stream is never read backwards, so that it can come from a pipe or a
+    socket.
+*/
+
+#define PUSH_WINDOW_SIZE    (64 * 1024)
+#define MAX_PUSH_TIFF_SIZE  (64 * 1024 * 1024)
+#define TIFF_HEADER_SIZE    8
+
+typedef enum {
+    PUSH_START, PUSH_SEGMENTS, PUSH_SKIP, PUSH_SCAN, PUSH_TIFF,
+    PUSH_DONE, PUSH_FAILED
+} push_state_t;
+
+struct _exif_push {
+    exif_control_t      control;
+    push_state_t        state;
+    uint64_t            received;       // stream bytes given so far
+    uint64_t            skip_to;        // stream offset for PUSH_SKIP
+
+    uint8_t             *data;          // kept data
+    size_t              len, size;
+    uint64_t            base;           // stream offset of data[0]
+    size_t              limit;          // max TIFF data size
+    size_t              want;           // TIFF data size for next parsing
+
+    exif_desc_t         *desc;
+};
+
+extern exif_push_t *exif_push_new( exif_control_t *control )
+{
+    exif_push_t *p = calloc( 1, sizeof(exif_push_t) );
+    if ( NULL != p && NULL != control ) {
+        p->control = *control;
+    }
+    return p;
+}
+
+extern void exif_push_free( exif_push_t *p )
+{
+    if ( NULL != p ) {
+        exif_free( p->desc );
+        free( p->data );
+        free( p );
+    }
+}
+
+// append at most n bytes from data, without exceeding max bytes kept, and
+// return the number of bytes appended.
+static size_t keep_data( exif_push_t *p, const uint8_t *data, size_t n,
+                         size_t max )
+{
+    if ( p->len >= max ) {
+        return 0;
+    }
+    if ( n > max - p->len ) {
+        n = max - p->len;
+    }
+    if ( p->len + n > p->size ) {
+        size_t size = 2 * p->size;
+        if ( size < p->len + n ) {
+            size = p->len + n;
+        }
+        uint8_t *kept = realloc( p->data, size );
+        if ( NULL == kept ) {
+            p->state = PUSH_FAILED;
+            return 0;
+        }
+        p->data = kept;
+        p->size = size;
+    }
+    memcpy( p->data + p->len, data, n );
+    p->len += n;
+    p->received += n;
+    return n;
+}
+
+// drop the first n bytes kept
+static void drop_data( exif_push_t *p, size_t n )
+{
+    memmove( p->data, p->data + n, p->len - n );
+    p->len -= n;
+    p->base += n;
+}
+
+static void start_tiff( exif_push_t *p, size_t limit )
+{
+    p->state = PUSH_TIFF;
+    p->limit = limit;
+    p->want = TIFF_HEADER_SIZE;
+    if ( p->len > limit ) {
+        p->len = limit;             // following data are not needed
+    }
+}
+
+// parse the TIFF data kept, and either update the size wanted for the next
+// parsing, or terminate with the resulting descriptor.
+static void parse_tiff_data( exif_push_t *p )
+{
+    // in lazy mode, values are not read during parsing: the size of the data
+    // is found with an eager parsing before the final lazy parsing.
+    exif_control_t eager = p->control;
+    eager.lazy_values = false;
+
+    size_t needed = 0;
+    exif_desc_t *desc = parse_tiff_buffer( p->data, p->len, &eager, &needed );
+    if ( needed > p->len && p->len < p->limit ) {
+        exif_free( desc );
+        p->want = ( needed < p->limit ) ? needed : p->limit;
+        return;
+    }
+    if ( NULL != desc && p->control.lazy_values ) {
+        exif_free( desc );
+        desc = parse_tiff_buffer( p->data, p->len, &p->control, NULL );
+    }
+    if ( NULL == desc ) {
+        p->state = PUSH_FAILED;
+        return;
+    }
+    desc->own_data = p->data;       // kept data belong to the descriptor
+    p->data = NULL;
+    p->len = p->size = 0;
+    p->desc = desc;
+    p->state = PUSH_DONE;
+}
+
+static void walk_segments( exif_push_t *p )
+{
+    size_t pos = 0;
+    uint32_t tiff_size;
+    switch ( walk_jpeg_segments( p->data, p->len, &pos, &tiff_size ) ) {
+    case EXIF_SEGMENT:
+        drop_data( p, pos );
+        start_tiff( p, tiff_size );
+        break;
+    case TRUNCATED_JPEG:
+        if ( pos <= p->len ) {
+            if ( 0 == pos && PUSH_WINDOW_SIZE == p->len ) {
+                p->state = PUSH_FAILED;     // no progress
+            }
+            drop_data( p, pos );
+        } else {
+            p->skip_to = p->base + pos;
+            p->base = p->received;
+            p->len = 0;
+            p->state = PUSH_SKIP;
+        }
+        break;
+    case NOT_A_JPEG:
+        p->state = PUSH_SCAN;               // broken structure
+        break;
+    default:
+        p->state = PUSH_FAILED;
+        break;
+    }
+}
+
+static void scan_header( exif_push_t *p )
+{
+    size_t i = scan_exif_header( p->data, p->len );
+    if ( i < p->len ) {
+        drop_data( p, i + ORIGIN_OFFSET );
+        start_tiff( p, MAX_PUSH_TIFF_SIZE );
+    } else if ( p->len >= ORIGIN_OFFSET ) { // keep a possible partial header
+        drop_data( p, p->len - ( ORIGIN_OFFSET - 1 ) );
+    }
+}
+
+static void check_start( exif_push_t *p )
+{
+    const uint8_t *d = p->data;
+    if ( JPEG_MARKER == d[0] && JPEG_SOI == d[1] ) {
+        drop_data( p, 2 );
+        p->state = PUSH_SEGMENTS;
+    } else if ( ( 'I' == d[0] && 'I' == d[1] && 42 == d[2] && 0 == d[3] ) ||
+                ( 'M' == d[0] && 'M' == d[1] && 0 == d[2] && 42 == d[3] ) ) {
+        start_tiff( p, MAX_PUSH_TIFF_SIZE );
+    } else {
+        p->state = PUSH_SCAN;
+    }
+}
+
+extern exif_push_status_t exif_push( exif_push_t *p,
+                                     const uint8_t *data, size_t len )
+{
+    if ( NULL == p || ( NULL == data && 0 != len ) ) {
+        return EXIF_PUSH_FAILED;
+    }
+    while ( PUSH_DONE != p->state && PUSH_FAILED != p->state ) {
+        push_state_t state = p->state;
+        size_t n = 0;
+        switch ( state ) {
+        case PUSH_START:
+            n = keep_data( p, data, len, 4 );
+            if ( 4 == p->len ) {
+                check_start( p );
+            }
+            break;
+        case PUSH_SEGMENTS:
+            n = keep_data( p, data, len, PUSH_WINDOW_SIZE );
+            walk_segments( p );
+            break;
+        case PUSH_SKIP:
+            n = ( p->skip_to - p->received < len ) ?
+                                (size_t)( p->skip_to - p->received ) : len;
+            p->received += n;
+            if ( p->received == p->skip_to ) {
+                p->base = p->received;
+                p->state = PUSH_SEGMENTS;
+            }
+            break;
+        case PUSH_SCAN:
+            n = keep_data( p, data, len, PUSH_WINDOW_SIZE );
+            scan_header( p );
+            break;
+        default:    // PUSH_TIFF
+            n = keep_data( p, data, len, p->limit );
+            if ( p->len >= p->want || p->len == p->limit ) {
+                parse_tiff_data( p );
+            }
+            break;
+        }
+        data += n;
+        len -= n;
+        if ( 0 == len && state == p->state ) {
+            break;                  // wait for more data
+        }
+    }
+    switch ( p->state ) {
+    case PUSH_DONE:     return EXIF_PUSH_DONE;
+    case PUSH_FAILED:   return EXIF_PUSH_FAILED;
+    default:            return EXIF_PUSH_MORE;
+    }
+}
+
+extern exif_push_status_t exif_push_end( exif_push_t *p )
+{
+    if ( NULL == p ) {
+        return EXIF_PUSH_FAILED;
+    }
+    if ( PUSH_TIFF == p->state ) {
+        p->limit = p->len;          // no more data: parse what is kept
+        parse_tiff_data( p );
+    } else if ( PUSH_DONE != p->state ) {
+        p->state = PUSH_FAILED;
+    }
+    return ( PUSH_DONE == p->state ) ? EXIF_PUSH_DONE : EXIF_PUSH_FAILED;
+}
+
+extern bool exif_push_get_needed( exif_push_t *p,
+                                  uint64_t *offset, size_t *size )
+{
+    if ( NULL == p ) {
+        return false;
+    }
+    uint64_t start = p->base + p->len;
+    size_t n = 0;                   // unknown
+    switch ( p->state ) {
+    case PUSH_START:
+        n = 4 - p->len;
+        break;
+    case PUSH_SKIP:
+        start = p->skip_to;
+        break;
+    case PUSH_TIFF:
+        n = p->want - p->len;
+        break;
+    case PUSH_SEGMENTS: case PUSH_SCAN:
+        break;
+    default:
+        return false;
+    }
+    if ( NULL != offset ) {
+        *offset = start;
+    }
+    if ( NULL != size ) {
+        *size = n;
+    }
+    return true;
+}
+
+extern exif_desc_t *exif_push_get_desc( exif_push_t *p )
+{
+    if ( NULL == p ) {
+        return NULL;
+    }
+    exif_desc_t *desc = p->desc;
+    p->desc = NULL;                 // now owned by the caller
+    return desc;
+}
@@ -0,0 +1,184 @@
+
+#include <string.h>
+
+#include "scan.h"
+
+#define EXIF_HEADER_SIZE 6
+
+static const uint8_t exif_header[EXIF_HEADER_SIZE] = { 'E', 'x', 'i', 'f', 0, 0 };
+
+// bitap table for Exif, inverted so that all other bytes are 0: the mask for
+// a byte is the complement of its table entry.
+static const unsigned char inverted_masks[256] = {
+    ['E'] = 0x01,       // E position at bit 0 in pattern,
+    ['x'] = 0x02,       // x position at bit 1,
+    ['i'] = 0x04,       // i position at bit 2,
+    ['f'] = 0x08,       // f position at bit 3,
+    [ 0 ] = 0x30        // \0 at 2 positions, bits 4 and 5.
+};
+
+static size_t scan_bitap( const uint8_t *data, size_t len )
+{
+    unsigned char bit_mask = 0xfe;
+
+    for ( size_t i = 0; i < len; ++i ) {
+        bit_mask |= (unsigned char)~inverted_masks[data[i]];
+        bit_mask <<= 1;
+        if ( 0 == ( bit_mask & 64 ) ) {
+            return i + 1 - EXIF_HEADER_SIZE;
+        }
+    }
+    return len;
+}
+
+// The vectorized variants compare W bytes at once with 'E' and the W bytes
+// starting 5 bytes further with '\0', which are the first and last header
+// bytes. Only the candidate positions where both match are then verified.
+// The last positions, for which W+5 bytes cannot be loaded, are verified
+// one by one.
+static inline bool is_exif_header( const uint8_t *data )
+{
+    return 0 == memcmp( data, exif_header, EXIF_HEADER_SIZE );
+}
+
+static size_t scan_tail( const uint8_t *data, size_t i, size_t len )
+{
+    for ( ; len - i >= EXIF_HEADER_SIZE; ++i ) {
+        if ( 'E' == data[i] && is_exif_header( data + i ) ) {
+            return i;
+        }
+    }
+    return len;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+
+#define SIMD_SCAN 1
+
+static size_t scan_sse2( const uint8_t *data, size_t len )
+{
+    const __m128i first = _mm_set1_epi8( 'E' );
+    const __m128i last = _mm_setzero_si128( );
+
+    size_t i = 0;
+    for ( ; len - i >= 16 + EXIF_HEADER_SIZE - 1; i += 16 ) {
+        __m128i b0 = _mm_loadu_si128( (const __m128i *)(data + i) );
+        __m128i b5 = _mm_loadu_si128( (const __m128i *)(data + i + 5) );
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+                                _mm_and_si128( _mm_cmpeq_epi8( b0, first ),
+                                               _mm_cmpeq_epi8( b5, last ) ) );
+        while ( mask ) {
+            size_t j = i + __builtin_ctz( mask );
+            if ( is_exif_header( data + j ) ) {
+                return j;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return scan_tail( data, i, len );
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2( const uint8_t *data, size_t len )
+{
+    const __m256i first = _mm256_set1_epi8( 'E' );
+    const __m256i last = _mm256_setzero_si256( );
+
+    size_t i = 0;
+    for ( ; len - i >= 32 + EXIF_HEADER_SIZE - 1; i += 32 ) {
+        __m256i b0 = _mm256_loadu_si256( (const __m256i *)(data + i) );
+        __m256i b5 = _mm256_loadu_si256( (const __m256i *)(data + i + 5) );
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                            _mm256_and_si256( _mm256_cmpeq_epi8( b0, first ),
+                                              _mm256_cmpeq_epi8( b5, last ) ) );
+        while ( mask ) {
+            size_t j = i + __builtin_ctz( mask );
+            if ( is_exif_header( data + j ) ) {
+                return j;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return scan_tail( data, i, len );
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t scan_avx512( const uint8_t *data, size_t len )
+{
+    const __m512i first = _mm512_set1_epi8( 'E' );
+    const __m512i last = _mm512_setzero_si512( );
+
+    size_t i = 0;
+    for ( ; len - i >= 64 + EXIF_HEADER_SIZE - 1; i += 64 ) {
+        __m512i b0 = _mm512_loadu_si512( (const void *)(data + i) );
+        __m512i b5 = _mm512_loadu_si512( (const void *)(data + i + 5) );
+        uint64_t mask = _mm512_cmpeq_epi8_mask( b0, first ) &
+                        _mm512_cmpeq_epi8_mask( b5, last );
+        while ( mask ) {
+            size_t j = i + __builtin_ctzll( mask );
+            if ( is_exif_header( data + j ) ) {
+                return j;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return scan_tail( data, i, len );
+}
+#endif
+
+extern bool scan_variant_supported( scan_variant_t variant )
+{
+    switch ( variant ) {
+    case SCAN_BITAP: case SCAN_AUTO:
+        return true;
+#ifdef SIMD_SCAN
+    case SCAN_SSE2:
+        return true;            // always available on x86_64
+    case SCAN_AVX2:
+        return __builtin_cpu_supports( "avx2" );
+    case SCAN_AVX512:
+        return __builtin_cpu_supports( "avx512f" ) &&
+               __builtin_cpu_supports( "avx512bw" );
+#endif
+    default:
+        break;
+    }
+    return false;
+}
+
+extern const char *scan_variant_name( scan_variant_t variant )
+{
+    switch ( variant ) {
+    case SCAN_BITAP:    return "bitap";
+    case SCAN_SSE2:     return "sse2";
+    case SCAN_AVX2:     return "avx2";
+    case SCAN_AVX512:   return "avx512";
+    case SCAN_AUTO:     return "auto";
+    }
+    return NULL;
+}
+
+extern size_t scan_exif_header_variant( scan_variant_t variant,
+                                        const uint8_t *data, size_t len )
+{
+    if ( SCAN_AUTO == variant ) {   // cpu features are cached by libgcc
+        if ( scan_variant_supported( SCAN_AVX512 ) ) {
+            variant = SCAN_AVX512;
+        } else if ( scan_variant_supported( SCAN_AVX2 ) ) {
+            variant = SCAN_AVX2;
+        } else {
+            variant = SCAN_SSE2;
+        }
+    }
+    switch ( variant ) {
+#ifdef SIMD_SCAN
+    case SCAN_SSE2:     return scan_sse2( data, len );
+    case SCAN_AVX2:     return scan_avx2( data, len );
+    case SCAN_AVX512:   return scan_avx512( data, len );
+#endif
+    default:
+        break;
+    }
+    return scan_bitap( data, len );
+}
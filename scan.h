@@ -0,0 +1,33 @@
+
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Exif header scanners. All variants return the same result, the position
+// of the first byte of the first "Exif\x0\x0" header found in data, or len
+// if there is none. SCAN_BITAP is the portable reference implementation,
+// the other variants are vectorized and available only on x86_64 and if
+// the processor supports them.
+typedef enum {
+    SCAN_BITAP,             // shift-or, 1 byte per iteration
+    SCAN_SSE2,              // 16 bytes per iteration
+    SCAN_AVX2,              // 32 bytes per iteration
+    SCAN_AVX512,            // 64 bytes per iteration (AVX-512BW)
+    SCAN_AUTO               // best variant supported by the processor
+} scan_variant_t;
+
+extern bool scan_variant_supported( scan_variant_t variant );
+extern const char *scan_variant_name( scan_variant_t variant );
+
+extern size_t scan_exif_header_variant( scan_variant_t variant,
+                                        const uint8_t *data, size_t len );
+
+static inline size_t scan_exif_header( const uint8_t *data, size_t len )
+{
+    return scan_exif_header_variant( SCAN_AUTO, data, len );
+}
+
+#endif /* __SCAN_H__ */
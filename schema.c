@@ -0,0 +1,91 @@
+#include "schema.h"
+
+#define SCHEMA_ROW( ifds, tag, types, min, max, parse, name, print, format ) \
+    { tag, SCHEMA_IFD_##ifds, PARSE_##parse, SCHEMA_TYPE_##types,           \
+      min, max, name },
+
+const tag_schema_t tag_schema[] = {
+    TAG_SCHEMA( SCHEMA_ROW )
+};
+
+// C99 static assertion: a negative array size does not compile.
+#define SCHEMA_CHECK( name, cond )  typedef char name[ (cond) ? 1 : -1 ]
+
+// Rows are found through a direct index generated at compile time: the high
+// byte of a tag selects a page of 256 slots for its IFD, and the low byte
+// selects a slot in that page, which gives the row index + 1, or 0 if the tag
+// is not known in that IFD. Page 0 stays empty for all unused high bytes.
+//
+// SCHEMA_PAGES lists the high bytes of the known tags, each giving a page.
+// A tag whose high byte is missing in this list does not compile.
+#define SCHEMA_PAGES( X, a )                                                \
+    X( 0x00, a ) X( 0x01, a ) X( 0x02, a ) X( 0x10, a ) X( 0x82, a )        \
+    X( 0x87, a ) X( 0x88, a ) X( 0x90, a ) X( 0x91, a ) X( 0x92, a )        \
+    X( 0x9a, a ) X( 0x9c, a ) X( 0xa0, a ) X( 0xa2, a ) X( 0xa3, a )        \
+    X( 0xa4, a ) X( 0xc4, a ) X( 0xc6, a ) X( 0xea, a )
+
+#define SCHEMA_PAGE_ID( high, a )   SCHEMA_PAGE_##high,
+enum {                              // a duplicate high byte does not compile
+    SCHEMA_PAGES( SCHEMA_PAGE_ID, ~ )
+    SCHEMA_N_PAGES
+};
+
+// page of a tag as a constant expression, 0 if its high byte is not listed
+#define SCHEMA_PAGE_IF( high, tag ) \
+    ( (high) == ( (tag) >> 8 ) ) ? SCHEMA_PAGE_##high + 1 :
+#define SCHEMA_PAGE( tag )          ( SCHEMA_PAGES( SCHEMA_PAGE_IF, tag ) 0 )
+
+#define SCHEMA_PAGE_MAP( high, a )  [high] = SCHEMA_PAGE_##high + 1,
+static const uint8_t schema_page_map[256] = {
+    SCHEMA_PAGES( SCHEMA_PAGE_MAP, ~ )
+};
+
+// IFDs of each SCHEMA_IFD_<ifds> combination used in TAG_SCHEMA
+#define SCHEMA_FOR_TIFF( F, tag, row )      F( PRIMARY, tag, row )          \
+                                            F( THUMBNAIL, tag, row )
+#define SCHEMA_FOR_EXIF( F, tag, row )      F( EXIF, tag, row )
+#define SCHEMA_FOR_GPS( F, tag, row )       F( GPS, tag, row )
+#define SCHEMA_FOR_IOP( F, tag, row )       F( IOP, tag, row )
+#define SCHEMA_FOR_TIFF_EXIF( F, tag, row ) SCHEMA_FOR_TIFF( F, tag, row )  \
+                                            F( EXIF, tag, row )
+#define SCHEMA_FOR_TIFF_IOP( F, tag, row )  SCHEMA_FOR_TIFF( F, tag, row )  \
+                                            F( IOP, tag, row )
+
+#define SCHEMA_ROW_ID( ifds, tag, types, min, max, parse, name, print,      \
+                       format )     SCHEMA_ROW_##ifds##_##tag,
+enum {
+    TAG_SCHEMA( SCHEMA_ROW_ID )
+    SCHEMA_N_ROWS
+};
+SCHEMA_CHECK( schema_rows_fit_in_slots, SCHEMA_N_ROWS < 256 );
+
+// a tag with two rows in the same IFD does not compile
+#define SCHEMA_IFD_TAG( id, tag, row )      SCHEMA_##id##_##tag,
+#define SCHEMA_UNIQUE( ifds, tag, types, min, max, parse, name, print,      \
+                       format )     SCHEMA_FOR_##ifds( SCHEMA_IFD_TAG, tag, ~ )
+enum {
+    TAG_SCHEMA( SCHEMA_UNIQUE )
+};
+
+#define SCHEMA_PAGE_CHECK( ifds, tag, types, min, max, parse, name, print,  \
+                           format )                                         \
+    SCHEMA_CHECK( schema_page_##ifds##_##tag, 0 != SCHEMA_PAGE( tag ) );
+TAG_SCHEMA( SCHEMA_PAGE_CHECK )
+
+#define SCHEMA_SLOT( id, tag, row )                                         \
+    [id][SCHEMA_PAGE( tag )][(tag) & 0xff] = (row) + 1,
+#define SCHEMA_SLOTS( ifds, tag, types, min, max, parse, name, print,       \
+                      format )                                              \
+    SCHEMA_FOR_##ifds( SCHEMA_SLOT, tag, SCHEMA_ROW_##ifds##_##tag )
+static const uint8_t schema_index[_IFD_N][SCHEMA_N_PAGES + 1][256] = {
+    TAG_SCHEMA( SCHEMA_SLOTS )
+};
+
+extern const tag_schema_t *schema_lookup( ifd_id_t id, uint16_t tag )
+{
+    if ( id < PRIMARY || id >= _IFD_N ) {
+        return NULL;
+    }
+    uint8_t row = schema_index[id][schema_page_map[tag >> 8]][tag & 0xff];
+    return ( 0 == row ) ? NULL : &tag_schema[row-1];
+}
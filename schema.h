@@ -0,0 +1,418 @@
+#ifndef __SCHEMA_H__
+#define __SCHEMA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "exif.h"
+#include "parse.h"
+
+// The tag schema is the single description of all known tags: for each tag,
+// the IFDs it is expected in, the accepted TIFF types and counts, how its
+// values are parsed and how they are printed. Each row is
+//
+//  X( ifds, tag, types, min, max, parse, name, print, format )
+//
+// ifds:    TIFF (PRIMARY and THUMBNAIL), EXIF, GPS, IOP or a combination
+//          (SCHEMA_IFD_<ifds> below). A tag may have several rows, provided
+//          that their IFDs are different.
+// types:   accepted TIFF types (SCHEMA_TYPE_<types> below).
+// min:     minimum count, max: maximum count or 0 if unlimited.
+// parse:   how entries are processed (PARSE_<parse> below), once their type
+//          and count have been accepted.
+// name:    the name printed, or NULL if the tag is not printed.
+// print:   the print function (see print.c) and format, the optional value
+// format:  formatter given to the print function.
+//
+// Each module expands the rows for its own needs: schema.c for the tag
+// lookup, parse.c and print.c (see print_rules) for parsing and printing.
+// Tags are known by their values given in exif.h and parse.h.
+
+#define TAG_SCHEMA( X )                                                     \
+    /* PRIMARY and THUMBNAIL IFDs */                                        \
+    X( TIFF, PROCESSING_SOFTWARE, STRING, 1, 0, VALUES,                     \
+       "Processing Software", print_string_tag, NULL )                      \
+    X( TIFF, IMAGE_WIDTH_TAG, SHORT_LONG, 1, 1, VALUES,                     \
+       "Image Width", print_uint_tag_array, NULL )                          \
+    X( TIFF, IMAGE_LENGTH_TAG, SHORT_LONG, 1, 1, VALUES,                    \
+       "Image Length", print_uint_tag_array, NULL )                         \
+    X( TIFF, BITS_PER_SAMPLE_TAG, INTEGER, 0, 0, VALUES,                    \
+       "Bits per Sample", print_uint_tag_array, NULL )                      \
+    X( TIFF, COMPRESSION_TAG, SHORT, 1, 1, VALUES,                          \
+       "Compression", print_uint_tag_array, format_compression )            \
+    X( TIFF, PHOTOMETRIC_INTERPRETATION_TAG, SHORT, 1, 1, VALUES,           \
+       "Photographic Interpretation", print_uint_tag_array,                 \
+       format_photographic_interpretation )                                 \
+    X( TIFF, IMAGE_DESCRIPTION_TAG, STRING, 1, 0, VALUES,                   \
+       "Image Description", print_string_tag, NULL )                        \
+    X( TIFF, MAKE_TAG, STRING, 1, 0, VALUES,                                \
+       "Manufacturer", print_string_tag, NULL )                             \
+    X( TIFF, MODEL_TAG, STRING, 1, 0, VALUES,                               \
+       "Model", print_string_tag, NULL )                                    \
+    X( TIFF, STRIP_OFFSETS_TAG, SHORT_LONG, 0, 0, VALUES,                   \
+       "Strip offsets", print_uint_tag_array, NULL )                        \
+    X( TIFF, ORIENTATION_TAG, SHORT, 1, 1, VALUES,                          \
+       "Image Orientation", print_uint_tag_array, format_orientation )      \
+    X( TIFF, SAMPLES_PER_PIXEL_TAG, SHORT, 1, 1, VALUES,                    \
+       "Samples per Pixel", print_uint_tag_array, NULL )                    \
+    X( TIFF, ROWS_PER_STRIP_TAG, SHORT_LONG, 1, 1, VALUES,                  \
+       "Rows per strip", print_uint_tag_array, NULL )                       \
+    X( TIFF, STRIP_BYTE_COUNTS_TAG, SHORT_LONG, 0, 0, VALUES,               \
+       "Strip byte counts", print_uint_tag_array, NULL )                    \
+    X( TIFF, X_RESOLUTION_TAG, RATIONAL, 1, 1, VALUES,                      \
+       "X Resolution", print_uint_tag_array, NULL )                         \
+    X( TIFF, Y_RESOLUTION_TAG, RATIONAL, 1, 1, VALUES,                      \
+       "Y Resolution", print_uint_tag_array, NULL )                         \
+    X( TIFF, PLANAR_CONFIGURATION_TAG, SHORT, 1, 1, VALUES,                 \
+       "Planar Configuration", print_uint_tag_array,                        \
+       format_planar_configuration )                                        \
+    X( TIFF, RESOLUTION_UNIT_TAG, SHORT, 1, 1, VALUES,                      \
+       "Resolution unit", print_uint_tag_array, format_resolution_unit )    \
+    X( TIFF, SOFTWARE_TAG, STRING, 1, 0, VALUES,                            \
+       "Software", print_string_tag, NULL )                                 \
+    X( TIFF, DATE_TIME_TAG, STRING, 1, 0, VALUES,                           \
+       "Date", print_string_tag, NULL )                                     \
+    X( TIFF, ARTIST_TAG, STRING, 1, 0, VALUES,                              \
+       "Artist", print_string_tag, NULL )                                   \
+    X( TIFF, HOST_COMPUTER_TAG, STRING, 1, 0, VALUES,                       \
+       "HostComputer", print_string_tag, NULL )                             \
+    X( TIFF, WHITE_POINT_TAG, RATIONAL, 2, 2, VALUES,                       \
+       "White point", print_uint_tag_array, NULL )                          \
+    X( TIFF, PRIMARY_CHROMACITIES_TAG, RATIONAL, 6, 6, VALUES,              \
+       "Primary Chromacities", print_uint_tag_array, NULL )                 \
+    X( TIFF, TILE_WIDTH_TAG, SHORT_LONG, 1, 1, VALUES,                      \
+       "Tile width", print_uint_tag_array, NULL )                           \
+    X( TIFF, TILE_LENGTH_TAG, SHORT_LONG, 1, 1, VALUES,                     \
+       "Tile length", print_uint_tag_array, NULL )                          \
+    X( TIFF, TILE_OFFSETS_TAG, LONG, 1, 1, VALUES,                          \
+       "Tiles offset in TIFF", print_uint_tag_array, NULL )                 \
+    X( TIFF, TILE_BYTE_COUNTS_TAG, SHORT_LONG, 1, 1, VALUES,                \
+       "Tiles size in bytes", print_uint_tag_array, NULL )                  \
+    X( TIFF, JPEG_INTERCHANGE_FORMAT_TAG, LONG, 1, 1, THUMB_OFFSET,         \
+       NULL, NULL, NULL )                                                   \
+    X( TIFF, JPEG_INTERCHANGE_FORMAT_LENGTH_TAG, LONG, 1, 1, THUMB_SIZE,    \
+       NULL, NULL, NULL )                                                   \
+    X( TIFF, YCBCR_COEFFICIENTS_TAG, RATIONAL, 3, 3, VALUES,                \
+       "YCbCr Coefficients", print_uint_tag_array, NULL )                   \
+    X( TIFF, YCBCR_SUBSAMPLING_TAG, SHORT, 2, 2, VALUES,                    \
+       "YCbCr Subsampling", print_uint_tag_array, NULL )                    \
+    X( TIFF, YCBCR_POSITIONING_TAG, SHORT, 1, 1, VALUES,                    \
+       "YCbCr Positioning", print_uint_tag_array, format_ycbcr_positioning )\
+    X( TIFF, REFERENCE_BLACK_WHITE_TAG, RATIONAL, 6, 6, VALUES,             \
+       "Reference Black, White", print_uint_tag_array, NULL )               \
+    X( TIFF, UNKNOWN_TAG1, ANY, 0, 0, IGNORE, NULL, NULL, NULL )            \
+    X( TIFF, UNKNOWN_TAG2, ANY, 0, 0, IGNORE, NULL, NULL, NULL )            \
+    X( TIFF, UNKNOWN_TAG3, ANY, 0, 0, IGNORE, NULL, NULL, NULL )            \
+    X( TIFF, UNKNOWN_TAG4, ANY, 0, 0, IGNORE, NULL, NULL, NULL )            \
+    X( TIFF, COPYRIGHT_TAG, STRING, 1, 0, VALUES,                           \
+       "Copyright", print_string_tag, NULL )                                \
+    X( TIFF, EXIF_IFD_TAG, LONG, 1, 1, EXIF_IFD, NULL, NULL, NULL )         \
+    X( TIFF, GPS_IFD_TAG, LONG, 1, 1, GPS_IFD, NULL, NULL, NULL )           \
+    X( TIFF, XP_COMMENT, ANY, 0, 0, IGNORE, NULL, NULL, NULL )              \
+    X( TIFF, DIGITAL_ZOOM_RATIO_TAG, RATIONAL, 1, 1, VALUES,                \
+       NULL, NULL, NULL )                                                   \
+    X( TIFF, PRINT_IM_TAG, UNDEFINED, 0, 0, VALUES,                         \
+       "Print IM", print_uint_tag_array, format_hex_bytes )                 \
+    X( TIFF, PANASONIC_TITLE, ANY, 0, 0, IGNORE, NULL, NULL, NULL )         \
+    X( TIFF, PANASONIC_TITLE2, ANY, 0, 0, IGNORE, NULL, NULL, NULL )        \
+                                                                            \
+    /* EXIF tags also found in PRIMARY or THUMBNAIL IFDs */                 \
+    X( TIFF_IOP, RELATED_IMAGE_WIDTH_TAG, SHORT, 1, 1, VALUES,              \
+       NULL, NULL, NULL )                                                   \
+    X( TIFF_IOP, RELATED_IMAGE_HEIGHT_TAG, SHORT, 1, 1, VALUES,             \
+       NULL, NULL, NULL )                                                   \
+    X( TIFF_EXIF, UNKNOWN_TAG5, ANY, 0, 0, IGNORE, NULL, NULL, NULL )       \
+    X( TIFF_EXIF, UNKNOWN_TAG6, ANY, 0, 0, IGNORE, NULL, NULL, NULL )       \
+    X( TIFF_EXIF, CUSTOM_RENDERED_TAG, SHORT, 1, 1, VALUES,                 \
+       "Data Processing", print_uint_tag_array, format_custom_rendered )    \
+    X( TIFF_EXIF, EXPOSURE_MODE_TAG, SHORT, 1, 1, VALUES,                   \
+       "Exposure Mode", print_uint_tag_array, format_exposure_mode )        \
+    X( TIFF_EXIF, WHITE_BALANCE_TAG, SHORT, 1, 1, VALUES,                   \
+       "White Balance", print_uint_tag_array, format_white_balance )        \
+    X( TIFF_EXIF, FOCAL_LENGTH_IN_35MM_FILM_TAG, SHORT, 1, 1, VALUES,       \
+       "Focal length in 35mm film", print_uint_tag_array,                   \
+       format_35mm_focal_length )                                           \
+    X( TIFF_EXIF, SCENE_CAPTURE_TYPE_TAG, SHORT, 1, 1, VALUES,              \
+       "Scene Capture Type", print_uint_tag_array,                          \
+       format_scene_capture_type )                                          \
+    X( TIFF_EXIF, GAIN_CONTROL_TAG, SHORT, 1, 1, VALUES,                    \
+       "Gain Control", print_uint_tag_array, format_gain_control )          \
+    X( TIFF_EXIF, CONTRAST_TAG, SHORT, 1, 1, VALUES,                        \
+       "Contrast", print_uint_tag_array, format_contrast )                  \
+    X( TIFF_EXIF, SATURATION_TAG, SHORT, 1, 1, VALUES,                      \
+       "Saturation", print_uint_tag_array, format_saturation )              \
+    X( TIFF_EXIF, SHARPNESS_TAG, SHORT, 1, 1, VALUES,                       \
+       "Sharpness", print_uint_tag_array, format_sharpness )                \
+    X( TIFF_EXIF, SUBJECT_DISTANCE_RANGE_TAG, SHORT, 1, 1, VALUES,          \
+       "Subject Distance Range", print_uint_tag_array,                      \
+       format_subject_distance_range )                                      \
+    X( TIFF_EXIF, PADDING_TAG, ANY, 0, 0, IGNORE, NULL, NULL, NULL )        \
+                                                                            \
+    /* EXIF IFD */                                                          \
+    X( EXIF, EXPOSURE_TIME_TAG, URATIONAL, 1, 1, VALUES,                    \
+       "Exposure Time", print_uint_tag_array, format_exposure_time )        \
+    X( EXIF, FNUMBER_TAG, URATIONAL, 1, 1, VALUES,                          \
+       "FNumber", print_uint_tag_array, NULL )                              \
+    X( EXIF, EXPOSURE_PROGRAM_TAG, SHORT, 1, 1, VALUES,                     \
+       "Exposure Program", print_uint_tag_array, format_exposure_program )  \
+    X( EXIF, ISO_SPEED_RATINGS_TAG, SHORT, 1, 1, VALUES,                    \
+       "ISO Speed Ratings", print_uint_tag_array, NULL )                    \
+    X( EXIF, SENSITIVITY_TYPE_TAG, SHORT, 1, 1, VALUES,                     \
+       "Sensitivity type", print_uint_tag_array, format_sensitivity_type )  \
+    X( EXIF, STANDARD_OUTPUT_SENSITIVITY_TAG, LONG, 1, 1, VALUES,           \
+       "Standard output sensitivity", print_uint_tag_array, NULL )          \
+    X( EXIF, RECOMMENDED_EXPOSURE_INDEX_TAG, LONG, 1, 1, VALUES,            \
+       "Recommended exposure index", print_uint_tag_array, NULL )           \
+    X( EXIF, EXIF_VERSION_TAG, UNDEFINED, 4, 4, VERSION,                    \
+       "Exif version", print_string_tag, NULL )                             \
+    X( EXIF, DATE_TIME_ORIGINAL_TAG, STRING, 1, 0, VALUES,                  \
+       "Original Picture Date", print_string_tag, NULL )                    \
+    X( EXIF, DATE_TIME_DIGITIZED_TAG, STRING, 1, 0, VALUES,                 \
+       "Digitized Picture Date", print_string_tag, NULL )                   \
+    X( EXIF, OFFSET_TIME_TAG, STRING, 1, 0, VALUES,                         \
+       "Time offset from UTC", print_string_tag, NULL )                     \
+    X( EXIF, OFFSET_TIME_ORIGINAL_TAG, STRING, 1, 0, VALUES,                \
+       "Original Picture Time offset from UTC", print_string_tag, NULL )    \
+    X( EXIF, OFFSET_TIME_DIGITIZED_TAG, STRING, 1, 0, VALUES,               \
+       "Digitized Picture Time offset from UTC", print_string_tag, NULL )   \
+    X( EXIF, COMPONENTS_CONFIGURATION_TAG, UNDEFINED, 0, 4, COMPONENTS,     \
+       "Components configuration", print_string_tag, NULL )                 \
+    X( EXIF, COMPRESSED_BITS_PER_PIXEL_TAG, URATIONAL, 1, 1, VALUES,        \
+       "Compressed bits per pixel", print_uint_tag_array, NULL )            \
+    X( EXIF, SHUTTER_SPEED_VALUE_TAG, RATIONAL, 1, 1, VALUES,               \
+       "Shutter-speed value", print_uint_tag_array, format_srational )      \
+    X( EXIF, APERTURE_VALUE_TAG, URATIONAL, 1, 1, VALUES,                   \
+       "Aperture Value", print_uint_tag_array, NULL )                       \
+    X( EXIF, BRIGHTNESS_VALUE_TAG, RATIONAL, 1, 1, VALUES,                  \
+       "Brightness Value", print_uint_tag_array, format_srational )         \
+    X( EXIF, EXPOSURE_BIAS_VALUE_TAG, RATIONAL, 1, 1, VALUES,               \
+       "Exposure-Bias value", print_uint_tag_array, format_srational )      \
+    X( EXIF, MAX_APERTURE_VALUE_TAG, URATIONAL, 1, 1, VALUES,               \
+       "Max Aperture Value", print_uint_tag_array, NULL )                   \
+    X( EXIF, SUBJECT_DISTANCE_TAG, URATIONAL, 1, 1, VALUES,                 \
+       "Subject Distance", print_uint_tag_array, NULL )                     \
+    X( EXIF, METERING_MODE_TAG, SHORT, 1, 1, VALUES,                        \
+       "Metering mode", print_uint_tag_array, format_metering_mode )        \
+    X( EXIF, LIGHT_SOURCE_TAG, SHORT, 1, 1, VALUES,                         \
+       "Light Source", print_uint_tag_array, format_ligth_source )          \
+    X( EXIF, FLASH_TAG, SHORT, 1, 1, VALUES,                                \
+       "Flash", print_uint_tag_array, format_flash )                        \
+    X( EXIF, FOCAL_LENGTH_TAG, URATIONAL, 1, 1, VALUES,                     \
+       "Focal length", print_uint_tag_array, NULL )                         \
+    X( EXIF, SUBJECT_AREA_TAG, SHORT, 2, 4, VALUES,                         \
+       "Subject Area", print_uint_tag_array, NULL )                         \
+    X( EXIF, MAKER_NOTE_TAG, ANY, 0, 0, IGNORE, NULL, NULL, NULL )          \
+    X( EXIF, USER_COMMENT_TAG, UNDEFINED, 8, 0, USER_COMMENT,               \
+       "User Comment", print_user_comment, NULL )                           \
+    X( EXIF, SUBSEC_TIME_TAG, STRING, 1, 0, VALUES,                         \
+       "Sub-second time", print_string_tag, NULL )                          \
+    X( EXIF, SUBSEC_TIME_ORIGINAL_TAG, STRING, 1, 0, VALUES,                \
+       "Sub-second original time", print_string_tag, NULL )                 \
+    X( EXIF, SUBSEC_TIME_DIGITIZED_TAG, STRING, 1, 0, VALUES,               \
+       "Sub-second digitized time", print_string_tag, NULL )                \
+    X( EXIF, FLASHPIX_VERSION_TAG, UNDEFINED, 4, 4, VERSION,                \
+       "Flashpix version", print_string_tag, NULL )                         \
+    X( EXIF, COLOR_SPACE_TAG, SHORT, 1, 1, VALUES,                          \
+       "Color Space", print_uint_tag_array, format_color_space )            \
+    X( EXIF, PIXEL_X_DIMENSION_TAG, SHORT_LONG, 1, 1, VALUES,               \
+       "Image X dimension in pixels", print_uint_tag_array, NULL )          \
+    X( EXIF, PIXEL_Y_DIMENSION_TAG, SHORT_LONG, 1, 1, VALUES,               \
+       "Image Y dimension in pixels", print_uint_tag_array, NULL )          \
+    X( EXIF, RELATED_SOUND_FILE_TAG, STRING, 1, 0, VALUES,                  \
+       "Related Sound File", print_string_tag, NULL )                       \
+    X( EXIF, INTEROPERABILITY_IFD_TAG, LONG, 1, 1, IOP_IFD,                 \
+       NULL, NULL, NULL )                                                   \
+    X( EXIF, SPATIAL_FREQUENCY_RESPONSE_TAG, BYTE, 0, 0, VALUES,            \
+       "Spatial frequency response", print_uint_tag_array,                  \
+       format_hex_bytes )                                                   \
+    X( EXIF, FOCAL_PLANE_X_RESOLUTION_TAG, URATIONAL, 1, 1, VALUES,         \
+       "Focal Plane X resolution", print_uint_tag_array, NULL )             \
+    X( EXIF, FOCAL_PLANE_Y_RESOLUTION_TAG, URATIONAL, 1, 1, VALUES,         \
+       "Focal Plane Y resolution", print_uint_tag_array, NULL )             \
+    X( EXIF, FOCAL_PLANE_RESOLUTION_UNIT_TAG, SHORT, 1, 1, VALUES,          \
+       "Focal Plane Resolution Unit", print_uint_tag_array,                 \
+       format_resolution_uint )                                             \
+    X( EXIF, SUBJECT_LOCATION_TAG, SHORT, 2, 2, VALUES,                     \
+       "Subject Location (X,Y)", print_uint_tag_array, NULL )               \
+    X( EXIF, EXPOSURE_INDEX_TAG, URATIONAL, 1, 1, VALUES,                   \
+       "Exposure Index", print_uint_tag_array, NULL )                       \
+    X( EXIF, SENSING_METHOD_TAG, SHORT, 1, 1, VALUES,                       \
+       "Sensing Method", print_uint_tag_array, format_sensing_method )      \
+    X( EXIF, FILE_SOURCE_TAG, UNDEFINED, 1, 1, VALUES,                      \
+       "File Source", print_uint_tag_array, format_file_source )            \
+    X( EXIF, SCENE_TYPE_TAG, UNDEFINED, 1, 1, VALUES,                       \
+       "Scene Type", print_uint_tag_array, format_scene_type )              \
+    /* CFA pattern is replaced with an ascii string during parsing */       \
+    X( EXIF, CFA_PATTERN_TAG, UNDEFINED, 5, 0, CFA_PATTERN,                 \
+       "Color Filter Array", print_string_tag, NULL )                       \
+    X( EXIF, DIGITAL_ZOOM_RATIO_TAG, URATIONAL, 1, 1, VALUES,               \
+       "Digital Zoom Ration", print_uint_tag_array,                         \
+       format_digital_zoom_ratio )                                          \
+    X( EXIF, IMAGE_UNIQUE_ID_TAG, STRING, 1, 0, VALUES,                     \
+       "Image Unique ID", print_string_tag, NULL )                          \
+    X( EXIF, OWNER_NAME_TAG, STRING, 1, 0, VALUES,                          \
+       "Owner name", print_string_tag, NULL )                               \
+    X( EXIF, BODY_SERIAL_NUMBER_TAG, STRING, 1, 0, VALUES,                  \
+       "Serial Numner", print_string_tag, NULL )                            \
+    X( EXIF, LENS_SPECIFICATION_TAG, URATIONAL, 4, 4, VALUES,               \
+       "Lens Specification", print_uint_tag_array, NULL )                   \
+    X( EXIF, LENS_MAKE_TAG, STRING, 1, 0, VALUES,                           \
+       "Lens Manufacturer", print_string_tag, NULL )                        \
+    X( EXIF, LENS_MODEL_TAG, STRING, 1, 0, VALUES,                          \
+       "Lens Model", print_string_tag, NULL )                               \
+    X( EXIF, LENS_SERIAL_NUMBER_TAG, STRING, 1, 0, VALUES,                  \
+       "Lens serial number", print_string_tag, NULL )                       \
+    X( EXIF, COMPOSITE_IMAGE_TAG, SHORT, 1, 1, VALUES,                      \
+       "Composition", print_uint_tag_array, format_composite_image )        \
+    X( EXIF, COMPOSITE_IMAGE_COUNT_TAG, SHORT, 2, 2, VALUES,                \
+       "Composite image count", print_uint_tag_array, NULL )                \
+    X( EXIF, COMPOSITE_IMAGE_EXPOSURE_TIME_TAG, UNDEFINED, 0, 0, VALUES,    \
+       "Composite image exposure time", print_uint_tag_array, NULL )        \
+    X( EXIF, OFFSET_SCHEMA_TAG, ANY, 0, 0, IGNORE, NULL, NULL, NULL )       \
+                                                                            \
+    /* GPS IFD */                                                           \
+    X( GPS, GPS_VERSION_ID_TAG, UNDEFINED, 4, 4, VERSION,                   \
+       "GPS version", print_uint_tag_array, NULL )                          \
+    X( GPS, GPS_LATITUDE_REF_TAG, STRING, 1, 0, VALUES,                     \
+       "GPS Latitude reference", print_gps_latitude_ref, NULL )             \
+    X( GPS, GPS_LATITUDE_TAG, URATIONAL, 3, 3, VALUES,                      \
+       "GPS Latitude", print_uint_tag_array, gps_coordinates )              \
+    X( GPS, GPS_LONGITUDE_REF_TAG, STRING, 1, 0, VALUES,                    \
+       "GPS Longitude reference", print_gps_longitude_ref, NULL )           \
+    X( GPS, GPS_LONGITUDE_TAG, URATIONAL, 3, 3, VALUES,                     \
+       "GPS Longitude", print_uint_tag_array, gps_coordinates )             \
+    X( GPS, GPS_ALTITUDE_REF_TAG, BYTE, 1, 1, VALUES,                       \
+       "GPS Altitude reference", print_gps_altitude_ref, NULL )             \
+    X( GPS, GPS_ALTITUDE_TAG, URATIONAL, 1, 1, VALUES,                      \
+       "GPS Altitude", print_uint_tag_array, gps_altitude )                 \
+    X( GPS, GPS_TIME_STAMP_TAG, URATIONAL, 3, 3, VALUES,                    \
+       "GPS time", print_uint_tag_array, gps_time )                         \
+    X( GPS, GPS_SATELLITES_TAG, STRING, 1, 0, VALUES,                       \
+       "GPS Satellites", print_string_tag, NULL )                           \
+    X( GPS, GPS_STATUS_TAG, STRING, 1, 0, VALUES,                           \
+       "GPS Status", print_string_tag, NULL )                               \
+    X( GPS, GPS_MEASURE_MODE_TAG, STRING, 1, 0, VALUES,                     \
+       "GPS Measure mode", print_string_tag, NULL )                         \
+    X( GPS, GPS_DOP_TAG, URATIONAL, 1, 1, VALUES,                           \
+       "GPS DOP", print_uint_tag_array, NULL )                              \
+    X( GPS, GPS_SPEED_REF_TAG, STRING, 1, 0, VALUES,                        \
+       "GPS Speed reference", print_string_tag, NULL )                      \
+    X( GPS, GPS_SPEED_TAG, URATIONAL, 1, 1, VALUES,                         \
+       "GPS Speed", print_uint_tag_array, NULL )                            \
+    X( GPS, GPS_TRACK_REF_TAG, STRING, 1, 0, VALUES,                        \
+       "GPS Track reference", print_gps_direction_ref, NULL )               \
+    X( GPS, GPS_TRACK_TAG, URATIONAL, 1, 1, VALUES,                         \
+       "GPS Track", print_uint_tag_array, NULL )                            \
+    X( GPS, GPS_IMG_DIRECTION_REF_TAG, STRING, 1, 0, VALUES,                \
+       "GPS Image direction reference", print_gps_direction_ref, NULL )     \
+    X( GPS, GPS_IMG_DIRECTION_TAG, URATIONAL, 1, 1, VALUES,                 \
+       "GPS Image direction", print_uint_tag_array, gps_angle )             \
+    X( GPS, GPS_MAP_DATUM_TAG, STRING, 1, 0, VALUES,                        \
+       "GPS Map Datum", print_string_tag, NULL )                            \
+    X( GPS, GPS_DEST_LATITUDE_REF_TAG, STRING, 1, 0, VALUES,                \
+       "GPS Destination latitude reference", print_gps_latitude_ref, NULL ) \
+    X( GPS, GPS_DEST_LATITUDE_TAG, URATIONAL, 3, 3, VALUES,                 \
+       "GPS Destination latitude", print_uint_tag_array, gps_coordinates )  \
+    X( GPS, GPS_DEST_LONGITUDE_REF_TAG, STRING, 1, 0, VALUES,               \
+       "GPS Destination longitude reference", print_gps_longitude_ref,      \
+       NULL )                                                               \
+    X( GPS, GPS_DEST_LONGITUDE_TAG, URATIONAL, 3, 3, VALUES,                \
+       "GPS Destination longitude", print_uint_tag_array, gps_coordinates ) \
+    X( GPS, GPS_DEST_BEARING_REF_TAG, STRING, 1, 0, VALUES,                 \
+       "GPS Destination bearing reference", print_gps_direction_ref, NULL ) \
+    X( GPS, GPS_DEST_BEARING_TAG, URATIONAL, 1, 1, VALUES,                  \
+       "GPS Destination bearing", print_uint_tag_array, NULL )              \
+    X( GPS, GPS_DEST_DISTANCE_REF_TAG, STRING, 1, 0, VALUES,                \
+       NULL, NULL, NULL )                                                   \
+    X( GPS, GPS_DEST_DISTANCE_TAG, URATIONAL, 1, 1, VALUES,                 \
+       NULL, NULL, NULL )                                                   \
+    X( GPS, GPS_PROCESSING_METHOD_TAG, BYTE, 0, 0, VALUES,                  \
+       "GPS Processing method", print_user_comment, NULL )                  \
+    X( GPS, GPS_AREA_INFORMATION_TAG, BYTE, 0, 0, VALUES,                   \
+       "GPS Area information", print_user_comment, NULL )                   \
+    X( GPS, GPS_DATE_STAMP_TAG, STRING, 1, 0, VALUES,                       \
+       "GPS UTC Date stamp", print_string_tag, NULL )                       \
+    X( GPS, GPS_DIFFERENTIAL_TAG, SHORT, 1, 1, VALUES,                      \
+       "GPS Differential applied", print_gps_yes_no, NULL )                 \
+    X( GPS, GPS_H_POSITIONING_ERROR_TAG, URATIONAL, 1, 1, VALUES,           \
+       "GPS Positioning error", print_uint_tag_array, NULL )                \
+                                                                            \
+    /* INTEROPERABILITY IFD */                                              \
+    X( IOP, INTEROPERABILITY_INDEX_TAG, STRING, 1, 0, VALUES,               \
+       NULL, NULL, NULL )                                                   \
+    X( IOP, INTEROPERABILITY_VERSION_TAG, UNDEFINED, 4, 4, VERSION,         \
+       NULL, NULL, NULL )                                                   \
+    X( IOP, RELATED_IMAGE_FILE_FORMAT_TAG, STRING, 1, 0, VALUES,            \
+       NULL, NULL, NULL )
+
+// IFD masks
+#define SCHEMA_IFD( id )            ( 1u << (id) )
+#define SCHEMA_IFD_TIFF             ( SCHEMA_IFD( PRIMARY ) |               \
+                                      SCHEMA_IFD( THUMBNAIL ) )
+#define SCHEMA_IFD_EXIF             SCHEMA_IFD( EXIF )
+#define SCHEMA_IFD_GPS              SCHEMA_IFD( GPS )
+#define SCHEMA_IFD_IOP              SCHEMA_IFD( IOP )
+#define SCHEMA_IFD_TIFF_EXIF        ( SCHEMA_IFD_TIFF | SCHEMA_IFD_EXIF )
+#define SCHEMA_IFD_TIFF_IOP         ( SCHEMA_IFD_TIFF | SCHEMA_IFD_IOP )
+
+// TIFF type masks
+#define SCHEMA_TYPE( type )         ( 1u << (type) )
+#define SCHEMA_TYPE_BYTE            SCHEMA_TYPE( TIFF_UINT8 )
+#define SCHEMA_TYPE_STRING          SCHEMA_TYPE( TIFF_STRING )
+#define SCHEMA_TYPE_SHORT           SCHEMA_TYPE( TIFF_UINT16 )
+#define SCHEMA_TYPE_LONG            SCHEMA_TYPE( TIFF_UINT32 )
+#define SCHEMA_TYPE_SHORT_LONG      ( SCHEMA_TYPE_SHORT | SCHEMA_TYPE_LONG )
+#define SCHEMA_TYPE_URATIONAL       SCHEMA_TYPE( TIFF_URATIONAL )
+#define SCHEMA_TYPE_RATIONAL        SCHEMA_TYPE( TIFF_RATIONAL )
+#define SCHEMA_TYPE_UNDEFINED       SCHEMA_TYPE( TIFF_UNDEFINED )
+// any type stored as 8, 16 or 32-bit items
+#define SCHEMA_TYPE_INTEGER         ( SCHEMA_TYPE( TIFF_UINT8 ) |           \
+                                      SCHEMA_TYPE( TIFF_STRING ) |          \
+                                      SCHEMA_TYPE( TIFF_UINT16 ) |          \
+                                      SCHEMA_TYPE( TIFF_UINT32 ) |          \
+                                      SCHEMA_TYPE( TIFF_INT8 ) |            \
+                                      SCHEMA_TYPE( TIFF_INT16 ) |           \
+                                      SCHEMA_TYPE( TIFF_INT32 ) |           \
+                                      SCHEMA_TYPE( TIFF_FLOAT ) )
+#define SCHEMA_TYPE_ANY             0xffff
+
+// how an accepted entry is processed by the parser
+typedef enum {
+    PARSE_VALUES,           // values stored as they are
+    PARSE_VERSION,          // 4 characters stored as a string
+    PARSE_COMPONENTS,       // components stored as a string, e.g. "YCbCr"
+    PARSE_USER_COMMENT,     // 8-byte encoding and text stored as a string
+    PARSE_CFA_PATTERN,      // CFA pattern stored as a string
+    PARSE_THUMB_OFFSET,     // thumbnail offset, not stored
+    PARSE_THUMB_SIZE,       // thumbnail size, not stored
+    PARSE_EXIF_IFD,         // embedded IFDs, parsed but not stored
+    PARSE_GPS_IFD,
+    PARSE_IOP_IFD,
+    PARSE_IGNORE            // known, but neither stored nor reported
+} schema_parse_t;
+
+typedef struct {
+    uint16_t        tag;
+    uint8_t         ifds;           // SCHEMA_IFD mask
+    uint8_t         parse;          // schema_parse_t
+    uint16_t        types;          // SCHEMA_TYPE mask
+    uint32_t        min_count, max_count;   // max_count 0 if unlimited
+    const char      *name;          // NULL if not printed
+} tag_schema_t;
+
+// the schema rows in TAG_SCHEMA order
+extern const tag_schema_t tag_schema[];
+
+// return the schema row for tag in IFD id, or NULL if the tag is not known in
+// that IFD. This is a direct table lookup, whatever the number of tags.
+extern const tag_schema_t *schema_lookup( ifd_id_t id, uint16_t tag );
+
+static inline bool schema_accepts( const tag_schema_t *schema, uint16_t type,
+                                   uint32_t count )
+{
+    return ( schema->types & SCHEMA_TYPE( type ) ) &&
+           count >= schema->min_count &&
+           ( 0 == schema->max_count || count <= schema->max_count );
+}
+
+#endif /* __SCHEMA_H__ */
@@ -0,0 +1,198 @@
+#include "swap.h"
+
+static void swap_uint16_scalar( uint16_t *values, size_t n )
+{
+    for ( size_t i = 0; i < n; ++i ) {
+        values[i] = __builtin_bswap16( values[i] );
+    }
+}
+
+static void swap_uint32_scalar( uint32_t *values, size_t n )
+{
+    for ( size_t i = 0; i < n; ++i ) {
+        values[i] = __builtin_bswap32( values[i] );
+    }
+}
+
+// The vectorized variants load W bytes at once, reverse the bytes in each 16
+// or 32-bit value with a single shuffle and store them back. They return the
+// number of bytes swapped, a multiple of W: the last values, after the last
+// full block, are swapped one by one.
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+
+#define SIMD_SWAP_X86 1
+
+// shuffle controls, repeated for each 128-bit lane
+static const uint8_t swap16_shuffle[32] = {
+    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+};
+static const uint8_t swap32_shuffle[32] = {
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+__attribute__((target("ssse3")))
+static size_t swap_ssse3( uint8_t *data, size_t size, const uint8_t *shuffle )
+{
+    const __m128i control = _mm_loadu_si128( (const __m128i *)shuffle );
+
+    size_t i = 0;
+    for ( ; size - i >= 16; i += 16 ) {
+        __m128i b = _mm_loadu_si128( (const __m128i *)(data + i) );
+        _mm_storeu_si128( (__m128i *)(data + i), _mm_shuffle_epi8( b, control ) );
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t swap_avx2( uint8_t *data, size_t size, const uint8_t *shuffle )
+{
+    const __m256i control = _mm256_loadu_si256( (const __m256i *)shuffle );
+
+    size_t i = 0;
+    for ( ; size - i >= 64; i += 64 ) {
+        __m256i b0 = _mm256_loadu_si256( (const __m256i *)(data + i) );
+        __m256i b1 = _mm256_loadu_si256( (const __m256i *)(data + i + 32) );
+        _mm256_storeu_si256( (__m256i *)(data + i),
+                             _mm256_shuffle_epi8( b0, control ) );
+        _mm256_storeu_si256( (__m256i *)(data + i + 32),
+                             _mm256_shuffle_epi8( b1, control ) );
+    }
+    for ( ; size - i >= 32; i += 32 ) {
+        __m256i b = _mm256_loadu_si256( (const __m256i *)(data + i) );
+        _mm256_storeu_si256( (__m256i *)(data + i),
+                             _mm256_shuffle_epi8( b, control ) );
+    }
+    return i;
+}
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__)
+#include <arm_neon.h>
+
+#define SIMD_SWAP_NEON 1
+
+static size_t swap16_neon( uint8_t *data, size_t size )
+{
+    size_t i = 0;
+    for ( ; size - i >= 16; i += 16 ) {
+        vst1q_u8( data + i, vrev16q_u8( vld1q_u8( data + i ) ) );
+    }
+    return i;
+}
+
+static size_t swap32_neon( uint8_t *data, size_t size )
+{
+    size_t i = 0;
+    for ( ; size - i >= 16; i += 16 ) {
+        vst1q_u8( data + i, vrev32q_u8( vld1q_u8( data + i ) ) );
+    }
+    return i;
+}
+#endif
+
+extern bool swap_variant_supported( swap_variant_t variant )
+{
+    switch ( variant ) {
+    case SWAP_SCALAR: case SWAP_AUTO:
+        return true;
+#ifdef SIMD_SWAP_X86
+    case SWAP_SSSE3:
+        return __builtin_cpu_supports( "ssse3" );
+    case SWAP_AVX2:
+        return __builtin_cpu_supports( "avx2" );
+#endif
+#ifdef SIMD_SWAP_NEON
+    case SWAP_NEON:
+        return true;            // always available on aarch64
+#endif
+    default:
+        break;
+    }
+    return false;
+}
+
+extern const char *swap_variant_name( swap_variant_t variant )
+{
+    switch ( variant ) {
+    case SWAP_SCALAR:   return "scalar";
+    case SWAP_SSSE3:    return "ssse3";
+    case SWAP_AVX2:     return "avx2";
+    case SWAP_NEON:     return "neon";
+    case SWAP_AUTO:     return "auto";
+    }
+    return NULL;
+}
+
+// arrays smaller than this are always swapped one value at a time
+#define MIN_SIMD_SWAP_SIZE  32
+
+static swap_variant_t select_variant( swap_variant_t variant, size_t size )
+{
+    if ( SWAP_AUTO == variant ) {   // cpu features are cached by libgcc
+        if ( size < MIN_SIMD_SWAP_SIZE ) {
+            variant = SWAP_SCALAR;
+        } else if ( swap_variant_supported( SWAP_AVX2 ) ) {
+            variant = SWAP_AVX2;
+        } else if ( swap_variant_supported( SWAP_SSSE3 ) ) {
+            variant = SWAP_SSSE3;
+        } else if ( swap_variant_supported( SWAP_NEON ) ) {
+            variant = SWAP_NEON;
+        } else {
+            variant = SWAP_SCALAR;
+        }
+    }
+    return variant;
+}
+
+extern void swap_uint16_array_variant( swap_variant_t variant,
+                                       uint16_t *values, size_t n )
+{
+    size_t size = n * sizeof(uint16_t), done = 0;
+    switch ( select_variant( variant, size ) ) {
+#ifdef SIMD_SWAP_X86
+    case SWAP_SSSE3:
+        done = swap_ssse3( (uint8_t *)values, size, swap16_shuffle );
+        break;
+    case SWAP_AVX2:
+        done = swap_avx2( (uint8_t *)values, size, swap16_shuffle );
+        break;
+#endif
+#ifdef SIMD_SWAP_NEON
+    case SWAP_NEON:
+        done = swap16_neon( (uint8_t *)values, size );
+        break;
+#endif
+    default:
+        break;
+    }
+    done /= sizeof(uint16_t);
+    swap_uint16_scalar( values + done, n - done );
+}
+
+extern void swap_uint32_array_variant( swap_variant_t variant,
+                                       uint32_t *values, size_t n )
+{
+    size_t size = n * sizeof(uint32_t), done = 0;
+    switch ( select_variant( variant, size ) ) {
+#ifdef SIMD_SWAP_X86
+    case SWAP_SSSE3:
+        done = swap_ssse3( (uint8_t *)values, size, swap32_shuffle );
+        break;
+    case SWAP_AVX2:
+        done = swap_avx2( (uint8_t *)values, size, swap32_shuffle );
+        break;
+#endif
+#ifdef SIMD_SWAP_NEON
+    case SWAP_NEON:
+        done = swap32_neon( (uint8_t *)values, size );
+        break;
+#endif
+    default:
+        break;
+    }
+    done /= sizeof(uint32_t);
+    swap_uint32_scalar( values + done, n - done );
+}
@@ -0,0 +1,40 @@
+
+#ifndef __SWAP_H__
+#define __SWAP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// In place byte swap of 16 or 32-bit value arrays, for TIFF data that are not
+// in the native byte order. All variants give the same result. SWAP_SCALAR
+// is the portable reference implementation, the other variants shuffle bytes
+// with SIMD instructions and are available only if the processor supports
+// them (SSSE3 and AVX2 on x86_64, NEON on aarch64).
+typedef enum {
+    SWAP_SCALAR,            // 1 value per iteration
+    SWAP_SSSE3,             // 16 bytes per iteration
+    SWAP_AVX2,              // 32 bytes per iteration
+    SWAP_NEON,              // 16 bytes per iteration
+    SWAP_AUTO               // best variant supported by the processor
+} swap_variant_t;
+
+extern bool swap_variant_supported( swap_variant_t variant );
+extern const char *swap_variant_name( swap_variant_t variant );
+
+extern void swap_uint16_array_variant( swap_variant_t variant,
+                                       uint16_t *values, size_t n );
+extern void swap_uint32_array_variant( swap_variant_t variant,
+                                       uint32_t *values, size_t n );
+
+static inline void swap_uint16_array( uint16_t *values, size_t n )
+{
+    swap_uint16_array_variant( SWAP_AUTO, values, n );
+}
+
+static inline void swap_uint32_array( uint32_t *values, size_t n )
+{
+    swap_uint32_array_variant( SWAP_AUTO, values, n );
+}
+
+#endif /* __SWAP_H__ */
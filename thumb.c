@@ -0,0 +1,165 @@
+
+#define _GNU_SOURCE                 // for copy_file_range
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "exif.h"
+#include "parse.h"
+
+// true if IFD1 locates a thumbnail, which is then at thumb_offset from the
+// TIFF header, whether it is in memory or in a file.
+static bool has_thumbnail( exif_desc_t *desc )
+{
+    return NULL != desc && NULL != desc->ifds[THUMBNAIL] &&
+           0 != desc->thumb_size;
+}
+
+// return the thumbnail address in memory, or NULL if the descriptor data are
+// not in memory or do not include the whole thumbnail.
+static const uint8_t *get_thumbnail_data( exif_desc_t *desc )
+{
+    if ( NULL == desc->data || desc->thumb_offset > desc->size ||
+         desc->thumb_size > desc->size - desc->thumb_offset ) {
+        return NULL;
+    }
+    return desc->data + desc->thumb_offset;
+}
+
+extern bool exif_get_thumbnail( exif_desc_t *desc,
+                                const uint8_t **data, uint32_t *size )
+{
+    if ( ! has_thumbnail( desc ) ) {
+        return false;
+    }
+    const uint8_t *thumbnail = get_thumbnail_data( desc );
+    if ( NULL == thumbnail ) {
+        return false;
+    }
+    if ( NULL != data ) {
+        *data = thumbnail;
+    }
+    if ( NULL != size ) {
+        *size = desc->thumb_size;
+    }
+    return true;
+}
+
+extern bool exif_get_thumbnail_info( exif_desc_t *desc, thumbnail_info_t *info )
+{
+    if ( ! has_thumbnail( desc ) || NULL == info ) {
+        return false;
+    }
+    info->origin = THUMBNAIL;
+    info->comp = JPEG;          // implied by JPEGInterchangeFormat
+    info->size = desc->thumb_size;
+
+    ifd_entry_t *entry = ifd_table_lookup( desc->ifds[THUMBNAIL],
+                                           COMPRESSION_TAG );
+    if ( NULL != entry && entry->deferred ) {
+        exif_load_ifd_entry( desc, THUMBNAIL, entry );
+    }
+    if ( NULL != entry && NULL != entry->values ) {
+        info->comp = (compression_t)*(const uint16_t *)entry->values->data;
+    }
+    return true;
+}
+
+// return the file from which the descriptor was parsed, if it is still open,
+// and the thumbnail offset in that file.
+static int get_thumbnail_file( exif_desc_t *desc, off_t *offset )
+{
+    if ( NULL != desc->file ) {
+        *offset = (off_t)desc->header + desc->thumb_offset;
+        return fileno( desc->file );
+    }
+    if ( -1 != desc->fd ) {     // kept by read_exif_mmap
+        *offset = (off_t)( desc->data - (const uint8_t *)desc->mapping ) +
+                  desc->thumb_offset;
+        return desc->fd;
+    }
+    return -1;
+}
+
+// copy size bytes at offset in file src to the current position of fd in the
+// kernel, without passing them through user space: with copy_file_range if
+// fd is a regular file on a file system that supports it, or with sendfile
+// otherwise (e.g. to a socket or a pipe). It returns the number of bytes
+// copied, which is less than size if they could not be copied that way.
+static size_t copy_in_kernel( int src, off_t offset, int fd, size_t size )
+{
+    size_t done = 0;
+#ifdef __linux__
+    bool copy_range = true;
+    while ( done < size ) {
+        ssize_t n;
+        if ( copy_range ) {
+            off64_t src_offset = (off64_t)offset + done;
+            n = copy_file_range( src, &src_offset, fd, NULL, size - done, 0 );
+            if ( -1 == n && EINTR != errno ) {
+                copy_range = false;     // cross-device, pipe, socket etc.
+                continue;
+            }
+        } else {
+            off_t src_offset = offset + (off_t)done;
+            n = sendfile( fd, src, &src_offset, size - done );
+        }
+        if ( -1 == n && EINTR == errno ) {
+            continue;
+        }
+        if ( n <= 0 ) {
+            break;
+        }
+        done += (size_t)n;
+    }
+#endif
+    return done;
+}
+
+static bool write_all( int fd, const uint8_t *data, size_t size )
+{
+    while ( size > 0 ) {
+        ssize_t n = write( fd, data, size );
+        if ( -1 == n && EINTR == errno ) {
+            continue;
+        }
+        if ( n <= 0 ) {
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+extern bool exif_write_thumbnail_fd( exif_desc_t *desc, int fd )
+{
+    if ( ! has_thumbnail( desc ) || fd < 0 ) {
+        return false;
+    }
+    const uint8_t *data = get_thumbnail_data( desc );
+    size_t size = desc->thumb_size, done = 0;
+
+    off_t offset;
+    int src = get_thumbnail_file( desc, &offset );
+    struct stat st;
+    if ( -1 != src && 0 == fstat( src, &st ) && offset <= st.st_size &&
+         size <= (size_t)( st.st_size - offset ) ) {
+        done = copy_in_kernel( src, offset, fd, size );
+    }
+    if ( done == size ) {
+        return true;
+    }
+    if ( NULL == data ) {       // neither in a file nor in memory
+        return false;
+    }
+    return write_all( fd, data + done, size - done );
+}